@@ -0,0 +1,182 @@
+﻿using System;
+using System.Text;
+using System.Threading;
+using Microsoft.Xna.Framework.Graphics;
+using Squared.Render.STB.Native;
+
+namespace Squared.Render.STB {
+    /// <summary>
+    /// Encodes and writes images on background threads, so capturing screenshots (or every frame of a
+    ///  recording) doesn't stall the caller.
+    /// The queue owns a fixed number of pixel buffers and each queued image holds one until its file has
+    ///  been written. Once they're all in use, Enqueue waits for one to come back (or gives up after
+    ///  timeoutMs) instead of letting the backlog and its memory grow without bound.
+    /// </summary>
+    public unsafe sealed class ImageWriteQueue : IDisposable {
+        private IntPtr _Handle;
+        private void* Handle => (void*)_Handle;
+
+        /// <summary>
+        /// The size of each buffer in bytes; larger images can't be queued.
+        /// </summary>
+        public readonly long BufferSize;
+        public readonly int BufferCount;
+
+        public bool IsDisposed => _Handle == IntPtr.Zero;
+
+        /// <param name="bufferCount">How many images can be waiting to be written at once.</param>
+        /// <param name="threadCount">How many images are encoded and written at once. Large images are
+        ///  already spread across the native worker pool, so one is usually enough.</param>
+        public ImageWriteQueue (long bufferSize, int bufferCount = 4, int threadCount = 1) {
+            if (bufferSize <= 0)
+                throw new ArgumentOutOfRangeException(nameof(bufferSize));
+            if (bufferCount < 1)
+                throw new ArgumentOutOfRangeException(nameof(bufferCount));
+            if ((threadCount < 1) || (threadCount > 64))
+                throw new ArgumentOutOfRangeException(nameof(threadCount));
+
+            BufferSize = bufferSize;
+            BufferCount = bufferCount;
+            _Handle = (IntPtr)API.stbn_encode_queue_create(threadCount, bufferCount, bufferSize);
+            if (_Handle == IntPtr.Zero)
+                throw new Exception("Failed to create encode queue");
+        }
+
+        /// <summary>
+        /// Creates a queue whose buffers fit a texture of the given size and format.
+        /// </summary>
+        public static ImageWriteQueue ForTextures (int width, int height, SurfaceFormat format, int bufferCount = 4, int threadCount = 1) {
+            var bytesPerPixel = Evil.TextureUtils.GetBytesPerPixelAndComponents(format, out _);
+            return new ImageWriteQueue((long)width * height * bytesPerPixel, bufferCount, threadCount);
+        }
+
+        /// <summary>
+        /// Copies the texture's pixels into a free buffer and queues them to be written to filename.
+        /// Must be called from a thread that can read back textures.
+        /// </summary>
+        /// <param name="timeoutMs">How long to wait for a buffer if they're all in use (-1 to wait indefinitely).</param>
+        /// <returns>false if no buffer was free in time, in which case nothing was queued.</returns>
+        public bool Enqueue (
+            Texture2D tex, string filename,
+            ImageWriteFormat format = ImageWriteFormat.PNG, int jpegQuality = 75,
+            int? pngCompressionLevel = null, PNGFilter? pngFilter = null, int timeoutMs = -1
+        ) {
+            int numComponents, bytesPerPixel;
+            var options = ImageWrite.GetEncodeOptions(
+                tex.Format, format, jpegQuality, pngCompressionLevel, pngFilter,
+                out numComponents, out bytesPerPixel
+            );
+            var size = (long)tex.Width * tex.Height * bytesPerPixel;
+            if (size > BufferSize)
+                throw new ArgumentException("Texture is too large for this queue's buffers", nameof(tex));
+
+            var buffer = Acquire(timeoutMs);
+            if (buffer == null)
+                return false;
+
+            try {
+                tex.GetDataPointerEXT(0, null, (IntPtr)buffer, (int)size);
+            } catch {
+                API.stbn_encode_queue_release(Handle, buffer);
+                throw;
+            }
+
+            Submit(buffer, &options, tex.Width, tex.Height, numComponents, filename);
+            return true;
+        }
+
+        /// <summary>
+        /// Copies the pixels into a free buffer and queues them to be written to filename.
+        /// The data can be reused as soon as this returns.
+        /// </summary>
+        /// <param name="timeoutMs">How long to wait for a buffer if they're all in use (-1 to wait indefinitely).</param>
+        /// <returns>false if no buffer was free in time, in which case nothing was queued.</returns>
+        public bool Enqueue (
+            byte* data, int dataLength, int width, int height,
+            SurfaceFormat sourceFormat, string filename,
+            ImageWriteFormat format = ImageWriteFormat.PNG, int jpegQuality = 75,
+            int? pngCompressionLevel = null, PNGFilter? pngFilter = null, int timeoutMs = -1
+        ) {
+            int numComponents, bytesPerPixel;
+            var options = ImageWrite.GetEncodeOptions(
+                sourceFormat, format, jpegQuality, pngCompressionLevel, pngFilter,
+                out numComponents, out bytesPerPixel
+            );
+            var size = (long)width * height * bytesPerPixel;
+            if (dataLength < size)
+                throw new ArgumentException("buffer");
+            if (size > BufferSize)
+                throw new ArgumentException("Image is too large for this queue's buffers", nameof(dataLength));
+
+            var buffer = Acquire(timeoutMs);
+            if (buffer == null)
+                return false;
+
+            Buffer.MemoryCopy(data, buffer, BufferSize, size);
+            Submit(buffer, &options, width, height, numComponents, filename);
+            return true;
+        }
+
+        private void* Acquire (int timeoutMs) {
+            if (IsDisposed)
+                throw new ObjectDisposedException("ImageWriteQueue");
+            return API.stbn_encode_queue_acquire(Handle, timeoutMs < 0 ? -1 : timeoutMs);
+        }
+
+        private void Submit (void* buffer, stbn_encode_options* options, int width, int height, int numComponents, string filename) {
+            var pathBytes = Encoding.UTF8.GetByteCount(filename);
+            var path = new byte[pathBytes + 1];
+            Encoding.UTF8.GetBytes(filename, 0, filename.Length, path, 0);
+
+            fixed (byte* pPath = path)
+                if (API.stbn_encode_queue_submit(Handle, buffer, options, width, height, numComponents, 0, pPath) == 0) {
+                    API.stbn_encode_queue_release(Handle, buffer);
+                    throw new Exception("Failed to queue image");
+                }
+        }
+
+        /// <summary>
+        /// Blocks until every image queued so far has been written (or has failed).
+        /// </summary>
+        public void WaitForIdle () {
+            if (IsDisposed)
+                throw new ObjectDisposedException("ImageWriteQueue");
+            API.stbn_encode_queue_wait(Handle);
+        }
+
+        public stbn_encode_queue_stats GetStats () {
+            if (IsDisposed)
+                throw new ObjectDisposedException("ImageWriteQueue");
+            API.stbn_encode_queue_get_stats(Handle, out var result);
+            return result;
+        }
+
+        /// <summary>
+        /// Images that are queued or being written
+        /// </summary>
+        public int PendingCount => GetStats().pending;
+        /// <summary>
+        /// Images that couldn't be encoded or written (e.g. because the directory doesn't exist)
+        /// </summary>
+        public long FailedCount => GetStats().failed;
+
+        /// <summary>
+        /// Waits for every queued image to be written, then releases the buffers and threads.
+        /// If the queue is finalized instead, the images are still written but the buffers and threads
+        ///  are only released once that's done, in the background.
+        /// </summary>
+        public void Dispose () {
+            var handle = (void*)Interlocked.Exchange(ref _Handle, IntPtr.Zero);
+            if (handle != null)
+                API.stbn_encode_queue_destroy(handle);
+            GC.SuppressFinalize(this);
+        }
+
+        ~ImageWriteQueue () {
+            // Waiting for the writers here would stall every other finalizer until they're done
+            var handle = (void*)Interlocked.Exchange(ref _Handle, IntPtr.Zero);
+            if (handle != null)
+                API.stbn_encode_queue_abandon(handle);
+        }
+    }
+}
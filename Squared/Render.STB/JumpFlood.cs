@@ -0,0 +1,66 @@
+﻿using System;
+using Microsoft.Xna.Framework;
+using Squared.Render.STB.Native;
+
+namespace Squared.Render.DistanceField {
+    /// <summary>
+    /// Native versions of the JumpFlood.GenerateDistanceField overloads, with the same inputs and results.
+    /// They run on the native worker pool, so <see cref="JumpFloodConfig.ThreadGroup"/> and
+    ///  <see cref="JumpFloodConfig.ChunkSize"/> are ignored.
+    /// Unlike the managed versions, they support <see cref="DistanceFieldAlgorithm.Exact"/>.
+    /// </summary>
+    public static unsafe class STBJumpFlood {
+        /// <param name="input">A grayscale image to act as the source for alpha</param>
+        /// <returns>A signed distance field</returns>
+        public static float[] GenerateDistanceField (byte* input, JumpFloodConfig config) =>
+            Generate(input, stbn_df_input.GRAY8, config);
+
+        /// <param name="input">An RGBA image to act as the source for alpha</param>
+        /// <returns>A signed distance field</returns>
+        public static float[] GenerateDistanceField (Color* input, JumpFloodConfig config) =>
+            Generate(input, stbn_df_input.RGBA8, config);
+
+        /// <param name="input">A grayscale image to act as the source for alpha</param>
+        /// <returns>A signed distance field</returns>
+        public static float[] GenerateDistanceField (float* input, JumpFloodConfig config) =>
+            Generate(input, stbn_df_input.GRAY32F, config);
+
+        /// <param name="input">An RGBA image to act as the source for alpha</param>
+        /// <returns>A signed distance field</returns>
+        public static float[] GenerateDistanceField (Vector4* input, JumpFloodConfig config) =>
+            Generate(input, stbn_df_input.RGBA32F, config);
+
+        private static float[] Generate (void* input, stbn_df_input format, JumpFloodConfig config) {
+            var result = new float[config.Width * config.Height];
+            fixed (float* pResult = result)
+                GenerateDistanceField(input, format, config, pResult);
+            return result;
+        }
+
+        /// <summary>
+        /// Writes the distance field for the config's region into output, which must be
+        ///  Width x Height like the input. Pixels outside the region are left alone.
+        /// </summary>
+        public static void GenerateDistanceField (void* input, stbn_df_input format, JumpFloodConfig config, float* output) {
+            if (input == null)
+                throw new ArgumentNullException(nameof(input));
+            if (output == null)
+                throw new ArgumentNullException(nameof(output));
+
+            var region = config.GetRegion();
+            int ok;
+            switch (config.Algorithm) {
+                case DistanceFieldAlgorithm.JumpFlood:
+                    ok = API.stbn_distance_field_jump_flood(input, format, config.Width, config.Height, region.X, region.Y, region.Width, region.Height, output);
+                    break;
+                case DistanceFieldAlgorithm.Exact:
+                    ok = API.stbn_distance_field_exact(input, format, config.Width, config.Height, region.X, region.Y, region.Width, region.Height, output);
+                    break;
+                default:
+                    throw new ArgumentOutOfRangeException(nameof(config.Algorithm));
+            }
+            if (ok == 0)
+                throw new Exception("Failed to generate distance field");
+        }
+    }
+}
@@ -5,9 +5,21 @@ using Squared.Render.STB.Native;
 namespace Squared.Render {
     public static class STBMipGenerator {
         /// <summary>
-        /// Replaces the built in Squared.Render mip generators with stb_image_resize
+        /// The stb_image_resize filter STB.Image generates mips with when a format has no box filter reducer.
         /// </summary>
-        public static void InstallGlobally () {
+        public const stbir_filter DefaultFilter = stbir_filter.DEFAULT;
+        /// <summary>
+        /// Bumped whenever the output of the native mip generators changes, so that anything storing
+        ///  generated mips (like the texture cache) can tell they're out of date.
+        /// </summary>
+        public const int Revision = 2;
+
+        /// <summary>
+        /// Replaces the built in Squared.Render mip generators with native ones.
+        /// Formats with a native 2:1 box filter reducer use it unless preferBoxFilter is false;
+        ///  everything else uses stb_image_resize.
+        /// </summary>
+        public static void InstallGlobally (bool preferBoxFilter = true) {
             var formats = new[] {
                 MipFormat.Gray1,
                 MipFormat.pRGBA, MipFormat.RGBA, MipFormat.pGray4,
@@ -18,12 +30,113 @@ namespace Squared.Render {
                 MipFormat.pVector4,
                 MipFormat.HalfSingle,
                 MipFormat.HalfVector4,
+                MipFormat.Single,
+                MipFormat.SingleMin,
+                MipFormat.SinglePseudoMin,
+                MipFormat.SingleMax,
+                MipFormat.HalfSingleMin,
+                MipFormat.HalfSinglePseudoMin,
+                MipFormat.HalfSingleMax,
             };
 
             foreach (var format in formats)
-                MipGenerator.Set(format, Get(format));
+                MipGenerator.Set(format, (preferBoxFilter ? GetBox(format) : null) ?? Get(format));
+        }
+
+        /// <summary>
+        /// Returns a native SIMD 2:1 box filter mip generator for the format, or null if there isn't one.
+        /// The destination must be half the size of the source in each dimension (rounded up or down).
+        /// Results differ slightly from the managed generators: averages are rounded instead of truncated, and
+        ///  for non-premultiplied RGBA (and sRGB RGBA) the color channels are weighted by alpha, so the color
+        ///  of transparent texels doesn't bleed into their neighbors the way it does with MipGenerator.
+        /// </summary>
+        public static unsafe MipGeneratorFn GetBox (MipFormat format) {
+            switch (format) {
+                case MipFormat.pRGBA:
+                    return BoxPremultipliedRGBA;
+                case MipFormat.RGBA:
+                    return BoxRGBA;
+                case MipFormat.pRGBA | MipFormat.sRGB:
+                    return BoxPremultipliedsRGBA;
+                case MipFormat.RGBA | MipFormat.sRGB:
+                    return BoxsRGBA;
+                case MipFormat.Gray1:
+                    return BoxGray;
+                case MipFormat.pGray4:
+                    return BoxPAGray;
+                case MipFormat.pGray4 | MipFormat.sRGB:
+                    return BoxsRGBPAGray;
+                case MipFormat.Single:
+                    return BoxSingle;
+                case MipFormat.SingleMin:
+                    return BoxSingleMin;
+                case MipFormat.SinglePseudoMin:
+                    return BoxSinglePseudoMin;
+                case MipFormat.SingleMax:
+                    return BoxSingleMax;
+                case MipFormat.HalfSingle:
+                    return BoxHalfSingle;
+                case MipFormat.HalfSingleMin:
+                    return BoxHalfSingleMin;
+                case MipFormat.HalfSinglePseudoMin:
+                    return BoxHalfSinglePseudoMin;
+                case MipFormat.HalfSingleMax:
+                    return BoxHalfSingleMax;
+                default:
+                    return null;
+            }
         }
 
+        private static void CheckBoxResult (int result) {
+            if (result == 0)
+                throw new ArgumentOutOfRangeException("Destination must be half the size of the source");
+        }
+
+        private static unsafe void BoxPremultipliedRGBA (void* src, int srcWidth, int srcHeight, int srcStrideBytes, void* dest, int destWidth, int destHeight, int destStrideBytes) =>
+            CheckBoxResult(API.stbn_mip_rgba8_premultiplied(src, srcWidth, srcHeight, srcStrideBytes, dest, destWidth, destHeight, destStrideBytes));
+
+        private static unsafe void BoxRGBA (void* src, int srcWidth, int srcHeight, int srcStrideBytes, void* dest, int destWidth, int destHeight, int destStrideBytes) =>
+            CheckBoxResult(API.stbn_mip_rgba8(src, srcWidth, srcHeight, srcStrideBytes, dest, destWidth, destHeight, destStrideBytes));
+
+        private static unsafe void BoxPremultipliedsRGBA (void* src, int srcWidth, int srcHeight, int srcStrideBytes, void* dest, int destWidth, int destHeight, int destStrideBytes) =>
+            CheckBoxResult(API.stbn_mip_rgba8_srgb_premultiplied(src, srcWidth, srcHeight, srcStrideBytes, dest, destWidth, destHeight, destStrideBytes));
+
+        private static unsafe void BoxsRGBA (void* src, int srcWidth, int srcHeight, int srcStrideBytes, void* dest, int destWidth, int destHeight, int destStrideBytes) =>
+            CheckBoxResult(API.stbn_mip_rgba8_srgb(src, srcWidth, srcHeight, srcStrideBytes, dest, destWidth, destHeight, destStrideBytes));
+
+        private static unsafe void BoxGray (void* src, int srcWidth, int srcHeight, int srcStrideBytes, void* dest, int destWidth, int destHeight, int destStrideBytes) =>
+            CheckBoxResult(API.stbn_mip_gray8(src, srcWidth, srcHeight, srcStrideBytes, dest, destWidth, destHeight, destStrideBytes));
+
+        private static unsafe void BoxPAGray (void* src, int srcWidth, int srcHeight, int srcStrideBytes, void* dest, int destWidth, int destHeight, int destStrideBytes) =>
+            CheckBoxResult(API.stbn_mip_pgray4(src, srcWidth, srcHeight, srcStrideBytes, dest, destWidth, destHeight, destStrideBytes));
+
+        private static unsafe void BoxsRGBPAGray (void* src, int srcWidth, int srcHeight, int srcStrideBytes, void* dest, int destWidth, int destHeight, int destStrideBytes) =>
+            CheckBoxResult(API.stbn_mip_pgray4_srgb(src, srcWidth, srcHeight, srcStrideBytes, dest, destWidth, destHeight, destStrideBytes));
+
+        private static unsafe void BoxSingle (void* src, int srcWidth, int srcHeight, int srcStrideBytes, void* dest, int destWidth, int destHeight, int destStrideBytes) =>
+            CheckBoxResult(API.stbn_mip_single(src, srcWidth, srcHeight, srcStrideBytes, dest, destWidth, destHeight, destStrideBytes));
+
+        private static unsafe void BoxSingleMin (void* src, int srcWidth, int srcHeight, int srcStrideBytes, void* dest, int destWidth, int destHeight, int destStrideBytes) =>
+            CheckBoxResult(API.stbn_mip_single_min(src, srcWidth, srcHeight, srcStrideBytes, dest, destWidth, destHeight, destStrideBytes));
+
+        private static unsafe void BoxSinglePseudoMin (void* src, int srcWidth, int srcHeight, int srcStrideBytes, void* dest, int destWidth, int destHeight, int destStrideBytes) =>
+            CheckBoxResult(API.stbn_mip_single_pseudo_min(src, srcWidth, srcHeight, srcStrideBytes, dest, destWidth, destHeight, destStrideBytes));
+
+        private static unsafe void BoxSingleMax (void* src, int srcWidth, int srcHeight, int srcStrideBytes, void* dest, int destWidth, int destHeight, int destStrideBytes) =>
+            CheckBoxResult(API.stbn_mip_single_max(src, srcWidth, srcHeight, srcStrideBytes, dest, destWidth, destHeight, destStrideBytes));
+
+        private static unsafe void BoxHalfSingle (void* src, int srcWidth, int srcHeight, int srcStrideBytes, void* dest, int destWidth, int destHeight, int destStrideBytes) =>
+            CheckBoxResult(API.stbn_mip_half(src, srcWidth, srcHeight, srcStrideBytes, dest, destWidth, destHeight, destStrideBytes));
+
+        private static unsafe void BoxHalfSingleMin (void* src, int srcWidth, int srcHeight, int srcStrideBytes, void* dest, int destWidth, int destHeight, int destStrideBytes) =>
+            CheckBoxResult(API.stbn_mip_half_min(src, srcWidth, srcHeight, srcStrideBytes, dest, destWidth, destHeight, destStrideBytes));
+
+        private static unsafe void BoxHalfSinglePseudoMin (void* src, int srcWidth, int srcHeight, int srcStrideBytes, void* dest, int destWidth, int destHeight, int destStrideBytes) =>
+            CheckBoxResult(API.stbn_mip_half_pseudo_min(src, srcWidth, srcHeight, srcStrideBytes, dest, destWidth, destHeight, destStrideBytes));
+
+        private static unsafe void BoxHalfSingleMax (void* src, int srcWidth, int srcHeight, int srcStrideBytes, void* dest, int destWidth, int destHeight, int destStrideBytes) =>
+            CheckBoxResult(API.stbn_mip_half_max(src, srcWidth, srcHeight, srcStrideBytes, dest, destWidth, destHeight, destStrideBytes));
+
         public static unsafe MipGeneratorFn Get (
             MipFormat format, 
             stbir_filter filter = stbir_filter.DEFAULT,
@@ -76,10 +189,16 @@ namespace Squared.Render {
                     dataType = stbir_datatype.HALF_FLOAT;
                     break;
 
-                default:
+                // stb_image_resize has no min/max filters
                 case MipFormat.SingleMin:
                 case MipFormat.SinglePseudoMin:
                 case MipFormat.SingleMax:
+                case MipFormat.HalfSingleMin:
+                case MipFormat.HalfSinglePseudoMin:
+                case MipFormat.HalfSingleMax:
+                    return GetBox(masked);
+
+                default:
                     return null;
             }
 
@@ -12,6 +12,12 @@ namespace Squared.Render.STB.Native {
     public unsafe delegate int EOFCallback (void* userData);
     [UnmanagedFunctionPointer(CallingConvention.Cdecl)]
     public unsafe delegate void WriteCallback (void* userData, byte* data, int size);
+    [UnmanagedFunctionPointer(CallingConvention.Cdecl)]
+    public unsafe delegate void* AllocCallback (void* userData, UIntPtr size, stbn_alloc_subsystem subsystem);
+    [UnmanagedFunctionPointer(CallingConvention.Cdecl)]
+    public unsafe delegate void FreeCallback (void* userData, void* ptr, UIntPtr size, stbn_alloc_subsystem subsystem);
+    [UnmanagedFunctionPointer(CallingConvention.Cdecl)]
+    public unsafe delegate void DecodeCallback (void* userData, int index, stbn_decode_result* result);
 
     [StructLayout(LayoutKind.Sequential)]
     public unsafe struct STBI_IO_Callbacks {
@@ -68,6 +74,137 @@ namespace Squared.Render.STB.Native {
         OTHER        = 7,  // User callback specified
     }
 
+    public enum stbn_alloc_subsystem : int {
+        IMAGE  = 0,  // stb_image decoding
+        RESIZE = 1,  // stb_image_resize2 and resize contexts
+        WRITE  = 2,  // stb_image_write encoding
+        NATIVE = 3,  // everything else in STBNative
+    }
+
+    [StructLayout(LayoutKind.Sequential)]
+    public struct stbn_allocator_stats {
+        public long bytes_in_use, peak_bytes_in_use, total_bytes_allocated, total_allocations;
+        // Allocations that reused a block from a thread cache instead of going to the heap
+        public long cache_hits;
+    }
+
+    [Flags]
+    public enum stbn_half_flags : int {
+        NONE        = 0,
+        PREMULTIPLY = 1,  // only affects images with alpha (2 or 4 channels)
+        LINEARIZE   = 2,  // convert color channels from sRGB to linear; alpha is left alone
+    }
+
+    [Flags]
+    public enum stbn_colorspace_flags : int {
+        NONE        = 0,
+        PREMULTIPLY = 1,  // premultiply in linear space; only affects images with alpha (2 or 4 channels)
+    }
+
+    // A pixel is inside if its alpha (or only channel) is greater than zero
+    public enum stbn_df_input : int {
+        GRAY8   = 0,  // byte
+        RGBA8   = 1,  // Color
+        GRAY32F = 2,  // float
+        RGBA32F = 3,  // Vector4
+    }
+
+    public enum stbn_decode_format : int {
+        U8  = 0,
+        U16 = 1,  // falls back to U8 if the image isn't 16-bit
+        F32 = 2,
+        F16 = 3,  // falls back to U8 if the image isn't 16-bit
+    }
+
+    [Flags]
+    public enum stbn_decode_flags : int {
+        NONE             = 0,
+        PREMULTIPLY      = 1,
+        SRGB_TO_LINEAR   = 2,
+        SRGB_FROM_LINEAR = 4,
+        NATIVE_CHANNELS  = 8,  // 1-channel images stay 1-channel, everything else becomes 4; desired_channels is ignored
+        TWO_CHANNEL      = 16, // with NATIVE_CHANNELS, 16-bit and float gray + alpha images stay 2-channel
+    }
+
+    public enum stbn_decode_status : int {
+        PENDING = 0,
+        OK      = 1,
+        FAILED  = -1,
+    }
+
+    [StructLayout(LayoutKind.Sequential)]
+    public unsafe struct stbn_decode_desc {
+        public byte* buffer;
+        public int length;
+        // 1-4, or 0 to keep the channel count of the file
+        public int desired_channels;
+        public stbn_decode_format format;
+        public stbn_decode_flags flags;
+    }
+
+    [StructLayout(LayoutKind.Sequential)]
+    public unsafe struct stbn_decode_result {
+        // Free with stbi_image_free
+        public void* pixels;
+        public byte* failure_reason;
+        public int width, height, channels_in_file, channels;
+        public stbn_decode_format format;
+        // Set last, once the rest of the result is filled in
+        public volatile stbn_decode_status status;
+    }
+
+    [StructLayout(LayoutKind.Sequential)]
+    public unsafe struct stbn_image_info {
+        public int width, height, channels;
+        public int is_16_bit;
+        // 1 if the header was read successfully, otherwise failure_reason is set
+        public int ok;
+        public byte* failure_reason;
+    }
+
+    [StructLayout(LayoutKind.Sequential)]
+    public struct stbn_encode_options {
+        public ImageWriteFormat format;
+        // JPEG only, 1-100
+        public int jpeg_quality;
+        // PNG only
+        public int png_compression_level;
+        public PNGFilter png_filter;
+        // QOI only. 0 for none, otherwise the zstd level the image is wrapped at
+        public int qoi_zstd_level;
+    }
+
+    [StructLayout(LayoutKind.Sequential)]
+    public struct stbn_encode_queue_stats {
+        // Images submitted but not written yet
+        public int pending;
+        // Buffers currently held by the caller
+        public int acquired;
+        public long written, failed;
+    }
+
+    [StructLayout(LayoutKind.Sequential)]
+    public struct stbn_texcache_info {
+        // Identifies what the pixels were produced from. Not interpreted by the native side
+        public ulong key;
+        public int width, height, original_width, original_height;
+        public int channels, original_channels, bytes_per_pixel;
+        public int flags;
+        // Level n is (width >> n) x (height >> n)
+        public int level_count;
+    }
+
+    public enum stbn_rect_pack_algorithm : int {
+        SKYLINE  = 0,  // fast, and what stb_rect_pack does
+        MAXRECTS = 1,  // packs tighter (it can fill holes), but each insert gets slower as the atlas fills up
+    }
+
+    [Flags]
+    public enum stbn_qoi_flags : int {
+        NONE   = 0,
+        LINEAR = 1,  // marks the image as linear instead of sRGB in the header
+    }
+
     public enum stbir_datatype : int {
         UINT8            = 0,
         UINT8_SRGB       = 1,
@@ -121,9 +258,49 @@ namespace Squared.Render.STB.Native {
         [DllImport(DllName, CallingConvention = CallingConvention.Cdecl, SetLastError = false)]
         public static extern byte* stbi_failure_reason ();
 
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl, SetLastError = false)]
+        public static extern void stbi_set_jpeg_parallel (int flag_true_if_should_decode_in_parallel);
+
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl, SetLastError = false)]
+        public static extern void* stbi_stream_begin_from_memory (byte* buffer, int len, out int x, out int y, out int channels, int desired_channels);
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl, SetLastError = false)]
+        public static extern int stbi_stream_read_rows (void* stream, byte* output, int strideInBytes, int maxRows);
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl, SetLastError = false)]
+        public static extern void stbi_stream_free (void* stream);
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl, SetLastError = false)]
+        public static extern ushort* stbn_load_half_from_memory (byte* buffer, int len, out int x, out int y, out int channels, int desired_channels, stbn_half_flags flags);
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl, SetLastError = false)]
+        public static extern int stbi_load_into_from_memory (
+            byte* buffer, int len, void* output, int outputWidth, int outputHeight, int strideInBytes,
+            int destX, int destY, out int x, out int y, out int channels, int desired_channels, int bytesPerChannel
+        );
+
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl, SetLastError = false)]
+        public static extern int stbn_decode_batch (stbn_decode_desc* descs, stbn_decode_result* results, int count, DecodeCallback callback, void* userData);
+
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl, SetLastError = false)]
+        public static extern int stbn_probe_files (byte** utf8Paths, int count, stbn_image_info* results);
+
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl, SetLastError = false)]
+        public static extern int stbn_srgb8_to_linear8 (byte* src, int srcStride, byte* dest, int destStride, int width, int height, int channels, stbn_colorspace_flags flags);
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl, SetLastError = false)]
+        public static extern int stbn_linear8_to_srgb8 (byte* src, int srcStride, byte* dest, int destStride, int width, int height, int channels, stbn_colorspace_flags flags);
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl, SetLastError = false)]
+        public static extern int stbn_srgb8_to_linear16 (byte* src, int srcStride, ushort* dest, int destStride, int width, int height, int channels, stbn_colorspace_flags flags);
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl, SetLastError = false)]
+        public static extern int stbn_srgb8_to_linearf (byte* src, int srcStride, float* dest, int destStride, int width, int height, int channels, stbn_colorspace_flags flags);
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl, SetLastError = false)]
+        public static extern int stbn_linearf_to_srgb8 (float* src, int srcStride, byte* dest, int destStride, int width, int height, int channels, stbn_colorspace_flags flags);
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl, SetLastError = false)]
+        public static extern int stbn_srgbf_to_linearf (float* src, int srcStride, float* dest, int destStride, int width, int height, int channels, stbn_colorspace_flags flags);
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl, SetLastError = false)]
+        public static extern int stbn_linearf_to_srgbf (float* src, int srcStride, float* dest, int destStride, int width, int height, int channels, stbn_colorspace_flags flags);
+
         [DllImport(DllName, CallingConvention = CallingConvention.Cdecl, SetLastError = false)]
         public static extern int stbi_write_png_to_func (WriteCallback callback, void *user, int w, int h, int comp, byte* data, int strideInBytes);
         [DllImport(DllName, CallingConvention = CallingConvention.Cdecl, SetLastError = false)]
+        public static extern int stbi_write_png_to_func_ex (WriteCallback callback, void *user, int w, int h, int comp, byte* data, int strideInBytes, int compressionLevel, PNGFilter filter);
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl, SetLastError = false)]
         public static extern int stbi_write_bmp_to_func (WriteCallback callback, void *user, int w, int h, int comp, byte* data);
         [DllImport(DllName, CallingConvention = CallingConvention.Cdecl, SetLastError = false)]
         public static extern int stbi_write_tga_to_func (WriteCallback callback, void *user, int w, int h, int comp, byte* data);
@@ -132,6 +309,69 @@ namespace Squared.Render.STB.Native {
         [DllImport(DllName, CallingConvention = CallingConvention.Cdecl, SetLastError = false)]
         public static extern int stbi_write_hdr_to_func (WriteCallback callback, void *user, int w, int h, int comp, float* data);
 
+        // Returns the encoded image, which must be freed with stbi_image_free
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl, SetLastError = false)]
+        public static extern void* stbn_encode_image (stbn_encode_options* options, void* pixels, int width, int height, int channels, int stride, out int length);
+        // Writes at offset without using the file pointer; returns the number of bytes written or -1
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl, SetLastError = false)]
+        public static extern long stbn_encode_image_to_file (stbn_encode_options* options, void* pixels, int width, int height, int channels, int stride, IntPtr file, long offset);
+
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl, SetLastError = false)]
+        public static extern void* stbn_encode_queue_create (int threadCount, int bufferCount, long bufferSize);
+        // Waits for pending writes to finish
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl, SetLastError = false)]
+        public static extern void stbn_encode_queue_destroy (void* queue);
+        // Returns immediately; the writers free the queue once they're done with it
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl, SetLastError = false)]
+        public static extern void stbn_encode_queue_abandon (void* queue);
+        // Returns null if no buffer was free within timeoutMs (-1 to wait indefinitely)
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl, SetLastError = false)]
+        public static extern void* stbn_encode_queue_acquire (void* queue, int timeoutMs);
+        // On success the buffer belongs to the queue again; returns 0 if the arguments are invalid
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl, SetLastError = false)]
+        public static extern int stbn_encode_queue_submit (void* queue, void* buffer, stbn_encode_options* options, int width, int height, int channels, int stride, byte* utf8Path);
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl, SetLastError = false)]
+        public static extern void stbn_encode_queue_release (void* queue, void* buffer);
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl, SetLastError = false)]
+        public static extern void stbn_encode_queue_wait (void* queue);
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl, SetLastError = false)]
+        public static extern void stbn_encode_queue_get_stats (void* queue, out stbn_encode_queue_stats result);
+
+        // QOI images can also be loaded from memory through stbi_load_from_memory and friends
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl, SetLastError = false)]
+        public static extern void* stbn_qoi_encode (void* pixels, int width, int height, int channels, int stride, stbn_qoi_flags flags, int zstdLevel, out int length);
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl, SetLastError = false)]
+        public static extern int stbn_qoi_info (void* buffer, int length, out int width, out int height, out int channels);
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl, SetLastError = false)]
+        public static extern int stbn_qoi_decode_into (void* buffer, int length, void* dest, int destStride, int destChannels);
+
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl, SetLastError = false)]
+        public static extern ulong stbn_xxh64 (void* data, long length, ulong seed);
+        // levels[n] points to the tightly packed pixels of level n. Free the result with stbi_image_free
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl, SetLastError = false)]
+        public static extern void* stbn_texcache_write (stbn_texcache_info* info, void** levels, int zstdLevel, out long length);
+        // Returns 0 if the buffer isn't a complete, valid cache file
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl, SetLastError = false)]
+        public static extern int stbn_texcache_read_info (void* buffer, long length, out stbn_texcache_info info);
+        // dests[i] receives level firstLevel + i
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl, SetLastError = false)]
+        public static extern int stbn_texcache_decompress (void* buffer, long length, int firstLevel, int levelCount, void** dests);
+
+        // Returns null if the arguments are invalid
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl, SetLastError = false)]
+        public static extern void* stbn_rect_pack_create (int width, int height, stbn_rect_pack_algorithm algorithm);
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl, SetLastError = false)]
+        public static extern void stbn_rect_pack_destroy (void* packer);
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl, SetLastError = false)]
+        public static extern void stbn_rect_pack_reset (void* packer);
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl, SetLastError = false)]
+        public static extern int stbn_rect_pack_insert (void* packer, int width, int height, out int x, out int y);
+        // rects has the same layout as Squared.Render.Atlases.PackedRectangle. Returns -1 if the arguments are invalid
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl, SetLastError = false)]
+        public static extern int stbn_rect_pack_insert_batch (void* packer, void* rects, int count, int sort);
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl, SetLastError = false)]
+        public static extern long stbn_rect_pack_used_area (void* packer);
+
         [DllImport(DllName, CallingConvention = CallingConvention.Cdecl, SetLastError = false)]
         public static extern int get_stbi_write_png_compression_level ();
         [DllImport(DllName, CallingConvention = CallingConvention.Cdecl, SetLastError = false)]
@@ -146,5 +386,71 @@ namespace Squared.Render.STB.Native {
             stbir_pixel_layout pixel_layout, stbir_datatype data_type,
             stbir_edge edge, stbir_filter filter
         );
+
+        // The delegates must be kept alive until every block they allocated has been freed
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl, SetLastError = false)]
+        public static unsafe extern void stbn_set_allocator(AllocCallback alloc, FreeCallback free, void* userData);
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl, SetLastError = false)]
+        public static unsafe extern int stbn_get_allocator_stats(stbn_alloc_subsystem subsystem, out stbn_allocator_stats result);
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl, SetLastError = false)]
+        public static unsafe extern long stbn_get_cached_bytes();
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl, SetLastError = false)]
+        public static unsafe extern void stbn_set_thread_cache_limit(long bytes);
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl, SetLastError = false)]
+        public static unsafe extern void stbn_trim_thread_cache();
+
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl, SetLastError = false)]
+        public static unsafe extern void * stbn_resize_context_create(
+            int input_w, int input_h, int output_w, int output_h,
+            stbir_pixel_layout pixel_layout, stbir_datatype data_type,
+            stbir_edge edge, stbir_filter filter
+        );
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl, SetLastError = false)]
+        public static unsafe extern int stbn_resize_context_execute(
+            void *context,
+            void *input_pixels, int input_stride_in_bytes,
+            void *output_pixels, int output_stride_in_bytes
+        );
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl, SetLastError = false)]
+        public static unsafe extern void stbn_resize_context_destroy(void *context);
+
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl, SetLastError = false)]
+        public static unsafe extern int stbn_mip_rgba8_premultiplied(void* src, int srcWidth, int srcHeight, int srcStrideBytes, void* dest, int destWidth, int destHeight, int destStrideBytes);
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl, SetLastError = false)]
+        public static unsafe extern int stbn_mip_rgba8(void* src, int srcWidth, int srcHeight, int srcStrideBytes, void* dest, int destWidth, int destHeight, int destStrideBytes);
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl, SetLastError = false)]
+        public static unsafe extern int stbn_mip_rgba8_srgb_premultiplied(void* src, int srcWidth, int srcHeight, int srcStrideBytes, void* dest, int destWidth, int destHeight, int destStrideBytes);
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl, SetLastError = false)]
+        public static unsafe extern int stbn_mip_rgba8_srgb(void* src, int srcWidth, int srcHeight, int srcStrideBytes, void* dest, int destWidth, int destHeight, int destStrideBytes);
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl, SetLastError = false)]
+        public static unsafe extern int stbn_mip_gray8(void* src, int srcWidth, int srcHeight, int srcStrideBytes, void* dest, int destWidth, int destHeight, int destStrideBytes);
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl, SetLastError = false)]
+        public static unsafe extern int stbn_mip_pgray4(void* src, int srcWidth, int srcHeight, int srcStrideBytes, void* dest, int destWidth, int destHeight, int destStrideBytes);
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl, SetLastError = false)]
+        public static unsafe extern int stbn_mip_pgray4_srgb(void* src, int srcWidth, int srcHeight, int srcStrideBytes, void* dest, int destWidth, int destHeight, int destStrideBytes);
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl, SetLastError = false)]
+        public static unsafe extern int stbn_mip_single(void* src, int srcWidth, int srcHeight, int srcStrideBytes, void* dest, int destWidth, int destHeight, int destStrideBytes);
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl, SetLastError = false)]
+        public static unsafe extern int stbn_mip_single_min(void* src, int srcWidth, int srcHeight, int srcStrideBytes, void* dest, int destWidth, int destHeight, int destStrideBytes);
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl, SetLastError = false)]
+        public static unsafe extern int stbn_mip_single_pseudo_min(void* src, int srcWidth, int srcHeight, int srcStrideBytes, void* dest, int destWidth, int destHeight, int destStrideBytes);
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl, SetLastError = false)]
+        public static unsafe extern int stbn_mip_single_max(void* src, int srcWidth, int srcHeight, int srcStrideBytes, void* dest, int destWidth, int destHeight, int destStrideBytes);
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl, SetLastError = false)]
+        public static unsafe extern int stbn_mip_half(void* src, int srcWidth, int srcHeight, int srcStrideBytes, void* dest, int destWidth, int destHeight, int destStrideBytes);
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl, SetLastError = false)]
+        public static unsafe extern int stbn_mip_half_min(void* src, int srcWidth, int srcHeight, int srcStrideBytes, void* dest, int destWidth, int destHeight, int destStrideBytes);
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl, SetLastError = false)]
+        public static unsafe extern int stbn_mip_half_pseudo_min(void* src, int srcWidth, int srcHeight, int srcStrideBytes, void* dest, int destWidth, int destHeight, int destStrideBytes);
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl, SetLastError = false)]
+        public static unsafe extern int stbn_mip_half_max(void* src, int srcWidth, int srcHeight, int srcStrideBytes, void* dest, int destWidth, int destHeight, int destStrideBytes);
+
+        // input and output are width x height, and only the region of output is written.
+        // Distances are negative inside. Returns 0 if the arguments are invalid.
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl, SetLastError = false)]
+        public static unsafe extern int stbn_distance_field_jump_flood(void* input, stbn_df_input inputFormat, int width, int height, int regionX, int regionY, int regionWidth, int regionHeight, float* output);
+        // Same as above, but exact
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl, SetLastError = false)]
+        public static unsafe extern int stbn_distance_field_exact(void* input, stbn_df_input inputFormat, int width, int height, int regionX, int regionY, int regionWidth, int regionHeight, float* output);
     }
 }
\ No newline at end of file
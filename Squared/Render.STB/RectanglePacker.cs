@@ -0,0 +1,99 @@
+﻿using System;
+using Squared.Render.Atlases;
+using Squared.Render.STB.Native;
+
+namespace Squared.Render.STB {
+    /// <summary>
+    /// A native skyline or maxrects packer, for atlases with thousands of entries where managed packing
+    ///  shows up as frame spikes (on glyph cache misses, or when a runtime atlas is rebuilt).
+    /// </summary>
+    public unsafe sealed class STBRectanglePacker : IRectanglePacker {
+        private void* Handle;
+
+        public readonly stbn_rect_pack_algorithm Algorithm;
+        public int Width { get; private set; }
+        public int Height { get; private set; }
+
+        public bool IsDisposed => Handle == null;
+
+        public STBRectanglePacker (int width, int height, stbn_rect_pack_algorithm algorithm = stbn_rect_pack_algorithm.SKYLINE) {
+            if ((width <= 0) || (width > 65536))
+                throw new ArgumentOutOfRangeException(nameof(width));
+            if ((height <= 0) || (height > 65536))
+                throw new ArgumentOutOfRangeException(nameof(height));
+
+            Width = width;
+            Height = height;
+            Algorithm = algorithm;
+            Handle = API.stbn_rect_pack_create(width, height, algorithm);
+            if (Handle == null)
+                throw new Exception("Failed to create rectangle packer");
+        }
+
+        /// <summary>
+        /// Makes DynamicAtlas (and anything else that uses RectanglePacker.Create) use native packers.
+        /// </summary>
+        public static void InstallGlobally (stbn_rect_pack_algorithm algorithm = stbn_rect_pack_algorithm.SKYLINE) {
+            RectanglePacker.Set((width, height) => new STBRectanglePacker(width, height, algorithm));
+        }
+
+        /// <summary>
+        /// The total area of every rectangle inserted since the packer was created or cleared.
+        /// </summary>
+        public long UsedArea {
+            get {
+                CheckDisposed();
+                return API.stbn_rect_pack_used_area(Handle);
+            }
+        }
+
+        private void CheckDisposed () {
+            if (IsDisposed)
+                throw new ObjectDisposedException("STBRectanglePacker");
+        }
+
+        public bool TryInsert (int width, int height, out int x, out int y) {
+            CheckDisposed();
+            if (API.stbn_rect_pack_insert(Handle, width, height, out x, out y) != 0)
+                return true;
+            x = y = -1;
+            return false;
+        }
+
+        public int InsertBatch (PackedRectangle[] rectangles, int offset, int count, RectanglePackerSort sort) {
+            CheckDisposed();
+            if (rectangles == null)
+                throw new ArgumentNullException(nameof(rectangles));
+            if ((offset < 0) || (offset > rectangles.Length))
+                throw new ArgumentOutOfRangeException(nameof(offset));
+            if ((count < 0) || (count > rectangles.Length - offset))
+                throw new ArgumentOutOfRangeException(nameof(count));
+            if (count == 0)
+                return 0;
+
+            int result;
+            fixed (PackedRectangle* pRectangles = &rectangles[offset])
+                result = API.stbn_rect_pack_insert_batch(Handle, pRectangles, count, (int)sort);
+            if (result < 0)
+                throw new Exception("Failed to pack rectangles");
+            return result;
+        }
+
+        public void Clear () {
+            CheckDisposed();
+            API.stbn_rect_pack_reset(Handle);
+        }
+
+        public void Dispose () {
+            var handle = Handle;
+            Handle = null;
+            if (handle != null)
+                API.stbn_rect_pack_destroy(handle);
+            GC.SuppressFinalize(this);
+        }
+
+        ~STBRectanglePacker () {
+            Dispose();
+        }
+    }
+}
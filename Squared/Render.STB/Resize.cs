@@ -0,0 +1,63 @@
+﻿using System;
+using Squared.Render.STB.Native;
+
+namespace Squared.Render.STB {
+    /// <summary>
+    /// Builds stb_image_resize's samplers once for a fixed size/format so repeated resizes
+    ///  (video frames, thumbnails, readbacks) don't pay for setup and allocation every call.
+    /// Not thread-safe; use one context per thread.
+    /// </summary>
+    public unsafe sealed class ResizeContext : IDisposable {
+        private void* Handle;
+
+        public readonly int InputWidth, InputHeight, OutputWidth, OutputHeight;
+        public readonly stbir_pixel_layout PixelLayout;
+        public readonly stbir_datatype DataType;
+
+        public bool IsDisposed => Handle == null;
+
+        public ResizeContext (
+            int inputWidth, int inputHeight, int outputWidth, int outputHeight,
+            stbir_pixel_layout pixelLayout, stbir_datatype dataType,
+            stbir_edge edge = stbir_edge.CLAMP, stbir_filter filter = stbir_filter.DEFAULT
+        ) {
+            InputWidth = inputWidth;
+            InputHeight = inputHeight;
+            OutputWidth = outputWidth;
+            OutputHeight = outputHeight;
+            PixelLayout = pixelLayout;
+            DataType = dataType;
+
+            Handle = API.stbn_resize_context_create(
+                inputWidth, inputHeight, outputWidth, outputHeight,
+                pixelLayout, dataType, edge, filter
+            );
+            if (Handle == null)
+                throw new Exception("Failed to create stb_image_resize context");
+        }
+
+        /// <param name="inputStrideBytes">The distance between rows in the input, or 0 if tightly packed</param>
+        /// <param name="outputStrideBytes">The distance between rows in the output, or 0 if tightly packed</param>
+        public void Resize (void* input, int inputStrideBytes, void* output, int outputStrideBytes) {
+            if (IsDisposed)
+                throw new ObjectDisposedException("ResizeContext");
+            if ((input == null) || (output == null))
+                throw new ArgumentNullException(input == null ? "input" : "output");
+
+            if (API.stbn_resize_context_execute(Handle, input, inputStrideBytes, output, outputStrideBytes) == 0)
+                throw new Exception("An error occurred in stb_image_resize");
+        }
+
+        public void Dispose () {
+            var handle = Handle;
+            Handle = null;
+            if (handle != null)
+                API.stbn_resize_context_destroy(handle);
+            GC.SuppressFinalize(this);
+        }
+
+        ~ResizeContext () {
+            Dispose();
+        }
+    }
+}
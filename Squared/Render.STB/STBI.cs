@@ -17,10 +17,36 @@ using Squared.Util;
 namespace Squared.Render.STB {
     public unsafe sealed class Image : IDisposable {
         private static readonly NativeAllocator ResizedDataAllocator = new NativeAllocator { Name = "STB.Image.ResizedData" };
+        private static readonly NativeAllocator StreamingAllocator = new NativeAllocator { Name = "STB.Image.Streaming" };
+        private static readonly NativeAllocator BatchAllocator = new NativeAllocator { Name = "STB.Image.Batch" };
+        private static readonly Native.DecodeCallback OnBatchImageDecoded = _OnBatchImageDecoded;
 
         // FIXME: Causes crashes
         public const bool EnableMmap = true;
 
+        private static bool _ParallelJpegDecoding = true;
+        /// <summary>
+        /// If set, large JPEGs are decoded using multiple threads. Color conversion is always
+        ///  split up, but the entropy decoding of baseline JPEGs can only be split when the
+        ///  file contains restart markers.
+        /// </summary>
+        public static bool ParallelJpegDecoding {
+            get => _ParallelJpegDecoding;
+            set {
+                _ParallelJpegDecoding = value;
+                Native.API.stbi_set_jpeg_parallel(value ? 1 : 0);
+            }
+        }
+
+        /// <summary>
+        /// Streamed images are decoded and uploaded in bands of roughly this many bytes.
+        /// </summary>
+        public static int StreamingBandBytes = 256 * 1024;
+        /// <summary>
+        /// How many bands of a streamed image can be decoded and waiting to be uploaded at once.
+        /// </summary>
+        public static int StreamingBandCount = 3;
+
         public readonly string Name;
         private volatile int _RefCount;
         public int RefCount => _RefCount;
@@ -34,6 +60,15 @@ namespace Squared.Render.STB {
         public bool IsPremultiplied { get; set; }
         public bool IsFloatingPoint { get; private set; }
         public bool Is16Bit { get; private set; }
+        /// <summary>
+        /// The image was 16-bit and has been decoded to half floats (HalfSingle/HalfVector2/HalfVector4).
+        /// </summary>
+        public bool IsHalfFloat { get; private set; }
+        /// <summary>
+        /// The image was decoded with as few channels as it can be uploaded with (see <see cref="GetNativeChannelCount"/>).
+        /// Single-channel images use a red format (opaque gray) instead of Alpha8.
+        /// </summary>
+        public bool UsesNativeChannelCount { get; private set; }
 
         public int DataLength => Width * Height * ChannelCount;
 
@@ -41,14 +76,33 @@ namespace Squared.Render.STB {
 
         private NativeAllocation ResizedData;
 
+        private volatile void* _Stream;
+        private NativeAllocation StreamSource;
+        /// <summary>
+        /// If set, the image hasn't actually been decoded yet and <see cref="Data"/> is null.
+        /// CreateTexture/CreateTextureAsync decode it a band of rows at a time, uploading each
+        ///  band as soon as it's ready, so the whole image never has to be in memory at once.
+        /// Only non-interlaced 8-bit PNGs and baseline JPEGs can be streamed, and only when no
+        ///  resizing or mip generation was requested.
+        /// </summary>
+        public bool IsStreaming => _Stream != null;
+
         private static FileStream OpenStream (string path) {
             return File.Open(path, FileMode.Open, FileAccess.Read, FileShare.ReadWrite);
         }
 
         public static unsafe void GetInfoFromFile (FileStream stream, string path, out int width, out int height, out int channels) {
-            bool ownsStream = stream == null;
-            if (ownsStream)
-                stream = File.Open(path, FileMode.Open);
+            if (stream == null) {
+                var info = GetInfoFromFiles(new[] { path })[0];
+                // Like stbi_info, an unrecognized file just reports a size of 0
+                if ((info.ok == 0) && !File.Exists(path))
+                    throw new FileNotFoundException("Failed to read image header: " + GetFailureReason(info.failure_reason), path);
+                width = info.width;
+                height = info.height;
+                channels = info.channels;
+                return;
+            }
+
             using (var mappedFile = MemoryMappedFile.CreateFromFile(stream, null, 0, MemoryMappedFileAccess.Read, HandleInheritability.None, true))
             using (var view = mappedFile.CreateViewAccessor(0, stream.Length, MemoryMappedFileAccess.Read)) {
                 byte* ptr = null;
@@ -56,8 +110,199 @@ namespace Squared.Render.STB {
                 Native.API.stbi_info_from_memory(ptr, (int)view.Capacity, out width, out height, out channels);
                 view.SafeMemoryMappedViewHandle.ReleasePointer();
             }
-            if (ownsStream)
-                stream.Dispose();
+        }
+
+        /// <summary>
+        /// Reads the dimensions, channel count and bit depth of many image files at once, in parallel.
+        /// Only the first KB or so of each file is read unless its header turns out to be further in.
+        /// Files that couldn't be read have ok == 0 in their result instead of throwing.
+        /// </summary>
+        public static unsafe Native.stbn_image_info[] GetInfoFromFiles (IReadOnlyList<string> paths) {
+            var count = paths.Count;
+            var result = new Native.stbn_image_info[count];
+            if (count == 0)
+                return result;
+
+            // Null-terminated UTF-8 paths packed into one buffer, followed by the pointers to them
+            int pathBytes = 0;
+            for (int i = 0; i < count; i++)
+                pathBytes += Encoding.UTF8.GetByteCount(paths[i]) + 1;
+            var pointerOffset = (pathBytes + 7) & ~7;
+            using (var buffer = BatchAllocator.Allocate(pointerOffset + (count * sizeof(byte*)))) {
+                var pStrings = (byte*)buffer.Data;
+                var pPointers = (byte**)(pStrings + pointerOffset);
+                for (int i = 0, offset = 0; i < count; i++) {
+                    var path = paths[i];
+                    pPointers[i] = pStrings + offset;
+                    fixed (char* pPath = path)
+                        offset += Encoding.UTF8.GetBytes(pPath, path.Length, pStrings + offset, pathBytes - offset);
+                    pStrings[offset++] = 0;
+                }
+
+                fixed (Native.stbn_image_info* pResult = result)
+                    Native.API.stbn_probe_files(pPointers, count, pResult);
+            }
+            return result;
+        }
+
+        private static string GetFailureReason (byte* reason) {
+            if (reason == null)
+                return "unknown error";
+            int length = 0;
+            while ((length < 128) && (reason[length] != 0))
+                length++;
+            return Encoding.UTF8.GetString(reason, length);
+        }
+
+        /// <summary>
+        /// Decodes an image straight into caller-provided memory (e.g. a mapped upload buffer or an atlas page)
+        ///  instead of into a new Image, so the pixels are only written once.
+        /// The image's top-left pixel is written at (x, y) in a destination of destinationWidth x destinationHeight
+        ///  pixels whose rows are pitch bytes apart. Nothing is written if the image doesn't fit.
+        /// </summary>
+        public static void DecodeInto (
+            byte* buffer, int length, void* destination, int destinationWidth, int destinationHeight, int pitch,
+            int x, int y, out int width, out int height, int channelCount = 4, bool premultiply = true,
+            bool asFloatingPoint = false, bool as16Bit = false
+        ) {
+            if ((channelCount < 1) || (channelCount > 4))
+                throw new ArgumentOutOfRangeException(nameof(channelCount));
+            if (asFloatingPoint && as16Bit)
+                throw new ArgumentException("Only one of asFloatingPoint and as16Bit can be set");
+
+            int bytesPerChannel = asFloatingPoint ? 4 : (as16Bit ? 2 : 1);
+            if (Native.API.stbi_load_into_from_memory(
+                buffer, length, destination, destinationWidth, destinationHeight, pitch,
+                x, y, out width, out height, out _, channelCount, bytesPerChannel
+            ) == 0)
+                throw new Exception("Failed to load image: " + GetFailureReason(Native.API.stbi_failure_reason()));
+
+            if (!premultiply || (channelCount != 4))
+                return;
+
+            var pRow = (byte*)destination + (y * (long)pitch) + (x * channelCount * bytesPerChannel);
+            for (int i = 0; i < height; i++, pRow += pitch) {
+                if (asFloatingPoint)
+                    PremultiplyFPData((float*)pRow, width);
+                else if (as16Bit)
+                    PremultiplyData16((ushort*)pRow, width);
+                else
+                    PremultiplyData((uint*)pRow, width);
+            }
+        }
+
+        public static void DecodeInto (
+            ArraySegment<byte> buffer, void* destination, int destinationWidth, int destinationHeight, int pitch,
+            int x, int y, out int width, out int height, int channelCount = 4, bool premultiply = true,
+            bool asFloatingPoint = false, bool as16Bit = false
+        ) {
+            fixed (byte* pBuffer = buffer.Array)
+                DecodeInto(
+                    pBuffer + buffer.Offset, buffer.Count, destination, destinationWidth, destinationHeight, pitch,
+                    x, y, out width, out height, channelCount, premultiply, asFloatingPoint, as16Bit
+                );
+        }
+
+        /// <summary>
+        /// Decodes a batch of images across the native worker pool. Each future is completed from a worker
+        ///  thread as soon as its image (including any resizing and mip generation) is ready, so the first
+        ///  images can be used before the whole batch is done. Failures are reported through the futures.
+        /// The buffers stay pinned until every image in the batch has finished.
+        /// </summary>
+        /// <param name="names">Optional names for the resulting images, in the same order as the buffers.</param>
+        public static Future<Image>[] LoadBatch (
+            IReadOnlyList<ArraySegment<byte>> buffers, IReadOnlyList<string> names = null,
+            bool premultiply = true, bool asFloatingPoint = false, bool enable16Bit = false,
+            bool generateMips = false, bool sRGB = false, bool enableGrayscale = false,
+            int maxWidth = 0, int maxHeight = 0, bool nativeChannelCount = false, bool enableTwoChannel = false,
+            bool enableHalfFloat = false, bool sRGBToLinear = false, bool sRGBFromLinear = false
+        ) {
+            var count = buffers.Count;
+            if ((names != null) && (names.Count != count))
+                throw new ArgumentException("Must have one name per buffer", nameof(names));
+
+            var batch = new DecodeBatch {
+                Futures = new Future<Image>[count],
+                Pins = new GCHandle[count],
+                Names = names,
+                Premultiply = premultiply,
+                GenerateMips = generateMips,
+                sRGB = sRGB,
+                UsesNativeChannelCount = nativeChannelCount,
+                MaxWidth = maxWidth,
+                MaxHeight = maxHeight,
+            };
+            for (int i = 0; i < count; i++)
+                batch.Futures[i] = new Future<Image>();
+            if (count == 0)
+                return batch.Futures;
+
+            var format = asFloatingPoint
+                ? Native.stbn_decode_format.F32
+                : (enableHalfFloat ? Native.stbn_decode_format.F16 : (enable16Bit ? Native.stbn_decode_format.U16 : Native.stbn_decode_format.U8));
+            var flags = premultiply ? Native.stbn_decode_flags.PREMULTIPLY : Native.stbn_decode_flags.NONE;
+            if (sRGBToLinear)
+                flags |= Native.stbn_decode_flags.SRGB_TO_LINEAR;
+            if (sRGBFromLinear)
+                flags |= Native.stbn_decode_flags.SRGB_FROM_LINEAR;
+            // Grayscale mode picks channel counts the same way, it just uploads 1-channel images as Alpha8
+            if (nativeChannelCount || enableGrayscale)
+                flags |= Native.stbn_decode_flags.NATIVE_CHANNELS;
+            // Premultiplication and mip generation only handle 1 and 4 channels
+            if (nativeChannelCount && enableTwoChannel && !premultiply && !generateMips)
+                flags |= Native.stbn_decode_flags.TWO_CHANNEL;
+
+            batch.Results = BatchAllocator.Allocate<Native.stbn_decode_result>(count);
+            // The descriptors are copied by stbn_decode_batch, so they can go right away
+            using (var descs = BatchAllocator.Allocate<Native.stbn_decode_desc>(count)) {
+                var pDescs = (Native.stbn_decode_desc*)descs.Data;
+                for (int i = 0; i < count; i++) {
+                    var buffer = buffers[i];
+                    batch.Pins[i] = GCHandle.Alloc(buffer.Array, GCHandleType.Pinned);
+                    pDescs[i] = new Native.stbn_decode_desc {
+                        buffer = (byte*)batch.Pins[i].AddrOfPinnedObject() + buffer.Offset,
+                        length = buffer.Count,
+                        desired_channels = 4,
+                        format = format,
+                        flags = flags,
+                    };
+                }
+
+                batch.Self = GCHandle.Alloc(batch, GCHandleType.Normal);
+                if (Native.API.stbn_decode_batch(
+                    pDescs, (Native.stbn_decode_result*)batch.Results.Data, count,
+                    OnBatchImageDecoded, (void*)GCHandle.ToIntPtr(batch.Self)
+                ) == 0) {
+                    batch.Release();
+                    throw new Exception("Failed to start batch decode");
+                }
+            }
+
+            return batch.Futures;
+        }
+
+        private static void _OnBatchImageDecoded (void* userData, int index, Native.stbn_decode_result* result) {
+            var batch = (DecodeBatch)GCHandle.FromIntPtr((IntPtr)userData).Target;
+            // Called once more after the last image
+            if (index < 0) {
+                batch.Release();
+                return;
+            }
+
+            var future = batch.Futures[index];
+            // This runs on a native worker, so nothing can be allowed to escape
+            try {
+                if (result->status != Native.stbn_decode_status.OK) {
+                    var message = "Failed to load image";
+                    if (result->failure_reason != null)
+                        message += ": " + GetFailureReason(result->failure_reason);
+                    throw new Exception(message);
+                }
+
+                future.SetResult(new Image(batch.Names?[index], result, batch), null);
+            } catch (Exception exc) {
+                future.SetResult2(null, ExceptionDispatchInfo.Capture(exc));
+            }
         }
 
         public Image (string path, bool premultiply = true, bool asFloatingPoint = false, bool enable16Bit = false)
@@ -68,7 +313,9 @@ namespace Squared.Render.STB {
         public Image (
             Stream stream, bool ownsStream, bool premultiply = true, 
             bool asFloatingPoint = false, bool enable16Bit = false, bool generateMips = false,
-            bool sRGB = false, bool enableGrayscale = false, int maxWidth = 0, int maxHeight = 0
+            bool sRGB = false, bool enableGrayscale = false, int maxWidth = 0, int maxHeight = 0,
+            bool allowStreaming = false, bool nativeChannelCount = false, bool enableTwoChannel = false,
+            bool enableHalfFloat = false, bool sRGBToLinear = false, bool sRGBFromLinear = false
         ) {
             var length = stream.Length - stream.Position;
 
@@ -114,7 +361,13 @@ namespace Squared.Render.STB {
                 sRGB: sRGB,
                 enableGrayscale: enableGrayscale,
                 maxWidth: maxWidth,
-                maxHeight: maxHeight
+                maxHeight: maxHeight,
+                allowStreaming: allowStreaming,
+                nativeChannelCount: nativeChannelCount,
+                enableTwoChannel: enableTwoChannel,
+                enableHalfFloat: enableHalfFloat,
+                sRGBToLinear: sRGBToLinear,
+                sRGBFromLinear: sRGBFromLinear
             );
 
             if (ownsStream)
@@ -130,7 +383,9 @@ namespace Squared.Render.STB {
         public unsafe Image (
             ArraySegment<byte> buffer, bool premultiply = true, bool asFloatingPoint = false, 
             bool generateMips = false, bool sRGB = false, bool enableGrayscale = false,
-            int maxWidth = 0, int maxHeight = 0
+            int maxWidth = 0, int maxHeight = 0, bool allowStreaming = false,
+            bool nativeChannelCount = false, bool enableTwoChannel = false,
+            bool enableHalfFloat = false, bool sRGBToLinear = false, bool sRGBFromLinear = false
         ) {
             fixed (byte* pBuffer = buffer.Array) {
                 InitializeFromPointer(
@@ -142,28 +397,78 @@ namespace Squared.Render.STB {
                     sRGB: sRGB,
                     enableGrayscale: enableGrayscale,
                     maxWidth: maxWidth,
-                    maxHeight: maxHeight
+                    maxHeight: maxHeight,
+                    allowStreaming: allowStreaming,
+                    nativeChannelCount: nativeChannelCount,
+                    enableTwoChannel: enableTwoChannel,
+                    enableHalfFloat: enableHalfFloat,
+                    sRGBToLinear: sRGBToLinear,
+                    sRGBFromLinear: sRGBFromLinear
                 );
             }
         }
 
+        private Image (string name, Native.stbn_decode_result* result, DecodeBatch batch) {
+            _RefCount = 1;
+            Name = name;
+            _OriginalData = _Data = result->pixels;
+            Width = OriginalWidth = result->width;
+            Height = OriginalHeight = result->height;
+            OriginalChannelCount = result->channels_in_file;
+            ChannelCount = result->channels;
+            IsFloatingPoint = result->format == Native.stbn_decode_format.F32;
+            Is16Bit = result->format == Native.stbn_decode_format.U16;
+            IsHalfFloat = result->format == Native.stbn_decode_format.F16;
+            UsesNativeChannelCount = batch.UsesNativeChannelCount;
+            SizeofPixel = Evil.TextureUtils.GetBytesPerPixelAndComponents(GetFormat(batch.sRGB, ChannelCount), out _);
+
+            // Color space conversion and premultiplication already happened on the worker
+            FinishInitialize(batch.Premultiply, batch.sRGB, batch.MaxWidth, batch.MaxHeight, batch.GenerateMips);
+        }
+
         private void InitializeFromPointer (
             byte* pBuffer, int offset, int length, 
             bool premultiply = true, bool asFloatingPoint = false, 
             bool enable16Bit = false, bool generateMips = false,
             bool sRGB = false, bool enableGrayscale = false,
-            int maxWidth = 0, int maxHeight = 0
+            int maxWidth = 0, int maxHeight = 0, bool allowStreaming = false,
+            bool nativeChannelCount = false, bool enableTwoChannel = false,
+            bool enableHalfFloat = false, bool sRGBToLinear = false, bool sRGBFromLinear = false
         ) {
             IsFloatingPoint = asFloatingPoint;
-            Native.API.stbi_info_from_memory(pBuffer + offset, length, out _, out _, out int components);
-            int desiredChannelCount = !enableGrayscale || (components > 1) ? 4 : 1;
-
-            // FIXME: Don't request RGBA?
-            Is16Bit = enable16Bit && Native.API.stbi_is_16_bit_from_memory(pBuffer + offset, length) != 0;
+            // stbi_info reports the channel count the image decodes to, including alpha from tRNS
+            Native.API.stbi_info_from_memory(pBuffer + offset, length, out int infoWidth, out int infoHeight, out int components);
+            bool is16BitSource = (enable16Bit || enableHalfFloat) && Native.API.stbi_is_16_bit_from_memory(pBuffer + offset, length) != 0;
+            // Half floats take priority, since they're the same size and don't need converting on the GPU
+            IsHalfFloat = enableHalfFloat && is16BitSource && !asFloatingPoint;
+            Is16Bit = enable16Bit && is16BitSource && !IsHalfFloat;
+
+            int desiredChannelCount;
+            if (nativeChannelCount) {
+                // Premultiplication and mip generation only handle 1 and 4 channels
+                desiredChannelCount = GetNativeChannelCount(
+                    components, asFloatingPoint || IsHalfFloat, Is16Bit, enableTwoChannel && !premultiply && !generateMips
+                );
+                UsesNativeChannelCount = true;
+            } else
+                desiredChannelCount = !enableGrayscale || (components > 1) ? 4 : 1;
+
+            if (
+                allowStreaming && !asFloatingPoint && !Is16Bit && !IsHalfFloat && !generateMips &&
+                !sRGBToLinear && !sRGBFromLinear &&
+                (TextureLoadOptions.ComputeScaleRatio(infoWidth, infoHeight, maxWidth, maxHeight) >= 1) &&
+                TryBeginStreaming(pBuffer + offset, length, desiredChannelCount, premultiply, sRGB)
+            )
+                return;
 
             if (asFloatingPoint)
                 _OriginalData = Native.API.stbi_loadf_from_memory(pBuffer + offset, length, out OriginalWidth, out OriginalHeight, out OriginalChannelCount, desiredChannelCount);
-            else if (Is16Bit)
+            else if (IsHalfFloat) {
+                var flags = premultiply ? Native.stbn_half_flags.PREMULTIPLY : Native.stbn_half_flags.NONE;
+                if (sRGBToLinear)
+                    flags |= Native.stbn_half_flags.LINEARIZE;
+                _OriginalData = Native.API.stbn_load_half_from_memory(pBuffer + offset, length, out OriginalWidth, out OriginalHeight, out OriginalChannelCount, desiredChannelCount, flags);
+            } else if (Is16Bit)
                 _OriginalData = Native.API.stbi_load_16_from_memory(pBuffer + offset, length, out OriginalWidth, out OriginalHeight, out OriginalChannelCount, desiredChannelCount);
             else
                 _OriginalData = Native.API.stbi_load_from_memory(pBuffer + offset, length, out OriginalWidth, out OriginalHeight, out OriginalChannelCount, desiredChannelCount);
@@ -184,13 +489,20 @@ namespace Squared.Render.STB {
 
             SizeofPixel = Evil.TextureUtils.GetBytesPerPixelAndComponents(GetFormat(sRGB, desiredChannelCount), out _);
 
-            if (asFloatingPoint)
+            // Half floats were already premultiplied (and linearized) during decode
+            if ((sRGBToLinear && !IsHalfFloat) || sRGBFromLinear)
+                ConvertColorSpace(sRGBToLinear, premultiply);
+            else if (asFloatingPoint)
                 ConvertFPData(premultiply);
             else if (Is16Bit)
                 ConvertData16(premultiply);
-            else
+            else if (!IsHalfFloat)
                 ConvertData(premultiply);
 
+            FinishInitialize(premultiply, sRGB, maxWidth, maxHeight, generateMips);
+        }
+
+        private void FinishInitialize (bool premultiply, bool sRGB, int maxWidth, int maxHeight, bool generateMips) {
             IsPremultiplied = premultiply;
 
             double scaleRatio = TextureLoadOptions.ComputeScaleRatio(OriginalWidth, OriginalHeight, maxWidth, maxHeight);
@@ -201,6 +513,31 @@ namespace Squared.Render.STB {
                 GenerateMips(sRGB);
         }
 
+        private bool TryBeginStreaming (byte* pBuffer, int length, int desiredChannelCount, bool premultiply, bool sRGB) {
+            // The stream keeps reading the compressed data until the last row is decoded,
+            //  which will be long after our caller has unmapped or unpinned it
+            var source = StreamingAllocator.Allocate(length);
+            Buffer.MemoryCopy(pBuffer, source.Data, length, length);
+            var stream = Native.API.stbi_stream_begin_from_memory(
+                (byte*)source.Data, length, out OriginalWidth, out OriginalHeight, out OriginalChannelCount, desiredChannelCount
+            );
+            if (stream == null) {
+                // Not a format we can stream (or corrupt). The regular path will report any errors
+                source.ReleaseReference();
+                return false;
+            }
+
+            StreamSource = source;
+            _Stream = stream;
+            ChannelCount = desiredChannelCount;
+            Width = OriginalWidth;
+            Height = OriginalHeight;
+            SizeofPixel = Evil.TextureUtils.GetBytesPerPixelAndComponents(GetFormat(sRGB, desiredChannelCount), out _);
+            // Applied to each band as it's decoded
+            IsPremultiplied = premultiply;
+            return true;
+        }
+
         private unsafe void Resize (double scaleRatio) {
             if (ResizedData != null)
                 throw new InvalidOperationException("Image already resized");
@@ -216,12 +553,16 @@ namespace Squared.Render.STB {
                 dataType = Native.stbir_datatype.UINT16;
             else if (IsFloatingPoint)
                 dataType = Native.stbir_datatype.FLOAT;
+            else if (IsHalfFloat)
+                dataType = Native.stbir_datatype.HALF_FLOAT;
 
             Native.stbir_pixel_layout pixelLayout;
             if (ChannelCount == 4)
                 pixelLayout = IsPremultiplied ? Native.stbir_pixel_layout.RGBA_PM : Native.stbir_pixel_layout.RGBA;
             else if (ChannelCount == 1)
                 pixelLayout = Native.stbir_pixel_layout._1CHANNEL;
+            else if (ChannelCount == 2)
+                pixelLayout = IsPremultiplied ? Native.stbir_pixel_layout.RA_PM : Native.stbir_pixel_layout.RA;
             else if (ChannelCount == 3)
                 pixelLayout = Native.stbir_pixel_layout.RGB;
             else
@@ -254,12 +595,42 @@ namespace Squared.Render.STB {
                 PremultiplyData();
         }
 
+        /// <summary>
+        /// Converts the color channels between sRGB and linear in place, premultiplying in linear space if requested.
+        /// Runs before resizing and mip generation so that they see the converted data.
+        /// </summary>
+        private unsafe void ConvertColorSpace (bool toLinear, bool premultiply) {
+            if (Is16Bit || IsHalfFloat)
+                throw new NotImplementedException("Color space conversion of 16-bit and half float images");
+
+            var flags = premultiply ? Native.stbn_colorspace_flags.PREMULTIPLY : Native.stbn_colorspace_flags.NONE;
+            int ok;
+            if (IsFloatingPoint) {
+                var pData = (float*)_Data;
+                ok = toLinear
+                    ? Native.API.stbn_srgbf_to_linearf(pData, 0, pData, 0, Width, Height, ChannelCount, flags)
+                    : Native.API.stbn_linearf_to_srgbf(pData, 0, pData, 0, Width, Height, ChannelCount, flags);
+            } else {
+                var pData = (byte*)_Data;
+                ok = toLinear
+                    ? Native.API.stbn_srgb8_to_linear8(pData, 0, pData, 0, Width, Height, ChannelCount, flags)
+                    : Native.API.stbn_linear8_to_srgb8(pData, 0, pData, 0, Width, Height, ChannelCount, flags);
+            }
+            if (ok == 0)
+                throw new Exception("Failed to convert image color space");
+        }
+
         private unsafe void PremultiplyFPData () {
             if (IsDisposed)
                 throw new ObjectDisposedException("Image");
-            var pData = (float*)_Data;
-            var pEnd = pData + DataLength;
-            for (; pData < pEnd; pData+=ChannelCount) {
+            if (ChannelCount != 4)
+                throw new InvalidOperationException("Image is not rgba");
+            PremultiplyFPData((float*)_Data, Width * Height);
+        }
+
+        private static unsafe void PremultiplyFPData (float* pData, int pixelCount) {
+            var pEnd = pData + (pixelCount * 4);
+            for (; pData < pEnd; pData+=4) {
                 var a = pData[3];
                 var temp = pData[0];
                 pData[0] *= a;
@@ -273,8 +644,11 @@ namespace Squared.Render.STB {
                 throw new ObjectDisposedException("Image");
             if (ChannelCount != 4)
                 throw new InvalidOperationException("Image is not rgba");
-            var pData = (ushort*)_Data;
-            var pEnd = pData + (Width * Height * 4);
+            PremultiplyData16((ushort*)_Data, Width * Height);
+        }
+
+        private static unsafe void PremultiplyData16 (ushort* pData, int pixelCount) {
+            var pEnd = pData + (pixelCount * 4);
             for (; pData < pEnd; pData += 4) {
                 ushort r = pData[0], g = pData[1], b = pData[2], a = pData[3];
                 pData[0] = (ushort)(r * a / ushort.MaxValue);
@@ -288,10 +662,13 @@ namespace Squared.Render.STB {
                 throw new ObjectDisposedException("Image");
             if (ChannelCount != 4)
                 throw new InvalidOperationException("Image is not rgba");
-            var pData = (uint*)_Data;
+            PremultiplyData((uint*)_Data, Width * Height);
+        }
+
+        private static unsafe void PremultiplyData (uint* pData, int pixelCount) {
             var pBytes = (byte*)pData;
-            var pEnd = pData + (Width * Height);
-            for (; pData < pEnd; pData++, pBytes+=SizeofPixel) {
+            var pEnd = pData + pixelCount;
+            for (; pData < pEnd; pData++, pBytes+=4) {
                 var value = *pData;
                 var a = (value & 0xFF000000) >> 24;
                 var r = (value & 0xFF);
@@ -303,18 +680,42 @@ namespace Squared.Render.STB {
             }
         }
 
+        /// <summary>
+        /// Picks how many channels to decode an image with sourceChannels channels to so it can be
+        ///  uploaded without expanding it. There are no 3-channel formats, and 8-bit images can't
+        ///  use a 2-channel format, so those are expanded to 4.
+        /// </summary>
+        /// <param name="allowTwoChannel">If set, 2-channel (gray + alpha) 16-bit and floating point images stay
+        ///  2-channel, uploaded as Rg32 or Vector2. Otherwise they're expanded to 4.</param>
+        public static int GetNativeChannelCount (int sourceChannels, bool asFloatingPoint, bool is16Bit, bool allowTwoChannel) {
+            switch (sourceChannels) {
+                case 1:
+                    return 1;
+                case 2:
+                    return allowTwoChannel && (asFloatingPoint || is16Bit) ? 2 : 4;
+                default:
+                    return 4;
+            }
+        }
+
         public SurfaceFormat GetFormat (bool sRGB, int channelCount) {
             switch (channelCount) {
                 case 1:
                     if (IsFloatingPoint)
                         return SurfaceFormat.Single;
-                    else if (Is16Bit)
+                    else if (IsHalfFloat)
+                        return SurfaceFormat.HalfSingle;
+                    else if (Is16Bit) {
+                        if (UsesNativeChannelCount)
+                            return SurfaceFormat.UShortEXT;
                         throw new ArgumentOutOfRangeException(nameof(channelCount));
-                    else
-                        return SurfaceFormat.Alpha8;
+                    } else
+                        return UsesNativeChannelCount ? SurfaceFormat.ByteEXT : SurfaceFormat.Alpha8;
                 case 2:
                     if (IsFloatingPoint)
                         return SurfaceFormat.Vector2;
+                    else if (IsHalfFloat)
+                        return SurfaceFormat.HalfVector2;
                     else if (Is16Bit)
                         return SurfaceFormat.Rg32;
                     else
@@ -322,6 +723,8 @@ namespace Squared.Render.STB {
                 case 4:
                     if (IsFloatingPoint)
                         return SurfaceFormat.Vector4;
+                    else if (IsHalfFloat)
+                        return SurfaceFormat.HalfVector4;
                     else if (Is16Bit)
                         return SurfaceFormat.Rgba64;
                     else
@@ -362,7 +765,11 @@ namespace Squared.Render.STB {
 
             var result = CreateTextureLocked(coordinator, sRGB, name, existingInstance, width, height);
 
-            if (MipChain != null)
+            if (IsStreaming) {
+                UploadStreamed(coordinator, result, false).GetResult(out _, out var error);
+                if (error != null)
+                    ExceptionDispatchInfo.Capture(error).Throw();
+            } else if (MipChain != null)
                 UploadWithMips(coordinator, result, false);
             else
                 UploadDirect(coordinator, result, false);
@@ -381,7 +788,9 @@ namespace Squared.Render.STB {
             var tex = CreateTextureLocked(coordinator, sRGB, name, existingInstance, width, height);
 
             Future<Texture2D> result;
-            if (MipChain != null)
+            if (IsStreaming)
+                result = UploadStreamed(coordinator, tex, true);
+            else if (MipChain != null)
                 result = UploadWithMips(coordinator, tex, true);
             else
                 result = UploadDirect(coordinator, tex, true);
@@ -396,6 +805,8 @@ namespace Squared.Render.STB {
         private Future<Texture2D> UploadDirect (RenderCoordinator coordinator, Texture2D result, bool async) {
             if (IsDisposed)
                 throw new ObjectDisposedException("Image");
+            if (Data == null)
+                throw new InvalidOperationException("Image was streamed and its data has already been uploaded");
             // FIXME: async?
             // FIXME: Make sure this happens before the next issue
             UploadTimer.Restart();
@@ -405,6 +816,22 @@ namespace Squared.Render.STB {
             return new Future<Texture2D>(result);
         }
 
+        private Future<Texture2D> UploadStreamed (RenderCoordinator coordinator, Texture2D result, bool async) {
+            // The upload owns the stream from here on, and frees it once every band is uploaded
+            var upload = new StreamedUpload(
+                coordinator, result, _Stream, StreamSource, Width, Height, SizeofPixel, 
+                IsPremultiplied && (ChannelCount == 4), async ? Math.Max(StreamingBandCount, 1) : 1
+            );
+            _Stream = null;
+            StreamSource = null;
+
+            if (async)
+                upload.Start();
+            else
+                upload.DecodeBands(false);
+            return upload.Future;
+        }
+
         private unsafe void GenerateMips (bool sRGB) {
             void* pPreviousLevelData = null, pLevelData = Data;
             int levelWidth = Width, levelHeight = Height;
@@ -419,6 +846,12 @@ namespace Squared.Render.STB {
                 } else if (ChannelCount == 1) {
                     format = MipFormat.Single;
                 }
+            } else if (IsHalfFloat) {
+                if (ChannelCount == 4) {
+                    format = IsPremultiplied ? MipFormat.pHalfVector4 : MipFormat.HalfVector4;
+                } else if (ChannelCount == 1) {
+                    format = MipFormat.HalfSingle;
+                }
             } else if (!Is16Bit) {
                 if (ChannelCount == 4) {
                     format = IsPremultiplied ? MipFormat.pRGBA : MipFormat.RGBA;
@@ -432,7 +865,7 @@ namespace Squared.Render.STB {
             if (sRGB)
                 format |= MipFormat.sRGB;
 
-            var mipGenerator = STBMipGenerator.Get(format);
+            var mipGenerator = STBMipGenerator.GetBox(format) ?? STBMipGenerator.Get(format, STBMipGenerator.DefaultFilter);
             if (mipGenerator == null)
                 return;
 
@@ -552,6 +985,151 @@ namespace Squared.Render.STB {
             return f;
         }
 
+        [Flags]
+        private enum CacheFlags : int {
+            Premultiplied = 1,
+            FloatingPoint = 2,
+            Is16Bit = 4,
+            HalfFloat = 8,
+            NativeChannelCount = 16,
+        }
+
+        private int MipLevelCount {
+            get {
+                int result = 1;
+                if (MipChain != null)
+                    while ((result <= MipChain.Length) && (MipChain[result - 1] != null))
+                        result++;
+                return result;
+            }
+        }
+
+        /// <summary>
+        /// Writes the processed pixels of every level, exactly as they'll be uploaded, to output as a
+        ///  zstd-compressed cache entry that <see cref="TryLoadFromCache"/> can load without decoding anything.
+        /// </summary>
+        /// <param name="key">Identifies the source data and the options it was loaded with.</param>
+        public void WriteCache (Stream output, ulong key, int zstdLevel = 3) {
+            if (IsDisposed)
+                throw new ObjectDisposedException("Image");
+            if (Data == null)
+                throw new InvalidOperationException("Image is streamed and has no pixel data to cache");
+
+            var flags = default(CacheFlags);
+            if (IsPremultiplied)
+                flags |= CacheFlags.Premultiplied;
+            if (IsFloatingPoint)
+                flags |= CacheFlags.FloatingPoint;
+            if (Is16Bit)
+                flags |= CacheFlags.Is16Bit;
+            if (IsHalfFloat)
+                flags |= CacheFlags.HalfFloat;
+            if (UsesNativeChannelCount)
+                flags |= CacheFlags.NativeChannelCount;
+
+            var info = new Native.stbn_texcache_info {
+                key = key,
+                width = Width,
+                height = Height,
+                original_width = OriginalWidth,
+                original_height = OriginalHeight,
+                channels = ChannelCount,
+                original_channels = OriginalChannelCount,
+                bytes_per_pixel = SizeofPixel,
+                flags = (int)flags,
+                level_count = MipLevelCount,
+            };
+
+            var levels = stackalloc void*[info.level_count];
+            var pins = new GCHandle[info.level_count - 1];
+            try {
+                levels[0] = Data;
+                for (int i = 1; i < info.level_count; i++) {
+                    pins[i - 1] = GCHandle.Alloc(MipChain[i - 1], GCHandleType.Pinned);
+                    levels[i] = (void*)pins[i - 1].AddrOfPinnedObject();
+                }
+
+                var result = Native.API.stbn_texcache_write(&info, levels, zstdLevel, out long length);
+                if (result == null)
+                    throw new Exception("Failed to write image cache");
+                try {
+                    using (var source = new UnmanagedMemoryStream((byte*)result, length))
+                        source.CopyTo(output);
+                } finally {
+                    Native.API.stbi_image_free(result);
+                }
+            } finally {
+                foreach (var pin in pins)
+                    if (pin.IsAllocated)
+                        pin.Free();
+            }
+        }
+
+        /// <summary>
+        /// Loads an image written by <see cref="WriteCache"/>, decompressing every level straight into the
+        ///  buffers it will be uploaded from.
+        /// Returns null if buffer isn't a valid cache entry or was written with a different key.
+        /// </summary>
+        public static Image TryLoadFromCache (string name, byte* buffer, long length, ulong expectedKey) {
+            if (Native.API.stbn_texcache_read_info(buffer, length, out var info) == 0)
+                return null;
+            if (info.key != expectedKey)
+                return null;
+
+            var flags = (CacheFlags)info.flags;
+            var result = new Image(name) {
+                Width = info.width,
+                Height = info.height,
+                OriginalWidth = info.original_width,
+                OriginalHeight = info.original_height,
+                ChannelCount = info.channels,
+                OriginalChannelCount = info.original_channels,
+                IsPremultiplied = (flags & CacheFlags.Premultiplied) != 0,
+                IsFloatingPoint = (flags & CacheFlags.FloatingPoint) != 0,
+                Is16Bit = (flags & CacheFlags.Is16Bit) != 0,
+                IsHalfFloat = (flags & CacheFlags.HalfFloat) != 0,
+                UsesNativeChannelCount = (flags & CacheFlags.NativeChannelCount) != 0,
+                SizeofPixel = info.bytes_per_pixel,
+            };
+
+            var dests = stackalloc void*[info.level_count];
+            var pins = new GCHandle[info.level_count - 1];
+            bool ok = false;
+            try {
+                // Entries written by an older build might not describe a format we can upload
+                if (Evil.TextureUtils.GetBytesPerPixelAndComponents(result.GetFormat(false, result.ChannelCount), out _) != info.bytes_per_pixel)
+                    return null;
+
+                result.ResizedData = ResizedDataAllocator.Allocate(info.bytes_per_pixel * info.width * info.height);
+                result._Data = result.ResizedData.Data;
+                dests[0] = result._Data;
+                if (info.level_count > 1)
+                    result.MipChain = new byte[64][];
+                for (int i = 1; i < info.level_count; i++) {
+                    var levelBuf = new byte[(info.width >> i) * (info.height >> i) * info.bytes_per_pixel];
+                    result.MipChain[i - 1] = levelBuf;
+                    pins[i - 1] = GCHandle.Alloc(levelBuf, GCHandleType.Pinned);
+                    dests[i] = (void*)pins[i - 1].AddrOfPinnedObject();
+                }
+
+                ok = Native.API.stbn_texcache_decompress(buffer, length, 0, info.level_count, dests) != 0;
+                return ok ? result : null;
+            } catch (ArgumentOutOfRangeException) {
+                return null;
+            } finally {
+                foreach (var pin in pins)
+                    if (pin.IsAllocated)
+                        pin.Free();
+                if (!ok)
+                    result.Dispose();
+            }
+        }
+
+        private Image (string name) {
+            _RefCount = 1;
+            Name = name;
+        }
+
         public void AddRef () {
             if (IsDisposed)
                 throw new ObjectDisposedException("Image");
@@ -572,6 +1150,10 @@ namespace Squared.Render.STB {
                 if (_OriginalData != null)
                     Native.API.stbi_image_free(_OriginalData);
                 ResizedData?.ReleaseReference();
+                if (_Stream != null)
+                    Native.API.stbi_stream_free(_Stream);
+                _Stream = null;
+                StreamSource?.ReleaseReference();
 
                 GC.SuppressFinalize(this);
             }
@@ -582,6 +1164,200 @@ namespace Squared.Render.STB {
             _Data = null;
             if (data != null)
                 Native.API.stbi_image_free(data);
+            var stream = _Stream;
+            _Stream = null;
+            if (stream != null)
+                Native.API.stbi_stream_free(stream);
+        }
+
+        private sealed class DecodeBatch {
+            public Future<Image>[] Futures;
+            public GCHandle[] Pins;
+            public GCHandle Self;
+            public NativeAllocation Results;
+            public IReadOnlyList<string> Names;
+            public bool Premultiply, GenerateMips, sRGB, UsesNativeChannelCount;
+            public int MaxWidth, MaxHeight;
+
+            public void Release () {
+                foreach (var pin in Pins)
+                    if (pin.IsAllocated)
+                        pin.Free();
+                Results?.ReleaseReference();
+                Results = null;
+                if (Self.IsAllocated)
+                    Self.Free();
+            }
+        }
+
+        /// <summary>
+        /// Decodes a streamed image into a small ring of staging buffers on the thread group, and
+        ///  uploads each band as soon as it's decoded while the next one is being decoded.
+        /// </summary>
+        private sealed class StreamedUpload {
+            public readonly Future<Texture2D> Future = new Future<Texture2D>();
+
+            private readonly RenderCoordinator Coordinator;
+            private readonly Texture2D Texture;
+            private readonly int Width, Height, BandHeight;
+            private readonly uint Pitch;
+            private readonly bool Premultiply;
+            private readonly Stack<NativeAllocation> FreeBands;
+            private void* Stream;
+            private NativeAllocation Source;
+
+            private int NextRow, UploadsPending;
+            private bool IsDecoding, IsDecodeFinished;
+            private ExceptionDispatchInfo Error;
+
+            public StreamedUpload (
+                RenderCoordinator coordinator, Texture2D texture, void* stream, NativeAllocation source,
+                int width, int height, int sizeofPixel, bool premultiply, int bandCount
+            ) {
+                Coordinator = coordinator;
+                Texture = texture;
+                Stream = stream;
+                Source = source;
+                Width = width;
+                Height = height;
+                Pitch = (uint)(width * sizeofPixel);
+                Premultiply = premultiply;
+                BandHeight = Math.Max(1, Math.Min(height, StreamingBandBytes / (int)Pitch));
+                FreeBands = new Stack<NativeAllocation>(bandCount);
+                for (int i = 0; i < bandCount; i++)
+                    FreeBands.Push(StreamingAllocator.Allocate(BandHeight * (int)Pitch));
+            }
+
+            public void Start () {
+                lock (this)
+                    IsDecoding = true;
+                Coordinator.ThreadGroup.Enqueue(new DecodeBandsWorkItem { Upload = this });
+            }
+
+            /// <summary>
+            /// Decodes bands until we run out of free staging buffers or rows. If async is set the
+            ///  bands are queued for upload, otherwise they're uploaded before the next one is decoded.
+            /// </summary>
+            public void DecodeBands (bool async = true) {
+                var queue = async
+                    ? Coordinator.ThreadGroup.GetQueueForType<UploadBandWorkItem>(!Coordinator.GraphicsBackendIsThreadingSafe)
+                    : null;
+
+                lock (this)
+                    IsDecoding = true;
+
+                while (true) {
+                    NativeAllocation band;
+                    int y;
+                    lock (this) {
+                        if (IsDecodeFinished || (FreeBands.Count == 0)) {
+                            IsDecoding = false;
+                            // An upload may have failed and finished off the rest while we were decoding
+                            TryComplete();
+                            return;
+                        }
+                        band = FreeBands.Pop();
+                        y = NextRow;
+                    }
+
+                    var rows = Native.API.stbi_stream_read_rows(Stream, (byte*)band.Data, (int)Pitch, BandHeight);
+                    if ((rows > 0) && Premultiply)
+                        PremultiplyData((uint*)band.Data, rows * Width);
+
+                    lock (this) {
+                        if (rows <= 0) {
+                            FreeBands.Push(band);
+                            if (rows < 0)
+                                Error = Error ?? ExceptionDispatchInfo.Capture(new Exception("Failed to load image: " + GetFailureReason()));
+                            else if (NextRow < Height)
+                                Error = Error ?? ExceptionDispatchInfo.Capture(new Exception("Failed to load image: Stream ended early"));
+                            IsDecodeFinished = true;
+                            IsDecoding = false;
+                            TryComplete();
+                            return;
+                        }
+                        NextRow += rows;
+                        UploadsPending++;
+                    }
+
+                    var workItem = new UploadBandWorkItem {
+                        Upload = this,
+                        Band = band,
+                        Y = y,
+                        Rows = rows,
+                    };
+                    if (queue != null)
+                        queue.Enqueue(workItem);
+                    else
+                        workItem.Execute(Coordinator.ThreadGroup);
+                }
+            }
+
+            private void UploadBand (NativeAllocation band, int y, int rows) {
+                try {
+                    Evil.TextureUtils.SetDataFast(Texture, 0, band.Data, new Rectangle(0, y, Width, rows), Pitch);
+                } catch (Exception exc) {
+                    lock (this)
+                        Error = Error ?? ExceptionDispatchInfo.Capture(exc);
+                }
+
+                bool resume;
+                lock (this) {
+                    FreeBands.Push(band);
+                    UploadsPending--;
+                    if (Error != null)
+                        IsDecodeFinished = true;
+                    if (TryComplete())
+                        return;
+                    resume = !IsDecoding && !IsDecodeFinished;
+                    if (resume)
+                        IsDecoding = true;
+                }
+
+                if (resume)
+                    Coordinator.ThreadGroup.Enqueue(new DecodeBandsWorkItem { Upload = this });
+            }
+
+            // Must be called with the lock held
+            private bool TryComplete () {
+                if (!IsDecodeFinished || IsDecoding || (UploadsPending > 0) || (Stream == null))
+                    return false;
+
+                Native.API.stbi_stream_free(Stream);
+                Stream = null;
+                Source.ReleaseReference();
+                Source = null;
+                while (FreeBands.Count > 0)
+                    FreeBands.Pop().ReleaseReference();
+
+                if (Error != null)
+                    Future.SetResult2(null, Error);
+                else
+                    Future.SetResult(Texture, null);
+                return true;
+            }
+
+            private static string GetFailureReason () {
+                return Image.GetFailureReason(Native.API.stbi_failure_reason());
+            }
+
+            private struct DecodeBandsWorkItem : IWorkItem {
+                internal StreamedUpload Upload;
+
+                public void Execute (ThreadGroup group) {
+                    Upload.DecodeBands();
+                }
+            }
+
+            private struct UploadBandWorkItem : IMainThreadWorkItem {
+                internal StreamedUpload Upload;
+                internal NativeAllocation Band;
+                internal int Y, Rows;
+
+                public void Execute (ThreadGroup group) {
+                    Upload.UploadBand(Band, Y, Rows);
+                }
+            }
         }
 
         private unsafe struct UploadMipWorkItem : IMainThreadWorkItem {
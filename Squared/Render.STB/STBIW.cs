@@ -9,18 +9,91 @@ using Squared.Util;
 
 namespace Squared.Render.STB {
     public static class ImageWrite {
+        private static volatile int _PNGCompressionLevel = 8;
+
+        /// <summary>
+        /// The compression level used by writes that don't specify one. Each write passes its level
+        ///  to the native encoder, so changing this doesn't affect writes already in progress.
+        /// </summary>
         public static int PNGCompressionLevel {
             get {
-                return Native.API.get_stbi_write_png_compression_level();
+                return _PNGCompressionLevel;
             }
             set {
-                if (value < 0)
-                    throw new ArgumentOutOfRangeException("value");
-                else if (value > 9)
+                CheckPNGCompressionLevel(value);
+                _PNGCompressionLevel = value;
+            }
+        }
+
+        /// <summary>
+        /// The filter used by writes that don't specify one.
+        /// </summary>
+        public static volatile PNGFilter DefaultPNGFilter = PNGFilter.Adaptive;
+
+        private static volatile int _QOIZstdLevel = 0;
+
+        /// <summary>
+        /// If nonzero, QOI images are wrapped with zstd at this level (1-22). Higher levels are
+        ///  much slower to write but not to read.
+        /// </summary>
+        public static int QOIZstdLevel {
+            get {
+                return _QOIZstdLevel;
+            }
+            set {
+                if ((value < 0) || (value > 22))
                     throw new ArgumentOutOfRangeException("value");
+                _QOIZstdLevel = value;
+            }
+        }
+
+        private static void CheckPNGCompressionLevel (int level) {
+            if ((level < 0) || (level > 9))
+                throw new ArgumentOutOfRangeException("pngCompressionLevel");
+        }
+
+        internal static Native.stbn_encode_options GetEncodeOptions (
+            SurfaceFormat sourceFormat, ImageWriteFormat format, int jpegQuality,
+            int? pngCompressionLevel, PNGFilter? pngFilter,
+            out int numComponents, out int bytesPerPixel
+        ) {
+            bytesPerPixel = Evil.TextureUtils.GetBytesPerPixelAndComponents(sourceFormat, out numComponents);
 
-                Native.API.set_stbi_write_png_compression_level(value);
+            var compressionLevel = pngCompressionLevel ?? PNGCompressionLevel;
+            CheckPNGCompressionLevel(compressionLevel);
+            var filter = pngFilter ?? DefaultPNGFilter;
+            if ((filter < PNGFilter.Adaptive) || (filter > PNGFilter.Paeth))
+                throw new ArgumentOutOfRangeException("pngFilter");
+
+            switch (format) {
+                case ImageWriteFormat.HDR:
+                    if ((bytesPerPixel / numComponents) != 4)
+                        throw new NotImplementedException("Non-fp32");
+                    break;
+                case ImageWriteFormat.PNG:
+                case ImageWriteFormat.BMP:
+                case ImageWriteFormat.TGA:
+                case ImageWriteFormat.JPEG:
+                    if ((bytesPerPixel / numComponents) != 1)
+                        throw new NotImplementedException("Non-8bpp");
+                    break;
+                case ImageWriteFormat.QOI:
+                    if ((bytesPerPixel / numComponents) != 1)
+                        throw new NotImplementedException("Non-8bpp");
+                    else if (numComponents < 3)
+                        throw new NotImplementedException("QOI requires RGB or RGBA");
+                    break;
+                default:
+                    throw new ArgumentOutOfRangeException("format");
             }
+
+            return new Native.stbn_encode_options {
+                format = format,
+                jpeg_quality = jpegQuality,
+                png_compression_level = compressionLevel,
+                png_filter = filter,
+                qoi_zstd_level = QOIZstdLevel
+            };
         }
 
         public static byte[] GetTextureData (Texture2D tex) {
@@ -38,88 +111,94 @@ namespace Squared.Render.STB {
 
         public static void WriteImage (
             Texture2D tex, string filename, 
-            ImageWriteFormat format = ImageWriteFormat.PNG, int jpegQuality = 75
+            ImageWriteFormat format = ImageWriteFormat.PNG, int jpegQuality = 75,
+            int? pngCompressionLevel = null, PNGFilter? pngFilter = null
         ) {
             using (var stream = File.Create(filename))
-                WriteImage(tex, stream, format);
+                WriteImage(tex, stream, format, jpegQuality, pngCompressionLevel, pngFilter);
         }
 
         public static void WriteImage (
             Texture2D tex, Stream stream, 
-            ImageWriteFormat format = ImageWriteFormat.PNG, int jpegQuality = 75
+            ImageWriteFormat format = ImageWriteFormat.PNG, int jpegQuality = 75,
+            int? pngCompressionLevel = null, PNGFilter? pngFilter = null
         ) {
             var buffer = GetTextureData(tex);
-            WriteImage(buffer, tex.Width, tex.Height, tex.Format, stream, format);
+            WriteImage(buffer, tex.Width, tex.Height, tex.Format, stream, format, jpegQuality, pngCompressionLevel, pngFilter);
         }
 
         public static unsafe void WriteImage (
             byte[] buffer, int width, int height, 
             SurfaceFormat sourceFormat, Stream stream, 
-            ImageWriteFormat format = ImageWriteFormat.PNG, int jpegQuality = 75
+            ImageWriteFormat format = ImageWriteFormat.PNG, int jpegQuality = 75,
+            int? pngCompressionLevel = null, PNGFilter? pngFilter = null
         ) {
             fixed (byte* pBuffer = buffer)
-                WriteImage(pBuffer, buffer.Length, width, height, sourceFormat, stream, format, jpegQuality);
+                WriteImage(pBuffer, buffer.Length, width, height, sourceFormat, stream, format, jpegQuality, pngCompressionLevel, pngFilter);
         }
 
         public static unsafe void WriteImage (
             byte * data, int dataLength, int width, int height, 
             SurfaceFormat sourceFormat, Stream stream, 
-            ImageWriteFormat format = ImageWriteFormat.PNG, int jpegQuality = 75
+            ImageWriteFormat format = ImageWriteFormat.PNG, int jpegQuality = 75,
+            int? pngCompressionLevel = null, PNGFilter? pngFilter = null
         ) {
-            int numComponents;
-            var bytesPerPixel = Evil.TextureUtils.GetBytesPerPixelAndComponents(sourceFormat, out numComponents);
+            int numComponents, bytesPerPixel;
+            var options = GetEncodeOptions(
+                sourceFormat, format, jpegQuality, pngCompressionLevel, pngFilter,
+                out numComponents, out bytesPerPixel
+            );
 
             if (dataLength < (bytesPerPixel * width * height))
                 throw new ArgumentException("buffer");
 
-            const int bufferSize = 1024 * 64;
-
-            using (var scratch = BufferPool<byte>.Allocate(bufferSize))
-            fixed (byte * _pScratch = scratch.Data) {
-                Native.WriteCallback callback = (pScratch, pData, count) => {
-                    int offset = 0;
-                    while (count > 0) {
-                        var copySize = Math.Min(count, scratch.Data.Length);
-                        Buffer.MemoryCopy(pData + offset, pScratch, copySize, copySize);
-                        stream.Write(scratch.Data, 0, copySize);
-                        count -= copySize;
-                        offset += copySize;
-                    }
-                };
-
-                switch (format) {
-                    case ImageWriteFormat.HDR:
-                        if ((bytesPerPixel / numComponents) != 4)
-                            throw new NotImplementedException("Non-fp32");
-                        Native.API.stbi_write_hdr_to_func(callback, _pScratch, width, height, numComponents, (float*)(void*)data);
-                        break;
-                    case ImageWriteFormat.PNG:
-                        if ((bytesPerPixel / numComponents) != 1)
-                            throw new NotImplementedException("Non-8bpp");
-                        Native.API.stbi_write_png_to_func(callback, _pScratch, width, height, numComponents, data, width * bytesPerPixel);
-                        break;
-                    case ImageWriteFormat.BMP:
-                        if ((bytesPerPixel / numComponents) != 1)
-                            throw new NotImplementedException("Non-8bpp");
-                        Native.API.stbi_write_bmp_to_func(callback, _pScratch, width, height, numComponents, data);
-                        break;
-                    case ImageWriteFormat.TGA:
-                        if ((bytesPerPixel / numComponents) != 1)
-                            throw new NotImplementedException("Non-8bpp");
-                        Native.API.stbi_write_tga_to_func(callback, _pScratch, width, height, numComponents, data);
-                        break;
-                    case ImageWriteFormat.JPEG:
-                        if ((bytesPerPixel / numComponents) != 1)
-                            throw new NotImplementedException("Non-8bpp");
-                        Native.API.stbi_write_jpg_to_func(callback, _pScratch, width, height, numComponents, data, jpegQuality);
-                        break;
-                    default:
-                        throw new ArgumentOutOfRangeException("format");
-                }
+            // The whole image is encoded in native memory and then written out in one go,
+            //  either straight into the file or copied into the stream.
+            var fs = stream as FileStream;
+            if ((fs != null) && fs.CanSeek && fs.CanWrite && !fs.IsAsync) {
+                fs.Flush();
+                var offset = fs.Position;
+                var written = Native.API.stbn_encode_image_to_file(
+                    &options, data, width, height, numComponents, 0, 
+                    fs.SafeFileHandle.DangerousGetHandle(), offset
+                );
+                if (written < 0)
+                    throw new IOException("Failed to write image");
+                // Positioned writes leave the OS file pointer somewhere platform-specific, and the FileStream
+                //  doesn't know it moved, so put both where the image ends
+                fs.Position = offset + written;
+                return;
+            }
+
+            int length;
+            var encoded = Native.API.stbn_encode_image(&options, data, width, height, numComponents, 0, out length);
+            if (encoded == null)
+                throw new Exception("Failed to encode image");
+
+            try {
+                using (var source = new UnmanagedMemoryStream((byte*)encoded, length))
+                    source.CopyTo(stream);
+            } finally {
+                Native.API.stbi_image_free(encoded);
             }
         }
     }
 
+    /// <summary>
+    /// The PNG filter applied to each row before compression.
+    /// </summary>
+    public enum PNGFilter : int {
+        /// <summary>
+        /// Picks the filter for each row that leaves the smallest residuals (slower, usually smaller)
+        /// </summary>
+        Adaptive = -1,
+        None = 0,
+        Sub = 1,
+        Up = 2,
+        Average = 3,
+        Paeth = 4
+    }
+
     public enum ImageWriteFormat {
         PNG = 0,
         BMP,
@@ -128,6 +207,11 @@ namespace Squared.Render.STB {
         /// <summary>
         /// Linear floating-point RGBA (Vector4)
         /// </summary>
-        HDR
+        HDR,
+        /// <summary>
+        /// Lossless and much faster than PNG, but larger unless wrapped with zstd (see QOIZstdLevel).
+        /// Can be loaded back through Image like any other format.
+        /// </summary>
+        QOI
     }
 }
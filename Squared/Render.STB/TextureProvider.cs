@@ -30,17 +30,42 @@ namespace Squared.Render {
         public bool FloatingPoint;
         // If the source image is more than 8 bpp, enable loading it as 16bpp
         public bool Enable16Bit;
+        /// <summary>
+        /// If the source image is more than 8 bpp, decode it straight to half floats (HalfVector4 etc).
+        /// Takes priority over <see cref="Enable16Bit"/>, and handles <see cref="sRGBToLinear"/> during decode.
+        /// </summary>
+        public bool HalfFloat;
         // If the source image is grayscale, enable loading it as grayscale
         public bool EnableGrayscale;
+        /// <summary>
+        /// Decodes images with as few channels as they can be uploaded with instead of expanding them to RGBA,
+        ///  so grayscale images become R8 (or R16/R32F) textures. Replaces <see cref="EnableGrayscale"/>.
+        /// </summary>
+        public bool NativeChannelCount;
+        /// <summary>
+        /// With <see cref="NativeChannelCount"/>, keeps 16-bit and floating point gray + alpha images as
+        ///  2-channel textures. Ignored when premultiplying or generating mips.
+        /// </summary>
+        public bool EnableTwoChannel;
         public bool GenerateMips;
         public bool GenerateDistanceField;
         /// <summary>
+        /// How the distance field is generated when <see cref="GenerateDistanceField"/> is set.
+        /// </summary>
+        public DistanceFieldAlgorithm DistanceFieldAlgorithm;
+        /// <summary>
         /// Pads the bottom and right edges of the image so its width and height are a power of two.
         /// The original width/height are stored in <see cref="Result"/>.
         /// </summary>
         public bool PadToPowerOfTwo;
         /// <summary>
-        /// Performs color-space conversion
+        /// Allows suitable images to be decoded a band of rows at a time while they're uploaded,
+        ///  instead of being decoded in full first. Ignored when other options need the pixel data.
+        /// </summary>
+        public bool AllowStreaming = true;
+        /// <summary>
+        /// Performs color-space conversion of the color channels (alpha is left alone) during decode,
+        ///  before premultiplication, resizing and mip generation. Not supported for 16-bit images.
         /// </summary>
         public bool sRGBToLinear, sRGBFromLinear;
         /// <summary>
@@ -95,6 +120,22 @@ namespace Squared.Render {
         private EventHandler<EventArgs> OnTextureWithDistanceFieldDisposed;
         private OnFutureResolvedWithData _DisposeHandler, _GenerateDistanceFieldThenDispose;
 
+        // Bump whenever a change to decoding or processing makes existing cache entries wrong
+        private const int CacheVersion = 1;
+
+        /// <summary>
+        /// If set, the processed pixels of every texture loaded (after premultiplication, resizing, mip
+        ///  generation etc.) are cached in this directory, and later loads of the same data with the same
+        ///  options skip decoding entirely. Each set of options gets its own entry (named after a hash of
+        ///  them), and entries are keyed on a hash of the source data, so stale ones are simply rewritten.
+        /// Loads that miss the cache can't be streamed, since the whole image is needed to write the entry.
+        /// </summary>
+        public string CacheDirectory;
+        /// <summary>
+        /// The zstd level cache entries are compressed at.
+        /// </summary>
+        public int CacheCompressionLevel = 3;
+
         new public TextureLoadOptions DefaultOptions {
             get {
                 return (TextureLoadOptions)base.DefaultOptions;
@@ -134,32 +175,120 @@ namespace Squared.Render {
             return base.LoadSync(name, options, cached, optional);
         }
 
-        private unsafe static void ApplyColorSpaceConversion (STB.Image img, TextureLoadOptions options) {
-            if (img.IsFloatingPoint || img.Is16Bit)
-                throw new NotImplementedException();
-            var pData = (byte*)img.Data;
-            var pEnd = pData + img.DataLength;
-            var table = options.sRGBFromLinear ? ColorSpace.LinearByteTosRGBByteTable : ColorSpace.sRGBByteToLinearByteTable;
-            for (; pData < pEnd; pData++)
-                *pData = table[*pData];
-        }
+        public static STB.Image DefaultPreload (string name, Stream stream, TextureLoadOptions options) =>
+            DefaultPreload(name, stream, options, options.AllowStreaming);
 
-        public static STB.Image DefaultPreload (string name, Stream stream, TextureLoadOptions options) {
+        private static STB.Image DefaultPreload (string name, Stream stream, TextureLoadOptions options, bool allowStreaming) {
+            allowStreaming = allowStreaming && !options.GenerateDistanceField &&
+                !options.sRGBFromLinear && !options.sRGBToLinear;
             var image = new STB.Image(
                 stream, false, options.Premultiply ?? true, options.FloatingPoint, 
                 options.Enable16Bit, options.GenerateMips, options.sRGBFromLinear || options.sRGB,
-                options.EnableGrayscale, options.MaxWidth, options.MaxHeight
+                options.EnableGrayscale, options.MaxWidth, options.MaxHeight, allowStreaming,
+                options.NativeChannelCount, options.EnableTwoChannel,
+                options.HalfFloat, options.sRGBToLinear, options.sRGBFromLinear
             );
-            if (options.sRGBFromLinear || options.sRGBToLinear)
-                ApplyColorSpaceConversion(image, options);
             return image;
         }
 
         protected override object PreloadInstance (string name, Stream stream, object data) {
             var options = (TextureLoadOptions)data ?? DefaultOptions ?? new TextureLoadOptions();
+            if (CacheDirectory != null)
+                return CachedPreload(name, stream, options);
             return DefaultPreload(name, stream, options);
         }
 
+        protected unsafe STB.Image CachedPreload (string name, Stream stream, TextureLoadOptions options) {
+            var length = (int)(stream.Length - stream.Position);
+            var source = new byte[length];
+            for (int offset = 0, read; offset < length; offset += read) {
+                read = stream.Read(source, offset, length - offset);
+                if (read <= 0)
+                    throw new EndOfStreamException();
+            }
+
+            ulong seed = GetCacheSeed(options), key;
+            fixed (byte* pSource = source)
+                key = STB.Native.API.stbn_xxh64(pSource, length, seed);
+
+            var path = GetCachePath(name, seed);
+            var result = TryLoadCacheEntry(name, path, key);
+            if (result != null)
+                return result;
+
+            result = DefaultPreload(name, new MemoryStream(source, 0, length, false, true), options, false);
+            WriteCacheEntry(result, path, key);
+            return result;
+        }
+
+        private static unsafe ulong GetCacheSeed (TextureLoadOptions options) {
+            const int count = 15;
+            var values = stackalloc int[count];
+            values[0] = CacheVersion;
+            values[1] = (options.Premultiply ?? true) ? 1 : 0;
+            values[2] = options.FloatingPoint ? 1 : 0;
+            values[3] = options.Enable16Bit ? 1 : 0;
+            values[4] = options.HalfFloat ? 1 : 0;
+            values[5] = options.EnableGrayscale ? 1 : 0;
+            values[6] = options.NativeChannelCount ? 1 : 0;
+            values[7] = options.EnableTwoChannel ? 1 : 0;
+            values[8] = options.GenerateMips ? 1 : 0;
+            // Mips are generated in sRGB space for sRGB textures
+            values[9] = (options.sRGB || options.sRGBFromLinear) ? 1 : 0;
+            values[10] = (options.sRGBToLinear ? 1 : 0) | (options.sRGBFromLinear ? 2 : 0);
+            values[11] = options.MaxWidth;
+            values[12] = options.MaxHeight;
+            // Mips made by an older or different generator don't match what we'd generate now
+            values[13] = options.GenerateMips ? STBMipGenerator.Revision : 0;
+            values[14] = options.GenerateMips ? (int)STBMipGenerator.DefaultFilter : 0;
+            return STB.Native.API.stbn_xxh64(values, count * sizeof(int), 0);
+        }
+
+        private string GetCachePath (string name, ulong seed) {
+            var fileName = new StringBuilder(name);
+            foreach (var ch in Path.GetInvalidFileNameChars())
+                fileName.Replace(ch, '_');
+            // Loading the same asset with different options mustn't overwrite the other entry
+            fileName.Append('.').Append(seed.ToString("x16")).Append(".stbtex");
+            return Path.Combine(CacheDirectory, fileName.ToString());
+        }
+
+        private static unsafe STB.Image TryLoadCacheEntry (string name, string path, ulong key) {
+            byte[] entry;
+            try {
+                if (!File.Exists(path))
+                    return null;
+                entry = File.ReadAllBytes(path);
+            } catch (IOException) {
+                return null;
+            } catch (UnauthorizedAccessException) {
+                return null;
+            }
+
+            fixed (byte* pEntry = entry)
+                return STB.Image.TryLoadFromCache(name, pEntry, entry.Length, key);
+        }
+
+        private void WriteCacheEntry (STB.Image image, string path, ulong key) {
+            // Written to a temporary file first so a crash or a concurrent load never sees half an entry
+            var tempPath = path + "." + Path.GetRandomFileName();
+            try {
+                Directory.CreateDirectory(CacheDirectory);
+                using (var output = File.Create(tempPath))
+                    image.WriteCache(output, key, CacheCompressionLevel);
+                if (File.Exists(path))
+                    File.Delete(path);
+                File.Move(tempPath, path);
+            } catch (Exception exc) {
+                // The image already loaded fine, so failing to cache it must never fail the load
+                System.Diagnostics.Debug.WriteLine($"Failed to write texture cache entry '{path}': {exc.Message}");
+                try {
+                    File.Delete(tempPath);
+                } catch {
+                }
+            }
+        }
+
         protected unsafe override Future<Texture2D> CreateInstance (string name, Stream stream, object data, object preloadedData, bool async) {
             var img = (STB.Image)preloadedData;
             // Returning null from preload means you want the load to fail
@@ -204,7 +333,8 @@ namespace Squared.Render {
             var oRhs = rhs.Data as TextureLoadOptions;
             var result = (oLhs?.GenerateMips == oRhs?.GenerateMips) && (oLhs?.GenerateDistanceField == oRhs?.GenerateDistanceField) &&
                 (oLhs?.Premultiply == oRhs?.Premultiply) && (oLhs?.PadToPowerOfTwo == oRhs?.PadToPowerOfTwo) &&
-                (oLhs?.FloatingPoint == oRhs?.FloatingPoint);
+                (oLhs?.FloatingPoint == oRhs?.FloatingPoint) && (oLhs?.NativeChannelCount == oRhs?.NativeChannelCount) &&
+                (oLhs?.HalfFloat == oRhs?.HalfFloat) && (oLhs?.DistanceFieldAlgorithm == oRhs?.DistanceFieldAlgorithm);
             if (!result)
                 OnCacheMiss(lhs, rhs);
             return result;
@@ -214,28 +344,29 @@ namespace Squared.Render {
             var closure = (GDFTFClosure)resource;
             var img = closure.Image;
             var options = closure.Options;
-            // FIXME: Optimize this
             float[] buf;
             var config = new JumpFloodConfig {
                 Width = img.Width,
                 Height = img.Height,
-                ThreadGroup = Coordinator.ThreadGroup
+                ThreadGroup = Coordinator.ThreadGroup,
+                Algorithm = options.DistanceFieldAlgorithm
             };
             var format = img.GetFormat(options.sRGB | options.sRGBFromLinear, img.ChannelCount);
             switch (format) {
                 case SurfaceFormat.Alpha8:
-                    buf = JumpFlood.GenerateDistanceField((byte*)img.Data, config);
+                case SurfaceFormat.ByteEXT:
+                    buf = STBJumpFlood.GenerateDistanceField((byte*)img.Data, config);
                     break;
                 case SurfaceFormat.Color:
                 case SurfaceFormat.ColorBgraEXT:
                 case SurfaceFormat.ColorSrgbEXT:
-                    buf = JumpFlood.GenerateDistanceField((Color*)img.Data, config);
+                    buf = STBJumpFlood.GenerateDistanceField((Color*)img.Data, config);
                     break;
                 case SurfaceFormat.Single:
-                    buf = JumpFlood.GenerateDistanceField((float*)img.Data, config);
+                    buf = STBJumpFlood.GenerateDistanceField((float*)img.Data, config);
                     break;
                 case SurfaceFormat.Vector4:
-                    buf = JumpFlood.GenerateDistanceField((Vector4*)img.Data, config);
+                    buf = STBJumpFlood.GenerateDistanceField((Vector4*)img.Data, config);
                     break;
                 default:
                     throw new Exception($"Pixel format {format} not supported by distance field generator");
@@ -9,6 +9,7 @@ using System.Threading.Tasks;
 using Microsoft.Xna.Framework;
 using Microsoft.Xna.Framework.Graphics;
 using Squared.Game;
+using Squared.Render.Atlases;
 using Squared.Render.Mips;
 using Squared.Threading;
 using Squared.Util;
@@ -117,7 +118,7 @@ namespace Squared.Render {
         public int Spacing { get; private set; }
         public T? ClearValue;
 
-        private int X, Y, RowHeight;
+        private IRectanglePacker Packer;
         private object Lock = new object();
         private Action _BeforeIssue;
         private Action<Frame> _BeforePrepare;
@@ -140,8 +141,9 @@ namespace Squared.Render {
             int temp;
             BytesPerPixel = Evil.TextureUtils.GetBytesPerPixelAndComponents(Format, out temp);
             Spacing = spacing;
-            X = Y = Spacing;
-            RowHeight = 0;
+            // Every reservation is padded by the spacing on its right and bottom edges, and the
+            //  packer's space starts at (spacing, spacing), so there's a gap around every one
+            Packer = RectanglePacker.Create(width - spacing, height - spacing);
             _BeforeIssue = Flush;
             _BeforePrepare = QueueGenerateMips;
             Tag = tag;
@@ -420,27 +422,12 @@ namespace Squared.Render {
 
         public bool TryReserve (int width, int height, out DynamicAtlasReservation result) {
             lock (Lock) {
-                bool needWrap = (X + width) >= (Width - 1);
-
-                if (
-                    ((Y + height) >= Height) ||
-                    (
-                        needWrap && ((Y + RowHeight + height) >= Height)
-                    )
-                ) {
+                if (!Packer.TryInsert(width + Spacing, height + Spacing, out int x, out int y)) {
                     result = default(DynamicAtlasReservation);
                     return false;
                 }
 
-                if (needWrap) {
-                    Y += (RowHeight + Spacing);
-                    X = Spacing;
-                    RowHeight = 0;
-                }
-
-                result = new DynamicAtlasReservation(this, X, Y, width, height);
-                X += width + Spacing;
-                RowHeight = Math.Max(RowHeight, height);
+                result = new DynamicAtlasReservation(this, x + Spacing, y + Spacing, width, height);
             }
 
             AutoClear();
@@ -448,6 +435,42 @@ namespace Squared.Render {
             return true;
         }
 
+        /// <summary>
+        /// Reserves space for a whole set of rectangles at once, which packs them much more tightly than
+        ///  reserving them one at a time in whatever order they arrive (when rebuilding an atlas, for example).
+        /// </summary>
+        /// <param name="results">Receives the reservation for each size, or default if it didn't fit.</param>
+        /// <returns>The number of sizes that fit.</returns>
+        public int TryReserveBatch (
+            Point[] sizes, DynamicAtlasReservation[] results,
+            RectanglePackerSort sort = RectanglePackerSort.Height
+        ) {
+            if (sizes == null)
+                throw new ArgumentNullException(nameof(sizes));
+            if (results == null)
+                throw new ArgumentNullException(nameof(results));
+            if (results.Length < sizes.Length)
+                throw new ArgumentOutOfRangeException(nameof(results));
+
+            var rects = new PackedRectangle[sizes.Length];
+            for (int i = 0; i < sizes.Length; i++)
+                rects[i] = new PackedRectangle(sizes[i].X + Spacing, sizes[i].Y + Spacing);
+
+            int count;
+            lock (Lock)
+                count = Packer.InsertBatch(rects, 0, rects.Length, sort);
+
+            for (int i = 0; i < sizes.Length; i++)
+                results[i] = rects[i].IsPacked
+                    ? new DynamicAtlasReservation(this, rects[i].X + Spacing, rects[i].Y + Spacing, sizes[i].X, sizes[i].Y)
+                    : default(DynamicAtlasReservation);
+
+            if (count > 0)
+                AutoClear();
+
+            return count;
+        }
+
         private void AutoClear () {
             lock (Lock) {
                 if (!_NeedClear)
@@ -472,8 +495,7 @@ namespace Squared.Render {
             lock (Lock) {
                 if (!_NeedClear)
                     _NeedClear = eraseOldPixels;
-                X = Y = Spacing;
-                RowHeight = 0;
+                Packer.Clear();
             }
 
             Invalidate();
@@ -490,6 +512,7 @@ namespace Squared.Render {
                 IsDisposed = true;
 
                 Coordinator.DisposeResource(Texture);
+                Packer.Dispose();
                 MipBuffer?.ReleaseReference();
                 PixelBuffer?.ReleaseReference();
                 Texture = null;
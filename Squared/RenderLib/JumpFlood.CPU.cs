@@ -15,6 +15,18 @@ using Squared.Threading;
 using Squared.Util;
 
 namespace Squared.Render.DistanceField {
+    public enum DistanceFieldAlgorithm {
+        /// <summary>
+        /// Jump flooding. A small fraction of pixels end up slightly too far from the edge.
+        /// </summary>
+        JumpFlood = 0,
+        /// <summary>
+        /// An exact Euclidean distance transform (Felzenszwalb-Huttenlocher). Only available through
+        ///  the native generator (Squared.Render.STB's STBJumpFlood).
+        /// </summary>
+        Exact = 1,
+    }
+
     public struct JumpFloodConfig {
         // TODO: Select a better value - maybe a non-power-of-two one to minimize false cache sharing?
         // Basic testing in single and multi threaded scenarios shows little difference though
@@ -22,6 +34,7 @@ namespace Squared.Render.DistanceField {
 
         public Rectangle? Region;
         public ThreadGroup ThreadGroup;
+        public DistanceFieldAlgorithm Algorithm;
         public int Width, Height;
         private int ChunkSizeOffset;
         public int ChunkSize {
@@ -40,6 +53,11 @@ namespace Squared.Render.DistanceField {
     public static partial class JumpFlood {
         const float MaxDistance = 2048;
 
+        private static void CheckAlgorithm (JumpFloodConfig config) {
+            if (config.Algorithm != DistanceFieldAlgorithm.JumpFlood)
+                throw new NotSupportedException($"The managed distance field generator does not support {config.Algorithm}");
+        }
+
         private static int GetStepCount (int width, int height) {
             int l2x = BitOperations.Log2Ceiling((uint)width),
                 l2y = BitOperations.Log2Ceiling((uint)height),
@@ -249,6 +267,7 @@ namespace Squared.Render.DistanceField {
         /// <param name="input">A grayscale image to act as the source for alpha</param>
         /// <returns>A signed distance field</returns>
         public static unsafe float[] GenerateDistanceField (byte* input, JumpFloodConfig config) {
+            CheckAlgorithm(config);
             var buf1 = new Vector4[config.Width * config.Height];
             Initialize(input, buf1, config);
             return GenerateEpilogue(buf1, config);
@@ -260,6 +279,7 @@ namespace Squared.Render.DistanceField {
         /// <param name="input">An RGBA image to act as the source for alpha</param>
         /// <returns>A signed distance field</returns>
         public static unsafe float[] GenerateDistanceField (Color* input, JumpFloodConfig config) {
+            CheckAlgorithm(config);
             var buf1 = new Vector4[config.Width * config.Height];
             Initialize(input, buf1, config);
             return GenerateEpilogue(buf1, config);
@@ -271,6 +291,7 @@ namespace Squared.Render.DistanceField {
         /// <param name="input">A grayscale image to act as the source for alpha</param>
         /// <returns>A signed distance field</returns>
         public static unsafe float[] GenerateDistanceField (float* input, JumpFloodConfig config) {
+            CheckAlgorithm(config);
             var buf1 = new Vector4[config.Width * config.Height];
             Initialize(input, buf1, config);
             return GenerateEpilogue(buf1, config);
@@ -282,6 +303,7 @@ namespace Squared.Render.DistanceField {
         /// <param name="input">An RGBA image to act as the source for alpha</param>
         /// <returns>A signed distance field</returns>
         public static unsafe float[] GenerateDistanceField (Vector4* input, JumpFloodConfig config) {
+            CheckAlgorithm(config);
             var buf1 = new Vector4[config.Width * config.Height];
             Initialize(input, buf1, config);
             return GenerateEpilogue(buf1, config);
@@ -4,6 +4,7 @@ using System.Linq;
 using System.Runtime.CompilerServices;
 using System.Text;
 using System.Threading.Tasks;
+using Microsoft.Xna.Framework.Graphics.PackedVector;
 
 namespace Squared.Render.Mips {
     public unsafe delegate void MipGeneratorFn (
@@ -38,6 +39,12 @@ namespace Squared.Render.Mips {
         HalfVector4 = 11,
         // 8 byte premultiplied RGBA where each channel is a half float
         pHalfVector4 = 12,
+        // 16-bit grayscale float using Minimum instead of Average value
+        HalfSingleMin = 13,
+        // 16-bit grayscale float combining Minimum and Average values
+        HalfSinglePseudoMin = 14,
+        // 16-bit grayscale float using Maximum instead of Average value
+        HalfSingleMax = 15,
 
         // If set, the RGB channels are sRGB. Not valid for Gray1.
         sRGB = 0x100,
@@ -210,7 +217,7 @@ namespace Squared.Render.Mips {
         private static readonly MipGeneratorFn[] Cache;
 
         static MipGenerator () {
-            Cache = new MipGeneratorFn[1 + (int)(MipFormat.sRGB | MipFormat.SingleMax)];
+            Cache = new MipGeneratorFn[1 + (int)(MipFormat.sRGB | MipFormat.HalfSingleMax)];
             for (int i = 0; i < Cache.Length; i++)
                 Cache[i] = _Get((MipFormat)i);
         }
@@ -242,7 +249,15 @@ namespace Squared.Render.Mips {
                     return _SinglePseudoMin;
                 case MipFormat.SingleMax:
                     return _SingleMax;
-                // FIXME: Add the new half float formats
+                case MipFormat.HalfSingle:
+                    return _HalfSingle;
+                case MipFormat.HalfSingleMin:
+                    return _HalfSingleMin;
+                case MipFormat.HalfSinglePseudoMin:
+                    return _HalfSinglePseudoMin;
+                case MipFormat.HalfSingleMax:
+                    return _HalfSingleMax;
+                // STBMipGenerator.InstallGlobally provides the half float vector formats
                 default:
                     return null;
             }
@@ -489,6 +504,70 @@ namespace Squared.Render.Mips {
             }
         }
 
+        private static unsafe void _HalfSingle (
+            void* src, int srcWidth, int srcHeight, int srcStrideBytes, void* dest, int destWidth, int destHeight, int destStrideBytes
+        ) => _HalfSingleImpl(MipFormat.HalfSingle, src, srcWidth, srcHeight, srcStrideBytes, dest, destWidth, destHeight, destStrideBytes);
+
+        private static unsafe void _HalfSingleMin (
+            void* src, int srcWidth, int srcHeight, int srcStrideBytes, void* dest, int destWidth, int destHeight, int destStrideBytes
+        ) => _HalfSingleImpl(MipFormat.HalfSingleMin, src, srcWidth, srcHeight, srcStrideBytes, dest, destWidth, destHeight, destStrideBytes);
+
+        private static unsafe void _HalfSinglePseudoMin (
+            void* src, int srcWidth, int srcHeight, int srcStrideBytes, void* dest, int destWidth, int destHeight, int destStrideBytes
+        ) => _HalfSingleImpl(MipFormat.HalfSinglePseudoMin, src, srcWidth, srcHeight, srcStrideBytes, dest, destWidth, destHeight, destStrideBytes);
+
+        private static unsafe void _HalfSingleMax (
+            void* src, int srcWidth, int srcHeight, int srcStrideBytes, void* dest, int destWidth, int destHeight, int destStrideBytes
+        ) => _HalfSingleImpl(MipFormat.HalfSingleMax, src, srcWidth, srcHeight, srcStrideBytes, dest, destWidth, destHeight, destStrideBytes);
+
+        [MethodImpl(MethodImplOptions.AggressiveInlining)]
+        private static float HalfToSingle (ushort value) =>
+            new HalfSingle { PackedValue = value }.ToSingle();
+
+        // Same math as the Single formats, done in float and rounded back to half once per texel
+        private static unsafe void _HalfSingleImpl (
+            MipFormat format,
+            void* src, int srcWidth, int srcHeight, int srcStrideBytes, void* dest, int destWidth, int destHeight, int destStrideBytes
+        ) {
+            if ((destWidth < srcWidth / 2) || (destHeight < srcHeight / 2))
+                throw new ArgumentOutOfRangeException();
+
+            byte* pSrc = (byte*)src, pDest = (byte*)dest;
+            
+            unchecked {
+                for (var y = 0; y < destHeight; y++) {
+                    ushort* srcRow = (ushort*)(pSrc + ((y * 2) * srcStrideBytes)),
+                        srcRowNext = (ushort*)((byte*)srcRow + srcStrideBytes),
+                        destRow = (ushort*)(pDest + (y * destStrideBytes));
+
+                    for (var x = 0; x < destWidth; x++) {
+                        var a = srcRow + (x * 2);
+                        var c = srcRowNext + (x * 2);
+                        float a0 = HalfToSingle(a[0]), a1 = HalfToSingle(a[1]),
+                            c0 = HalfToSingle(c[0]), c1 = HalfToSingle(c[1]);
+
+                        float gray;
+                        switch (format) {
+                            case MipFormat.HalfSingleMin:
+                                gray = Math.Min(Math.Min(a0, a1), Math.Min(c0, c1));
+                                break;
+                            case MipFormat.HalfSinglePseudoMin:
+                                gray = (Math.Min(Math.Min(a0, a1), Math.Min(c0, c1)) + Average(a0, a1, c0, c1)) / 2f;
+                                break;
+                            case MipFormat.HalfSingleMax:
+                                gray = Math.Max(Math.Max(a0, a1), Math.Max(c0, c1));
+                                break;
+                            default:
+                                gray = Average(a0, a1, c0, c1);
+                                break;
+                        }
+
+                        destRow[x] = new HalfSingle(gray).PackedValue;
+                    }
+                }
+            }
+        }
+
         private static unsafe void _PAGray (
             void* src, int srcWidth, int srcHeight, int srcStrideBytes, void* dest, int destWidth, int destHeight, int destStrideBytes
         ) {
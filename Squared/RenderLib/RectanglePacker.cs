@@ -0,0 +1,218 @@
+﻿using System;
+using System.Runtime.InteropServices;
+
+namespace Squared.Render.Atlases {
+    /// <summary>
+    /// The order a batch of rectangles is packed in. Packing larger rectangles first fills space
+    ///  much more tightly than packing them in whatever order they arrive.
+    /// </summary>
+    public enum RectanglePackerSort : int {
+        None = 0,
+        /// <summary>
+        /// Tallest first, then widest. Usually the best choice for glyphs and other rectangles of
+        ///  similar sizes.
+        /// </summary>
+        Height = 1,
+        /// <summary>
+        /// Widest first, then tallest.
+        /// </summary>
+        Width = 2,
+        /// <summary>
+        /// Largest first, then longest side.
+        /// </summary>
+        Area = 3,
+        /// <summary>
+        /// Longest side first, then shortest side.
+        /// </summary>
+        MaxSide = 4,
+        /// <summary>
+        /// Largest perimeter first, then longest side.
+        /// </summary>
+        Perimeter = 5,
+    }
+
+    [StructLayout(LayoutKind.Sequential)]
+    public struct PackedRectangle {
+        public int Width, Height;
+        /// <summary>
+        /// Set by the packer, or -1 if the rectangle didn't fit.
+        /// </summary>
+        public int X, Y;
+
+        public PackedRectangle (int width, int height) {
+            Width = width;
+            Height = height;
+            X = Y = -1;
+        }
+
+        public bool IsPacked => X >= 0;
+    }
+
+    public interface IRectanglePacker : IDisposable {
+        int Width { get; }
+        int Height { get; }
+        /// <summary>
+        /// Finds room for a single rectangle, in whatever space is left.
+        /// </summary>
+        /// <returns>false if there was no room.</returns>
+        bool TryInsert (int width, int height, out int x, out int y);
+        /// <summary>
+        /// Finds room for every rectangle in the range, packing them in the order chosen by sort without
+        ///  moving them around in the array. Rectangles that don't fit don't stop the rest from being packed.
+        /// </summary>
+        /// <returns>The number of rectangles that fit.</returns>
+        int InsertBatch (PackedRectangle[] rectangles, int offset, int count, RectanglePackerSort sort);
+        /// <summary>
+        /// Makes all of the space available again.
+        /// </summary>
+        void Clear ();
+    }
+
+    public delegate IRectanglePacker RectanglePackerFactory (int width, int height);
+
+    public static class RectanglePacker {
+        private static RectanglePackerFactory Factory = CreateDefault;
+
+        /// <summary>
+        /// Replaces the packer used by DynamicAtlas and Create (e.g. with Squared.Render.STB's native
+        ///  one). Pass null to go back to the built in shelf packer.
+        /// </summary>
+        public static void Set (RectanglePackerFactory factory) {
+            Factory = factory ?? CreateDefault;
+        }
+
+        public static IRectanglePacker Create (int width, int height) {
+            if (width <= 0)
+                throw new ArgumentOutOfRangeException(nameof(width));
+            if (height <= 0)
+                throw new ArgumentOutOfRangeException(nameof(height));
+            return Factory(width, height);
+        }
+
+        private static IRectanglePacker CreateDefault (int width, int height) =>
+            new ShelfRectanglePacker(width, height);
+
+        internal static void CheckRange (PackedRectangle[] rectangles, int offset, int count) {
+            if (rectangles == null)
+                throw new ArgumentNullException(nameof(rectangles));
+            if ((offset < 0) || (offset > rectangles.Length))
+                throw new ArgumentOutOfRangeException(nameof(offset));
+            if ((count < 0) || (count > rectangles.Length - offset))
+                throw new ArgumentOutOfRangeException(nameof(count));
+        }
+    }
+
+    /// <summary>
+    /// Places rectangles left to right in rows, starting a new row below the tallest rectangle in
+    ///  the current one whenever the next rectangle doesn't fit. Space left above shorter rectangles
+    ///  is never reused.
+    /// </summary>
+    public sealed class ShelfRectanglePacker : IRectanglePacker {
+        public int Width { get; private set; }
+        public int Height { get; private set; }
+
+        private int X, Y, RowHeight;
+
+        public ShelfRectanglePacker (int width, int height) {
+            Width = width;
+            Height = height;
+        }
+
+        public bool TryInsert (int width, int height, out int x, out int y) {
+            if ((width < 0) || (height < 0) || (width > Width)) {
+                x = y = -1;
+                return false;
+            }
+
+            bool needWrap = (X + width) > Width;
+            int rowY = needWrap ? Y + RowHeight : Y;
+            if (rowY + height > Height) {
+                x = y = -1;
+                return false;
+            }
+
+            if (needWrap) {
+                X = 0;
+                Y = rowY;
+                RowHeight = 0;
+            }
+            x = X;
+            y = Y;
+            X += width;
+            RowHeight = Math.Max(RowHeight, height);
+            return true;
+        }
+
+        public int InsertBatch (PackedRectangle[] rectangles, int offset, int count, RectanglePackerSort sort) {
+            RectanglePacker.CheckRange(rectangles, offset, count);
+
+            var order = new SortKey[count];
+            for (int i = 0; i < count; i++)
+                order[i] = new SortKey(ref rectangles[offset + i], offset + i, sort);
+            if (sort != RectanglePackerSort.None)
+                Array.Sort(order);
+
+            int result = 0;
+            foreach (var key in order) {
+                ref var rect = ref rectangles[key.Index];
+                if (TryInsert(rect.Width, rect.Height, out rect.X, out rect.Y))
+                    result++;
+            }
+            return result;
+        }
+
+        public void Clear () {
+            X = Y = RowHeight = 0;
+        }
+
+        void IDisposable.Dispose () {
+        }
+
+        private readonly struct SortKey : IComparable<SortKey> {
+            public readonly long Primary;
+            public readonly int Secondary, Index;
+
+            public SortKey (ref PackedRectangle rect, int index, RectanglePackerSort sort) {
+                int w = rect.Width, h = rect.Height;
+                Index = index;
+                switch (sort) {
+                    case RectanglePackerSort.None:
+                        Primary = Secondary = 0;
+                        break;
+                    case RectanglePackerSort.Height:
+                        Primary = h;
+                        Secondary = w;
+                        break;
+                    case RectanglePackerSort.Width:
+                        Primary = w;
+                        Secondary = h;
+                        break;
+                    case RectanglePackerSort.Area:
+                        Primary = (long)w * h;
+                        Secondary = Math.Max(w, h);
+                        break;
+                    case RectanglePackerSort.MaxSide:
+                        Primary = Math.Max(w, h);
+                        Secondary = Math.Min(w, h);
+                        break;
+                    case RectanglePackerSort.Perimeter:
+                        Primary = (long)w + h;
+                        Secondary = Math.Max(w, h);
+                        break;
+                    default:
+                        throw new ArgumentOutOfRangeException(nameof(sort));
+                }
+            }
+
+            // Descending, and stable
+            public int CompareTo (SortKey other) {
+                var result = other.Primary.CompareTo(Primary);
+                if (result == 0)
+                    result = other.Secondary.CompareTo(Secondary);
+                if (result == 0)
+                    result = Index.CompareTo(other.Index);
+                return result;
+            }
+        }
+    }
+}
@@ -0,0 +1,174 @@
+﻿using System;
+using NUnit.Framework;
+using Squared.Render.STB.Native;
+
+namespace Squared.Render {
+    [TestFixture]
+    public unsafe class DistanceFieldTests {
+        // What pixels get when there's nothing on the other side of the edge
+        static readonly float MaximumDistance = (float)Math.Sqrt(2.0 * 2048 * 2048);
+
+        private delegate int GeneratorFn (void* input, stbn_df_input format, int width, int height, int regionX, int regionY, int regionWidth, int regionHeight, float* output);
+
+        private static byte[] MakeInput (int width, int height, int pattern) {
+            var random = new Random(pattern);
+            var result = new byte[width * height];
+            for (int y = 0; y < height; y++) {
+                for (int x = 0; x < width; x++) {
+                    bool inside;
+                    switch (pattern) {
+                        case 0:
+                            // Scattered dots
+                            inside = random.Next(40) == 0;
+                            break;
+                        case 1: {
+                            float dx = x - (width * 0.4f), dy = y - (height * 0.5f);
+                            inside = (dx * dx) + (dy * dy) < (width * height) / 10f;
+                            break;
+                        }
+                        default:
+                            // Ragged checkerboard
+                            inside = ((((x / 7) ^ (y / 5)) & 1) != 0) && (random.Next(3) != 0);
+                            break;
+                    }
+                    result[(y * width) + x] = (byte)(inside ? 200 : 0);
+                }
+            }
+            return result;
+        }
+
+        // Distance from each pixel in the region to the nearest pixel in the region on the other side of the edge
+        private static float[] BruteForce (byte[] input, int width, int height, int regionX, int regionY, int regionWidth, int regionHeight) {
+            var result = new float[width * height];
+            for (int y = regionY; y < regionY + regionHeight; y++) {
+                for (int x = regionX; x < regionX + regionWidth; x++) {
+                    bool inside = input[(y * width) + x] != 0;
+                    long best = long.MaxValue;
+                    for (int sy = regionY; sy < regionY + regionHeight; sy++) {
+                        for (int sx = regionX; sx < regionX + regionWidth; sx++) {
+                            if ((input[(sy * width) + sx] != 0) == inside)
+                                continue;
+                            long distanceSquared = ((long)(sx - x) * (sx - x)) + ((long)(sy - y) * (sy - y));
+                            best = Math.Min(best, distanceSquared);
+                        }
+                    }
+                    float distance = (best == long.MaxValue) ? MaximumDistance : (float)Math.Sqrt(best);
+                    result[(y * width) + x] = inside ? -distance : distance;
+                }
+            }
+            return result;
+        }
+
+        private static float[] Generate (GeneratorFn generator, byte[] input, int width, int height, int regionX, int regionY, int regionWidth, int regionHeight, float fill = 0) {
+            var result = new float[width * height];
+            for (int i = 0; i < result.Length; i++)
+                result[i] = fill;
+            fixed (byte* pInput = input)
+            fixed (float* pResult = result)
+                Assert.AreNotEqual(0, generator(pInput, stbn_df_input.GRAY8, width, height, regionX, regionY, regionWidth, regionHeight, pResult));
+            return result;
+        }
+
+        [TestCase(0)]
+        [TestCase(1)]
+        [TestCase(2)]
+        public void JumpFloodIsCloseToBruteForce (int pattern) {
+            const int width = 61, height = 47;
+            var input = MakeInput(width, height, pattern);
+            var expected = BruteForce(input, width, height, 0, 0, width, height);
+            var actual = Generate(API.stbn_distance_field_jump_flood, input, width, height, 0, 0, width, height);
+            for (int i = 0; i < actual.Length; i++) {
+                Assert.AreEqual(Math.Sign(expected[i]), Math.Sign(actual[i]), "sign of pixel {0}", i);
+                // Jump flooding can settle on a seed that isn't the nearest, but never on one closer than the nearest
+                var error = Math.Abs(actual[i]) - Math.Abs(expected[i]);
+                Assert.GreaterOrEqual(error, -1e-4f, "pixel {0}", i);
+                Assert.LessOrEqual(error, 1.5f, "pixel {0}", i);
+            }
+        }
+
+        [TestCase(1, 1, 0)]
+        [TestCase(1, 9, 1)]
+        [TestCase(9, 1, 2)]
+        [TestCase(61, 47, 0)]
+        [TestCase(61, 47, 1)]
+        [TestCase(61, 47, 2)]
+        [TestCase(300, 3, 2)]
+        public void ExactMatchesBruteForce (int width, int height, int pattern) {
+            var input = MakeInput(width, height, pattern);
+            var expected = BruteForce(input, width, height, 0, 0, width, height);
+            var actual = Generate(API.stbn_distance_field_exact, input, width, height, 0, 0, width, height);
+            Assert.AreEqual(expected, actual);
+        }
+
+        [Test]
+        public void ExactAcceptsEveryInputFormat () {
+            const int width = 40, height = 30;
+            var gray = MakeInput(width, height, 0);
+            var rgba = new byte[width * height * 4];
+            float[] single = new float[width * height], vector = new float[width * height * 4];
+            for (int i = 0; i < gray.Length; i++) {
+                // Only alpha decides what's inside
+                rgba[(i * 4) + 0] = 255;
+                rgba[(i * 4) + 3] = gray[i];
+                single[i] = gray[i] / 255f;
+                vector[(i * 4) + 0] = 1;
+                vector[(i * 4) + 3] = (gray[i] != 0) ? 1 : -1;
+            }
+
+            var expected = Generate(API.stbn_distance_field_exact, gray, width, height, 0, 0, width, height);
+            var actual = new float[width * height];
+            fixed (float* pActual = actual) {
+                fixed (byte* pInput = rgba)
+                    Assert.AreNotEqual(0, API.stbn_distance_field_exact(pInput, stbn_df_input.RGBA8, width, height, 0, 0, width, height, pActual));
+                Assert.AreEqual(expected, actual, "RGBA8");
+                fixed (float* pInput = single)
+                    Assert.AreNotEqual(0, API.stbn_distance_field_exact(pInput, stbn_df_input.GRAY32F, width, height, 0, 0, width, height, pActual));
+                Assert.AreEqual(expected, actual, "GRAY32F");
+                fixed (float* pInput = vector)
+                    Assert.AreNotEqual(0, API.stbn_distance_field_exact(pInput, stbn_df_input.RGBA32F, width, height, 0, 0, width, height, pActual));
+                Assert.AreEqual(expected, actual, "RGBA32F");
+            }
+        }
+
+        private static void CheckRegion (GeneratorFn generator, bool exact) {
+            const int width = 50, height = 40, regionX = 12, regionY = 9, regionWidth = 26, regionHeight = 21;
+            var input = MakeInput(width, height, 1);
+            var expected = BruteForce(input, width, height, regionX, regionY, regionWidth, regionHeight);
+            var actual = Generate(generator, input, width, height, regionX, regionY, regionWidth, regionHeight, fill: 77);
+            for (int y = 0; y < height; y++) {
+                for (int x = 0; x < width; x++) {
+                    int i = (y * width) + x;
+                    bool inRegion = (x >= regionX) && (x < regionX + regionWidth) && (y >= regionY) && (y < regionY + regionHeight);
+                    if (!inRegion)
+                        Assert.AreEqual(77f, actual[i], "({0}, {1}) is outside the region", x, y);
+                    else if (exact)
+                        Assert.AreEqual(expected[i], actual[i], "({0}, {1})", x, y);
+                    else
+                        Assert.AreEqual(Math.Sign(expected[i]), Math.Sign(actual[i]), "({0}, {1})", x, y);
+                }
+            }
+        }
+
+        [Test]
+        public void JumpFloodOnlyWritesInsideRegion () {
+            CheckRegion(API.stbn_distance_field_jump_flood, false);
+        }
+
+        [Test]
+        public void ExactOnlyWritesInsideRegion () {
+            CheckRegion(API.stbn_distance_field_exact, true);
+        }
+
+        [TestCase(0)]
+        [TestCase(200)]
+        public void JumpFloodOfUniformImageIsMaximumDistance (int value) {
+            const int width = 20, height = 10;
+            var input = new byte[width * height];
+            for (int i = 0; i < input.Length; i++)
+                input[i] = (byte)value;
+            var actual = Generate(API.stbn_distance_field_jump_flood, input, width, height, 0, 0, width, height);
+            foreach (var distance in actual)
+                Assert.AreEqual((value != 0) ? -MaximumDistance : MaximumDistance, distance);
+        }
+    }
+}
@@ -0,0 +1,201 @@
+﻿using System;
+using System.IO;
+using NUnit.Framework;
+using Squared.Render.STB;
+using Squared.Render.STB.Native;
+
+namespace Squared.Render {
+    [TestFixture]
+    public unsafe class EncodeTests {
+        // Big enough to be split up and encoded on the worker pool
+        const int LargeWidth = 1024, LargeHeight = 512;
+
+        // Gradients with a little noise, so the encoders have something realistic to compress
+        private static byte[] MakeImage (int width, int height, int channels, int seed) {
+            var random = new Random(seed);
+            var result = new byte[width * height * channels];
+            for (int y = 0, i = 0; y < height; y++) {
+                for (int x = 0; x < width; x++) {
+                    for (int c = 0; c < channels; c++, i++)
+                        result[i] = (byte)(((x * (c + 1)) + (y * (3 - c)) + random.Next(8)) & 0xFF);
+                }
+            }
+            return result;
+        }
+
+        private static byte[] Encode (stbn_encode_options options, byte[] pixels, int width, int height, int channels) {
+            fixed (byte* pPixels = pixels) {
+                var encoded = API.stbn_encode_image(&options, pPixels, width, height, channels, 0, out int length);
+                Assert.IsTrue(encoded != null, "Encoding failed");
+                try {
+                    var result = new byte[length];
+                    fixed (byte* pResult = result)
+                        Buffer.MemoryCopy(encoded, pResult, length, length);
+                    return result;
+                } finally {
+                    API.stbi_image_free(encoded);
+                }
+            }
+        }
+
+        private delegate int WriteToFunc (WriteCallback callback, byte* pixels);
+
+        private static byte[] EncodeWithCallback (WriteToFunc write, byte[] pixels) {
+            var output = new MemoryStream();
+            WriteCallback callback = (userData, data, size) => {
+                using (var source = new UnmanagedMemoryStream(data, size))
+                    source.CopyTo(output);
+            };
+            fixed (byte* pPixels = pixels)
+                Assert.AreNotEqual(0, write(callback, pPixels), "Encoding failed");
+            GC.KeepAlive(callback);
+            return output.ToArray();
+        }
+
+        private static byte[] Decode (byte[] encoded, int channels, out int width, out int height) {
+            fixed (byte* pEncoded = encoded) {
+                var decoded = API.stbi_load_from_memory(pEncoded, encoded.Length, out width, out height, out _, channels);
+                Assert.IsTrue(decoded != null, "Decoding failed");
+                try {
+                    var result = new byte[width * height * channels];
+                    fixed (byte* pResult = result)
+                        Buffer.MemoryCopy(decoded, pResult, result.Length, result.Length);
+                    return result;
+                } finally {
+                    API.stbi_image_free(decoded);
+                }
+            }
+        }
+
+        private static stbn_encode_options PNGOptions => new stbn_encode_options {
+            format = ImageWriteFormat.PNG,
+            png_compression_level = 8,
+            png_filter = PNGFilter.Adaptive,
+        };
+
+        private static stbn_encode_options JPEGOptions => new stbn_encode_options {
+            format = ImageWriteFormat.JPEG,
+            jpeg_quality = 90,
+        };
+
+        [Test]
+        public void SmallPNGMatchesSerialEncoder () {
+            const int width = 64, height = 48;
+            var pixels = MakeImage(width, height, 4, 1);
+            var expected = EncodeWithCallback(
+                (callback, pPixels) => API.stbi_write_png_to_func_ex(callback, null, width, height, 4, pPixels, width * 4, 8, PNGFilter.Adaptive),
+                pixels
+            );
+            Assert.AreEqual(expected, Encode(PNGOptions, pixels, width, height, 4));
+        }
+
+        [TestCase(3)]
+        [TestCase(4)]
+        public void LargePNGRoundTrips (int channels) {
+            var pixels = MakeImage(LargeWidth, LargeHeight, channels, channels);
+            var encoded = Encode(PNGOptions, pixels, LargeWidth, LargeHeight, channels);
+            var decoded = Decode(encoded, channels, out int width, out int height);
+            Assert.AreEqual(LargeWidth, width);
+            Assert.AreEqual(LargeHeight, height);
+            Assert.AreEqual(pixels, decoded);
+        }
+
+        [Test]
+        public void LargePNGIsDeterministic () {
+            var pixels = MakeImage(LargeWidth, LargeHeight, 4, 2);
+            var first = Encode(PNGOptions, pixels, LargeWidth, LargeHeight, 4);
+            for (int i = 0; i < 3; i++)
+                Assert.AreEqual(first, Encode(PNGOptions, pixels, LargeWidth, LargeHeight, 4));
+        }
+
+        [TestCase(3)]
+        [TestCase(4)]
+        public void LargeJPEGDecodesLikeSingleScan (int channels) {
+            var pixels = MakeImage(LargeWidth, LargeHeight, channels, channels);
+            var serial = EncodeWithCallback(
+                (callback, pPixels) => API.stbi_write_jpg_to_func(callback, null, LargeWidth, LargeHeight, channels, pPixels, JPEGOptions.jpeg_quality),
+                pixels
+            );
+            var parallel = Encode(JPEGOptions, pixels, LargeWidth, LargeHeight, channels);
+            // Restart intervals only change how the entropy coded data is laid out, not the coefficients
+            Assert.AreNotEqual(serial.Length, parallel.Length);
+            Assert.AreEqual(Decode(serial, channels, out _, out _), Decode(parallel, channels, out _, out _));
+        }
+
+        [Test]
+        public void LargeJPEGIsDeterministic () {
+            var pixels = MakeImage(LargeWidth, LargeHeight, 3, 7);
+            var first = Encode(JPEGOptions, pixels, LargeWidth, LargeHeight, 3);
+            for (int i = 0; i < 3; i++)
+                Assert.AreEqual(first, Encode(JPEGOptions, pixels, LargeWidth, LargeHeight, 3));
+        }
+
+        private static byte[] EncodeQOI (byte[] pixels, int width, int height, int channels, int stride, int zstdLevel) {
+            fixed (byte* pPixels = pixels) {
+                var encoded = API.stbn_qoi_encode(pPixels, width, height, channels, stride, stbn_qoi_flags.NONE, zstdLevel, out int length);
+                Assert.IsTrue(encoded != null, "Encoding failed");
+                try {
+                    var result = new byte[length];
+                    fixed (byte* pResult = result)
+                        Buffer.MemoryCopy(encoded, pResult, length, length);
+                    return result;
+                } finally {
+                    API.stbi_image_free(encoded);
+                }
+            }
+        }
+
+        [TestCase(3, 0)]
+        [TestCase(4, 0)]
+        [TestCase(3, 3)]
+        [TestCase(4, 3)]
+        public void QOIRoundTrips (int channels, int zstdLevel) {
+            const int width = 123, height = 77;
+            var pixels = MakeImage(width, height, channels, channels + zstdLevel);
+            var encoded = EncodeQOI(pixels, width, height, channels, 0, zstdLevel);
+
+            fixed (byte* pEncoded = encoded) {
+                Assert.AreNotEqual(0, API.stbn_qoi_info(pEncoded, encoded.Length, out int infoWidth, out int infoHeight, out int infoChannels));
+                Assert.AreEqual(width, infoWidth);
+                Assert.AreEqual(height, infoHeight);
+                Assert.AreEqual(channels, infoChannels);
+
+                var decoded = new byte[pixels.Length];
+                fixed (byte* pDecoded = decoded)
+                    Assert.AreNotEqual(0, API.stbn_qoi_decode_into(pEncoded, encoded.Length, pDecoded, 0, channels));
+                Assert.AreEqual(pixels, decoded);
+            }
+
+            // Loading through stb_image has to work too, since that's what Image uses
+            Assert.AreEqual(pixels, Decode(encoded, channels, out _, out _));
+        }
+
+        [Test]
+        public void QOIHonorsStrides () {
+            const int width = 40, height = 9, stride = (width * 4) + 12;
+            var packed = MakeImage(width, height, 4, 5);
+            var padded = new byte[stride * height];
+            for (int y = 0; y < height; y++)
+                Array.Copy(packed, y * width * 4, padded, y * stride, width * 4);
+
+            var encoded = EncodeQOI(padded, width, height, 4, stride, 0);
+            Assert.AreEqual(EncodeQOI(packed, width, height, 4, 0, 0), encoded);
+
+            var decoded = new byte[stride * height];
+            fixed (byte* pEncoded = encoded, pDecoded = decoded)
+                Assert.AreNotEqual(0, API.stbn_qoi_decode_into(pEncoded, encoded.Length, pDecoded, stride, 4));
+            for (int y = 0; y < height; y++)
+                for (int x = 0; x < width * 4; x++)
+                    Assert.AreEqual(packed[(y * width * 4) + x], decoded[(y * stride) + x]);
+        }
+
+        [Test]
+        public void QOIRejectsTruncatedData () {
+            const int width = 32, height = 32;
+            var encoded = EncodeQOI(MakeImage(width, height, 4, 6), width, height, 4, 0, 3);
+            var decoded = new byte[width * height * 4];
+            fixed (byte* pEncoded = encoded, pDecoded = decoded)
+                Assert.AreEqual(0, API.stbn_qoi_decode_into(pEncoded, encoded.Length / 2, pDecoded, 0, 4));
+        }
+    }
+}
@@ -0,0 +1,189 @@
+﻿using System;
+using Microsoft.Xna.Framework.Graphics.PackedVector;
+using NUnit.Framework;
+using Squared.Render.Mips;
+
+namespace Squared.Render {
+    [TestFixture]
+    public unsafe class MipTests {
+        private static byte[] MakeNoise (int length, int seed) {
+            var result = new byte[length];
+            new Random(seed).NextBytes(result);
+            return result;
+        }
+
+        private static void Reduce (MipGeneratorFn generator, byte[] src, int srcWidth, int srcHeight, byte[] dest, int destWidth, int destHeight, int bytesPerPixel) {
+            fixed (byte* pSrc = src, pDest = dest)
+                generator(pSrc, srcWidth, srcHeight, srcWidth * bytesPerPixel, pDest, destWidth, destHeight, destWidth * bytesPerPixel);
+        }
+
+        // The source texels covered by destination texel i: two of them, except that the last one absorbs an
+        //  odd leftover when the size was rounded down and only has one when it was rounded up
+        private static void GetSpan (int i, int sourceSize, int destSize, out int first, out int count) {
+            first = i * 2;
+            var end = (i == destSize - 1) ? sourceSize : first + 2;
+            count = Math.Min(end, sourceSize) - first;
+        }
+
+        private static byte[] ReferenceAverage (byte[] src, int srcWidth, int srcHeight, int destWidth, int destHeight, int bytesPerPixel) {
+            var result = new byte[destWidth * destHeight * bytesPerPixel];
+            for (int y = 0; y < destHeight; y++) {
+                GetSpan(y, srcHeight, destHeight, out var firstRow, out var rows);
+                for (int x = 0; x < destWidth; x++) {
+                    GetSpan(x, srcWidth, destWidth, out var firstColumn, out var columns);
+                    for (int c = 0; c < bytesPerPixel; c++) {
+                        int sum = 0, n = rows * columns;
+                        for (int sy = firstRow; sy < firstRow + rows; sy++)
+                            for (int sx = firstColumn; sx < firstColumn + columns; sx++)
+                                sum += src[((sy * srcWidth) + sx) * bytesPerPixel + c];
+                        result[((y * destWidth) + x) * bytesPerPixel + c] = (byte)((sum + (n / 2)) / n);
+                    }
+                }
+            }
+            return result;
+        }
+
+        [TestCase(64, 64, 32, 32)]
+        [TestCase(37, 23, 18, 11)]
+        [TestCase(37, 23, 19, 12)]
+        [TestCase(300, 3, 150, 1)]
+        public void BoxPremultipliedRGBAIsRoundedAverage (int srcWidth, int srcHeight, int destWidth, int destHeight) {
+            var src = MakeNoise(srcWidth * srcHeight * 4, srcWidth);
+            var dest = new byte[destWidth * destHeight * 4];
+            Reduce(STBMipGenerator.GetBox(MipFormat.pRGBA), src, srcWidth, srcHeight, dest, destWidth, destHeight, 4);
+            Assert.AreEqual(ReferenceAverage(src, srcWidth, srcHeight, destWidth, destHeight, 4), dest);
+        }
+
+        [TestCase(64, 64, 32, 32)]
+        [TestCase(37, 23, 18, 11)]
+        [TestCase(37, 23, 19, 12)]
+        [TestCase(300, 3, 150, 1)]
+        public void BoxGrayIsRoundedAverage (int srcWidth, int srcHeight, int destWidth, int destHeight) {
+            var src = MakeNoise(srcWidth * srcHeight, srcHeight);
+            var dest = new byte[destWidth * destHeight];
+            Reduce(STBMipGenerator.GetBox(MipFormat.Gray1), src, srcWidth, srcHeight, dest, destWidth, destHeight, 1);
+            Assert.AreEqual(ReferenceAverage(src, srcWidth, srcHeight, destWidth, destHeight, 1), dest);
+        }
+
+        [Test]
+        public void BoxStraightRGBAIgnoresColorOfTransparentTexels () {
+            // Wide enough to go through the row kernels as well as the edge blocks
+            const int width = 34;
+            var src = new byte[width * 2 * 4];
+            for (int i = 0; i < src.Length; i += 4) {
+                // Transparent green everywhere but the top left of each block, which is opaque red
+                var isOpaque = (i < width * 4) && ((i / 4) % 2 == 0);
+                src[i + 0] = (byte)(isOpaque ? 255 : 0);
+                src[i + 1] = (byte)(isOpaque ? 0 : 255);
+                src[i + 3] = (byte)(isOpaque ? 255 : 0);
+            }
+
+            var dest = new byte[(width / 2) * 4];
+            Reduce(STBMipGenerator.GetBox(MipFormat.RGBA), src, width, 2, dest, width / 2, 1, 4);
+            for (int x = 0; x < width / 2; x++) {
+                Assert.AreEqual(255, dest[x * 4 + 0], "red");
+                Assert.AreEqual(0, dest[x * 4 + 1], "green");
+                Assert.AreEqual(0, dest[x * 4 + 2], "blue");
+                Assert.AreEqual(64, dest[x * 4 + 3], "alpha");
+            }
+        }
+
+        [Test]
+        public void BoxStraightRGBAOfOpaqueTexelsIsAverage () {
+            const int width = 66, height = 10;
+            var src = MakeNoise(width * height * 4, 3);
+            for (int i = 3; i < src.Length; i += 4)
+                src[i] = 255;
+
+            var dest = new byte[(width / 2) * (height / 2) * 4];
+            Reduce(STBMipGenerator.GetBox(MipFormat.RGBA), src, width, height, dest, width / 2, height / 2, 4);
+            var expected = ReferenceAverage(src, width, height, width / 2, height / 2, 4);
+            for (int i = 0; i < dest.Length; i++)
+                // Ties may round either way, since the weighted average is done in floating point
+                Assert.LessOrEqual(Math.Abs(expected[i] - dest[i]), 1, "byte {0}", i);
+        }
+
+        private static ushort[] MakeHalfNoise (int length, int seed) {
+            var random = new Random(seed);
+            var result = new ushort[length];
+            for (int i = 0; i < length; i++)
+                result[i] = new HalfSingle((float)(random.NextDouble() * 16 - 8)).PackedValue;
+            return result;
+        }
+
+        private static ushort[] ReduceHalf (MipGeneratorFn generator, ushort[] src, int srcWidth, int srcHeight, int destWidth, int destHeight) {
+            var result = new ushort[destWidth * destHeight];
+            fixed (ushort* pSrc = src, pDest = result)
+                generator(pSrc, srcWidth, srcHeight, srcWidth * 2, pDest, destWidth, destHeight, destWidth * 2);
+            return result;
+        }
+
+        [TestCase(MipFormat.HalfSingleMin)]
+        [TestCase(MipFormat.HalfSingleMax)]
+        public void HalfMinMaxMatchesManaged (MipFormat format) {
+            const int width = 70, height = 12;
+            var src = MakeHalfNoise(width * height, (int)format);
+            var native = ReduceHalf(STBMipGenerator.GetBox(format), src, width, height, width / 2, height / 2);
+            var managed = ReduceHalf(MipGenerator.Get(format), src, width, height, width / 2, height / 2);
+            // Picking one of the inputs doesn't round, so these have to be identical
+            Assert.AreEqual(managed, native);
+        }
+
+        [TestCase(MipFormat.HalfSingle)]
+        [TestCase(MipFormat.HalfSinglePseudoMin)]
+        public void HalfAverageMatchesManaged (MipFormat format) {
+            const int width = 70, height = 12;
+            var src = MakeHalfNoise(width * height, (int)format);
+            var native = ReduceHalf(STBMipGenerator.GetBox(format), src, width, height, width / 2, height / 2);
+            var managed = ReduceHalf(MipGenerator.Get(format), src, width, height, width / 2, height / 2);
+            for (int i = 0; i < native.Length; i++) {
+                float n = new HalfSingle { PackedValue = native[i] }.ToSingle(),
+                    m = new HalfSingle { PackedValue = managed[i] }.ToSingle();
+                // Half float conversions may round ties differently, but never by more than one step
+                Assert.LessOrEqual(Math.Abs(n - m), Math.Abs(m) / 1024 + 1e-6f, "texel {0}", i);
+            }
+        }
+
+        [TestCase(MipFormat.Single, 4)]
+        [TestCase(MipFormat.SinglePseudoMin, 4)]
+        [TestCase(MipFormat.HalfSingle, 2)]
+        [TestCase(MipFormat.HalfSinglePseudoMin, 2)]
+        public void FullBlocksMatchEdgeBlocks (MipFormat format, int bytesPerTexel) {
+            // The interior of a wide image goes through the row kernels, while a lone 2x2 block
+            //  goes through the scalar block function, so reduce every block both ways
+            const int width = 64;
+            var random = new Random((int)format);
+            var src = new byte[width * 2 * bytesPerTexel];
+            for (int i = 0; i < width * 2; i++) {
+                var value = (float)(random.NextDouble() * 16 - 8);
+                var bytes = (bytesPerTexel == 2)
+                    ? BitConverter.GetBytes(new HalfSingle(value).PackedValue)
+                    : BitConverter.GetBytes(value);
+                Array.Copy(bytes, 0, src, i * bytesPerTexel, bytesPerTexel);
+            }
+
+            var generator = STBMipGenerator.GetBox(format);
+            var dest = new byte[(width / 2) * bytesPerTexel];
+            Reduce(generator, src, width, 2, dest, width / 2, 1, bytesPerTexel);
+
+            var block = new byte[4 * bytesPerTexel];
+            var single = new byte[bytesPerTexel];
+            for (int x = 0; x < width / 2; x++) {
+                for (int y = 0; y < 2; y++)
+                    Array.Copy(src, ((y * width) + (x * 2)) * bytesPerTexel, block, y * 2 * bytesPerTexel, 2 * bytesPerTexel);
+                Reduce(generator, block, 2, 2, single, 1, 1, bytesPerTexel);
+                for (int i = 0; i < bytesPerTexel; i++)
+                    Assert.AreEqual(single[i], dest[(x * bytesPerTexel) + i], "texel {0}", x);
+            }
+        }
+
+        [Test]
+        public void BoxRejectsWrongDestinationSize () {
+            var src = new byte[64 * 64 * 4];
+            var dest = new byte[16 * 16 * 4];
+            Assert.Throws<ArgumentOutOfRangeException>(
+                () => Reduce(STBMipGenerator.GetBox(MipFormat.pRGBA), src, 64, 64, dest, 16, 16, 4)
+            );
+        }
+    }
+}
@@ -0,0 +1,149 @@
+﻿using System;
+using NUnit.Framework;
+using Squared.Render.Atlases;
+using Squared.Render.STB;
+using Squared.Render.STB.Native;
+
+namespace Squared.Render {
+    [TestFixture]
+    public class RectanglePackerTests {
+        public enum PackerKind {
+            Shelf,
+            Skyline,
+            MaxRects,
+        }
+
+        private static IRectanglePacker Create (PackerKind kind, int width, int height) {
+            switch (kind) {
+                case PackerKind.Shelf:
+                    return new ShelfRectanglePacker(width, height);
+                case PackerKind.Skyline:
+                    return new STBRectanglePacker(width, height, stbn_rect_pack_algorithm.SKYLINE);
+                case PackerKind.MaxRects:
+                    return new STBRectanglePacker(width, height, stbn_rect_pack_algorithm.MAXRECTS);
+                default:
+                    throw new ArgumentOutOfRangeException(nameof(kind));
+            }
+        }
+
+        private static PackedRectangle[] MakeRectangles (int count, int maxSize, int seed) {
+            var random = new Random(seed);
+            var result = new PackedRectangle[count];
+            for (int i = 0; i < count; i++)
+                result[i] = new PackedRectangle(1 + random.Next(maxSize), 1 + random.Next(maxSize));
+            return result;
+        }
+
+        private static void AssertNoOverlaps (PackedRectangle[] rectangles, int width, int height) {
+            var used = new int[width * height];
+            for (int i = 0; i < rectangles.Length; i++) {
+                var rect = rectangles[i];
+                if (!rect.IsPacked) {
+                    Assert.AreEqual(-1, rect.Y, "rectangle {0} wasn't packed but has a position", i);
+                    continue;
+                }
+
+                Assert.IsTrue(
+                    (rect.X >= 0) && (rect.Y >= 0) && (rect.X + rect.Width <= width) && (rect.Y + rect.Height <= height),
+                    "rectangle {0} at ({1}, {2}) is out of bounds", i, rect.X, rect.Y
+                );
+                for (int y = rect.Y; y < rect.Y + rect.Height; y++) {
+                    for (int x = rect.X; x < rect.X + rect.Width; x++) {
+                        var other = used[(y * width) + x];
+                        if (other != 0)
+                            Assert.Fail("rectangles {0} and {1} overlap at ({2}, {3})", other - 1, i, x, y);
+                        used[(y * width) + x] = i + 1;
+                    }
+                }
+            }
+        }
+
+        private static int CountPacked (PackedRectangle[] rectangles, int offset, int count) {
+            int result = 0;
+            for (int i = offset; i < offset + count; i++)
+                if (rectangles[i].IsPacked)
+                    result++;
+            return result;
+        }
+
+        [TestCase(PackerKind.Shelf)]
+        [TestCase(PackerKind.Skyline)]
+        [TestCase(PackerKind.MaxRects)]
+        public void BatchesDontOverlapOrLeaveTheAtlas (PackerKind kind) {
+            const int width = 200, height = 150;
+            for (var sort = RectanglePackerSort.None; sort <= RectanglePackerSort.Perimeter; sort++) {
+                var rectangles = MakeRectangles(300, 30, (int)sort);
+                using (var packer = Create(kind, width, height)) {
+                    var packed = packer.InsertBatch(rectangles, 0, rectangles.Length, sort);
+                    Assert.AreEqual(CountPacked(rectangles, 0, rectangles.Length), packed, "sort {0}", sort);
+                    // There are far more rectangles than fit
+                    Assert.Greater(packed, 0, "sort {0}", sort);
+                    Assert.Less(packed, rectangles.Length, "sort {0}", sort);
+                    AssertNoOverlaps(rectangles, width, height);
+                }
+            }
+        }
+
+        [TestCase(PackerKind.Shelf)]
+        [TestCase(PackerKind.Skyline)]
+        [TestCase(PackerKind.MaxRects)]
+        public void InsertsAndBatchesShareSpace (PackerKind kind) {
+            const int width = 128, height = 128;
+            var rectangles = MakeRectangles(200, 20, 1);
+            int half = rectangles.Length / 2;
+            using (var packer = Create(kind, width, height)) {
+                for (int i = 0; i < half; i++) {
+                    ref var rect = ref rectangles[i];
+                    Assert.AreEqual(
+                        packer.TryInsert(rect.Width, rect.Height, out rect.X, out rect.Y), rect.IsPacked
+                    );
+                }
+                var packed = packer.InsertBatch(rectangles, half, rectangles.Length - half, RectanglePackerSort.Height);
+                Assert.AreEqual(CountPacked(rectangles, half, rectangles.Length - half), packed);
+                AssertNoOverlaps(rectangles, width, height);
+            }
+        }
+
+        [TestCase(PackerKind.Shelf)]
+        [TestCase(PackerKind.Skyline)]
+        [TestCase(PackerKind.MaxRects)]
+        public void ClearMakesEverythingAvailableAgain (PackerKind kind) {
+            using (var packer = Create(kind, 64, 64)) {
+                Assert.IsTrue(packer.TryInsert(64, 64, out int x, out int y));
+                Assert.AreEqual(0, x);
+                Assert.AreEqual(0, y);
+                Assert.IsFalse(packer.TryInsert(1, 1, out _, out _));
+
+                packer.Clear();
+                Assert.IsTrue(packer.TryInsert(64, 64, out x, out y));
+                Assert.AreEqual(0, x);
+                Assert.AreEqual(0, y);
+            }
+        }
+
+        [TestCase(PackerKind.Shelf)]
+        [TestCase(PackerKind.Skyline)]
+        [TestCase(PackerKind.MaxRects)]
+        public void RejectsRectanglesBiggerThanTheAtlas (PackerKind kind) {
+            using (var packer = Create(kind, 64, 32)) {
+                Assert.IsFalse(packer.TryInsert(65, 1, out int x, out int y));
+                Assert.AreEqual(-1, x);
+                Assert.AreEqual(-1, y);
+                Assert.IsFalse(packer.TryInsert(1, 33, out _, out _));
+                // Nothing was used up by the failed inserts
+                Assert.IsTrue(packer.TryInsert(64, 32, out _, out _));
+            }
+        }
+
+        [TestCase(PackerKind.Shelf)]
+        [TestCase(PackerKind.Skyline)]
+        [TestCase(PackerKind.MaxRects)]
+        public void BatchRangeIsChecked (PackerKind kind) {
+            var rectangles = MakeRectangles(4, 4, 2);
+            using (var packer = Create(kind, 64, 64)) {
+                Assert.Throws<ArgumentOutOfRangeException>(() => packer.InsertBatch(rectangles, 3, 2, RectanglePackerSort.None));
+                Assert.Throws<ArgumentNullException>(() => packer.InsertBatch(null, 0, 0, RectanglePackerSort.None));
+            }
+        }
+    }
+}
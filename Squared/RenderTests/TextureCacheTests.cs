@@ -0,0 +1,133 @@
+﻿using System;
+using System.Runtime.InteropServices;
+using System.Text;
+using NUnit.Framework;
+using Squared.Render.STB.Native;
+
+namespace Squared.Render {
+    [TestFixture]
+    public unsafe class TextureCacheTests {
+        // Level 0 is bigger than a chunk, so it gets split
+        const int Width = 1024, Height = 300, BytesPerPixel = 4, LevelCount = 4;
+
+        private static byte[][] MakeLevels (int seed) {
+            var random = new Random(seed);
+            var result = new byte[LevelCount][];
+            for (int i = 0; i < LevelCount; i++) {
+                result[i] = new byte[(Width >> i) * (Height >> i) * BytesPerPixel];
+                // Runs of repeated bytes, so there's something to compress
+                for (int j = 0; j < result[i].Length; j++)
+                    result[i][j] = (j % 16 == 0) ? (byte)random.Next(256) : result[i][j - 1];
+            }
+            return result;
+        }
+
+        private static stbn_texcache_info MakeInfo () => new stbn_texcache_info {
+            key = 0x0123456789ABCDEFUL,
+            width = Width,
+            height = Height,
+            original_width = Width * 2,
+            original_height = Height * 2,
+            channels = 4,
+            original_channels = 3,
+            bytes_per_pixel = BytesPerPixel,
+            flags = 5,
+            level_count = LevelCount,
+        };
+
+        private static byte[] Write (stbn_texcache_info info, byte[][] levels) {
+            var pins = new GCHandle[levels.Length];
+            var pLevels = stackalloc void*[levels.Length];
+            try {
+                for (int i = 0; i < levels.Length; i++) {
+                    pins[i] = GCHandle.Alloc(levels[i], GCHandleType.Pinned);
+                    pLevels[i] = (void*)pins[i].AddrOfPinnedObject();
+                }
+
+                var container = API.stbn_texcache_write(&info, pLevels, 3, out long length);
+                Assert.IsTrue(container != null, "Writing failed");
+                try {
+                    var result = new byte[length];
+                    fixed (byte* pResult = result)
+                        Buffer.MemoryCopy(container, pResult, length, length);
+                    return result;
+                } finally {
+                    API.stbi_image_free(container);
+                }
+            } finally {
+                foreach (var pin in pins)
+                    if (pin.IsAllocated)
+                        pin.Free();
+            }
+        }
+
+        private static bool TryDecompress (byte[] container, long length, int firstLevel, byte[][] dests) {
+            var pins = new GCHandle[dests.Length];
+            var pDests = stackalloc void*[dests.Length];
+            try {
+                for (int i = 0; i < dests.Length; i++) {
+                    pins[i] = GCHandle.Alloc(dests[i], GCHandleType.Pinned);
+                    pDests[i] = (void*)pins[i].AddrOfPinnedObject();
+                }
+
+                fixed (byte* pContainer = container)
+                    return API.stbn_texcache_decompress(pContainer, length, firstLevel, dests.Length, pDests) != 0;
+            } finally {
+                foreach (var pin in pins)
+                    if (pin.IsAllocated)
+                        pin.Free();
+            }
+        }
+
+        [Test]
+        public void RoundTripsInfoAndEveryLevel () {
+            var levels = MakeLevels(1);
+            var container = Write(MakeInfo(), levels);
+
+            stbn_texcache_info info;
+            fixed (byte* pContainer = container)
+                Assert.AreNotEqual(0, API.stbn_texcache_read_info(pContainer, container.Length, out info));
+            Assert.AreEqual(MakeInfo(), info);
+
+            var decompressed = new byte[LevelCount][];
+            for (int i = 0; i < LevelCount; i++)
+                decompressed[i] = new byte[levels[i].Length];
+            Assert.IsTrue(TryDecompress(container, container.Length, 0, decompressed));
+            for (int i = 0; i < LevelCount; i++)
+                Assert.AreEqual(levels[i], decompressed[i], "level {0}", i);
+        }
+
+        [Test]
+        public void DecompressesARangeOfLevels () {
+            var levels = MakeLevels(2);
+            var container = Write(MakeInfo(), levels);
+
+            var decompressed = new[] { new byte[levels[1].Length], new byte[levels[2].Length] };
+            Assert.IsTrue(TryDecompress(container, container.Length, 1, decompressed));
+            Assert.AreEqual(levels[1], decompressed[0]);
+            Assert.AreEqual(levels[2], decompressed[1]);
+
+            Assert.IsFalse(TryDecompress(container, container.Length, LevelCount - 1, decompressed));
+        }
+
+        [Test]
+        public void RejectsTruncatedContainers () {
+            var levels = MakeLevels(3);
+            var container = Write(MakeInfo(), levels);
+
+            fixed (byte* pContainer = container) {
+                Assert.AreEqual(0, API.stbn_texcache_read_info(pContainer, 16, out _));
+                Assert.AreEqual(0, API.stbn_texcache_read_info(pContainer, container.Length - 1, out _));
+            }
+            Assert.IsFalse(TryDecompress(container, container.Length - 1, 0, new[] { new byte[levels[0].Length] }));
+        }
+
+        [TestCase("", 0UL, 0xEF46DB3751D8E999UL)]
+        [TestCase("abc", 0UL, 0x44BC2CF5AD770999UL)]
+        public void XXH64MatchesReference (string text, ulong seed, ulong expected) {
+            var bytes = Encoding.ASCII.GetBytes(text);
+            fixed (byte* pBytes = bytes)
+                Assert.AreEqual(expected, API.stbn_xxh64(pBytes, bytes.Length, seed));
+        }
+    }
+}
@@ -0,0 +1,227 @@
+#include "stbnative.h"
+#include "alloc.h"
+#include <atomic>
+#include <stdlib.h>
+#include <string.h>
+
+namespace {
+    struct allocator {
+        stbn_alloc_fn alloc;
+        stbn_free_fn free;
+        void * userdata;
+    };
+
+    // Sits in front of every block. 32 bytes, so the payload keeps malloc's 16-byte alignment.
+    struct header {
+        // What the caller asked for, and what the block can actually hold
+        size_t size, capacity;
+        // null for the default allocator
+        const allocator * owner;
+        int32_t subsystem;
+        // Thread cache size class, or -1 if the block is too small/large to cache
+        int32_t size_class;
+    };
+    static_assert(sizeof(header) == 32, "header must preserve 16-byte alignment");
+
+    // Cached blocks are rounded up to quarter steps between powers of two (at most 25% waste)
+    const int min_cached_shift = 16, max_cached_shift = 28;
+    const int size_class_count = (max_cached_shift - min_cached_shift) * 4;
+
+    struct counters {
+        std::atomic<int64_t> bytes_in_use, peak_bytes_in_use, total_bytes_allocated, total_allocations, cache_hits;
+    };
+
+    counters stats[STBN_ALLOC_SUBSYSTEM_COUNT];
+    std::atomic<const allocator *> current_allocator { nullptr };
+    std::atomic<int64_t> cache_limit { 32 * 1024 * 1024 }, cached_bytes { 0 };
+
+    // Kept trivially destructible so that blocks freed by other thread_local destructors
+    //  after the flush below has run can still safely check it.
+    struct thread_cache {
+        header * heads[size_class_count];
+        int64_t bytes;
+        bool closed;
+    };
+    thread_local thread_cache cache;
+
+    void flush_cache (thread_cache & c) {
+        for (int i = 0; i < size_class_count; i++) {
+            while (header * h = c.heads[i]) {
+                c.heads[i] = *(header **)(h + 1);
+                free(h);
+            }
+        }
+        cached_bytes -= c.bytes;
+        c.bytes = 0;
+    }
+
+    struct thread_cache_guard {
+        ~thread_cache_guard () {
+            flush_cache(cache);
+            cache.closed = true;
+        }
+    };
+    thread_local thread_cache_guard cache_guard;
+
+    int size_class (size_t size, size_t & capacity) {
+        capacity = size;
+        if (size < ((size_t)1 << min_cached_shift))
+            return -1;
+
+        int shift = min_cached_shift;
+        while ((shift < max_cached_shift) && (size >= ((size_t)2 << shift)))
+            shift++;
+        if (shift >= max_cached_shift)
+            return -1;
+
+        size_t step = (size_t)1 << (shift - 2),
+            quarters = (size + step - 1) / step;
+        int result = (shift - min_cached_shift) * 4 + (int)quarters - 4;
+        // Rounded up past the largest class
+        if (result >= size_class_count)
+            return -1;
+        capacity = quarters * step;
+        return result;
+    }
+
+    void count_alloc (int subsystem, size_t size, bool cache_hit) {
+        auto & s = stats[subsystem];
+        int64_t in_use = (s.bytes_in_use += (int64_t)size),
+            peak = s.peak_bytes_in_use.load(std::memory_order_relaxed);
+        while ((in_use > peak) && !s.peak_bytes_in_use.compare_exchange_weak(peak, in_use))
+            ;
+        s.total_bytes_allocated += (int64_t)size;
+        s.total_allocations++;
+        if (cache_hit)
+            s.cache_hits++;
+    }
+}
+
+void * stbn_malloc (size_t size, int subsystem) {
+    if ((subsystem < 0) || (subsystem >= STBN_ALLOC_SUBSYSTEM_COUNT))
+        subsystem = STBN_ALLOC_NATIVE;
+    if (size > SIZE_MAX - sizeof(header))
+        return nullptr;
+
+    header * h;
+    const allocator * owner = current_allocator.load(std::memory_order_acquire);
+    size_t capacity;
+    int cls = -1;
+    bool cache_hit = false;
+
+    if (owner) {
+        capacity = size;
+        h = (header *)owner->alloc(owner->userdata, size + sizeof(header), subsystem);
+    } else {
+        cls = size_class(size, capacity);
+        if ((cls >= 0) && (h = cache.heads[cls])) {
+            cache.heads[cls] = *(header **)(h + 1);
+            cache.bytes -= (int64_t)capacity;
+            cached_bytes -= (int64_t)capacity;
+            cache_hit = true;
+        } else {
+            h = (header *)malloc(capacity + sizeof(header));
+        }
+    }
+
+    if (!h)
+        return nullptr;
+
+    h->size = size;
+    h->capacity = capacity;
+    h->owner = owner;
+    h->subsystem = subsystem;
+    h->size_class = cls;
+    count_alloc(subsystem, size, cache_hit);
+    return h + 1;
+}
+
+void stbn_free (void * ptr) {
+    if (!ptr)
+        return;
+
+    header * h = (header *)ptr - 1;
+    stats[h->subsystem].bytes_in_use -= (int64_t)h->size;
+
+    if (h->owner) {
+        h->owner->free(h->owner->userdata, h, h->capacity + sizeof(header), h->subsystem);
+        return;
+    }
+
+    int64_t capacity = (int64_t)h->capacity;
+    if (
+        (h->size_class >= 0) && !cache.closed &&
+        (cache.bytes + capacity <= cache_limit.load(std::memory_order_relaxed))
+    ) {
+        *(header **)(h + 1) = cache.heads[h->size_class];
+        cache.heads[h->size_class] = h;
+        cache.bytes += capacity;
+        cached_bytes += capacity;
+        // Make sure this thread's cache gets flushed when it exits
+        (void)&cache_guard;
+        return;
+    }
+
+    free(h);
+}
+
+void * stbn_realloc (void * ptr, size_t size, int subsystem) {
+    if (!ptr)
+        return stbn_malloc(size, subsystem);
+
+    header * h = (header *)ptr - 1;
+    if (size <= h->capacity) {
+        stats[h->subsystem].bytes_in_use += (int64_t)size - (int64_t)h->size;
+        h->size = size;
+        return ptr;
+    }
+
+    void * result = stbn_malloc(size, h->subsystem);
+    if (!result)
+        return nullptr;
+    memcpy(result, ptr, h->size);
+    stbn_free(ptr);
+    return result;
+}
+
+// Replaces the default allocator for new allocations. Blocks that are already live keep
+//  track of the allocator they came from, so it must keep working until they're all freed.
+// Pass nulls to go back to the default.
+STBNDEF void stbn_set_allocator (stbn_alloc_fn alloc_fn, stbn_free_fn free_fn, void * userdata) {
+    if (!alloc_fn || !free_fn) {
+        current_allocator.store(nullptr, std::memory_order_release);
+        return;
+    }
+
+    // Never freed, since blocks refer to it
+    allocator * a = new allocator { alloc_fn, free_fn, userdata };
+    current_allocator.store(a, std::memory_order_release);
+}
+
+STBNDEF int stbn_get_allocator_stats (int subsystem, stbn_allocator_stats * result) {
+    if ((subsystem < 0) || (subsystem >= STBN_ALLOC_SUBSYSTEM_COUNT) || !result)
+        return 0;
+
+    auto & s = stats[subsystem];
+    result->bytes_in_use = s.bytes_in_use;
+    result->peak_bytes_in_use = s.peak_bytes_in_use;
+    result->total_bytes_allocated = s.total_bytes_allocated;
+    result->total_allocations = s.total_allocations;
+    result->cache_hits = s.cache_hits;
+    return 1;
+}
+
+// Total bytes sitting in thread caches waiting to be reused.
+STBNDEF int64_t stbn_get_cached_bytes () {
+    return cached_bytes;
+}
+
+// Sets how many bytes of freed blocks each thread can keep around. 0 disables caching.
+STBNDEF void stbn_set_thread_cache_limit (int64_t bytes) {
+    cache_limit = bytes > 0 ? bytes : 0;
+}
+
+// Releases everything the calling thread has cached back to the heap.
+STBNDEF void stbn_trim_thread_cache () {
+    flush_cache(cache);
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Every allocation made by stb_image, stb_image_resize2, stb_image_write and our own
+//  kernels goes through here, so it can be tracked per subsystem and so that large scratch
+//  buffers can be reused across loads instead of going back to the CRT heap each time.
+// By default, freed blocks of 64KB and up are kept in a small per-thread cache and handed
+//  back out to the next allocation of the same size class on that thread.
+// An allocator can be registered with stbn_set_allocator to take over from the default.
+
+enum stbn_alloc_subsystem {
+    STBN_ALLOC_IMAGE = 0,
+    STBN_ALLOC_RESIZE = 1,
+    STBN_ALLOC_WRITE = 2,
+    STBN_ALLOC_NATIVE = 3,
+    STBN_ALLOC_SUBSYSTEM_COUNT
+};
+
+struct stbn_allocator_stats {
+    // Bytes requested by allocations that haven't been freed yet
+    int64_t bytes_in_use;
+    int64_t peak_bytes_in_use;
+    int64_t total_bytes_allocated;
+    int64_t total_allocations;
+    // How many of those allocations were satisfied from a thread cache
+    int64_t cache_hits;
+};
+
+// Registered allocators must return memory aligned to at least 16 bytes. free receives the
+//  same size that was passed to alloc.
+typedef void * (*stbn_alloc_fn) (void * userdata, size_t size, int subsystem);
+typedef void (*stbn_free_fn) (void * userdata, void * ptr, size_t size, int subsystem);
+
+void * stbn_malloc (size_t size, int subsystem);
+void * stbn_realloc (void * ptr, size_t size, int subsystem);
+// The block remembers which subsystem and allocator it came from.
+void stbn_free (void * ptr);
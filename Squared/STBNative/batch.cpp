@@ -0,0 +1,217 @@
+#include "stbnative.h"
+#include "colorspace.h"
+#include "half.h"
+#include "threads.h"
+#include <atomic>
+#include <string.h>
+
+// Decoding many images at once on the worker pool, so loading a folder of content doesn't
+//  need a managed thread (and a round of interop) per file.
+// Each image is decoded, converted and premultiplied on a worker. Large temporary buffers are
+//  recycled by the per-thread allocator caches (see alloc.h), so a worker that decodes many
+//  images in a row stops going to the heap for them after the first few.
+
+enum {
+    STBN_DECODE_U8 = 0,
+    // Falls back to U8 if the image isn't 16-bit
+    STBN_DECODE_U16 = 1,
+    STBN_DECODE_F32 = 2,
+    // Falls back to U8 if the image isn't 16-bit
+    STBN_DECODE_F16 = 3,
+};
+
+enum {
+    STBN_DECODE_PREMULTIPLY = 1,
+    STBN_DECODE_SRGB_TO_LINEAR = 2,
+    STBN_DECODE_SRGB_FROM_LINEAR = 4,
+    // Ignore desired_channels: 1 channel images stay 1 channel, everything else becomes 4
+    STBN_DECODE_NATIVE_CHANNELS = 8,
+    // With STBN_DECODE_NATIVE_CHANNELS, keeps 2 channel images 2 channel unless they're 8-bit
+    STBN_DECODE_TWO_CHANNEL = 16,
+};
+
+enum {
+    STBN_DECODE_PENDING = 0,
+    STBN_DECODE_OK = 1,
+    STBN_DECODE_FAILED = -1,
+};
+
+struct stbn_decode_desc {
+    const stbi_uc * buffer;
+    int length;
+    // 1-4, or 0 to keep the channel count of the file
+    int desired_channels;
+    int format, flags;
+};
+
+struct stbn_decode_result {
+    // Free with stbi_image_free
+    void * pixels;
+    // Static string; only set when status is STBN_DECODE_FAILED
+    const char * failure_reason;
+    int width, height, channels_in_file, channels;
+    // The format that was actually decoded (see the fallbacks above)
+    int format;
+    // Written last, once everything else is filled in
+    volatile int32_t status;
+};
+
+// Called for each image once it's done (successfully or not), from a worker thread.
+// After the last image, it's called one more time with index -1 and a null result.
+typedef void (*stbn_decode_callback) (void * userdata, int index, stbn_decode_result * result);
+
+namespace {
+    struct batch {
+        stbn_decode_desc * descs;
+        stbn_decode_result * results;
+        stbn_decode_callback callback;
+        void * userdata;
+    };
+
+    template<typename T>
+    void premultiply (T * pixels, size_t count, float scale) {
+        for (size_t i = 0; i < count; i += 4) {
+            float a = pixels[i + 3] * scale;
+            for (int c = 0; c < 3; c++)
+                pixels[i + c] = (T)(pixels[i + c] * a);
+        }
+    }
+
+    void premultiply8 (uint8_t * pixels, size_t count) {
+        for (size_t i = 0; i < count; i += 4) {
+            uint32_t a = pixels[i + 3];
+            for (int c = 0; c < 3; c++)
+                pixels[i + c] = (uint8_t)(pixels[i + c] * a / 255);
+        }
+    }
+
+    const char * decode (const stbn_decode_desc & desc, stbn_decode_result & result) {
+        int info_w, info_h, components;
+        if (!stbi_info_from_memory(desc.buffer, desc.length, &info_w, &info_h, &components))
+            return stbi_failure_reason();
+
+        int format = desc.format;
+        if (((format == STBN_DECODE_U16) || (format == STBN_DECODE_F16)) && !stbi_is_16_bit_from_memory(desc.buffer, desc.length))
+            format = STBN_DECODE_U8;
+
+        int channels = desc.desired_channels;
+        if (desc.flags & STBN_DECODE_NATIVE_CHANNELS) {
+            if (components == 1)
+                channels = 1;
+            else if ((components == 2) && (desc.flags & STBN_DECODE_TWO_CHANNEL) && (format != STBN_DECODE_U8))
+                channels = 2;
+            else
+                channels = 4;
+        } else if ((channels < 0) || (channels > 4))
+            return "invalid channel count";
+        else if (channels == 0)
+            channels = components;
+
+        const bool to_linear = (desc.flags & STBN_DECODE_SRGB_TO_LINEAR) != 0,
+            from_linear = (desc.flags & STBN_DECODE_SRGB_FROM_LINEAR) != 0,
+            premultiply_alpha = (desc.flags & STBN_DECODE_PREMULTIPLY) != 0;
+        if ((to_linear || from_linear) && ((format == STBN_DECODE_U16) || ((format == STBN_DECODE_F16) && from_linear)))
+            return "color space conversion not supported for this format";
+
+        void * pixels;
+        int w, h, n;
+        switch (format) {
+            case STBN_DECODE_U16:
+                pixels = stbi_load_16_from_memory(desc.buffer, desc.length, &w, &h, &n, channels);
+                break;
+            case STBN_DECODE_F32:
+                pixels = stbi_loadf_from_memory(desc.buffer, desc.length, &w, &h, &n, channels);
+                break;
+            case STBN_DECODE_F16:
+                pixels = stbn_load_half_from_memory(
+                    desc.buffer, desc.length, &w, &h, &n, channels,
+                    (premultiply_alpha ? STBN_HALF_PREMULTIPLY : 0) | (to_linear ? STBN_HALF_LINEARIZE : 0)
+                );
+                break;
+            default:
+                pixels = stbi_load_from_memory(desc.buffer, desc.length, &w, &h, &n, channels);
+                break;
+        }
+        if (!pixels)
+            return stbi_failure_reason();
+
+        // Same rules as the managed loader: only RGBA is premultiplied, unless the color space
+        //  conversion can fuse it in. Half floats were handled during decode.
+        const size_t count = (size_t)w * h * channels;
+        const int cs_flags = premultiply_alpha ? STBN_COLORSPACE_PREMULTIPLY : 0;
+        if (format == STBN_DECODE_U8) {
+            uint8_t * p = (uint8_t *)pixels;
+            if (to_linear)
+                stbn_srgb8_to_linear8(p, 0, p, 0, w, h, channels, cs_flags);
+            else if (from_linear)
+                stbn_linear8_to_srgb8(p, 0, p, 0, w, h, channels, cs_flags);
+            else if (premultiply_alpha && (channels == 4))
+                premultiply8(p, count);
+        } else if (format == STBN_DECODE_F32) {
+            float * p = (float *)pixels;
+            if (to_linear)
+                stbn_srgbf_to_linearf(p, 0, p, 0, w, h, channels, cs_flags);
+            else if (from_linear)
+                stbn_linearf_to_srgbf(p, 0, p, 0, w, h, channels, cs_flags);
+            else if (premultiply_alpha && (channels == 4))
+                premultiply((float *)pixels, count, 1.0f);
+        } else if ((format == STBN_DECODE_U16) && premultiply_alpha && (channels == 4)) {
+            premultiply((uint16_t *)pixels, count, 1.0f / 65535.0f);
+        }
+
+        result.pixels = pixels;
+        result.width = w;
+        result.height = h;
+        result.channels_in_file = n;
+        result.channels = channels;
+        result.format = format;
+        return nullptr;
+    }
+
+    void decode_one (void * userdata, int index) {
+        const batch & b = *(const batch *)userdata;
+        stbn_decode_result & result = b.results[index];
+        const char * error = decode(b.descs[index], result);
+        if (error) {
+            result.pixels = nullptr;
+            result.failure_reason = error;
+        }
+        std::atomic_thread_fence(std::memory_order_release);
+        result.status = error ? STBN_DECODE_FAILED : STBN_DECODE_OK;
+
+        if (b.callback)
+            b.callback(b.userdata, index, &result);
+    }
+
+    void batch_done (void * userdata) {
+        batch * b = (batch *)userdata;
+        if (b->callback)
+            b->callback(b->userdata, -1, nullptr);
+        delete[] b->descs;
+        delete b;
+    }
+}
+
+// Starts decoding count images on the worker pool and returns immediately. The descriptors
+//  are copied, but each buffer has to stay alive until its image is done, and results has to
+//  stay alive until the whole batch is done. Progress can be tracked through the callback
+//  (optional) or by polling the status of each result.
+// Returns 0 if the arguments are invalid, in which case nothing was started.
+STBNDEF int stbn_decode_batch (
+    const stbn_decode_desc * descs, stbn_decode_result * results, int count,
+    stbn_decode_callback callback, void * userdata
+) {
+    if (!descs || !results || (count < 0))
+        return 0;
+
+    batch * b = new batch;
+    b->descs = new stbn_decode_desc[count];
+    memcpy(b->descs, descs, sizeof(stbn_decode_desc) * count);
+    b->results = results;
+    b->callback = callback;
+    b->userdata = userdata;
+    memset(results, 0, sizeof(stbn_decode_result) * count);
+
+    stbn_parallel_for_async(count, decode_one, b, batch_done, b);
+    return 1;
+}
@@ -0,0 +1,399 @@
+#include "stbnative.h"
+#include "colorspace.h"
+#include "cpu.h"
+#include "srgb.h"
+#include "threads.h"
+#include <immintrin.h>
+#include <string.h>
+
+// sRGB <-> linear conversion for decoded images, optionally fused with premultiplication.
+// 8-bit sources go through the lookup tables in srgb.h. Float data uses a polynomial
+//  approximation of pow (relative error around 2e-6), vectorized with SSE2 or AVX2+FMA.
+// Alpha is always linear, so it's left alone; premultiplication happens in linear space,
+//  after linearizing or before encoding to sRGB.
+
+namespace {
+    typedef void (*row_fn) (const void * src, void * dest, int pixels, int channels, int flags);
+
+    inline bool has_alpha (int channels) {
+        return (channels == 2) || (channels == 4);
+    }
+
+    // 8-bit kernels
+
+    void srgb8_to_linear8_row (const void * src, void * dest, int pixels, int channels, int flags) {
+        const uint8_t * s = (const uint8_t *)src;
+        uint8_t * d = (uint8_t *)dest;
+        const int count = pixels * channels;
+        if (!has_alpha(channels)) {
+            for (int i = 0; i < count; i++)
+                d[i] = stbn_srgb.to_linear8[s[i]];
+            return;
+        }
+
+        const int a = channels - 1;
+        for (int i = 0; i < count; i += channels) {
+            uint32_t alpha = s[i + a];
+            if (flags & STBN_COLORSPACE_PREMULTIPLY) {
+                for (int c = 0; c < a; c++)
+                    d[i + c] = (uint8_t)((stbn_srgb.to_linear16[s[i + c]] * alpha + 32767) / 65535);
+            } else {
+                for (int c = 0; c < a; c++)
+                    d[i + c] = stbn_srgb.to_linear8[s[i + c]];
+            }
+            d[i + a] = (uint8_t)alpha;
+        }
+    }
+
+    void linear8_to_srgb8_row (const void * src, void * dest, int pixels, int channels, int flags) {
+        const uint8_t * s = (const uint8_t *)src;
+        uint8_t * d = (uint8_t *)dest;
+        const int count = pixels * channels;
+        if (!has_alpha(channels) || !(flags & STBN_COLORSPACE_PREMULTIPLY)) {
+            const int a = has_alpha(channels) ? channels - 1 : channels;
+            for (int i = 0; i < count; i += channels)
+                for (int c = 0; c < a; c++)
+                    d[i + c] = stbn_linear16_to_srgb(s[i + c] * 257u);
+            if (a != channels)
+                for (int i = a; i < count; i += channels)
+                    d[i] = s[i];
+            return;
+        }
+
+        const int a = channels - 1;
+        for (int i = 0; i < count; i += channels) {
+            uint32_t alpha = s[i + a];
+            for (int c = 0; c < a; c++)
+                d[i + c] = stbn_linear16_to_srgb((s[i + c] * alpha * 257u + 127) / 255);
+            d[i + a] = (uint8_t)alpha;
+        }
+    }
+
+    void srgb8_to_linear16_row (const void * src, void * dest, int pixels, int channels, int flags) {
+        const uint8_t * s = (const uint8_t *)src;
+        uint16_t * d = (uint16_t *)dest;
+        const int count = pixels * channels;
+        const bool premultiply = has_alpha(channels) && (flags & STBN_COLORSPACE_PREMULTIPLY);
+        const int a = has_alpha(channels) ? channels - 1 : channels;
+        for (int i = 0; i < count; i += channels) {
+            uint32_t alpha = (a != channels) ? s[i + a] : 255;
+            for (int c = 0; c < a; c++) {
+                uint32_t l = stbn_srgb.to_linear16[s[i + c]];
+                d[i + c] = (uint16_t)(premultiply ? (l * alpha + 127) / 255 : l);
+            }
+            if (a != channels)
+                d[i + a] = (uint16_t)(alpha * 257);
+        }
+    }
+
+    void srgb8_to_linearf_row (const void * src, void * dest, int pixels, int channels, int flags) {
+        const uint8_t * s = (const uint8_t *)src;
+        float * d = (float *)dest;
+        const int count = pixels * channels;
+        const bool premultiply = has_alpha(channels) && (flags & STBN_COLORSPACE_PREMULTIPLY);
+        const int a = has_alpha(channels) ? channels - 1 : channels;
+        for (int i = 0; i < count; i += channels) {
+            float alpha = (a != channels) ? s[i + a] * (1.0f / 255.0f) : 1.0f;
+            for (int c = 0; c < a; c++)
+                d[i + c] = premultiply ? stbn_srgb.to_linearf[s[i + c]] * alpha : stbn_srgb.to_linearf[s[i + c]];
+            if (a != channels)
+                d[i + a] = alpha;
+        }
+    }
+
+    void linearf_to_srgb8_row (const void * src, void * dest, int pixels, int channels, int flags) {
+        const float * s = (const float *)src;
+        uint8_t * d = (uint8_t *)dest;
+        const int count = pixels * channels;
+        const bool premultiply = has_alpha(channels) && (flags & STBN_COLORSPACE_PREMULTIPLY);
+        const int a = has_alpha(channels) ? channels - 1 : channels;
+        for (int i = 0; i < count; i += channels) {
+            float alpha = (a != channels) ? s[i + a] : 1.0f;
+            for (int c = 0; c < a; c++)
+                d[i + c] = stbn_linearf_to_srgb(premultiply ? s[i + c] * alpha : s[i + c]);
+            if (a != channels) {
+                float clamped = alpha > 0 ? (alpha < 1 ? alpha : 1) : 0;
+                d[i + a] = (uint8_t)(clamped * 255.0f + 0.5f);
+            }
+        }
+    }
+
+    // Float kernels. pow(x, y) is evaluated as exp2(y * log2(x)) with minimax-ish polynomials
+    //  for log2 on the mantissa and exp2 on the fractional part of the exponent.
+
+    const float log2_poly[] = {
+        1.4426929832052033f, -0.7211440921784723f, 0.477496363681335f, -0.3383771976574389f,
+        0.21394321218015463f, -0.0946268097370113f, 0.020016649997648156f
+    };
+    const float exp2_poly[] = {
+        0.9999998983500243f, 0.693154489663232f, 0.2401418182014339f, 0.05586033707727633f,
+        0.008949590423301283f, 0.00189375405821825f
+    };
+
+    struct transfer {
+        // Values at or below threshold use the linear segment
+        float threshold, linear_scale, exponent, pre_scale, pre_offset, post_scale, post_offset;
+    };
+
+    // ((x + 0.055) / 1.055) ^ 2.4
+    const transfer to_linear_transfer = {
+        0.04045f, 1.0f / 12.92f, 2.4f, 1.0f / 1.055f, 0.055f / 1.055f, 1.0f, 0.0f
+    };
+    // 1.055 * x ^ (1 / 2.4) - 0.055
+    const transfer to_srgb_transfer = {
+        0.0031308f, 12.92f, 1.0f / 2.4f, 1.0f, 0.0f, 1.055f, -0.055f
+    };
+
+    // Lanes that are never alpha get 0, alpha lanes get all ones. Periods of 1, 2 and 4 line
+    //  up with both 4- and 8-wide vectors, and 3-channel images have no alpha.
+    int alpha_lane_bits (int channels) {
+        if (channels == 4)
+            return 0x88;
+        else if (channels == 2)
+            return 0xAA;
+        else
+            return 0;
+    }
+
+    __m128 sse_lane_mask (int bits) {
+        return _mm_castsi128_ps(_mm_set_epi32(
+            (bits & 8) ? -1 : 0, (bits & 4) ? -1 : 0, (bits & 2) ? -1 : 0, (bits & 1) ? -1 : 0
+        ));
+    }
+
+    inline __m128 sse_select (__m128 mask, __m128 a, __m128 b) {
+        return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+    }
+
+    inline __m128 sse_pow (__m128 x, __m128 y) {
+        // log2(x) = exponent + log2(mantissa), mantissa in [1, 2)
+        __m128i bits = _mm_castps_si128(_mm_max_ps(x, _mm_set1_ps(1e-30f)));
+        __m128 e = _mm_cvtepi32_ps(_mm_sub_epi32(_mm_srli_epi32(bits, 23), _mm_set1_epi32(127))),
+            t = _mm_sub_ps(_mm_castsi128_ps(_mm_or_si128(
+                _mm_and_si128(bits, _mm_set1_epi32(0x007FFFFF)), _mm_set1_epi32(0x3F800000)
+            )), _mm_set1_ps(1.0f));
+        __m128 p = _mm_set1_ps(log2_poly[6]);
+        for (int i = 5; i >= 0; i--)
+            p = _mm_add_ps(_mm_mul_ps(p, t), _mm_set1_ps(log2_poly[i]));
+        __m128 l = _mm_mul_ps(_mm_add_ps(e, _mm_mul_ps(p, t)), y);
+
+        // exp2(l) = 2^floor(l) * exp2(fraction)
+        l = _mm_min_ps(_mm_max_ps(l, _mm_set1_ps(-126.0f)), _mm_set1_ps(126.0f));
+        __m128i i = _mm_cvttps_epi32(l);
+        __m128 fi = _mm_cvtepi32_ps(i);
+        // Truncation rounds negative values up
+        __m128 adjust = _mm_and_ps(_mm_cmpgt_ps(fi, l), _mm_set1_ps(1.0f));
+        fi = _mm_sub_ps(fi, adjust);
+        i = _mm_cvtps_epi32(fi);
+        __m128 f = _mm_sub_ps(l, fi);
+        __m128 q = _mm_set1_ps(exp2_poly[5]);
+        for (int k = 4; k >= 0; k--)
+            q = _mm_add_ps(_mm_mul_ps(q, f), _mm_set1_ps(exp2_poly[k]));
+        __m128 scale = _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(i, _mm_set1_epi32(127)), 23));
+        return _mm_mul_ps(q, scale);
+    }
+
+    // to_linear: convert, then premultiply. Otherwise premultiply, then convert.
+    inline __m128 sse_convert (__m128 v, __m128 alpha_mask, int premultiply_shuffle, bool to_linear, const transfer & tf) {
+        __m128 original = v, alpha = v;
+        if (premultiply_shuffle)
+            alpha = premultiply_shuffle == 4
+                ? _mm_shuffle_ps(original, original, _MM_SHUFFLE(3, 3, 3, 3))
+                : _mm_shuffle_ps(original, original, _MM_SHUFFLE(3, 3, 1, 1));
+        if (premultiply_shuffle && !to_linear)
+            v = _mm_mul_ps(v, alpha);
+
+        __m128 curved = _mm_add_ps(_mm_mul_ps(
+            sse_pow(_mm_add_ps(_mm_mul_ps(v, _mm_set1_ps(tf.pre_scale)), _mm_set1_ps(tf.pre_offset)), _mm_set1_ps(tf.exponent)),
+            _mm_set1_ps(tf.post_scale)
+        ), _mm_set1_ps(tf.post_offset));
+        __m128 result = sse_select(_mm_cmple_ps(v, _mm_set1_ps(tf.threshold)), _mm_mul_ps(v, _mm_set1_ps(tf.linear_scale)), curved);
+
+        if (premultiply_shuffle && to_linear)
+            result = _mm_mul_ps(result, alpha);
+        return sse_select(alpha_mask, original, result);
+    }
+
+    void convert_float_sse (float * values, int count, int channels, int flags, bool to_linear) {
+        const transfer & tf = to_linear ? to_linear_transfer : to_srgb_transfer;
+        const __m128 alpha_mask = sse_lane_mask(alpha_lane_bits(channels) & 0xF);
+        const int premultiply_shuffle = (has_alpha(channels) && (flags & STBN_COLORSPACE_PREMULTIPLY)) ? channels : 0;
+        int i = 0;
+        for (; i + 4 <= count; i += 4)
+            _mm_storeu_ps(values + i, sse_convert(_mm_loadu_ps(values + i), alpha_mask, premultiply_shuffle, to_linear, tf));
+
+        // The remainder is always whole pixels, since 4 is a multiple of the alpha period
+        if (i < count) {
+            float tail[4] = { 0, 0, 0, 0 };
+            memcpy(tail, values + i, (count - i) * sizeof(float));
+            _mm_storeu_ps(tail, sse_convert(_mm_loadu_ps(tail), alpha_mask, premultiply_shuffle, to_linear, tf));
+            memcpy(values + i, tail, (count - i) * sizeof(float));
+        }
+    }
+
+    STBN_TARGET("avx2,fma") __m256 avx_pow (__m256 x, __m256 y) {
+        __m256i bits = _mm256_castps_si256(_mm256_max_ps(x, _mm256_set1_ps(1e-30f)));
+        __m256 e = _mm256_cvtepi32_ps(_mm256_sub_epi32(_mm256_srli_epi32(bits, 23), _mm256_set1_epi32(127))),
+            t = _mm256_sub_ps(_mm256_castsi256_ps(_mm256_or_si256(
+                _mm256_and_si256(bits, _mm256_set1_epi32(0x007FFFFF)), _mm256_set1_epi32(0x3F800000)
+            )), _mm256_set1_ps(1.0f));
+        __m256 p = _mm256_set1_ps(log2_poly[6]);
+        for (int i = 5; i >= 0; i--)
+            p = _mm256_fmadd_ps(p, t, _mm256_set1_ps(log2_poly[i]));
+        __m256 l = _mm256_mul_ps(_mm256_fmadd_ps(p, t, e), y);
+
+        l = _mm256_min_ps(_mm256_max_ps(l, _mm256_set1_ps(-126.0f)), _mm256_set1_ps(126.0f));
+        __m256 fi = _mm256_floor_ps(l), f = _mm256_sub_ps(l, fi);
+        __m256 q = _mm256_set1_ps(exp2_poly[5]);
+        for (int k = 4; k >= 0; k--)
+            q = _mm256_fmadd_ps(q, f, _mm256_set1_ps(exp2_poly[k]));
+        __m256i i = _mm256_cvtps_epi32(fi);
+        __m256 scale = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_add_epi32(i, _mm256_set1_epi32(127)), 23));
+        return _mm256_mul_ps(q, scale);
+    }
+
+    // to_linear: convert, then premultiply. Otherwise premultiply, then convert.
+    STBN_TARGET("avx2,fma") __m256 avx_convert (__m256 v, __m256 alpha_mask, int premultiply_shuffle, bool to_linear, const transfer & tf) {
+        __m256 original = v, alpha = v;
+        if (premultiply_shuffle)
+            alpha = premultiply_shuffle == 4
+                ? _mm256_shuffle_ps(original, original, _MM_SHUFFLE(3, 3, 3, 3))
+                : _mm256_shuffle_ps(original, original, _MM_SHUFFLE(3, 3, 1, 1));
+        if (premultiply_shuffle && !to_linear)
+            v = _mm256_mul_ps(v, alpha);
+
+        __m256 curved = _mm256_fmadd_ps(
+            avx_pow(_mm256_fmadd_ps(v, _mm256_set1_ps(tf.pre_scale), _mm256_set1_ps(tf.pre_offset)), _mm256_set1_ps(tf.exponent)),
+            _mm256_set1_ps(tf.post_scale), _mm256_set1_ps(tf.post_offset)
+        );
+        __m256 result = _mm256_blendv_ps(
+            curved, _mm256_mul_ps(v, _mm256_set1_ps(tf.linear_scale)), _mm256_cmp_ps(v, _mm256_set1_ps(tf.threshold), _CMP_LE_OQ)
+        );
+
+        if (premultiply_shuffle && to_linear)
+            result = _mm256_mul_ps(result, alpha);
+        return _mm256_blendv_ps(result, original, alpha_mask);
+    }
+
+    STBN_TARGET("avx2,fma") void convert_float_avx2 (float * values, int count, int channels, int flags, bool to_linear) {
+        const transfer & tf = to_linear ? to_linear_transfer : to_srgb_transfer;
+        const int bits = alpha_lane_bits(channels);
+        const __m256 alpha_mask = _mm256_castsi256_ps(_mm256_set_epi32(
+            (bits & 128) ? -1 : 0, (bits & 64) ? -1 : 0, (bits & 32) ? -1 : 0, (bits & 16) ? -1 : 0,
+            (bits & 8) ? -1 : 0, (bits & 4) ? -1 : 0, (bits & 2) ? -1 : 0, (bits & 1) ? -1 : 0
+        ));
+        const int premultiply_shuffle = (has_alpha(channels) && (flags & STBN_COLORSPACE_PREMULTIPLY)) ? channels : 0;
+        int i = 0;
+        for (; i + 8 <= count; i += 8)
+            _mm256_storeu_ps(values + i, avx_convert(_mm256_loadu_ps(values + i), alpha_mask, premultiply_shuffle, to_linear, tf));
+
+        if (i < count) {
+            float tail[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+            memcpy(tail, values + i, (count - i) * sizeof(float));
+            _mm256_storeu_ps(tail, avx_convert(_mm256_loadu_ps(tail), alpha_mask, premultiply_shuffle, to_linear, tf));
+            memcpy(values + i, tail, (count - i) * sizeof(float));
+        }
+    }
+
+    void convert_float_row (const void * src, void * dest, int pixels, int channels, int flags, bool to_linear) {
+        const int count = pixels * channels;
+        if (src != dest)
+            memmove(dest, src, count * sizeof(float));
+        const stbn_cpu_features & cpu = stbn_get_cpu_features();
+        if (cpu.avx2 && cpu.fma)
+            convert_float_avx2((float *)dest, count, channels, flags, to_linear);
+        else
+            convert_float_sse((float *)dest, count, channels, flags, to_linear);
+    }
+
+    void srgbf_to_linearf_row (const void * src, void * dest, int pixels, int channels, int flags) {
+        convert_float_row(src, dest, pixels, channels, flags, true);
+    }
+
+    void linearf_to_srgbf_row (const void * src, void * dest, int pixels, int channels, int flags) {
+        convert_float_row(src, dest, pixels, channels, flags, false);
+    }
+
+    struct convert_job {
+        row_fn fn;
+        const uint8_t * src;
+        uint8_t * dest;
+        int src_stride, dest_stride, width, height, channels, flags, band_rows;
+    };
+
+    void convert_band (void * userdata, int band) {
+        const convert_job & job = *(const convert_job *)userdata;
+        const int first = band * job.band_rows,
+            last = (first + job.band_rows < job.height) ? first + job.band_rows : job.height;
+        for (int y = first; y < last; y++)
+            job.fn(job.src + (size_t)y * job.src_stride, job.dest + (size_t)y * job.dest_stride, job.width, job.channels, job.flags);
+    }
+
+    int run (
+        row_fn fn, const void * src, int src_stride, int src_size,
+        void * dest, int dest_stride, int dest_size,
+        int width, int height, int channels, int flags
+    ) {
+        if (!src || !dest || (width <= 0) || (height <= 0) || (channels < 1) || (channels > 4))
+            return 0;
+        // A stride of 0 means tightly packed rows
+        if (!src_stride)
+            src_stride = width * channels * src_size;
+        if (!dest_stride)
+            dest_stride = width * channels * dest_size;
+        if ((src_stride < width * channels * src_size) || (dest_stride < width * channels * dest_size))
+            return 0;
+
+        convert_job job;
+        job.fn = fn;
+        job.src = (const uint8_t *)src;
+        job.dest = (uint8_t *)dest;
+        job.src_stride = src_stride;
+        job.dest_stride = dest_stride;
+        job.width = width;
+        job.height = height;
+        job.channels = channels;
+        job.flags = flags & STBN_COLORSPACE_PREMULTIPLY;
+        // Float conversions are much more expensive per value, so they get smaller bands
+        int row_cost = width * channels * ((fn == srgbf_to_linearf_row) || (fn == linearf_to_srgbf_row) ? 8 : 1),
+            budget = 1 << 18;
+        job.band_rows = (row_cost >= budget) ? 1 : budget / row_cost;
+        stbn_parallel_for((height + job.band_rows - 1) / job.band_rows, convert_band, &job);
+        return 1;
+    }
+}
+
+// All of these take 1-4 channel images, with alpha in the last channel of 2- and 4-channel
+//  images. Strides are in bytes, and 0 means the rows are tightly packed.
+// flags can include STBN_COLORSPACE_PREMULTIPLY. Returns 0 if the arguments are invalid.
+
+// In place is fine for the same-size conversions (src == dest with equal strides).
+STBNDEF int stbn_srgb8_to_linear8 (const uint8_t * src, int src_stride, uint8_t * dest, int dest_stride, int width, int height, int channels, int flags) {
+    return run(srgb8_to_linear8_row, src, src_stride, 1, dest, dest_stride, 1, width, height, channels, flags);
+}
+
+STBNDEF int stbn_linear8_to_srgb8 (const uint8_t * src, int src_stride, uint8_t * dest, int dest_stride, int width, int height, int channels, int flags) {
+    return run(linear8_to_srgb8_row, src, src_stride, 1, dest, dest_stride, 1, width, height, channels, flags);
+}
+
+STBNDEF int stbn_srgb8_to_linear16 (const uint8_t * src, int src_stride, uint16_t * dest, int dest_stride, int width, int height, int channels, int flags) {
+    return run(srgb8_to_linear16_row, src, src_stride, 1, dest, dest_stride, 2, width, height, channels, flags);
+}
+
+STBNDEF int stbn_srgb8_to_linearf (const uint8_t * src, int src_stride, float * dest, int dest_stride, int width, int height, int channels, int flags) {
+    return run(srgb8_to_linearf_row, src, src_stride, 1, dest, dest_stride, 4, width, height, channels, flags);
+}
+
+// Values outside of [0, 1] are clamped.
+STBNDEF int stbn_linearf_to_srgb8 (const float * src, int src_stride, uint8_t * dest, int dest_stride, int width, int height, int channels, int flags) {
+    return run(linearf_to_srgb8_row, src, src_stride, 4, dest, dest_stride, 1, width, height, channels, flags);
+}
+
+// Values above 1 follow the curve, so HDR data survives.
+STBNDEF int stbn_srgbf_to_linearf (const float * src, int src_stride, float * dest, int dest_stride, int width, int height, int channels, int flags) {
+    return run(srgbf_to_linearf_row, src, src_stride, 4, dest, dest_stride, 4, width, height, channels, flags);
+}
+
+STBNDEF int stbn_linearf_to_srgbf (const float * src, int src_stride, float * dest, int dest_stride, int width, int height, int channels, int flags) {
+    return run(linearf_to_srgbf_row, src, src_stride, 4, dest, dest_stride, 4, width, height, channels, flags);
+}
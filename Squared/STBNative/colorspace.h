@@ -0,0 +1,17 @@
+#pragma once
+
+#include <stdint.h>
+
+// sRGB <-> linear conversion kernels (see colorspace.cpp). Include after stbnative.h.
+
+enum {
+    STBN_COLORSPACE_PREMULTIPLY = 1,
+};
+
+STBNDEF int stbn_srgb8_to_linear8 (const uint8_t * src, int src_stride, uint8_t * dest, int dest_stride, int width, int height, int channels, int flags);
+STBNDEF int stbn_linear8_to_srgb8 (const uint8_t * src, int src_stride, uint8_t * dest, int dest_stride, int width, int height, int channels, int flags);
+STBNDEF int stbn_srgb8_to_linear16 (const uint8_t * src, int src_stride, uint16_t * dest, int dest_stride, int width, int height, int channels, int flags);
+STBNDEF int stbn_srgb8_to_linearf (const uint8_t * src, int src_stride, float * dest, int dest_stride, int width, int height, int channels, int flags);
+STBNDEF int stbn_linearf_to_srgb8 (const float * src, int src_stride, uint8_t * dest, int dest_stride, int width, int height, int channels, int flags);
+STBNDEF int stbn_srgbf_to_linearf (const float * src, int src_stride, float * dest, int dest_stride, int width, int height, int channels, int flags);
+STBNDEF int stbn_linearf_to_srgbf (const float * src, int src_stride, float * dest, int dest_stride, int width, int height, int channels, int flags);
@@ -0,0 +1,63 @@
+#include "cpu.h"
+#include <stdint.h>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+
+static void cpuid (int leaf, int subleaf, int result[4]) {
+#if defined(_MSC_VER)
+    __cpuidex(result, leaf, subleaf);
+#else
+    unsigned a, b, c, d;
+    __cpuid_count(leaf, subleaf, a, b, c, d);
+    result[0] = (int)a; result[1] = (int)b; result[2] = (int)c; result[3] = (int)d;
+#endif
+}
+
+static uint64_t xgetbv0 () {
+#if defined(_MSC_VER)
+    return _xgetbv(0);
+#else
+    uint32_t lo, hi;
+    __asm__ volatile ("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+    return ((uint64_t)hi << 32) | lo;
+#endif
+}
+
+static stbn_cpu_features detect () {
+    stbn_cpu_features result = {};
+    int info[4];
+
+    cpuid(0, 0, info);
+    int max_leaf = info[0];
+    if (max_leaf < 1)
+        return result;
+
+    cpuid(1, 0, info);
+    bool osxsave = (info[2] & (1 << 27)) != 0,
+        avx = (info[2] & (1 << 28)) != 0;
+    result.sse41 = (info[2] & (1 << 19)) != 0;
+
+    // AVX state has to be enabled by the OS before any VEX-encoded instruction is safe
+    bool ymm_enabled = osxsave && avx && ((xgetbv0() & 6) == 6);
+    if (!ymm_enabled)
+        return result;
+
+    result.fma = (info[2] & (1 << 12)) != 0;
+    result.f16c = (info[2] & (1 << 29)) != 0;
+
+    if (max_leaf >= 7) {
+        cpuid(7, 0, info);
+        result.avx2 = (info[1] & (1 << 5)) != 0;
+    }
+
+    return result;
+}
+
+const stbn_cpu_features & stbn_get_cpu_features () {
+    static const stbn_cpu_features features = detect();
+    return features;
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+// Runtime CPU feature detection for the SIMD kernels.
+// SSE2 is assumed everywhere; anything newer has to be checked before use.
+
+struct stbn_cpu_features {
+    bool sse41, avx2, fma, f16c;
+};
+
+const stbn_cpu_features & stbn_get_cpu_features ();
+
+// MSVC lets any function use any intrinsic. GCC and Clang need each function that uses
+//  instructions beyond the baseline to opt in explicitly.
+#if defined(__GNUC__) || defined(__clang__)
+#define STBN_TARGET(features) __attribute__((target(features)))
+#else
+#define STBN_TARGET(features)
+#endif
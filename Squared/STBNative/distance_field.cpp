@@ -0,0 +1,603 @@
+#include "stbnative.h"
+#include "distance_field.h"
+#include "threads.h"
+#include "cpu.h"
+#include <atomic>
+#include <immintrin.h>
+#include <math.h>
+#include <string.h>
+
+// Jump flooding (1+JFA) with the same step schedule and neighbor order as JumpFlood.CPU.cs.
+// Instead of a Vector4 per pixel, every pixel stores the offset to its nearest seed as a pair
+//  of int16s in separate x and y planes, plus an inside/outside byte. The squared distance is
+//  recomputed from the offset when it's needed, which SSE2 (AVX2) does for 8 (16) pixels at
+//  once with pmaddwd. Each pass is split into bands of rows that run on the worker pool.
+// Offsets always fit in an int16: nothing further than max_distance_squared away is accepted,
+//  and the largest step is 16384.
+
+namespace {
+    // Matches JumpFlood.MaxDistance
+    const int max_distance = 2048;
+    const int32_t max_distance_squared = 2 * max_distance * max_distance;
+    // Pixels that haven't found a seed yet
+    const int16_t no_seed = INT16_MIN;
+    // Roughly how many pixels each task processes per pass
+    const int band_pixels = 64 * 1024;
+
+    struct df_region {
+        int x, y, width, height;
+    };
+
+    bool clip_region (int width, int height, int x, int y, int region_width, int region_height, df_region & result) {
+        int x1 = (x + region_width < width) ? x + region_width : width,
+            y1 = (y + region_height < height) ? y + region_height : height;
+        result.x = (x > 0) ? x : 0;
+        result.y = (y > 0) ? y : 0;
+        result.width = (x1 > result.x) ? x1 - result.x : 0;
+        result.height = (y1 > result.y) ? y1 - result.y : 0;
+        return (result.width > 0) && (result.height > 0);
+    }
+
+    int get_band_rows (int width) {
+        return (width >= band_pixels) ? 1 : band_pixels / width;
+    }
+
+    int log2_ceiling (int value) {
+        int result = 0;
+        while ((1 << result) < value)
+            result++;
+        return result;
+    }
+
+    struct classify_job {
+        const uint8_t * input;
+        int format, stride;
+        df_region region;
+        // 0xFF inside, 0 outside
+        uint8_t * inside;
+        int band_rows;
+    };
+
+    void classify_band (void * userdata, int band) {
+        const classify_job & job = *(const classify_job *)userdata;
+        const int first = band * job.band_rows,
+            last = (first + job.band_rows < job.region.height) ? first + job.band_rows : job.region.height;
+        for (int y = first; y < last; y++) {
+            const size_t source_offset = (size_t)(y + job.region.y) * job.stride + job.region.x;
+            uint8_t * dest = job.inside + (size_t)y * job.region.width;
+            switch (job.format) {
+                case STBN_DF_INPUT_GRAY8: {
+                    const uint8_t * src = job.input + source_offset;
+                    for (int x = 0; x < job.region.width; x++)
+                        dest[x] = src[x] ? 0xFF : 0;
+                    break;
+                }
+                case STBN_DF_INPUT_RGBA8: {
+                    const uint8_t * src = job.input + source_offset * 4;
+                    for (int x = 0; x < job.region.width; x++)
+                        dest[x] = src[x * 4 + 3] ? 0xFF : 0;
+                    break;
+                }
+                case STBN_DF_INPUT_GRAY32F: {
+                    const float * src = (const float *)job.input + source_offset;
+                    for (int x = 0; x < job.region.width; x++)
+                        dest[x] = (src[x] > 0) ? 0xFF : 0;
+                    break;
+                }
+                case STBN_DF_INPUT_RGBA32F: {
+                    const float * src = (const float *)job.input + source_offset * 4;
+                    for (int x = 0; x < job.region.width; x++)
+                        dest[x] = (src[x * 4 + 3] > 0) ? 0xFF : 0;
+                    break;
+                }
+            }
+        }
+    }
+
+    bool check_arguments (const void * input, int input_format, int width, int height, const float * output) {
+        if (!input || !output || (width <= 0) || (height <= 0) || (input_format < STBN_DF_INPUT_GRAY8) || (input_format > STBN_DF_INPUT_RGBA32F))
+            return false;
+        // Jump flood steps are capped at 16384 so its offsets can't overflow, and column
+        //  distances in the exact transform are uint16s
+        return (width <= 65536) && (height <= 65536);
+    }
+
+    void classify (const void * input, int input_format, int stride, const df_region & region, uint8_t * inside) {
+        classify_job job;
+        job.input = (const uint8_t *)input;
+        job.format = input_format;
+        job.stride = stride;
+        job.region = region;
+        job.inside = inside;
+        job.band_rows = get_band_rows(region.width);
+        stbn_parallel_for((region.height + job.band_rows - 1) / job.band_rows, classify_band, &job);
+    }
+
+    inline float resolve_distance (int32_t distance_squared, bool inside) {
+        const float distance = sqrtf((float)((distance_squared < max_distance_squared) ? distance_squared : max_distance_squared));
+        return inside ? -distance : distance;
+    }
+
+    struct jump_job {
+        const uint8_t * inside;
+        const int16_t * in_x, * in_y;
+        int16_t * out_x, * out_y;
+        int width, height, step, band_rows;
+        bool avx2;
+    };
+
+    void jump_pixel (const jump_job & job, int x, int y) {
+        const size_t i = (size_t)y * job.width + x;
+        const uint8_t self_inside = job.inside[i];
+        int best_x = job.in_x[i], best_y = job.in_y[i];
+        int32_t best = (best_x == no_seed) ? max_distance_squared : (best_x * best_x) + (best_y * best_y);
+
+        for (int dy = -1; dy <= 1; dy++) {
+            const int ny = y + dy * job.step;
+            if ((ny < 0) || (ny >= job.height))
+                continue;
+            for (int dx = -1; dx <= 1; dx++) {
+                const int nx = x + dx * job.step;
+                if (((dx == 0) && (dy == 0)) || (nx < 0) || (nx >= job.width))
+                    continue;
+
+                const size_t n = (size_t)ny * job.width + nx;
+                int cx = dx * job.step, cy = dy * job.step;
+                // If we crossed an inside/outside boundary, the neighbor itself is the seed
+                if (job.inside[n] == self_inside) {
+                    if (job.in_x[n] == no_seed)
+                        continue;
+                    cx += job.in_x[n];
+                    cy += job.in_y[n];
+                }
+                const int32_t distance = (cx * cx) + (cy * cy);
+                if (distance < best) {
+                    best = distance;
+                    best_x = cx;
+                    best_y = cy;
+                }
+            }
+        }
+
+        job.out_x[i] = (int16_t)best_x;
+        job.out_y[i] = (int16_t)best_y;
+    }
+
+    inline __m128i select_si128 (__m128i mask, __m128i a, __m128i b) {
+        return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+    }
+
+    // Squared lengths of 8 int16 offsets, as two vectors of 4 int32s
+    inline void length_squared_x8 (__m128i x, __m128i y, __m128i & lo, __m128i & hi) {
+        const __m128i xy_lo = _mm_unpacklo_epi16(x, y), xy_hi = _mm_unpackhi_epi16(x, y);
+        lo = _mm_madd_epi16(xy_lo, xy_lo);
+        hi = _mm_madd_epi16(xy_hi, xy_hi);
+    }
+
+    inline __m128i load_inside_x8 (const uint8_t * p) {
+        const __m128i bytes = _mm_loadl_epi64((const __m128i *)p);
+        return _mm_unpacklo_epi8(bytes, bytes);
+    }
+
+    // Whether the neighbors step away from every pixel in [x, x + count) are all in bounds
+    //  horizontally (valid[0] to the left, valid[2] to the right). Returns false if only some
+    //  of them are, in which case the group has to go through jump_pixel.
+    inline bool get_column_validity (const jump_job & job, int x, int count, bool valid[3]) {
+        valid[0] = x - job.step >= 0;
+        valid[1] = true;
+        valid[2] = x + count - 1 + job.step < job.width;
+        return (valid[0] || (x + count - 1 - job.step < 0)) && (valid[2] || (x + job.step >= job.width));
+    }
+
+    // Processes the rest of the row from x 8 pixels at a time, returning where it stopped.
+    // Neighbors that are off the edge for all 8 pixels are skipped.
+    int jump_row_sse2 (const jump_job & job, int y, int x) {
+        const __m128i v_no_seed = _mm_set1_epi16(no_seed), v_max = _mm_set1_epi32(max_distance_squared);
+        const bool row_valid[3] = { y - job.step >= 0, true, y + job.step < job.height };
+
+        for (; x + 8 <= job.width; x += 8) {
+            bool column_valid[3];
+            if (!get_column_validity(job, x, 8, column_valid)) {
+                for (int i = 0; i < 8; i++)
+                    jump_pixel(job, x + i, y);
+                continue;
+            }
+            const size_t i = (size_t)y * job.width + x;
+            const __m128i self_inside = load_inside_x8(job.inside + i);
+            __m128i best_x = _mm_loadu_si128((const __m128i *)(job.in_x + i)),
+                best_y = _mm_loadu_si128((const __m128i *)(job.in_y + i)),
+                best_lo, best_hi;
+            length_squared_x8(best_x, best_y, best_lo, best_hi);
+            const __m128i none = _mm_cmpeq_epi16(best_x, v_no_seed);
+            best_lo = select_si128(_mm_unpacklo_epi16(none, none), v_max, best_lo);
+            best_hi = select_si128(_mm_unpackhi_epi16(none, none), v_max, best_hi);
+
+            for (int dy = -1; dy <= 1; dy++) {
+                if (!row_valid[dy + 1])
+                    continue;
+                for (int dx = -1; dx <= 1; dx++) {
+                    if (((dx == 0) && (dy == 0)) || !column_valid[dx + 1])
+                        continue;
+
+                    const size_t n = i + ((ptrdiff_t)dy * job.width + dx) * job.step;
+                    const __m128i n_x = _mm_loadu_si128((const __m128i *)(job.in_x + n)),
+                        n_y = _mm_loadu_si128((const __m128i *)(job.in_y + n)),
+                        same = _mm_cmpeq_epi16(load_inside_x8(job.inside + n), self_inside),
+                        // Neighbors on our side of the boundary without a seed have nothing to offer
+                        skip = _mm_and_si128(same, _mm_cmpeq_epi16(n_x, v_no_seed)),
+                        c_x = _mm_add_epi16(_mm_set1_epi16((int16_t)(dx * job.step)), _mm_and_si128(same, n_x)),
+                        c_y = _mm_add_epi16(_mm_set1_epi16((int16_t)(dy * job.step)), _mm_and_si128(same, n_y));
+
+                    __m128i d_lo, d_hi;
+                    length_squared_x8(c_x, c_y, d_lo, d_hi);
+                    const __m128i closer = _mm_packs_epi32(_mm_cmplt_epi32(d_lo, best_lo), _mm_cmplt_epi32(d_hi, best_hi)),
+                        take = _mm_andnot_si128(skip, closer);
+                    best_x = select_si128(take, c_x, best_x);
+                    best_y = select_si128(take, c_y, best_y);
+                    best_lo = select_si128(_mm_unpacklo_epi16(take, take), d_lo, best_lo);
+                    best_hi = select_si128(_mm_unpackhi_epi16(take, take), d_hi, best_hi);
+                }
+            }
+
+            _mm_storeu_si128((__m128i *)(job.out_x + i), best_x);
+            _mm_storeu_si128((__m128i *)(job.out_y + i), best_y);
+        }
+
+        return x;
+    }
+
+    STBN_TARGET("avx2") inline void length_squared_x16 (__m256i x, __m256i y, __m256i & lo, __m256i & hi) {
+        const __m256i xy_lo = _mm256_unpacklo_epi16(x, y), xy_hi = _mm256_unpackhi_epi16(x, y);
+        lo = _mm256_madd_epi16(xy_lo, xy_lo);
+        hi = _mm256_madd_epi16(xy_hi, xy_hi);
+    }
+
+    // Same as jump_row_sse2, 16 pixels at a time. The unpacks and packs all stay within 128-bit
+    //  lanes, so pixels come back out in the order they went in.
+    STBN_TARGET("avx2") int jump_row_avx2 (const jump_job & job, int y) {
+        const __m256i v_no_seed = _mm256_set1_epi16(no_seed), v_max = _mm256_set1_epi32(max_distance_squared);
+        const bool row_valid[3] = { y - job.step >= 0, true, y + job.step < job.height };
+
+        int x = 0;
+        for (; x + 16 <= job.width; x += 16) {
+            bool column_valid[3];
+            if (!get_column_validity(job, x, 16, column_valid)) {
+                for (int i = 0; i < 16; i++)
+                    jump_pixel(job, x + i, y);
+                continue;
+            }
+
+            const size_t i = (size_t)y * job.width + x;
+            const __m256i self_inside = _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i *)(job.inside + i)));
+            __m256i best_x = _mm256_loadu_si256((const __m256i *)(job.in_x + i)),
+                best_y = _mm256_loadu_si256((const __m256i *)(job.in_y + i)),
+                best_lo, best_hi;
+            length_squared_x16(best_x, best_y, best_lo, best_hi);
+            const __m256i none = _mm256_cmpeq_epi16(best_x, v_no_seed);
+            best_lo = _mm256_blendv_epi8(best_lo, v_max, _mm256_unpacklo_epi16(none, none));
+            best_hi = _mm256_blendv_epi8(best_hi, v_max, _mm256_unpackhi_epi16(none, none));
+
+            for (int dy = -1; dy <= 1; dy++) {
+                if (!row_valid[dy + 1])
+                    continue;
+                for (int dx = -1; dx <= 1; dx++) {
+                    if (((dx == 0) && (dy == 0)) || !column_valid[dx + 1])
+                        continue;
+
+                    const size_t n = i + ((ptrdiff_t)dy * job.width + dx) * job.step;
+                    const __m256i n_x = _mm256_loadu_si256((const __m256i *)(job.in_x + n)),
+                        n_y = _mm256_loadu_si256((const __m256i *)(job.in_y + n)),
+                        same = _mm256_cmpeq_epi16(_mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i *)(job.inside + n))), self_inside),
+                        skip = _mm256_and_si256(same, _mm256_cmpeq_epi16(n_x, v_no_seed)),
+                        c_x = _mm256_add_epi16(_mm256_set1_epi16((int16_t)(dx * job.step)), _mm256_and_si256(same, n_x)),
+                        c_y = _mm256_add_epi16(_mm256_set1_epi16((int16_t)(dy * job.step)), _mm256_and_si256(same, n_y));
+
+                    __m256i d_lo, d_hi;
+                    length_squared_x16(c_x, c_y, d_lo, d_hi);
+                    const __m256i closer = _mm256_packs_epi32(_mm256_cmpgt_epi32(best_lo, d_lo), _mm256_cmpgt_epi32(best_hi, d_hi)),
+                        take = _mm256_andnot_si256(skip, closer);
+                    best_x = _mm256_blendv_epi8(best_x, c_x, take);
+                    best_y = _mm256_blendv_epi8(best_y, c_y, take);
+                    best_lo = _mm256_blendv_epi8(best_lo, d_lo, _mm256_unpacklo_epi16(take, take));
+                    best_hi = _mm256_blendv_epi8(best_hi, d_hi, _mm256_unpackhi_epi16(take, take));
+                }
+            }
+
+            _mm256_storeu_si256((__m256i *)(job.out_x + i), best_x);
+            _mm256_storeu_si256((__m256i *)(job.out_y + i), best_y);
+        }
+
+        return x;
+    }
+
+    void jump_band (void * userdata, int band) {
+        const jump_job & job = *(const jump_job *)userdata;
+        const int first = band * job.band_rows,
+            last = (first + job.band_rows < job.height) ? first + job.band_rows : job.height;
+        for (int y = first; y < last; y++) {
+            int x = job.avx2 ? jump_row_avx2(job, y) : 0;
+            for (x = jump_row_sse2(job, y, x); x < job.width; x++)
+                jump_pixel(job, x, y);
+        }
+    }
+
+    struct resolve_job {
+        const uint8_t * inside;
+        const int16_t * seed_x, * seed_y;
+        df_region region;
+        int stride, band_rows;
+        float * output;
+    };
+
+    void resolve_band (void * userdata, int band) {
+        const resolve_job & job = *(const resolve_job *)userdata;
+        const int first = band * job.band_rows,
+            last = (first + job.band_rows < job.region.height) ? first + job.band_rows : job.region.height;
+        for (int y = first; y < last; y++) {
+            const size_t i = (size_t)y * job.region.width;
+            float * dest = job.output + (size_t)(y + job.region.y) * job.stride + job.region.x;
+            for (int x = 0; x < job.region.width; x++) {
+                const int sx = job.seed_x[i + x], sy = job.seed_y[i + x];
+                dest[x] = resolve_distance((sx == no_seed) ? max_distance_squared : (sx * sx) + (sy * sy), job.inside[i + x] != 0);
+            }
+        }
+    }
+
+    // Exact Euclidean distance transform (Felzenszwalb & Huttenlocher, "Distance Transforms of
+    //  Sampled Functions"), run once towards inside pixels and once towards outside ones.
+    // The column pass finds the distance to the nearest pixel of each kind in the same column,
+    //  and the row pass takes the lower envelope of the parabolas those distances describe.
+    //  Both are split into bands on the worker pool.
+
+    // Columns without a pixel of that kind, or where it's too far away to matter
+    const uint16_t far_rows = 0xFFFF;
+    // Columns per column pass task. Each task walks its columns a row at a time
+    const int band_columns = 256;
+
+    inline uint16_t next_row (uint16_t distance) {
+        return distance + (distance < far_rows);
+    }
+
+    struct column_job {
+        const uint8_t * inside;
+        uint16_t * to_inside, * to_outside;
+        int width, height;
+    };
+
+    void column_band (void * userdata, int band) {
+        const column_job & job = *(const column_job *)userdata;
+        const int first = band * band_columns,
+            last = (first + band_columns < job.width) ? first + band_columns : job.width;
+
+        for (int y = 0; y < job.height; y++) {
+            const size_t row = (size_t)y * job.width;
+            for (int x = first; x < last; x++) {
+                const size_t i = row + x;
+                const bool inside = job.inside[i] != 0;
+                const uint16_t above_inside = y ? next_row(job.to_inside[i - job.width]) : far_rows,
+                    above_outside = y ? next_row(job.to_outside[i - job.width]) : far_rows;
+                job.to_inside[i] = inside ? 0 : above_inside;
+                job.to_outside[i] = inside ? above_outside : 0;
+            }
+        }
+
+        for (int y = job.height - 2; y >= 0; y--) {
+            const size_t row = (size_t)y * job.width;
+            for (int x = first; x < last; x++) {
+                const size_t i = row + x;
+                const uint16_t below_inside = next_row(job.to_inside[i + job.width]),
+                    below_outside = next_row(job.to_outside[i + job.width]);
+                if (below_inside < job.to_inside[i])
+                    job.to_inside[i] = below_inside;
+                if (below_outside < job.to_outside[i])
+                    job.to_outside[i] = below_outside;
+            }
+        }
+    }
+
+    struct envelope_scratch {
+        // Parabola vertices, and the boundaries between them
+        int * vertices;
+        double * boundaries;
+    };
+
+    // result[x] = min over x' of (x - x')^2 + columns[x']^2, clamped to max_distance_squared
+    void lower_envelope (const uint16_t * columns, int width, const envelope_scratch & scratch, int32_t * result) {
+        int * v = scratch.vertices;
+        double * z = scratch.boundaries;
+        int k = -1;
+
+        for (int q = 0; q < width; q++) {
+            if (columns[q] == far_rows)
+                continue;
+            const double fq = (double)columns[q] * columns[q] + (double)q * q;
+            if (k < 0) {
+                k = 0;
+                v[0] = q;
+                z[0] = -HUGE_VAL;
+                z[1] = HUGE_VAL;
+                continue;
+            }
+
+            double s;
+            for (;;) {
+                const int p = v[k];
+                s = (fq - ((double)columns[p] * columns[p] + (double)p * p)) / (2.0 * (q - p));
+                // z[0] is -infinity, so the first parabola is never removed
+                if (s > z[k])
+                    break;
+                k--;
+            }
+            k++;
+            v[k] = q;
+            z[k] = s;
+            z[k + 1] = HUGE_VAL;
+        }
+
+        if (k < 0) {
+            for (int x = 0; x < width; x++)
+                result[x] = max_distance_squared;
+            return;
+        }
+
+        for (int x = 0, j = 0; x < width; x++) {
+            while (z[j + 1] < x)
+                j++;
+            const int64_t dx = x - v[j], dy = columns[v[j]],
+                distance = (dx * dx) + (dy * dy);
+            result[x] = (distance < max_distance_squared) ? (int32_t)distance : max_distance_squared;
+        }
+    }
+
+    struct envelope_job {
+        const uint8_t * inside;
+        const uint16_t * to_inside, * to_outside;
+        df_region region;
+        int stride, band_rows;
+        float * output;
+        std::atomic<bool> failed;
+    };
+
+    void envelope_band (void * userdata, int band) {
+        envelope_job & job = *(envelope_job *)userdata;
+        const int width = job.region.width, first = band * job.band_rows,
+            last = (first + job.band_rows < job.region.height) ? first + job.band_rows : job.region.height;
+
+        uint8_t * memory = (uint8_t *)stbn_malloc(
+            (sizeof(double) * (width + 1)) + (sizeof(int32_t) * width * 2) + (sizeof(int) * width), STBN_ALLOC_NATIVE
+        );
+        if (!memory) {
+            job.failed = true;
+            return;
+        }
+        envelope_scratch scratch;
+        scratch.boundaries = (double *)memory;
+        int32_t * distance_to_inside = (int32_t *)(scratch.boundaries + width + 1),
+            * distance_to_outside = distance_to_inside + width;
+        scratch.vertices = (int *)(distance_to_outside + width);
+
+        for (int y = first; y < last; y++) {
+            const size_t i = (size_t)y * width;
+            lower_envelope(job.to_inside + i, width, scratch, distance_to_inside);
+            lower_envelope(job.to_outside + i, width, scratch, distance_to_outside);
+            float * dest = job.output + (size_t)(y + job.region.y) * job.stride + job.region.x;
+            for (int x = 0; x < width; x++) {
+                const bool inside = job.inside[i + x] != 0;
+                dest[x] = resolve_distance(inside ? distance_to_outside[x] : distance_to_inside[x], inside);
+            }
+        }
+
+        stbn_free(memory);
+    }
+}
+
+STBNDEF int stbn_distance_field_jump_flood (
+    const void * input, int input_format, int width, int height,
+    int region_x, int region_y, int region_width, int region_height,
+    float * output
+) {
+    if (!check_arguments(input, input_format, width, height, output))
+        return 0;
+    df_region region;
+    if (!clip_region(width, height, region_x, region_y, region_width, region_height, region))
+        return 1;
+
+    const size_t count = (size_t)region.width * region.height;
+    // The x and y planes of both buffers, then inside (after the planes, so they stay aligned)
+    uint8_t * memory = (uint8_t *)stbn_malloc((count * sizeof(int16_t) * 4) + count, STBN_ALLOC_NATIVE);
+    if (!memory)
+        return 0;
+    int16_t * planes = (int16_t *)memory;
+    uint8_t * inside = memory + (count * sizeof(int16_t) * 4);
+    int16_t * seed_x[2] = { planes, planes + count * 2 },
+        * seed_y[2] = { planes + count, planes + count * 3 };
+
+    const int band_rows = get_band_rows(region.width),
+        band_count = (region.height + band_rows - 1) / band_rows;
+
+    classify(input, input_format, width, region, inside);
+
+    for (size_t i = 0; i < count; i++)
+        seed_x[0][i] = no_seed;
+    memset(seed_y[0], 0, count * sizeof(int16_t));
+
+    // 1+JFA: 1, N/4, N/8, ..., 1. The step sizes come from the whole image, not the region
+    const int l2 = log2_ceiling((width > height) ? width : height),
+        step_count = (l2 < 16) ? l2 : 16;
+    const bool avx2 = stbn_get_cpu_features().avx2;
+    int current = 0;
+    for (int i = 0; i < step_count; i++, current ^= 1) {
+        const int step = (i == 0) ? 1 : 1 << (l2 - i - 1);
+
+        jump_job job;
+        job.inside = inside;
+        job.in_x = seed_x[current];
+        job.in_y = seed_y[current];
+        job.out_x = seed_x[current ^ 1];
+        job.out_y = seed_y[current ^ 1];
+        job.width = region.width;
+        job.height = region.height;
+        job.step = step;
+        job.band_rows = band_rows;
+        job.avx2 = avx2;
+        stbn_parallel_for(band_count, jump_band, &job);
+    }
+
+    resolve_job resolve;
+    resolve.inside = inside;
+    resolve.seed_x = seed_x[current];
+    resolve.seed_y = seed_y[current];
+    resolve.region = region;
+    resolve.stride = width;
+    resolve.band_rows = band_rows;
+    resolve.output = output;
+    stbn_parallel_for(band_count, resolve_band, &resolve);
+
+    stbn_free(memory);
+    return 1;
+}
+
+STBNDEF int stbn_distance_field_exact (
+    const void * input, int input_format, int width, int height,
+    int region_x, int region_y, int region_width, int region_height,
+    float * output
+) {
+    if (!check_arguments(input, input_format, width, height, output))
+        return 0;
+    df_region region;
+    if (!clip_region(width, height, region_x, region_y, region_width, region_height, region))
+        return 1;
+
+    const size_t count = (size_t)region.width * region.height;
+    // Distances to the nearest inside and outside pixel in each column, then inside
+    uint8_t * memory = (uint8_t *)stbn_malloc((count * sizeof(uint16_t) * 2) + count, STBN_ALLOC_NATIVE);
+    if (!memory)
+        return 0;
+    uint16_t * to_inside = (uint16_t *)memory, * to_outside = to_inside + count;
+    uint8_t * inside = memory + count * sizeof(uint16_t) * 2;
+
+    classify(input, input_format, width, region, inside);
+
+    column_job columns;
+    columns.inside = inside;
+    columns.to_inside = to_inside;
+    columns.to_outside = to_outside;
+    columns.width = region.width;
+    columns.height = region.height;
+    stbn_parallel_for((region.width + band_columns - 1) / band_columns, column_band, &columns);
+
+    envelope_job rows;
+    rows.inside = inside;
+    rows.to_inside = to_inside;
+    rows.to_outside = to_outside;
+    rows.region = region;
+    rows.stride = width;
+    // Rows are far more expensive here than in the jump flood passes
+    rows.band_rows = (get_band_rows(region.width) + 7) / 8;
+    rows.output = output;
+    rows.failed = false;
+    stbn_parallel_for((region.height + rows.band_rows - 1) / rows.band_rows, envelope_band, &rows);
+
+    stbn_free(memory);
+    return rows.failed ? 0 : 1;
+}
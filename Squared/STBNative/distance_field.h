@@ -0,0 +1,37 @@
+#pragma once
+
+// Signed distance field generation (see distance_field.cpp). Include after stbnative.h.
+// Distances are in pixels, negative inside and positive outside, and a pixel is inside when its
+//  alpha (or its only channel) is greater than zero, like Squared.Render.DistanceField.
+
+// Matches the inputs accepted by JumpFlood.GenerateDistanceField
+enum {
+    // byte
+    STBN_DF_INPUT_GRAY8 = 0,
+    // Color (RGBA8)
+    STBN_DF_INPUT_RGBA8 = 1,
+    // float
+    STBN_DF_INPUT_GRAY32F = 2,
+    // Vector4
+    STBN_DF_INPUT_RGBA32F = 3,
+};
+
+// Both take the same arguments and produce the same range of values (distances stop at
+//  2048 * sqrt(2), which is also what pixels get when the image is all inside or all outside).
+// input and output are both width x height with tightly packed rows. Only the part of output
+//  inside the region (clipped to the image) is written.
+// Returns 0 if the arguments are invalid or we ran out of memory.
+
+// Approximate: a small fraction of pixels end up slightly further from their seed than they should
+STBNDEF int stbn_distance_field_jump_flood (
+    const void * input, int input_format, int width, int height,
+    int region_x, int region_y, int region_width, int region_height,
+    float * output
+);
+
+// Exact, and usually faster than jump flooding
+STBNDEF int stbn_distance_field_exact (
+    const void * input, int input_format, int width, int height,
+    int region_x, int region_y, int region_width, int region_height,
+    float * output
+);
@@ -0,0 +1,146 @@
+#include "stbnative.h"
+#include "encode.h"
+#include "qoi.h"
+#include <string.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <errno.h>
+#include <unistd.h>
+#endif
+
+// stb_image_write hands its output to a callback in small pieces (64 bytes at a time for
+//  most formats). Going through a managed delegate for every one of those means a reverse
+//  P/Invoke and two copies per piece, so instead we collect the whole file in native memory
+//  and hand it back (or write it out) once.
+// PNG and QOI are built in memory in one piece anyway, so their buffers are returned as-is.
+
+void stbn_encode_buffer_write (void * context, void * data, int size) {
+    stbn_encode_buffer & buffer = *(stbn_encode_buffer *)context;
+    if (buffer.failed || (size <= 0))
+        return;
+
+    size_t needed = buffer.length + (size_t)size;
+    if (needed > buffer.capacity) {
+        size_t capacity = buffer.capacity ? buffer.capacity * 2 : 64 * 1024;
+        while (capacity < needed)
+            capacity *= 2;
+        uint8_t * grown = (uint8_t *)stbn_realloc(buffer.data, capacity, STBN_ALLOC_WRITE);
+        if (!grown) {
+            buffer.failed = true;
+            return;
+        }
+        buffer.data = grown;
+        buffer.capacity = capacity;
+    }
+
+    memcpy(buffer.data + buffer.length, data, (size_t)size);
+    buffer.length = needed;
+}
+
+#ifdef _WIN32
+bool stbn_write_file_at (intptr_t file, const void * buffer, size_t count, int64_t offset) {
+    const uint8_t * data = (const uint8_t *)buffer;
+    while (count > 0) {
+        DWORD chunk = (count > (1u << 30)) ? (1u << 30) : (DWORD)count, written = 0;
+        OVERLAPPED position = {};
+        position.Offset = (DWORD)offset;
+        position.OffsetHigh = (DWORD)(offset >> 32);
+        if (!WriteFile((HANDLE)file, data, chunk, &written, &position) || !written)
+            return false;
+        data += written;
+        count -= written;
+        offset += written;
+    }
+    return true;
+}
+#else
+bool stbn_write_file_at (intptr_t file, const void * buffer, size_t count, int64_t offset) {
+    const uint8_t * data = (const uint8_t *)buffer;
+    while (count > 0) {
+        ssize_t written = pwrite((int)file, data, count, (off_t)offset);
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        } else if (written == 0)
+            return false;
+        data += written;
+        count -= (size_t)written;
+        offset += written;
+    }
+    return true;
+}
+#endif
+
+STBNDEF void * stbn_encode_image (
+    const stbn_encode_options * options, const void * pixels,
+    int width, int height, int channels, int stride, int * out_length
+) {
+    if (!options || !pixels || !out_length || (width <= 0) || (height <= 0) || (channels < 1) || (channels > 4))
+        return nullptr;
+    *out_length = 0;
+
+    if (options->format == STBN_ENCODE_PNG)
+        return stbi_write_png_to_mem_ex(
+            (const unsigned char *)pixels, stride, width, height, channels, out_length,
+            options->png_compression_level, options->png_filter
+        );
+    else if (options->format == STBN_ENCODE_QOI)
+        return stbn_qoi_encode(pixels, width, height, channels, stride, 0, options->qoi_zstd_level, out_length);
+
+    const int packed_stride = width * channels * ((options->format == STBN_ENCODE_HDR) ? (int)sizeof(float) : 1);
+    if (stride && (stride != packed_stride))
+        return nullptr;
+
+    stbn_encode_buffer buffer = {};
+    int ok;
+    switch (options->format) {
+        case STBN_ENCODE_BMP:
+            ok = stbi_write_bmp_to_func(stbn_encode_buffer_write, &buffer, width, height, channels, pixels);
+            break;
+        case STBN_ENCODE_TGA:
+            ok = stbi_write_tga_to_func(stbn_encode_buffer_write, &buffer, width, height, channels, pixels);
+            break;
+        case STBN_ENCODE_JPEG:
+            // Large images are split into restart intervals and encoded on the worker pool
+            ok = stbi_write_jpg_to_func_ex(stbn_encode_buffer_write, &buffer, width, height, channels, pixels, options->jpeg_quality, 1);
+            break;
+        case STBN_ENCODE_HDR:
+            ok = stbi_write_hdr_to_func(stbn_encode_buffer_write, &buffer, width, height, channels, (const float *)pixels);
+            break;
+        default:
+            ok = 0;
+            break;
+    }
+
+    if (!ok || buffer.failed || (buffer.length > INT32_MAX)) {
+        stbn_free(buffer.data);
+        return nullptr;
+    }
+    *out_length = (int)buffer.length;
+    return buffer.data;
+}
+
+// Encodes the image and writes it to an open file (a HANDLE on Windows, a descriptor
+//  elsewhere) starting at offset. The file must be opened for synchronous writes. Where the file
+//  pointer ends up depends on the platform: pwrite leaves it alone, but WriteFile on a synchronous
+//  handle moves it past the written data, so callers must set it themselves afterwards (STBIW.cs
+//  does). Returns the number of bytes written, or -1 on failure.
+STBNDEF int64_t stbn_encode_image_to_file (
+    const stbn_encode_options * options, const void * pixels,
+    int width, int height, int channels, int stride,
+    intptr_t file, int64_t offset
+) {
+    int length;
+    void * encoded = stbn_encode_image(options, pixels, width, height, channels, stride, &length);
+    if (!encoded)
+        return -1;
+
+    bool ok = stbn_write_file_at(file, encoded, (size_t)length, offset);
+    stbn_free(encoded);
+    return ok ? length : -1;
+}
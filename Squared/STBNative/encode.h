@@ -0,0 +1,82 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Encoding images into native memory (or straight into a file) in a single call.
+
+// Matches ImageWriteFormat
+enum {
+    STBN_ENCODE_PNG = 0,
+    STBN_ENCODE_BMP = 1,
+    STBN_ENCODE_TGA = 2,
+    STBN_ENCODE_JPEG = 3,
+    // Float RGB(A) input
+    STBN_ENCODE_HDR = 4,
+    // RGB or RGBA only, see qoi.h
+    STBN_ENCODE_QOI = 5,
+};
+
+struct stbn_encode_options {
+    int format;
+    // JPEG only, 1-100
+    int jpeg_quality;
+    // PNG only. Filter is -1 to pick one per row, or 0-4 to use the same one everywhere
+    int png_compression_level, png_filter;
+    // QOI only. 0 for none, otherwise the zstd level the image is wrapped at
+    int qoi_zstd_level;
+};
+
+// A growable block of stbn_malloc'd memory, used as an stbi_write_func context
+struct stbn_encode_buffer {
+    uint8_t * data;
+    size_t length, capacity;
+    bool failed;
+};
+
+void stbn_encode_buffer_write (void * context, void * data, int size);
+
+// Positioned write to a HANDLE (Windows) or descriptor, without moving the file pointer
+bool stbn_write_file_at (intptr_t file, const void * buffer, size_t count, int64_t offset);
+
+// Returns the encoded image (free with stbi_image_free) or null if it couldn't be encoded.
+// stride is in bytes (0 for tightly packed rows), and only PNG and QOI support padded rows.
+STBNDEF void * stbn_encode_image (
+    const stbn_encode_options * options, const void * pixels,
+    int width, int height, int channels, int stride, int * out_length
+);
+
+// Background encode queue (see encode_queue.cpp)
+struct stbn_encode_queue;
+
+struct stbn_encode_queue_stats {
+    // Images submitted but not written yet
+    int pending;
+    // Buffers currently held by the caller
+    int acquired;
+    int64_t written, failed;
+};
+
+// thread_count writers share buffer_count buffers of buffer_size bytes, which are allocated as
+//  they're first needed. Returns null if the arguments are invalid.
+STBNDEF stbn_encode_queue * stbn_encode_queue_create (int thread_count, int buffer_count, int64_t buffer_size);
+// Every acquired buffer must have been submitted or released. Waits for pending writes to finish.
+STBNDEF void stbn_encode_queue_destroy (stbn_encode_queue * queue);
+// Like destroy, but returns immediately; the writers finish what was submitted and then free the queue.
+STBNDEF void stbn_encode_queue_abandon (stbn_encode_queue * queue);
+
+// Takes a buffer off the free list, waiting up to timeout_ms (-1 for as long as it takes) for one
+//  to be returned if they're all in use. Returns null on timeout.
+STBNDEF void * stbn_encode_queue_acquire (stbn_encode_queue * queue, int timeout_ms);
+// Queues the pixels in an acquired buffer to be encoded and written to path (UTF-8), replacing
+//  any existing file. The buffer goes back on the free list once that's done.
+// Returns 0 if the arguments are invalid, in which case the caller still holds the buffer.
+STBNDEF int stbn_encode_queue_submit (
+    stbn_encode_queue * queue, void * buffer, const stbn_encode_options * options,
+    int width, int height, int channels, int stride, const char * path
+);
+// Returns an acquired buffer without writing anything
+STBNDEF void stbn_encode_queue_release (stbn_encode_queue * queue, void * buffer);
+// Waits until everything submitted so far has been written (or has failed)
+STBNDEF void stbn_encode_queue_wait (stbn_encode_queue * queue);
+STBNDEF void stbn_encode_queue_get_stats (stbn_encode_queue * queue, stbn_encode_queue_stats * result);
@@ -0,0 +1,281 @@
+#include "stbnative.h"
+#include "encode.h"
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Encoding and writing images in the background, so capturing a screenshot (or every frame of
+//  a recording) doesn't stall the render thread.
+// The queue owns a fixed set of pixel buffers. The caller takes one off the free list, fills it
+//  and submits it along with a path; a writer thread encodes it, writes the file and puts the
+//  buffer back. Every pending image holds a buffer, so once they're all in flight acquiring
+//  waits (or times out), which bounds both the memory used and how far behind the writers fall.
+// The writers are dedicated threads rather than worker pool tasks since they spend much of
+//  their time blocked on the disk. Large images are still spread across the pool by the encoders.
+
+namespace {
+    struct request {
+        void * buffer;
+        stbn_encode_options options;
+        int width, height, channels, stride;
+        std::string path;
+    };
+
+#ifdef _WIN32
+    intptr_t create_file (const char * path) {
+        int length = MultiByteToWideChar(CP_UTF8, 0, path, -1, nullptr, 0);
+        if (length <= 0)
+            return -1;
+        std::wstring wide((size_t)length, L'\0');
+        MultiByteToWideChar(CP_UTF8, 0, path, -1, &wide[0], length);
+        HANDLE result = CreateFileW(
+            wide.c_str(), GENERIC_WRITE, FILE_SHARE_READ,
+            nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr
+        );
+        return (result == INVALID_HANDLE_VALUE) ? -1 : (intptr_t)result;
+    }
+
+    void close_file (intptr_t file) {
+        CloseHandle((HANDLE)file);
+    }
+#else
+    intptr_t create_file (const char * path) {
+        return open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    }
+
+    void close_file (intptr_t file) {
+        close((int)file);
+    }
+#endif
+
+    // The file is only created once the image has been encoded, so a failed encode doesn't
+    //  leave an empty or truncated file behind
+    bool encode_and_write (const request & r) {
+        int length;
+        void * encoded = stbn_encode_image(&r.options, r.buffer, r.width, r.height, r.channels, r.stride, &length);
+        if (!encoded)
+            return false;
+
+        bool ok = false;
+        intptr_t file = create_file(r.path.c_str());
+        if (file != -1) {
+            ok = stbn_write_file_at(file, encoded, (size_t)length, 0);
+            close_file(file);
+        }
+        stbn_free(encoded);
+        return ok;
+    }
+}
+
+struct stbn_encode_queue {
+    std::mutex lock;
+    std::condition_variable work_available, buffer_available, idle;
+    std::deque<request> requests;
+    std::vector<void *> free_buffers;
+    std::vector<std::thread> writers;
+    size_t buffer_size;
+    // allocated counts buffers that exist (or are being allocated), in_progress the requests
+    //  the writers have taken off the queue and running the writers that haven't exited yet
+    int buffer_count, allocated, acquired, in_progress, running;
+    int64_t written, failed;
+    // Once abandoned, nobody is going to join the writers, so the last one out frees the queue
+    bool stopping, abandoned;
+
+    void write_loop () {
+        for (;;) {
+            request r;
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                work_available.wait(guard, [this] { return stopping || !requests.empty(); });
+                if (!requests.empty()) {
+                    r = std::move(requests.front());
+                    requests.pop_front();
+                    in_progress++;
+                } else {
+                    // Everything that was submitted is written before the writers exit. Once the
+                    //  lock is released the queue may be gone, unless this is the last writer out
+                    //  of an abandoned queue, which then owns it.
+                    if ((--running != 0) || !abandoned)
+                        return;
+                    guard.unlock();
+                    for (void * buffer : free_buffers)
+                        stbn_free(buffer);
+                    delete this;
+                    return;
+                }
+            }
+
+            bool ok = encode_and_write(r);
+
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                if (ok)
+                    written++;
+                else
+                    failed++;
+                free_buffers.push_back(r.buffer);
+                if ((--in_progress == 0) && requests.empty())
+                    idle.notify_all();
+            }
+            buffer_available.notify_one();
+        }
+    }
+};
+
+STBNDEF stbn_encode_queue * stbn_encode_queue_create (int thread_count, int buffer_count, int64_t buffer_size) {
+    if ((thread_count < 1) || (thread_count > 64) || (buffer_count < 1) || (buffer_size <= 0) || ((uint64_t)buffer_size > SIZE_MAX))
+        return nullptr;
+
+    stbn_encode_queue * queue = new stbn_encode_queue;
+    queue->buffer_size = (size_t)buffer_size;
+    queue->buffer_count = buffer_count;
+    queue->allocated = queue->acquired = queue->in_progress = 0;
+    queue->running = thread_count;
+    queue->written = queue->failed = 0;
+    queue->stopping = queue->abandoned = false;
+    queue->free_buffers.reserve(buffer_count);
+    for (int i = 0; i < thread_count; i++)
+        queue->writers.emplace_back([queue] { queue->write_loop(); });
+    return queue;
+}
+
+STBNDEF void stbn_encode_queue_destroy (stbn_encode_queue * queue) {
+    if (!queue)
+        return;
+
+    {
+        std::lock_guard<std::mutex> guard(queue->lock);
+        queue->stopping = true;
+    }
+    queue->work_available.notify_all();
+    for (auto & writer : queue->writers)
+        writer.join();
+
+    for (void * buffer : queue->free_buffers)
+        stbn_free(buffer);
+    delete queue;
+}
+
+STBNDEF void stbn_encode_queue_abandon (stbn_encode_queue * queue) {
+    if (!queue)
+        return;
+
+    // The last writer can free the queue as soon as the lock is released, so everything has
+    //  to happen while it's held; the writers only need it back once this returns
+    std::lock_guard<std::mutex> guard(queue->lock);
+    for (auto & writer : queue->writers)
+        writer.detach();
+    queue->stopping = queue->abandoned = true;
+    queue->work_available.notify_all();
+}
+
+STBNDEF void * stbn_encode_queue_acquire (stbn_encode_queue * queue, int timeout_ms) {
+    if (!queue)
+        return nullptr;
+
+    std::unique_lock<std::mutex> guard(queue->lock);
+    auto ready = [queue] {
+        return !queue->free_buffers.empty() || (queue->allocated < queue->buffer_count);
+    };
+    if (timeout_ms < 0)
+        queue->buffer_available.wait(guard, ready);
+    else if (!queue->buffer_available.wait_for(guard, std::chrono::milliseconds(timeout_ms), ready))
+        return nullptr;
+
+    void * result;
+    if (!queue->free_buffers.empty()) {
+        result = queue->free_buffers.back();
+        queue->free_buffers.pop_back();
+    } else {
+        // Reserve the slot, then allocate without holding the lock
+        queue->allocated++;
+        guard.unlock();
+        result = stbn_malloc(queue->buffer_size, STBN_ALLOC_WRITE);
+        guard.lock();
+        if (!result) {
+            queue->allocated--;
+            guard.unlock();
+            queue->buffer_available.notify_one();
+            return nullptr;
+        }
+    }
+    queue->acquired++;
+    return result;
+}
+
+STBNDEF int stbn_encode_queue_submit (
+    stbn_encode_queue * queue, void * buffer, const stbn_encode_options * options,
+    int width, int height, int channels, int stride, const char * path
+) {
+    if (!queue || !buffer || !options || !path || !path[0] ||
+        (width <= 0) || (height <= 0) || (channels < 1) || (channels > 4) || (stride < 0))
+        return 0;
+
+    const size_t row_bytes = stride
+        ? (size_t)stride
+        : (size_t)width * channels * ((options->format == STBN_ENCODE_HDR) ? sizeof(float) : 1);
+    if ((row_bytes > queue->buffer_size) || ((size_t)height > queue->buffer_size / row_bytes))
+        return 0;
+
+    request r;
+    r.buffer = buffer;
+    r.options = *options;
+    r.width = width;
+    r.height = height;
+    r.channels = channels;
+    r.stride = stride;
+    r.path = path;
+
+    {
+        std::lock_guard<std::mutex> guard(queue->lock);
+        queue->requests.push_back(std::move(r));
+        queue->acquired--;
+    }
+    queue->work_available.notify_one();
+    return 1;
+}
+
+STBNDEF void stbn_encode_queue_release (stbn_encode_queue * queue, void * buffer) {
+    if (!queue || !buffer)
+        return;
+
+    {
+        std::lock_guard<std::mutex> guard(queue->lock);
+        queue->free_buffers.push_back(buffer);
+        queue->acquired--;
+    }
+    queue->buffer_available.notify_one();
+}
+
+STBNDEF void stbn_encode_queue_wait (stbn_encode_queue * queue) {
+    if (!queue)
+        return;
+
+    std::unique_lock<std::mutex> guard(queue->lock);
+    queue->idle.wait(guard, [queue] { return queue->requests.empty() && (queue->in_progress == 0); });
+}
+
+STBNDEF void stbn_encode_queue_get_stats (stbn_encode_queue * queue, stbn_encode_queue_stats * result) {
+    if (!queue || !result)
+        return;
+
+    std::lock_guard<std::mutex> guard(queue->lock);
+    result->pending = (int)queue->requests.size() + queue->in_progress;
+    result->acquired = queue->acquired;
+    result->written = queue->written;
+    result->failed = queue->failed;
+}
@@ -0,0 +1,162 @@
+#include "stbnative.h"
+#include "cpu.h"
+#include "half.h"
+#include "srgb.h"
+#include "threads.h"
+#include <immintrin.h>
+#include <string.h>
+
+// Decoding straight to half floats (for HalfSingle/HalfVector2/HalfVector4 textures).
+// stb_image decodes to 16 bits per channel, and since a half float is also 2 bytes, each
+//  row is then converted in place. Converting from sRGB to linear and premultiplying by
+//  alpha happen during the same pass when requested, in float precision.
+
+namespace {
+    const float scale16 = 1.0f / 65535.0f;
+
+    // 16-bit sRGB -> linear float. Built on first use since most loads never need it.
+    const float * get_linear16_table () {
+        static const float * table = [] {
+            float * result = new float[65536];
+            for (int i = 0; i < 65536; i++)
+                result[i] = (float)stbn_srgb_to_linear(i / 65535.0);
+            return result;
+        }();
+        return table;
+    }
+
+    STBN_TARGET("f16c") int convert_row_f16c (uint16_t * row, int count) {
+        const __m128 scale = _mm_set1_ps(scale16);
+        const __m128i zero = _mm_setzero_si128();
+        int i = 0;
+        for (; i + 4 <= count; i += 4) {
+            __m128i values = _mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i *)(row + i)), zero);
+            __m128 f = _mm_mul_ps(_mm_cvtepi32_ps(values), scale);
+            _mm_storel_epi64((__m128i *)(row + i), _mm_cvtps_ph(f, _MM_FROUND_TO_NEAREST_INT));
+        }
+        return i;
+    }
+
+    STBN_TARGET("f16c") int store_row_f16c (const float * src, uint16_t * dest, int count) {
+        int i = 0;
+        for (; i + 4 <= count; i += 4)
+            _mm_storel_epi64((__m128i *)(dest + i), _mm_cvtps_ph(_mm_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT));
+        return i;
+    }
+
+    // Plain unorm16 -> half, without going through a float row
+    void convert_row (uint16_t * row, int count, bool f16c) {
+        int i = f16c ? convert_row_f16c(row, count) : 0;
+        for (; i < count; i++)
+            row[i] = stbn_float_to_half(row[i] * scale16);
+    }
+
+    void expand_row (const uint16_t * src, float * dest, int pixels, int channels, int flags) {
+        const int count = pixels * channels;
+        const bool has_alpha = (channels == 2) || (channels == 4);
+        const int color_channels = has_alpha ? channels - 1 : channels;
+
+        if (flags & STBN_HALF_LINEARIZE) {
+            const float * to_linear = get_linear16_table();
+            for (int i = 0; i < count; i += channels) {
+                for (int c = 0; c < color_channels; c++)
+                    dest[i + c] = to_linear[src[i + c]];
+                if (has_alpha)
+                    dest[i + color_channels] = src[i + color_channels] * scale16;
+            }
+        } else {
+            const __m128 scale = _mm_set1_ps(scale16);
+            const __m128i zero = _mm_setzero_si128();
+            int i = 0;
+            for (; i + 8 <= count; i += 8) {
+                __m128i values = _mm_loadu_si128((const __m128i *)(src + i));
+                _mm_storeu_ps(dest + i, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(values, zero)), scale));
+                _mm_storeu_ps(dest + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(values, zero)), scale));
+            }
+            for (; i < count; i++)
+                dest[i] = src[i] * scale16;
+        }
+
+        if (!(flags & STBN_HALF_PREMULTIPLY) || !has_alpha)
+            return;
+
+        if (channels == 4) {
+            const __m128 color_mask = _mm_castsi128_ps(_mm_set_epi32(0, -1, -1, -1)),
+                alpha_one = _mm_set_ps(1.0f, 0, 0, 0);
+            for (int i = 0; i < count; i += 4) {
+                __m128 pixel = _mm_loadu_ps(dest + i),
+                    alpha = _mm_shuffle_ps(pixel, pixel, _MM_SHUFFLE(3, 3, 3, 3)),
+                    factor = _mm_or_ps(_mm_and_ps(alpha, color_mask), alpha_one);
+                _mm_storeu_ps(dest + i, _mm_mul_ps(pixel, factor));
+            }
+        } else {
+            for (int i = 0; i < count; i += 2)
+                dest[i] *= dest[i + 1];
+        }
+    }
+
+    struct half_job {
+        uint16_t * pixels;
+        int width, height, channels, flags, band_rows;
+    };
+
+    void convert_band (void * userdata, int band) {
+        const half_job & job = *(const half_job *)userdata;
+        const bool f16c = stbn_get_cpu_features().f16c;
+        const int count = job.width * job.channels,
+            first = band * job.band_rows,
+            last = (first + job.band_rows < job.height) ? first + job.band_rows : job.height;
+        // Rows with flags go through float in chunks small enough to stay in L1
+        const int chunk_pixels = 1024;
+        float scratch[chunk_pixels * 4];
+
+        for (int y = first; y < last; y++) {
+            uint16_t * row = job.pixels + (size_t)y * count;
+            if (!job.flags) {
+                convert_row(row, count, f16c);
+                continue;
+            }
+
+            for (int x = 0; x < job.width; x += chunk_pixels) {
+                int pixels = (job.width - x < chunk_pixels) ? job.width - x : chunk_pixels,
+                    values = pixels * job.channels;
+                uint16_t * chunk = row + (size_t)x * job.channels;
+                expand_row(chunk, scratch, pixels, job.channels, job.flags);
+                int i = f16c ? store_row_f16c(scratch, chunk, values) : 0;
+                for (; i < values; i++)
+                    chunk[i] = stbn_float_to_half(scratch[i]);
+            }
+        }
+    }
+}
+
+// Like stbi_load_16_from_memory, but each channel is an IEEE half float in [0, 1] instead
+//  of a unorm16. 8-bit sources are widened first. desired_channels must be 1-4.
+// flags is a combination of STBN_HALF_PREMULTIPLY and STBN_HALF_LINEARIZE; premultiplying
+//  only affects images with alpha (2 or 4 channels). Free the result with stbi_image_free.
+STBNDEF uint16_t * stbn_load_half_from_memory (
+    const stbi_uc * buffer, int len, int * x, int * y, int * channels_in_file,
+    int desired_channels, int flags
+) {
+    if ((desired_channels < 1) || (desired_channels > 4))
+        return 0;
+
+    uint16_t * result = stbi_load_16_from_memory(buffer, len, x, y, channels_in_file, desired_channels);
+    if (!result)
+        return 0;
+
+    half_job job;
+    job.pixels = result;
+    job.width = *x;
+    job.height = *y;
+    job.channels = desired_channels;
+    job.flags = flags & (STBN_HALF_PREMULTIPLY | STBN_HALF_LINEARIZE);
+    if ((job.channels != 2) && (job.channels != 4))
+        job.flags &= ~STBN_HALF_PREMULTIPLY;
+    // Bands of roughly 256K channels, so small images don't pay for waking the pool
+    int row_values = job.width * job.channels;
+    job.band_rows = (row_values >= (1 << 18)) ? 1 : (1 << 18) / row_values;
+    stbn_parallel_for((job.height + job.band_rows - 1) / job.band_rows, convert_band, &job);
+
+    return result;
+}
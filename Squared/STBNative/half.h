@@ -0,0 +1,85 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+#include "stbnative.h"
+
+// Scalar IEEE 754 binary16 conversions, used when F16C isn't available.
+
+static inline float stbn_half_to_float (uint16_t h) {
+    uint32_t sign = (uint32_t)(h & 0x8000) << 16,
+        exponent = (h >> 10) & 0x1F,
+        mantissa = h & 0x3FF,
+        bits;
+
+    if (exponent == 0x1F) {
+        // Inf / NaN
+        bits = sign | 0x7F800000 | (mantissa << 13);
+    } else if (exponent != 0) {
+        bits = sign | ((exponent + (127 - 15)) << 23) | (mantissa << 13);
+    } else if (mantissa != 0) {
+        // Denormal; renormalize
+        exponent = 127 - 15 + 1;
+        while ((mantissa & 0x400) == 0) {
+            mantissa <<= 1;
+            exponent--;
+        }
+        bits = sign | (exponent << 23) | ((mantissa & 0x3FF) << 13);
+    } else {
+        bits = sign;
+    }
+
+    float result;
+    memcpy(&result, &bits, 4);
+    return result;
+}
+
+// Rounds to nearest even, like F16C with _MM_FROUND_TO_NEAREST_INT
+static inline uint16_t stbn_float_to_half (float f) {
+    uint32_t bits;
+    memcpy(&bits, &f, 4);
+
+    uint16_t sign = (uint16_t)((bits >> 16) & 0x8000);
+    uint32_t abs_bits = bits & 0x7FFFFFFF;
+
+    if (abs_bits >= 0x7F800000)
+        // Inf / NaN (keep NaNs quiet and nonzero)
+        return sign | 0x7C00 | ((abs_bits > 0x7F800000) ? (0x200 | ((abs_bits >> 13) & 0x3FF)) : 0);
+    if (abs_bits >= 0x477FF000)
+        // Rounds to a value too large for a half
+        return sign | 0x7C00;
+
+    if (abs_bits < 0x38800000) {
+        // Result is denormal or zero
+        if (abs_bits < 0x33000000)
+            return sign;
+        uint32_t exponent = abs_bits >> 23,
+            mantissa = (abs_bits & 0x7FFFFF) | 0x800000,
+            shift = 126 - exponent,
+            result = mantissa >> shift,
+            remainder = mantissa & ((1u << shift) - 1),
+            halfway = 1u << (shift - 1);
+        if ((remainder > halfway) || ((remainder == halfway) && (result & 1)))
+            result++;
+        return sign | (uint16_t)result;
+    }
+
+    uint32_t result = abs_bits - ((127 - 15) << 23);
+    // Round to nearest even on the 13 discarded bits
+    result += 0xFFF + ((result >> 13) & 1);
+    return sign | (uint16_t)(result >> 13);
+}
+
+// Decoding straight to half floats (see half.cpp).
+
+enum {
+    STBN_HALF_PREMULTIPLY = 1,
+    // Color channels are sRGB and should be converted to linear. Alpha is always linear.
+    STBN_HALF_LINEARIZE = 2,
+};
+
+STBNDEF uint16_t * stbn_load_half_from_memory (
+    const unsigned char * buffer, int len, int * x, int * y, int * channels_in_file,
+    int desired_channels, int flags
+);
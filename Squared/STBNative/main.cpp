@@ -1,30 +1,27 @@
 // @#*(%@#K% sprintf
 // #include <stdio.h>
 
-#define STBIDEF  extern "C" __declspec(dllexport)
-#define STBIWDEF extern "C" __declspec(dllexport)
-#define STBIRDEF extern "C" __declspec(dllexport)
-
-#define STBI_NO_STDIO
-// #define STBI_WRITE_NO_STDIO
-
-#define STBI_BUFFER_SIZE 40960
-
-#define STBI_NO_BMP
-#define STBI_NO_GIF
-#define STBI_NO_PIC
-#define STBI_NO_PNM
-#define STBI_NO_HDR
-
-// #define STBI_WRITE_NO_HDR
-
-#define STBIR_MAX_CHANNELS 4
-
-#include <stdio.h>
-
-#include "stb_image.h"
-#include "stb_image_write.h"
-#include "stb_image_resize2.h"
+#include "stbnative.h"
+#include "cpu.h"
+#include "threads.h"
+#include "qoi.h"
+
+// Let stb_image build its SSE4.1/AVX2 paths on top of our runtime detection
+#define STBI_SSE41_AVAILABLE() (stbn_get_cpu_features().sse41)
+#define STBI_SSE41_TARGET STBN_TARGET("sse4.1")
+#define STBI_AVX2_AVAILABLE() (stbn_get_cpu_features().avx2)
+#define STBI_AVX2_TARGET STBN_TARGET("avx2")
+// ...and spread large JPEG decodes across our worker pool
+#define STBI_PARALLEL_FOR(count, fn, user) stbn_parallel_for(count, fn, user)
+// ...and large PNG and JPEG encodes
+#define STBIW_PARALLEL_FOR(count, fn, user) stbn_parallel_for(count, fn, user)
+// ...and let stb_image_write use AVX2 for the JPEG DCT and color conversion
+#define STBIW_AVX2_AVAILABLE() (stbn_get_cpu_features().avx2)
+#define STBIW_AVX2_TARGET STBN_TARGET("avx2")
+// ...and let it load QOI images from memory
+#define STBI_QOI_TEST(buffer, len) stbn_qoi_test(buffer, len)
+#define STBI_QOI_INFO(buffer, len, x, y, comp) stbn_qoi_info(buffer, len, x, y, comp)
+#define STBI_QOI_LOAD(buffer, len, x, y, comp, req_comp) stbn_qoi_load(buffer, len, x, y, comp, req_comp)
 
 #define STB_IMAGE_IMPLEMENTATION
 #define STB_IMAGE_WRITE_IMPLEMENTATION
@@ -40,4 +37,4 @@ STBIWDEF int get_stbi_write_png_compression_level () {
 
 STBIWDEF void set_stbi_write_png_compression_level (int level) {
     stbi_write_png_compression_level = level;
-}
\ No newline at end of file
+}
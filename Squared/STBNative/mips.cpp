@@ -0,0 +1,649 @@
+#include "stbnative.h"
+#include "cpu.h"
+#include "half.h"
+#include "srgb.h"
+#include <immintrin.h>
+#include <string.h>
+
+// Fast 2:1 box filter mip reducers.
+// All of these share the MipGeneratorFn signature from Squared.Render.Mips. The destination
+//  must be floor(src / 2) or ceil(src / 2) in each dimension. When the source is odd and the
+//  destination is rounded down, the last row/column of the destination absorbs the extra
+//  source row/column; when it is rounded up, the last row/column only covers one source texel.
+// Full 2x2 blocks go through SSE2 kernels, and edges go through the scalar block functions.
+// The sRGB kernels still convert to and from linear with table lookups one texel at a time
+//  (SSE2 has no gather), but do everything in between four pixels at a time.
+// Every row kernel produces exactly the same results as its block function; the float
+//  kernels add up full blocks in the same order for that. The only exception is min/max of
+//  blocks containing NaNs, where which operand wins depends on the order of comparisons.
+// Half float kernels use F16C for their full blocks when the CPU supports it.
+
+namespace {
+    struct mip_span {
+        int first, count;
+    };
+
+    inline mip_span get_span (int i, int source_size, int dest_size) {
+        mip_span result;
+        result.first = i * 2;
+        int end = (i == dest_size - 1) ? source_size : result.first + 2;
+        if (end > source_size)
+            end = source_size;
+        result.count = end - result.first;
+        return result;
+    }
+
+    inline bool is_valid_reduction (int source_size, int dest_size) {
+        if ((source_size < 1) || (dest_size < 1))
+            return false;
+        return (dest_size == source_size / 2) || (dest_size == (source_size + 1) / 2);
+    }
+
+    // Number of leading destination texels that are backed by exactly two source texels
+    inline int count_full_pairs (int source_size, int dest_size) {
+        return (source_size == dest_size * 2) ? dest_size : dest_size - 1;
+    }
+
+    inline uint32_t divide_rounded (uint32_t sum, uint32_t count) {
+        return (sum + (count / 2)) / count;
+    }
+
+    const __m128i k_zero = _mm_setzero_si128();
+
+    inline __m128i load_pixel_epi32 (const uint8_t * p) {
+        int32_t v;
+        memcpy(&v, p, 4);
+        return _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(v), k_zero), k_zero);
+    }
+
+    // Sums two RGBA8 rows of 8 source pixels into 4 destination pixels (as 16-bit lanes)
+    inline void sum_rgba8_x4 (const uint8_t * r0, const uint8_t * r1, __m128i & out01, __m128i & out23) {
+        __m128i a0 = _mm_loadu_si128((const __m128i *)r0),
+            a1 = _mm_loadu_si128((const __m128i *)(r0 + 16)),
+            b0 = _mm_loadu_si128((const __m128i *)r1),
+            b1 = _mm_loadu_si128((const __m128i *)(r1 + 16));
+
+        __m128i s0 = _mm_add_epi16(_mm_unpacklo_epi8(a0, k_zero), _mm_unpacklo_epi8(b0, k_zero)),
+            s1 = _mm_add_epi16(_mm_unpackhi_epi8(a0, k_zero), _mm_unpackhi_epi8(b0, k_zero)),
+            s2 = _mm_add_epi16(_mm_unpacklo_epi8(a1, k_zero), _mm_unpacklo_epi8(b1, k_zero)),
+            s3 = _mm_add_epi16(_mm_unpackhi_epi8(a1, k_zero), _mm_unpackhi_epi8(b1, k_zero));
+
+        out01 = _mm_add_epi16(_mm_unpacklo_epi64(s0, s1), _mm_unpackhi_epi64(s0, s1));
+        out23 = _mm_add_epi16(_mm_unpacklo_epi64(s2, s3), _mm_unpackhi_epi64(s2, s3));
+    }
+
+    // Splits 8 RGBA8 pixels into one float vector per channel for the even pixels and another
+    //  for the odd ones, so lane n of each holds a texel of the 2x2 block for destination pixel n
+    inline void split_rgba8_pairs (const uint8_t * p, __m128 * even, __m128 * odd) {
+        const __m128i low_byte = _mm_set1_epi32(0xFF);
+        __m128i lo = _mm_loadu_si128((const __m128i *)p),
+            hi = _mm_loadu_si128((const __m128i *)(p + 16));
+        for (int c = 0; c < 4; c++) {
+            __m128 l = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(lo, c * 8), low_byte)),
+                h = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(hi, c * 8), low_byte));
+            even[c] = _mm_shuffle_ps(l, h, _MM_SHUFFLE(2, 0, 2, 0));
+            odd[c] = _mm_shuffle_ps(l, h, _MM_SHUFFLE(3, 1, 3, 1));
+        }
+    }
+
+    // The inverse of split_rgba8_pairs, for 4 pixels whose channels are already in [0, 255]
+    inline void store_rgba8_planes (const __m128i * channels, uint8_t * dest) {
+        __m128i result = _mm_or_si128(
+            _mm_or_si128(channels[0], _mm_slli_epi32(channels[1], 8)),
+            _mm_or_si128(_mm_slli_epi32(channels[2], 16), _mm_slli_epi32(channels[3], 24))
+        );
+        _mm_storeu_si128((__m128i *)dest, result);
+    }
+
+    // 1 / divisor in every lane where it's positive, and 0 where it isn't
+    inline __m128 safe_reciprocal (__m128 divisor, __m128 & is_positive) {
+        is_positive = _mm_cmpgt_ps(divisor, _mm_setzero_ps());
+        return _mm_and_ps(is_positive, _mm_div_ps(_mm_set1_ps(1.0f), _mm_max_ps(divisor, _mm_set1_ps(1.0f))));
+    }
+
+    inline __m128 select_ps (__m128 mask, __m128 a, __m128 b) {
+        return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+    }
+
+    // Simple average of every channel (premultiplied or non-alpha data)
+    struct rgba8_premultiplied {
+        enum { bpp = 4 };
+
+        static int row (const uint8_t * r0, const uint8_t * r1, uint8_t * dest, int count) {
+            const __m128i two = _mm_set1_epi16(2);
+            int x = 0;
+            for (; x + 4 <= count; x += 4) {
+                __m128i o01, o23;
+                sum_rgba8_x4(r0 + x * 8, r1 + x * 8, o01, o23);
+                o01 = _mm_srli_epi16(_mm_add_epi16(o01, two), 2);
+                o23 = _mm_srli_epi16(_mm_add_epi16(o23, two), 2);
+                _mm_storeu_si128((__m128i *)(dest + x * 4), _mm_packus_epi16(o01, o23));
+            }
+            return x;
+        }
+
+        static void block (const uint8_t * src, int stride, int cols, int rows, uint8_t * dest) {
+            uint32_t sum[4] = { 0, 0, 0, 0 }, n = cols * rows;
+            for (int y = 0; y < rows; y++, src += stride)
+                for (int x = 0; x < cols; x++)
+                    for (int c = 0; c < 4; c++)
+                        sum[c] += src[x * 4 + c];
+            for (int c = 0; c < 4; c++)
+                dest[c] = (uint8_t)divide_rounded(sum[c], n);
+        }
+    };
+
+    // Non-premultiplied RGBA: color is weighted by alpha so transparent texels don't bleed.
+    // Unlike the managed MipGenerator, which averages every channel on its own.
+    struct rgba8_straight {
+        enum { bpp = 4 };
+
+        static inline __m128 weighted_average (const uint8_t * const * pixels, int n) {
+            __m128 sum = _mm_setzero_ps(), weighted = _mm_setzero_ps(), alpha = _mm_setzero_ps();
+            for (int i = 0; i < n; i++) {
+                __m128 p = _mm_cvtepi32_ps(load_pixel_epi32(pixels[i])),
+                    a = _mm_shuffle_ps(p, p, _MM_SHUFFLE(3, 3, 3, 3));
+                sum = _mm_add_ps(sum, p);
+                weighted = _mm_add_ps(weighted, _mm_mul_ps(p, a));
+                alpha = _mm_add_ps(alpha, a);
+            }
+
+            __m128 is_opaque, inverse_alpha = safe_reciprocal(alpha, is_opaque),
+                average = _mm_mul_ps(sum, _mm_set1_ps(1.0f / n));
+            // Fully transparent blocks fall back to the unweighted average, and alpha itself
+            //  is never weighted
+            const __m128 weighted_mask = _mm_and_ps(is_opaque, _mm_castsi128_ps(_mm_set_epi32(0, -1, -1, -1)));
+            return select_ps(weighted_mask, _mm_mul_ps(weighted, inverse_alpha), average);
+        }
+
+        static inline void store (__m128 value, uint8_t * dest) {
+            __m128i i = _mm_cvtps_epi32(value);
+            i = _mm_packs_epi32(i, i);
+            i = _mm_packus_epi16(i, i);
+            int32_t v = _mm_cvtsi128_si32(i);
+            memcpy(dest, &v, 4);
+        }
+
+        static int row (const uint8_t * r0, const uint8_t * r1, uint8_t * dest, int count) {
+            const __m128 quarter = _mm_set1_ps(0.25f);
+            int x = 0;
+            for (; x + 4 <= count; x += 4) {
+                __m128 tl[4], tr[4], bl[4], br[4];
+                split_rgba8_pairs(r0 + x * 8, tl, tr);
+                split_rgba8_pairs(r1 + x * 8, bl, br);
+
+                __m128 alpha = _mm_add_ps(_mm_add_ps(_mm_add_ps(tl[3], tr[3]), bl[3]), br[3]),
+                    is_opaque, inverse_alpha = safe_reciprocal(alpha, is_opaque);
+                __m128i result[4];
+                for (int c = 0; c < 3; c++) {
+                    __m128 sum = _mm_add_ps(_mm_add_ps(_mm_add_ps(tl[c], tr[c]), bl[c]), br[c]),
+                        weighted = _mm_add_ps(
+                            _mm_add_ps(_mm_add_ps(_mm_mul_ps(tl[c], tl[3]), _mm_mul_ps(tr[c], tr[3])), _mm_mul_ps(bl[c], bl[3])),
+                            _mm_mul_ps(br[c], br[3])
+                        );
+                    result[c] = _mm_cvtps_epi32(select_ps(is_opaque, _mm_mul_ps(weighted, inverse_alpha), _mm_mul_ps(sum, quarter)));
+                }
+                result[3] = _mm_cvtps_epi32(_mm_mul_ps(alpha, quarter));
+                store_rgba8_planes(result, dest + x * 4);
+            }
+            return x;
+        }
+
+        static void block (const uint8_t * src, int stride, int cols, int rows, uint8_t * dest) {
+            const uint8_t * pixels[9];
+            int n = 0;
+            for (int y = 0; y < rows; y++, src += stride)
+                for (int x = 0; x < cols; x++)
+                    pixels[n++] = src + x * 4;
+            store(weighted_average(pixels, n), dest);
+        }
+    };
+
+    // sRGB color averaged in linear space. Alpha is linear.
+    struct rgba8_srgb_premultiplied {
+        enum { bpp = 4 };
+
+        // Converts a pair of texels to linear [0, 65535], with alpha left as it is
+        static inline __m128i load_pair (const uint8_t * p, const uint16_t * to_linear) {
+            return _mm_setr_epi16(
+                (short)to_linear[p[0]], (short)to_linear[p[1]], (short)to_linear[p[2]], p[3],
+                (short)to_linear[p[4]], (short)to_linear[p[5]], (short)to_linear[p[6]], p[7]
+            );
+        }
+
+        static int row (const uint8_t * r0, const uint8_t * r1, uint8_t * dest, int count) {
+            const uint16_t * to_linear = stbn_srgb.to_linear16;
+            const __m128i two = _mm_set1_epi32(2);
+            int x = 0;
+            for (; x + 4 <= count; x += 4) {
+                alignas(16) uint32_t averages[16];
+                for (int i = 0; i < 4; i++) {
+                    const int offset = (x + i) * 8;
+                    __m128i top = load_pair(r0 + offset, to_linear), bottom = load_pair(r1 + offset, to_linear);
+                    __m128i sum = _mm_add_epi32(
+                        _mm_add_epi32(_mm_unpacklo_epi16(top, k_zero), _mm_unpackhi_epi16(top, k_zero)),
+                        _mm_add_epi32(_mm_unpacklo_epi16(bottom, k_zero), _mm_unpackhi_epi16(bottom, k_zero))
+                    );
+                    _mm_store_si128((__m128i *)(averages + i * 4), _mm_srli_epi32(_mm_add_epi32(sum, two), 2));
+                }
+
+                uint8_t * d = dest + x * 4;
+                for (int i = 0; i < 16; i += 4) {
+                    d[i + 0] = stbn_linear16_to_srgb(averages[i + 0]);
+                    d[i + 1] = stbn_linear16_to_srgb(averages[i + 1]);
+                    d[i + 2] = stbn_linear16_to_srgb(averages[i + 2]);
+                    d[i + 3] = (uint8_t)averages[i + 3];
+                }
+            }
+            return x;
+        }
+
+        static void block (const uint8_t * src, int stride, int cols, int rows, uint8_t * dest) {
+            const uint16_t * to_linear = stbn_srgb.to_linear16;
+            uint32_t sum[4] = { 0, 0, 0, 0 }, n = cols * rows;
+            for (int y = 0; y < rows; y++, src += stride) {
+                for (int x = 0; x < cols; x++) {
+                    const uint8_t * p = src + x * 4;
+                    sum[0] += to_linear[p[0]];
+                    sum[1] += to_linear[p[1]];
+                    sum[2] += to_linear[p[2]];
+                    sum[3] += p[3];
+                }
+            }
+            for (int c = 0; c < 3; c++)
+                dest[c] = stbn_linear16_to_srgb(divide_rounded(sum[c], n));
+            dest[3] = (uint8_t)divide_rounded(sum[3], n);
+        }
+    };
+
+    // Non-premultiplied sRGB color, weighted by alpha in linear space
+    struct rgba8_srgb_straight {
+        enum { bpp = 4 };
+
+        // Channel c of the texel at p and of the 3 texels 8 bytes apart after it, in linear space
+        static inline __m128 load_linear (const uint8_t * p, int c, const float * to_linear) {
+            return _mm_setr_ps(to_linear[p[c]], to_linear[p[c + 8]], to_linear[p[c + 16]], to_linear[p[c + 24]]);
+        }
+
+        static int row (const uint8_t * r0, const uint8_t * r1, uint8_t * dest, int count) {
+            const float * to_linear = stbn_srgb.to_linearf;
+            const __m128 quarter = _mm_set1_ps(0.25f), zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f),
+                linear_scale = _mm_set1_ps((float)STBN_LINEAR_MAX), half = _mm_set1_ps(0.5f);
+            int x = 0;
+            for (; x + 4 <= count; x += 4) {
+                const uint8_t * top = r0 + x * 8, * bottom = r1 + x * 8;
+                // Only alpha is used from these
+                __m128 tl[4], tr[4], bl[4], br[4];
+                split_rgba8_pairs(top, tl, tr);
+                split_rgba8_pairs(bottom, bl, br);
+
+                __m128 alpha = _mm_add_ps(_mm_add_ps(_mm_add_ps(tl[3], tr[3]), bl[3]), br[3]),
+                    is_opaque, inverse_alpha = safe_reciprocal(alpha, is_opaque);
+                alignas(16) int32_t indices[12];
+                for (int c = 0; c < 3; c++) {
+                    __m128 ltl = load_linear(top, c, to_linear), ltr = load_linear(top + 4, c, to_linear),
+                        lbl = load_linear(bottom, c, to_linear), lbr = load_linear(bottom + 4, c, to_linear);
+                    __m128 sum = _mm_add_ps(_mm_add_ps(_mm_add_ps(ltl, ltr), lbl), lbr),
+                        weighted = _mm_add_ps(
+                            _mm_add_ps(_mm_add_ps(_mm_mul_ps(ltl, tl[3]), _mm_mul_ps(ltr, tr[3])), _mm_mul_ps(lbl, bl[3])),
+                            _mm_mul_ps(lbr, br[3])
+                        );
+                    __m128 linear = select_ps(is_opaque, _mm_mul_ps(weighted, inverse_alpha), _mm_mul_ps(sum, quarter));
+                    // Same rounding as stbn_linearf_to_srgb
+                    linear = _mm_min_ps(_mm_max_ps(linear, zero), one);
+                    _mm_store_si128((__m128i *)(indices + c * 4), _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(linear, linear_scale), half)));
+                }
+
+                alignas(16) int32_t alphas[4];
+                _mm_store_si128((__m128i *)alphas, _mm_srli_epi32(_mm_add_epi32(_mm_cvtps_epi32(alpha), _mm_set1_epi32(2)), 2));
+
+                uint8_t * d = dest + x * 4;
+                for (int i = 0; i < 4; i++, d += 4) {
+                    d[0] = stbn_srgb.from_linear[indices[i]];
+                    d[1] = stbn_srgb.from_linear[indices[i + 4]];
+                    d[2] = stbn_srgb.from_linear[indices[i + 8]];
+                    d[3] = (uint8_t)alphas[i];
+                }
+            }
+            return x;
+        }
+
+        static void block (const uint8_t * src, int stride, int cols, int rows, uint8_t * dest) {
+            const float * to_linear = stbn_srgb.to_linearf;
+            float sum[3] = { 0, 0, 0 }, weighted[3] = { 0, 0, 0 };
+            uint32_t alpha = 0, n = cols * rows;
+            for (int y = 0; y < rows; y++, src += stride) {
+                for (int x = 0; x < cols; x++) {
+                    const uint8_t * p = src + x * 4;
+                    for (int c = 0; c < 3; c++) {
+                        float l = to_linear[p[c]];
+                        sum[c] += l;
+                        weighted[c] += l * p[3];
+                    }
+                    alpha += p[3];
+                }
+            }
+            // Multiplying by the reciprocal matches the row kernel
+            const float inverse_alpha = alpha ? 1.0f / (float)alpha : 0;
+            for (int c = 0; c < 3; c++)
+                dest[c] = stbn_linearf_to_srgb(alpha ? weighted[c] * inverse_alpha : sum[c] / n);
+            dest[3] = (uint8_t)divide_rounded(alpha, n);
+        }
+    };
+
+    struct gray8 {
+        enum { bpp = 1 };
+
+        static int row (const uint8_t * r0, const uint8_t * r1, uint8_t * dest, int count) {
+            const __m128i two = _mm_set1_epi16(2), low_bytes = _mm_set1_epi16(0xFF);
+            int x = 0;
+            for (; x + 16 <= count; x += 16) {
+                __m128i a0 = _mm_loadu_si128((const __m128i *)(r0 + x * 2)),
+                    a1 = _mm_loadu_si128((const __m128i *)(r0 + x * 2 + 16)),
+                    b0 = _mm_loadu_si128((const __m128i *)(r1 + x * 2)),
+                    b1 = _mm_loadu_si128((const __m128i *)(r1 + x * 2 + 16));
+                __m128i lo = _mm_add_epi16(
+                    _mm_add_epi16(_mm_and_si128(a0, low_bytes), _mm_srli_epi16(a0, 8)),
+                    _mm_add_epi16(_mm_and_si128(b0, low_bytes), _mm_srli_epi16(b0, 8))
+                );
+                __m128i hi = _mm_add_epi16(
+                    _mm_add_epi16(_mm_and_si128(a1, low_bytes), _mm_srli_epi16(a1, 8)),
+                    _mm_add_epi16(_mm_and_si128(b1, low_bytes), _mm_srli_epi16(b1, 8))
+                );
+                lo = _mm_srli_epi16(_mm_add_epi16(lo, two), 2);
+                hi = _mm_srli_epi16(_mm_add_epi16(hi, two), 2);
+                _mm_storeu_si128((__m128i *)(dest + x), _mm_packus_epi16(lo, hi));
+            }
+            return x;
+        }
+
+        static void block (const uint8_t * src, int stride, int cols, int rows, uint8_t * dest) {
+            uint32_t sum = 0, n = cols * rows;
+            for (int y = 0; y < rows; y++, src += stride)
+                for (int x = 0; x < cols; x++)
+                    sum += src[x];
+            *dest = (uint8_t)divide_rounded(sum, n);
+        }
+    };
+
+    // RGBA where RGB = A; only alpha is averaged and then replicated
+    struct pgray4 {
+        enum { bpp = 4 };
+
+        static int row (const uint8_t * r0, const uint8_t * r1, uint8_t * dest, int count) {
+            const __m128i two = _mm_set1_epi16(2);
+            int x = 0;
+            for (; x + 4 <= count; x += 4) {
+                __m128i o01, o23;
+                sum_rgba8_x4(r0 + x * 8, r1 + x * 8, o01, o23);
+                o01 = _mm_srli_epi16(_mm_add_epi16(o01, two), 2);
+                o23 = _mm_srli_epi16(_mm_add_epi16(o23, two), 2);
+                o01 = _mm_shufflehi_epi16(_mm_shufflelo_epi16(o01, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+                o23 = _mm_shufflehi_epi16(_mm_shufflelo_epi16(o23, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+                _mm_storeu_si128((__m128i *)(dest + x * 4), _mm_packus_epi16(o01, o23));
+            }
+            return x;
+        }
+
+        static void block (const uint8_t * src, int stride, int cols, int rows, uint8_t * dest) {
+            uint32_t sum = 0, n = cols * rows;
+            for (int y = 0; y < rows; y++, src += stride)
+                for (int x = 0; x < cols; x++)
+                    sum += src[x * 4 + 3];
+            dest[0] = dest[1] = dest[2] = dest[3] = (uint8_t)divide_rounded(sum, n);
+        }
+    };
+
+    // Same as pgray4, but RGB holds the sRGB encoding of the (linear) alpha
+    struct pgray4_srgb {
+        enum { bpp = 4 };
+
+        static int row (const uint8_t * r0, const uint8_t * r1, uint8_t * dest, int count) {
+            const __m128i two = _mm_set1_epi16(2);
+            int x = 0;
+            for (; x + 4 <= count; x += 4) {
+                __m128i o01, o23;
+                sum_rgba8_x4(r0 + x * 8, r1 + x * 8, o01, o23);
+                alignas(16) uint16_t averages[16];
+                _mm_store_si128((__m128i *)averages, _mm_srli_epi16(_mm_add_epi16(o01, two), 2));
+                _mm_store_si128((__m128i *)(averages + 8), _mm_srli_epi16(_mm_add_epi16(o23, two), 2));
+
+                uint8_t * d = dest + x * 4;
+                for (int i = 0; i < 4; i++, d += 4) {
+                    const uint32_t alpha = averages[i * 4 + 3];
+                    d[0] = d[1] = d[2] = stbn_linear16_to_srgb(alpha * 257);
+                    d[3] = (uint8_t)alpha;
+                }
+            }
+            return x;
+        }
+
+        static void block (const uint8_t * src, int stride, int cols, int rows, uint8_t * dest) {
+            uint32_t sum = 0, n = cols * rows;
+            for (int y = 0; y < rows; y++, src += stride)
+                for (int x = 0; x < cols; x++)
+                    sum += src[x * 4 + 3];
+            uint32_t alpha = divide_rounded(sum, n);
+            dest[0] = dest[1] = dest[2] = stbn_linear16_to_srgb(alpha * 257);
+            dest[3] = (uint8_t)alpha;
+        }
+    };
+
+    // Single-channel float reductions. reduce4 receives the four texels of each 2x2 block
+    //  (top left, top right, bottom left, bottom right) for four blocks at once.
+    struct op_average {
+        static float reduce (const float * values, int n) {
+            // Full blocks are added in the same order as reduce4, so both round the same way
+            if (n == 4)
+                return ((values[0] + values[1]) + (values[2] + values[3])) * 0.25f;
+            float sum = 0;
+            for (int i = 0; i < n; i++)
+                sum += values[i];
+            return sum / n;
+        }
+
+        static inline __m128 reduce4 (__m128 a, __m128 b, __m128 c, __m128 d) {
+            return _mm_mul_ps(_mm_add_ps(_mm_add_ps(a, b), _mm_add_ps(c, d)), _mm_set1_ps(0.25f));
+        }
+    };
+
+    struct op_min {
+        static float reduce (const float * values, int n) {
+            float result = values[0];
+            for (int i = 1; i < n; i++)
+                result = (values[i] < result) ? values[i] : result;
+            return result;
+        }
+
+        static inline __m128 reduce4 (__m128 a, __m128 b, __m128 c, __m128 d) {
+            return _mm_min_ps(_mm_min_ps(a, b), _mm_min_ps(c, d));
+        }
+    };
+
+    struct op_max {
+        static float reduce (const float * values, int n) {
+            float result = values[0];
+            for (int i = 1; i < n; i++)
+                result = (values[i] > result) ? values[i] : result;
+            return result;
+        }
+
+        static inline __m128 reduce4 (__m128 a, __m128 b, __m128 c, __m128 d) {
+            return _mm_max_ps(_mm_max_ps(a, b), _mm_max_ps(c, d));
+        }
+    };
+
+    // Halfway between the minimum and the average (good for text SDFs)
+    struct op_pseudo_min {
+        static float reduce (const float * values, int n) {
+            return (op_min::reduce(values, n) + op_average::reduce(values, n)) * 0.5f;
+        }
+
+        static inline __m128 reduce4 (__m128 a, __m128 b, __m128 c, __m128 d) {
+            return _mm_mul_ps(_mm_add_ps(op_min::reduce4(a, b, c, d), op_average::reduce4(a, b, c, d)), _mm_set1_ps(0.5f));
+        }
+    };
+
+    // Deinterleaves 8 texels from each of two rows into 2x2 blocks and reduces them to 4 texels
+    template<typename Op>
+    inline __m128 reduce_pairs (__m128 top_lo, __m128 top_hi, __m128 bottom_lo, __m128 bottom_hi) {
+        return Op::reduce4(
+            _mm_shuffle_ps(top_lo, top_hi, _MM_SHUFFLE(2, 0, 2, 0)),
+            _mm_shuffle_ps(top_lo, top_hi, _MM_SHUFFLE(3, 1, 3, 1)),
+            _mm_shuffle_ps(bottom_lo, bottom_hi, _MM_SHUFFLE(2, 0, 2, 0)),
+            _mm_shuffle_ps(bottom_lo, bottom_hi, _MM_SHUFFLE(3, 1, 3, 1))
+        );
+    }
+
+    struct format_float {
+        enum { bpp = 4 };
+
+        static inline float load (const uint8_t * p) {
+            float result;
+            memcpy(&result, p, 4);
+            return result;
+        }
+
+        static inline void store (uint8_t * p, float value) {
+            memcpy(p, &value, 4);
+        }
+
+        template<typename Op>
+        static int row (const uint8_t * r0, const uint8_t * r1, uint8_t * dest, int count) {
+            const float * top = (const float *)r0, * bottom = (const float *)r1;
+            int x = 0;
+            for (; x + 4 <= count; x += 4) {
+                __m128 result = reduce_pairs<Op>(
+                    _mm_loadu_ps(top + x * 2), _mm_loadu_ps(top + x * 2 + 4),
+                    _mm_loadu_ps(bottom + x * 2), _mm_loadu_ps(bottom + x * 2 + 4)
+                );
+                _mm_storeu_ps((float *)dest + x, result);
+            }
+            return x;
+        }
+    };
+
+    template<typename Op>
+    STBN_TARGET("f16c") int half_row_f16c (const uint8_t * r0, const uint8_t * r1, uint8_t * dest, int count) {
+        int x = 0;
+        for (; x + 4 <= count; x += 4) {
+            __m128i top = _mm_loadu_si128((const __m128i *)(r0 + x * 4)),
+                bottom = _mm_loadu_si128((const __m128i *)(r1 + x * 4));
+            __m128 result = reduce_pairs<Op>(
+                _mm_cvtph_ps(top), _mm_cvtph_ps(_mm_unpackhi_epi64(top, top)),
+                _mm_cvtph_ps(bottom), _mm_cvtph_ps(_mm_unpackhi_epi64(bottom, bottom))
+            );
+            _mm_storel_epi64((__m128i *)(dest + x * 2), _mm_cvtps_ph(result, _MM_FROUND_TO_NEAREST_INT));
+        }
+        return x;
+    }
+
+    struct format_half {
+        enum { bpp = 2 };
+
+        static inline float load (const uint8_t * p) {
+            uint16_t result;
+            memcpy(&result, p, 2);
+            return stbn_half_to_float(result);
+        }
+
+        static inline void store (uint8_t * p, float value) {
+            uint16_t h = stbn_float_to_half(value);
+            memcpy(p, &h, 2);
+        }
+
+        template<typename Op>
+        static int row (const uint8_t * r0, const uint8_t * r1, uint8_t * dest, int count) {
+            if (!stbn_get_cpu_features().f16c)
+                return 0;
+            return half_row_f16c<Op>(r0, r1, dest, count);
+        }
+    };
+
+    template<typename Op, typename Format>
+    struct float_kernel {
+        enum { bpp = Format::bpp };
+
+        static int row (const uint8_t * r0, const uint8_t * r1, uint8_t * dest, int count) {
+            return Format::template row<Op>(r0, r1, dest, count);
+        }
+
+        static void block (const uint8_t * src, int stride, int cols, int rows, uint8_t * dest) {
+            float values[9] = {};
+            int n = 0;
+            for (int y = 0; y < rows; y++, src += stride)
+                for (int x = 0; x < cols; x++)
+                    values[n++] = Format::load(src + x * bpp);
+            Format::store(dest, Op::reduce(values, n));
+        }
+    };
+
+    template<typename Kernel>
+    int reduce (
+        const void * src, int src_w, int src_h, int src_stride_bytes,
+        void * dest, int dest_w, int dest_h, int dest_stride_bytes
+    ) {
+        if (!src || !dest)
+            return 0;
+        if (!is_valid_reduction(src_w, dest_w) || !is_valid_reduction(src_h, dest_h))
+            return 0;
+
+        if (src_stride_bytes == 0)
+            src_stride_bytes = src_w * Kernel::bpp;
+        if (dest_stride_bytes == 0)
+            dest_stride_bytes = dest_w * Kernel::bpp;
+
+        const int full_columns = count_full_pairs(src_w, dest_w);
+
+        for (int y = 0; y < dest_h; y++) {
+            mip_span sy = get_span(y, src_h, dest_h);
+            const uint8_t * src_row = (const uint8_t *)src + (size_t)sy.first * src_stride_bytes;
+            uint8_t * dest_row = (uint8_t *)dest + (size_t)y * dest_stride_bytes;
+
+            int x = 0;
+            if (sy.count == 2)
+                x = Kernel::row(src_row, src_row + src_stride_bytes, dest_row, full_columns);
+
+            for (; x < dest_w; x++) {
+                mip_span sx = get_span(x, src_w, dest_w);
+                Kernel::block(src_row + sx.first * Kernel::bpp, src_stride_bytes, sx.count, sy.count, dest_row + x * Kernel::bpp);
+            }
+        }
+
+        return 1;
+    }
+}
+
+#define STBN_MIP_REDUCER(name, kernel) \
+    STBNDEF int name ( \
+        const void * src, int src_w, int src_h, int src_stride_bytes, \
+        void * dest, int dest_w, int dest_h, int dest_stride_bytes \
+    ) { \
+        return reduce<kernel>(src, src_w, src_h, src_stride_bytes, dest, dest_w, dest_h, dest_stride_bytes); \
+    }
+
+STBN_MIP_REDUCER(stbn_mip_rgba8_premultiplied, rgba8_premultiplied)
+STBN_MIP_REDUCER(stbn_mip_rgba8, rgba8_straight)
+STBN_MIP_REDUCER(stbn_mip_rgba8_srgb_premultiplied, rgba8_srgb_premultiplied)
+STBN_MIP_REDUCER(stbn_mip_rgba8_srgb, rgba8_srgb_straight)
+STBN_MIP_REDUCER(stbn_mip_gray8, gray8)
+STBN_MIP_REDUCER(stbn_mip_pgray4, pgray4)
+STBN_MIP_REDUCER(stbn_mip_pgray4_srgb, pgray4_srgb)
+
+typedef float_kernel<op_average, format_float> single_average;
+typedef float_kernel<op_min, format_float> single_min;
+typedef float_kernel<op_pseudo_min, format_float> single_pseudo_min;
+typedef float_kernel<op_max, format_float> single_max;
+typedef float_kernel<op_average, format_half> half_average;
+typedef float_kernel<op_min, format_half> half_min;
+typedef float_kernel<op_pseudo_min, format_half> half_pseudo_min;
+typedef float_kernel<op_max, format_half> half_max;
+
+STBN_MIP_REDUCER(stbn_mip_single, single_average)
+STBN_MIP_REDUCER(stbn_mip_single_min, single_min)
+STBN_MIP_REDUCER(stbn_mip_single_pseudo_min, single_pseudo_min)
+STBN_MIP_REDUCER(stbn_mip_single_max, single_max)
+STBN_MIP_REDUCER(stbn_mip_half, half_average)
+STBN_MIP_REDUCER(stbn_mip_half_min, half_min)
+STBN_MIP_REDUCER(stbn_mip_half_pseudo_min, half_pseudo_min)
+STBN_MIP_REDUCER(stbn_mip_half_max, half_max)
@@ -0,0 +1,200 @@
+#include "stbnative.h"
+#include "threads.h"
+#include <stdint.h>
+#include <string.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Reading image dimensions from many files without mapping or reading all of them.
+// Only the start of each file is read with a positioned read. Headers are almost always in
+//  the first KB, but JPEGs can have large EXIF/ICC segments before their frame header, so
+//  if stbi_info fails we read more of the file (up to all of it) and try again.
+
+struct stbn_image_info {
+    int width, height, channels;
+    int is_16_bit;
+    // 1 if the header was read successfully, otherwise failure_reason is set
+    int ok;
+    const char * failure_reason;
+};
+
+namespace {
+    const int64_t initial_read = 1024;
+
+#ifdef _WIN32
+    typedef HANDLE file_handle;
+    const file_handle invalid_file = INVALID_HANDLE_VALUE;
+
+    file_handle open_file (const char * path) {
+        // Paths are UTF-8
+        wchar_t stack_path[MAX_PATH];
+        wchar_t * wide = stack_path;
+        int length = MultiByteToWideChar(CP_UTF8, 0, path, -1, nullptr, 0);
+        if (length <= 0)
+            return invalid_file;
+        if (length > MAX_PATH)
+            wide = (wchar_t *)stbn_malloc(length * sizeof(wchar_t), STBN_ALLOC_NATIVE);
+        if (!wide)
+            return invalid_file;
+        MultiByteToWideChar(CP_UTF8, 0, path, -1, wide, length);
+        file_handle result = CreateFileW(
+            wide, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+            nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr
+        );
+        if (wide != stack_path)
+            stbn_free(wide);
+        return result;
+    }
+
+    int64_t file_size (file_handle file) {
+        LARGE_INTEGER size;
+        return GetFileSizeEx(file, &size) ? size.QuadPart : -1;
+    }
+
+    int64_t read_at (file_handle file, void * buffer, int64_t offset, int64_t count) {
+        OVERLAPPED position = {};
+        position.Offset = (DWORD)offset;
+        position.OffsetHigh = (DWORD)(offset >> 32);
+        DWORD bytes_read = 0;
+        if (!ReadFile(file, buffer, (DWORD)count, &bytes_read, &position))
+            return -1;
+        return bytes_read;
+    }
+
+    void close_file (file_handle file) {
+        CloseHandle(file);
+    }
+#else
+    typedef int file_handle;
+    const file_handle invalid_file = -1;
+
+    file_handle open_file (const char * path) {
+        return open(path, O_RDONLY | O_CLOEXEC);
+    }
+
+    int64_t file_size (file_handle file) {
+        struct stat info;
+        return fstat(file, &info) == 0 ? (int64_t)info.st_size : -1;
+    }
+
+    int64_t read_at (file_handle file, void * buffer, int64_t offset, int64_t count) {
+        int64_t total = 0;
+        while (total < count) {
+            ssize_t result = pread(file, (uint8_t *)buffer + total, (size_t)(count - total), (off_t)(offset + total));
+            if (result < 0)
+                return -1;
+            else if (result == 0)
+                break;
+            total += result;
+        }
+        return total;
+    }
+
+    void close_file (file_handle file) {
+        close(file);
+    }
+#endif
+
+    // Reads more of the file into buffer (growing it) until stbi_info succeeds or the whole
+    //  file has been read.
+    void probe_file (const char * path, stbn_image_info & result) {
+        memset(&result, 0, sizeof(result));
+        file_handle file = path ? open_file(path) : invalid_file;
+        if (file == invalid_file) {
+            result.failure_reason = "can't open file";
+            return;
+        }
+
+        int64_t size = file_size(file);
+        if ((size < 0) || (size > INT32_MAX)) {
+            result.failure_reason = "can't get file size";
+            close_file(file);
+            return;
+        }
+
+        uint8_t stack_buffer[initial_read];
+        uint8_t * buffer = stack_buffer;
+        int64_t capacity = initial_read, loaded = 0;
+        result.failure_reason = "file is empty";
+
+        while (loaded < size) {
+            int64_t want = (capacity < size) ? capacity : size;
+            if (want > loaded) {
+                int64_t count = read_at(file, buffer + loaded, loaded, want - loaded);
+                if (count <= 0) {
+                    result.failure_reason = "can't read file";
+                    break;
+                }
+                loaded += count;
+            }
+
+            if (stbi_info_from_memory(buffer, (int)loaded, &result.width, &result.height, &result.channels)) {
+                result.is_16_bit = stbi_is_16_bit_from_memory(buffer, (int)loaded);
+                result.ok = 1;
+                result.failure_reason = nullptr;
+                break;
+            }
+            result.failure_reason = stbi_failure_reason();
+
+            // Grow quickly, since a header past the first KB is usually past the first 64KB too
+            int64_t next = capacity * 16;
+            uint8_t * grown = (uint8_t *)stbn_malloc((size_t)((next < size) ? next : size), STBN_ALLOC_NATIVE);
+            if (!grown) {
+                result.failure_reason = "out of memory";
+                break;
+            }
+            memcpy(grown, buffer, (size_t)loaded);
+            if (buffer != stack_buffer)
+                stbn_free(buffer);
+            buffer = grown;
+            capacity = next;
+        }
+
+        if (buffer != stack_buffer)
+            stbn_free(buffer);
+        close_file(file);
+    }
+
+    struct probe_job {
+        const char * const * paths;
+        stbn_image_info * results;
+        int count, files_per_task;
+    };
+
+    void probe_band (void * userdata, int band) {
+        const probe_job & job = *(const probe_job *)userdata;
+        int first = band * job.files_per_task,
+            last = (first + job.files_per_task < job.count) ? first + job.files_per_task : job.count;
+        for (int i = first; i < last; i++)
+            probe_file(job.paths[i], job.results[i]);
+    }
+}
+
+// Reads the dimensions, channel count and bit depth of count files (UTF-8 paths) in parallel,
+//  reading as little of each file as possible. Returns how many files were probed successfully;
+//  check each result's ok field for the rest.
+STBNDEF int stbn_probe_files (const char * const * paths, int count, stbn_image_info * results) {
+    if (!paths || !results || (count <= 0))
+        return 0;
+
+    probe_job job;
+    job.paths = paths;
+    job.results = results;
+    job.count = count;
+    // Small tasks, since every file is a few syscalls and mostly waiting on I/O
+    job.files_per_task = 8;
+    stbn_parallel_for((count + job.files_per_task - 1) / job.files_per_task, probe_band, &job);
+
+    int succeeded = 0;
+    for (int i = 0; i < count; i++)
+        succeeded += results[i].ok;
+    return succeeded;
+}
@@ -0,0 +1,393 @@
+#include "stbnative.h"
+#include "qoi.h"
+#include <stdint.h>
+#include <string.h>
+
+#define ZSTD_STATIC_LINKING_ONLY
+#include "../../Ext/zstd/zstd.h"
+
+// An implementation of the QOI format (https://qoiformat.org/qoi-specification.pdf).
+// Every pixel is encoded as one of a handful of byte-aligned ops (a run of the previous
+//  pixel, a hit in a 64-entry table of recently seen pixels, a small delta, or a literal),
+//  so encoding and decoding are a single branchy pass with no entropy coding. That makes it
+//  several times faster than PNG at a somewhat worse ratio; zstd can win most of that back.
+
+namespace {
+    const int header_size = 14, padding_size = 8;
+    const uint8_t padding[padding_size] = { 0, 0, 0, 0, 0, 0, 0, 1 };
+    // From the spec, and it keeps worst case sizes comfortably inside size_t on 32-bit
+    const uint32_t max_pixels = 400000000;
+
+    const uint8_t OP_INDEX = 0x00,
+        OP_DIFF = 0x40,
+        OP_LUMA = 0x80,
+        OP_RUN = 0xC0,
+        OP_RGB = 0xFE,
+        OP_RGBA = 0xFF,
+        OP_MASK = 0xC0;
+
+    struct rgba {
+        uint8_t r, g, b, a;
+    };
+
+    inline uint32_t pack (const rgba & px) {
+        uint32_t result;
+        memcpy(&result, &px, 4);
+        return result;
+    }
+
+    inline int hash (const rgba & px) {
+        return (px.r * 3 + px.g * 5 + px.b * 7 + px.a * 11) & 63;
+    }
+
+    inline void write_u32_be (uint8_t * dest, uint32_t value) {
+        dest[0] = (uint8_t)(value >> 24);
+        dest[1] = (uint8_t)(value >> 16);
+        dest[2] = (uint8_t)(value >> 8);
+        dest[3] = (uint8_t)value;
+    }
+
+    inline uint32_t read_u32_be (const uint8_t * src) {
+        return ((uint32_t)src[0] << 24) | ((uint32_t)src[1] << 16) | ((uint32_t)src[2] << 8) | src[3];
+    }
+
+    void * zstd_alloc (void *, size_t size) {
+        return stbn_malloc(size, STBN_ALLOC_NATIVE);
+    }
+
+    void zstd_free (void *, void * address) {
+        stbn_free(address);
+    }
+
+    const ZSTD_customMem zstd_memory = { zstd_alloc, zstd_free, nullptr };
+
+    struct header {
+        uint32_t width, height;
+        int channels, colorspace;
+        bool wrapped;
+    };
+
+    bool read_header (const void * buffer, int length, header & result) {
+        const uint8_t * src = (const uint8_t *)buffer;
+        if (!src || (length < header_size))
+            return false;
+        if (memcmp(src, "qoif", 4) == 0)
+            result.wrapped = false;
+        else if (memcmp(src, "qoiz", 4) == 0)
+            result.wrapped = true;
+        else
+            return false;
+
+        result.width = read_u32_be(src + 4);
+        result.height = read_u32_be(src + 8);
+        result.channels = src[12];
+        result.colorspace = src[13];
+        return (result.width > 0) && (result.height > 0) &&
+            (result.height <= max_pixels / result.width) &&
+            ((result.channels == 3) || (result.channels == 4)) &&
+            (result.colorspace <= 1);
+    }
+
+    template<int channels>
+    uint8_t * encode_pixels (const uint8_t * pixels, int width, int height, size_t stride, uint8_t * out) {
+        rgba index[64];
+        memset(index, 0, sizeof(index));
+        rgba prev = { 0, 0, 0, 255 };
+        uint32_t prev_packed = pack(prev);
+        int run = 0;
+
+        // The pixel stream (and so a run) continues from the end of one row to the next
+        for (int y = 0; y < height; y++) {
+            const uint8_t * src = pixels + stride * y;
+            for (int x = 0; x < width; x++, src += channels) {
+                rgba px;
+                px.r = src[0];
+                px.g = src[1];
+                px.b = src[2];
+                px.a = (channels == 4) ? src[3] : 255;
+                const uint32_t packed = pack(px);
+
+                if (packed == prev_packed) {
+                    if (++run == 62) {
+                        *out++ = (uint8_t)(OP_RUN | (run - 1));
+                        run = 0;
+                    }
+                    continue;
+                }
+
+                if (run) {
+                    *out++ = (uint8_t)(OP_RUN | (run - 1));
+                    run = 0;
+                }
+
+                const int h = hash(px);
+                if (pack(index[h]) == packed) {
+                    *out++ = (uint8_t)(OP_INDEX | h);
+                } else {
+                    index[h] = px;
+                    if (px.a == prev.a) {
+                        const int8_t vr = (int8_t)(px.r - prev.r),
+                            vg = (int8_t)(px.g - prev.g),
+                            vb = (int8_t)(px.b - prev.b),
+                            vg_r = (int8_t)(vr - vg),
+                            vg_b = (int8_t)(vb - vg);
+
+                        if ((vr > -3) && (vr < 2) && (vg > -3) && (vg < 2) && (vb > -3) && (vb < 2)) {
+                            *out++ = (uint8_t)(OP_DIFF | ((vr + 2) << 4) | ((vg + 2) << 2) | (vb + 2));
+                        } else if ((vg_r > -9) && (vg_r < 8) && (vg > -33) && (vg < 32) && (vg_b > -9) && (vg_b < 8)) {
+                            *out++ = (uint8_t)(OP_LUMA | (vg + 32));
+                            *out++ = (uint8_t)(((vg_r + 8) << 4) | (vg_b + 8));
+                        } else {
+                            *out++ = OP_RGB;
+                            *out++ = px.r;
+                            *out++ = px.g;
+                            *out++ = px.b;
+                        }
+                    } else {
+                        *out++ = OP_RGBA;
+                        memcpy(out, &px, 4);
+                        out += 4;
+                    }
+                }
+
+                prev = px;
+                prev_packed = packed;
+            }
+        }
+
+        if (run)
+            *out++ = (uint8_t)(OP_RUN | (run - 1));
+        return out;
+    }
+
+    // ops covers everything after the header, including the padding
+    template<int channels>
+    bool decode_pixels (const uint8_t * ops, size_t length, int width, int height, uint8_t * dest, size_t stride) {
+        if (length < padding_size)
+            return false;
+        // No op is longer than 5 bytes, so as long as an op starts before the padding it
+        //  can't read past the end of the buffer
+        const uint8_t * p = ops, * end = ops + length - padding_size;
+        rgba index[64];
+        memset(index, 0, sizeof(index));
+        rgba px = { 0, 0, 0, 255 };
+        int run = 0;
+
+        for (int y = 0; y < height; y++) {
+            uint8_t * out = dest + stride * y;
+            for (int x = 0; x < width; x++, out += channels) {
+                if (run > 0) {
+                    run--;
+                } else if (p < end) {
+                    const int b1 = *p++;
+                    if (b1 == OP_RGB) {
+                        px.r = p[0];
+                        px.g = p[1];
+                        px.b = p[2];
+                        p += 3;
+                    } else if (b1 == OP_RGBA) {
+                        memcpy(&px, p, 4);
+                        p += 4;
+                    } else {
+                        switch (b1 & OP_MASK) {
+                            case OP_INDEX:
+                                px = index[b1];
+                                break;
+                            case OP_DIFF:
+                                px.r += ((b1 >> 4) & 3) - 2;
+                                px.g += ((b1 >> 2) & 3) - 2;
+                                px.b += (b1 & 3) - 2;
+                                break;
+                            case OP_LUMA: {
+                                const int b2 = *p++, vg = (b1 & 0x3F) - 32;
+                                px.r += vg - 8 + ((b2 >> 4) & 0x0F);
+                                px.g += vg;
+                                px.b += vg - 8 + (b2 & 0x0F);
+                                break;
+                            }
+                            default:
+                                run = b1 & 0x3F;
+                                break;
+                        }
+                    }
+                    index[hash(px)] = px;
+                } else {
+                    // Truncated
+                    return false;
+                }
+
+                out[0] = px.r;
+                out[1] = px.g;
+                out[2] = px.b;
+                if (channels == 4)
+                    out[3] = px.a;
+            }
+        }
+
+        return true;
+    }
+
+    bool decode (const void * buffer, int length, const header & h, uint8_t * dest, size_t stride, int dest_channels) {
+        const uint8_t * ops = (const uint8_t *)buffer + header_size;
+        size_t ops_length = (size_t)length - header_size;
+        uint8_t * unwrapped = nullptr;
+
+        if (h.wrapped) {
+            // Refuse anything larger than the worst case for an image of this size
+            const unsigned long long size = ZSTD_getFrameContentSize(ops, ops_length),
+                max_size = (unsigned long long)h.width * h.height * (h.channels + 1) + padding_size;
+            if ((size == ZSTD_CONTENTSIZE_UNKNOWN) || (size == ZSTD_CONTENTSIZE_ERROR) || (size > max_size))
+                return false;
+
+            unwrapped = (uint8_t *)stbn_malloc((size_t)size, STBN_ALLOC_NATIVE);
+            ZSTD_DCtx * context = unwrapped ? ZSTD_createDCtx_advanced(zstd_memory) : nullptr;
+            if (!context) {
+                stbn_free(unwrapped);
+                return false;
+            }
+            const size_t decompressed = ZSTD_decompressDCtx(context, unwrapped, (size_t)size, ops, ops_length);
+            ZSTD_freeDCtx(context);
+            if (ZSTD_isError(decompressed) || (decompressed != size)) {
+                stbn_free(unwrapped);
+                return false;
+            }
+            ops = unwrapped;
+            ops_length = (size_t)size;
+        }
+
+        const bool ok = (dest_channels == 4)
+            ? decode_pixels<4>(ops, ops_length, (int)h.width, (int)h.height, dest, stride)
+            : decode_pixels<3>(ops, ops_length, (int)h.width, (int)h.height, dest, stride);
+        stbn_free(unwrapped);
+        return ok;
+    }
+}
+
+STBNDEF void * stbn_qoi_encode (
+    const void * pixels, int width, int height, int channels, int stride,
+    int flags, int zstd_level, int * out_length
+) {
+    if (!pixels || !out_length || (width <= 0) || (height <= 0) || ((channels != 3) && (channels != 4)))
+        return nullptr;
+    if ((uint32_t)height > max_pixels / (uint32_t)width)
+        return nullptr;
+    *out_length = 0;
+
+    const size_t row_size = (size_t)width * channels;
+    if (stride == 0)
+        stride = (int)row_size;
+    else if ((stride < 0) || ((size_t)stride < row_size))
+        return nullptr;
+
+    const size_t max_size = header_size + (size_t)width * height * (channels + 1) + padding_size;
+    uint8_t * result = (uint8_t *)stbn_malloc(max_size, STBN_ALLOC_WRITE);
+    if (!result)
+        return nullptr;
+
+    memcpy(result, "qoif", 4);
+    write_u32_be(result + 4, (uint32_t)width);
+    write_u32_be(result + 8, (uint32_t)height);
+    result[12] = (uint8_t)channels;
+    result[13] = (flags & STBN_QOI_LINEAR) ? 1 : 0;
+
+    uint8_t * end = (channels == 4)
+        ? encode_pixels<4>((const uint8_t *)pixels, width, height, (size_t)stride, result + header_size)
+        : encode_pixels<3>((const uint8_t *)pixels, width, height, (size_t)stride, result + header_size);
+    memcpy(end, padding, padding_size);
+    size_t length = (size_t)(end - result) + padding_size;
+
+    if (zstd_level > 0) {
+        const size_t body_size = length - header_size,
+            bound = ZSTD_compressBound(body_size);
+        uint8_t * wrapped = (uint8_t *)stbn_malloc(header_size + bound, STBN_ALLOC_WRITE);
+        ZSTD_CCtx * context = wrapped ? ZSTD_createCCtx_advanced(zstd_memory) : nullptr;
+        size_t compressed = 0;
+        if (context) {
+            compressed = ZSTD_compressCCtx(
+                context, wrapped + header_size, bound, result + header_size, body_size,
+                (zstd_level < ZSTD_maxCLevel()) ? zstd_level : ZSTD_maxCLevel()
+            );
+            ZSTD_freeCCtx(context);
+            memcpy(wrapped, result, header_size);
+            memcpy(wrapped, "qoiz", 4);
+        }
+        stbn_free(result);
+        if (!context || ZSTD_isError(compressed)) {
+            stbn_free(wrapped);
+            return nullptr;
+        }
+
+        result = wrapped;
+        length = header_size + compressed;
+    }
+
+    if (length > INT32_MAX) {
+        stbn_free(result);
+        return nullptr;
+    }
+    *out_length = (int)length;
+    return result;
+}
+
+STBNDEF int stbn_qoi_test (const void * buffer, int length) {
+    header h;
+    return read_header(buffer, length, h) ? 1 : 0;
+}
+
+STBNDEF int stbn_qoi_info (const void * buffer, int length, int * width, int * height, int * channels) {
+    header h;
+    if (!read_header(buffer, length, h))
+        return 0;
+    if (width)
+        *width = (int)h.width;
+    if (height)
+        *height = (int)h.height;
+    if (channels)
+        *channels = h.channels;
+    return 1;
+}
+
+STBNDEF int stbn_qoi_decode_into (
+    const void * buffer, int length, void * dest, int dest_stride, int dest_channels
+) {
+    header h;
+    if (!dest || ((dest_channels != 3) && (dest_channels != 4)) || !read_header(buffer, length, h))
+        return 0;
+
+    const size_t row_size = (size_t)h.width * dest_channels;
+    if (dest_stride == 0)
+        dest_stride = (int)row_size;
+    else if ((dest_stride < 0) || ((size_t)dest_stride < row_size))
+        return 0;
+
+    return decode(buffer, length, h, (uint8_t *)dest, (size_t)dest_stride, dest_channels) ? 1 : 0;
+}
+
+STBNDEF void * stbn_qoi_load (
+    const void * buffer, int length, int * width, int * height, int * channels_in_file, int desired_channels
+) {
+    header h;
+    if (!read_header(buffer, length, h))
+        return nullptr;
+
+    const int channels = desired_channels ? desired_channels : h.channels;
+    if ((channels != 3) && (channels != 4))
+        return nullptr;
+
+    // Allocated like stb_image's results, so it can be freed with stbi_image_free
+    uint8_t * result = (uint8_t *)stbn_malloc((size_t)h.width * h.height * channels, STBN_ALLOC_IMAGE);
+    if (!result)
+        return nullptr;
+    if (!decode(buffer, length, h, result, (size_t)h.width * channels, channels)) {
+        stbn_free(result);
+        return nullptr;
+    }
+
+    if (width)
+        *width = (int)h.width;
+    if (height)
+        *height = (int)h.height;
+    if (channels_in_file)
+        *channels_in_file = h.channels;
+    return result;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+// QOI ("Quite OK Image") lossless RGB/RGBA codec, for when PNG is too slow: screenshot bursts,
+//  render target dumps and intermediate caches.
+// Images can optionally be wrapped with zstd. A wrapped image keeps the plain 14-byte QOI
+//  header (with the magic changed to "qoiz") followed by a single zstd frame holding the rest
+//  of the file, so its dimensions can be read without decompressing anything.
+
+enum {
+    // Sets the colorspace field of the header to "all channels linear"
+    STBN_QOI_LINEAR = 1,
+};
+
+// Pixels are 8-bit RGB (3 channels) or RGBA (4 channels), stride 0 means tightly packed rows.
+// zstd_level > 0 wraps the result with zstd at that level.
+// Returns the encoded image (free with stbi_image_free), or null on failure.
+STBNDEF void * stbn_qoi_encode (
+    const void * pixels, int width, int height, int channels, int stride,
+    int flags, int zstd_level, int * out_length
+);
+
+// 1 if buffer starts with a QOI header (wrapped or not)
+STBNDEF int stbn_qoi_test (const void * buffer, int length);
+STBNDEF int stbn_qoi_info (const void * buffer, int length, int * width, int * height, int * channels);
+
+// Decodes into dest, which must hold height rows of dest_stride bytes (0 for tightly packed).
+// dest_channels is 3 or 4; a missing alpha channel is filled with 255. Returns 1 on success.
+STBNDEF int stbn_qoi_decode_into (
+    const void * buffer, int length, void * dest, int dest_stride, int dest_channels
+);
+
+// desired_channels is 0 (the file's channel count), 3 or 4. Free the result with stbi_image_free.
+STBNDEF void * stbn_qoi_load (
+    const void * buffer, int length, int * width, int * height, int * channels_in_file, int desired_channels
+);
@@ -0,0 +1,372 @@
+#include "stbnative.h"
+#include "rect_pack.h"
+#include <algorithm>
+#include <string.h>
+
+// The skyline is an array of segments ordered by x that always covers [0, width) exactly, so
+//  it never has more than width entries and is allocated up front. Adjacent segments at the
+//  same height are merged as rects are placed, which keeps it short (tens to a few hundred
+//  segments for a glyph atlas), so a linear scan per insert is all we need.
+// The maxrects free list only grows when a placement splits a free rect, and the pieces of a
+//  split can only be redundant with each other or with free rects next to the placed rect
+//  (every other pair was already checked when it was created), so pruning doesn't have to be
+//  quadratic in the size of the whole list.
+
+namespace {
+    // Bounds the skyline allocation
+    const int max_size = 65536;
+
+    struct skyline_node {
+        int x, y, width;
+    };
+
+    struct free_rect {
+        int x, y, width, height;
+    };
+
+    bool reserve (free_rect * & items, int & capacity, int needed) {
+        if (needed <= capacity)
+            return true;
+        int grown = capacity ? capacity * 2 : 64;
+        while (grown < needed)
+            grown *= 2;
+        free_rect * result = (free_rect *)stbn_realloc(items, (size_t)grown * sizeof(free_rect), STBN_ALLOC_NATIVE);
+        if (!result)
+            return false;
+        items = result;
+        capacity = grown;
+        return true;
+    }
+
+    bool contains (const free_rect & outer, const free_rect & inner) {
+        return (inner.x >= outer.x) && (inner.y >= outer.y) &&
+            (inner.x + inner.width <= outer.x + outer.width) &&
+            (inner.y + inner.height <= outer.y + outer.height);
+    }
+
+    bool overlaps (const free_rect & r, int x, int y, int width, int height) {
+        return (x < r.x + r.width) && (x + width > r.x) &&
+            (y < r.y + r.height) && (y + height > r.y);
+    }
+
+    struct sort_key {
+        int64_t primary;
+        int secondary, index;
+    };
+
+    bool sort_key_less (const sort_key & lhs, const sort_key & rhs) {
+        if (lhs.primary != rhs.primary)
+            return lhs.primary > rhs.primary;
+        if (lhs.secondary != rhs.secondary)
+            return lhs.secondary > rhs.secondary;
+        return lhs.index < rhs.index;
+    }
+}
+
+struct stbn_rect_packer {
+    int width, height, algorithm;
+    int64_t used_area;
+    // STBN_RECT_PACK_SKYLINE
+    skyline_node * nodes;
+    int node_count;
+    // STBN_RECT_PACK_MAXRECTS
+    free_rect * free_rects, * pieces;
+    int free_count, free_capacity, piece_capacity;
+};
+
+namespace {
+    bool skyline_insert (stbn_rect_packer & packer, int width, int height, int & result_x, int & result_y) {
+        skyline_node * nodes = packer.nodes;
+        int best_index = -1, best_y = INT32_MAX;
+        int64_t best_waste = INT64_MAX;
+
+        for (int i = 0, n = packer.node_count; i < n; i++) {
+            const int x = nodes[i].x;
+            if (x + width > packer.width)
+                break;
+            if (nodes[i].y > best_y)
+                continue;
+
+            // The rect rests on the highest segment under it, and everything between the
+            //  segments and its bottom edge is wasted. Both only go up as we move right, so
+            //  we can stop as soon as this position can't beat the best one.
+            int y = nodes[i].y, covered = 0;
+            int64_t waste = 0;
+            bool rejected = false;
+            for (int j = i; covered < width; j++) {
+                const skyline_node & node = nodes[j];
+                if (node.y > y) {
+                    waste += (int64_t)covered * (node.y - y);
+                    y = node.y;
+                }
+                const int span = (node.width < width - covered) ? node.width : width - covered;
+                waste += (int64_t)span * (y - node.y);
+                covered += span;
+                if (
+                    (y + height > packer.height) || (y > best_y) ||
+                    ((y == best_y) && (waste >= best_waste))
+                ) {
+                    rejected = true;
+                    break;
+                }
+            }
+
+            if (rejected)
+                continue;
+            best_index = i;
+            best_y = y;
+            best_waste = waste;
+        }
+
+        if (best_index < 0)
+            return false;
+
+        // Replace the segments under the rect with its top edge, trimming the last one if the
+        //  rect only covers part of it
+        const int x = nodes[best_index].x, right = x + width;
+        int last = best_index, n = packer.node_count;
+        while ((last < n) && (nodes[last].x + nodes[last].width <= right))
+            last++;
+        if ((last < n) && (nodes[last].x < right)) {
+            nodes[last].width -= right - nodes[last].x;
+            nodes[last].x = right;
+        }
+        memmove(nodes + best_index + 1, nodes + last, (size_t)(n - last) * sizeof(skyline_node));
+        n += 1 - (last - best_index);
+        nodes[best_index] = { x, best_y + height, width };
+
+        int index = best_index;
+        if ((index + 1 < n) && (nodes[index + 1].y == nodes[index].y)) {
+            nodes[index].width += nodes[index + 1].width;
+            memmove(nodes + index + 1, nodes + index + 2, (size_t)(n - index - 2) * sizeof(skyline_node));
+            n--;
+        }
+        if ((index > 0) && (nodes[index - 1].y == nodes[index].y)) {
+            nodes[index - 1].width += nodes[index].width;
+            memmove(nodes + index, nodes + index + 1, (size_t)(n - index - 1) * sizeof(skyline_node));
+            n--;
+        }
+        packer.node_count = n;
+
+        result_x = x;
+        result_y = best_y;
+        return true;
+    }
+
+    bool maxrects_insert (stbn_rect_packer & packer, int width, int height, int & result_x, int & result_y) {
+        // Best short side fit, then best long side fit
+        int best_index = -1, best_short = INT32_MAX, best_long = INT32_MAX;
+        for (int i = 0; i < packer.free_count; i++) {
+            const free_rect & r = packer.free_rects[i];
+            if ((r.width < width) || (r.height < height))
+                continue;
+            const int dx = r.width - width, dy = r.height - height,
+                short_side = (dx < dy) ? dx : dy, long_side = (dx < dy) ? dy : dx;
+            if ((short_side < best_short) || ((short_side == best_short) && (long_side < best_long))) {
+                best_index = i;
+                best_short = short_side;
+                best_long = long_side;
+                if (!long_side)
+                    break;
+            }
+        }
+
+        if (best_index < 0)
+            return false;
+
+        const int x = packer.free_rects[best_index].x, y = packer.free_rects[best_index].y;
+
+        // Make sure nothing can fail once we start modifying the free list. Each split rect
+        //  turns into at most 4 pieces.
+        int split_count = 0;
+        for (int i = 0; i < packer.free_count; i++)
+            if (overlaps(packer.free_rects[i], x, y, width, height))
+                split_count++;
+        if (
+            !reserve(packer.pieces, packer.piece_capacity, split_count * 4) ||
+            !reserve(packer.free_rects, packer.free_capacity, packer.free_count + split_count * 3)
+        )
+            return false;
+
+        // A free rect that contains one of the pieces has to share an edge with the placed
+        //  rect (it touches the piece's edge against it without overlapping it), so those are
+        //  gathered at the front of the list and the rest don't need to be checked.
+        free_rect * free_rects = packer.free_rects, * pieces = packer.pieces;
+        int kept = 0, touching = 0, piece_count = 0;
+        for (int i = 0, n = packer.free_count; i < n; i++) {
+            const free_rect r = free_rects[i];
+            if (!overlaps(r, x, y, width, height)) {
+                free_rects[kept++] = r;
+                if (overlaps(r, x - 1, y - 1, width + 2, height + 2))
+                    std::swap(free_rects[touching++], free_rects[kept - 1]);
+                continue;
+            }
+
+            const int right = x + width, bottom = y + height,
+                r_right = r.x + r.width, r_bottom = r.y + r.height;
+            if (x > r.x)
+                pieces[piece_count++] = { r.x, r.y, x - r.x, r.height };
+            if (right < r_right)
+                pieces[piece_count++] = { right, r.y, r_right - right, r.height };
+            if (y > r.y)
+                pieces[piece_count++] = { r.x, r.y, r.width, y - r.y };
+            if (bottom < r_bottom)
+                pieces[piece_count++] = { r.x, bottom, r.width, r_bottom - bottom };
+        }
+
+        // Identical pieces are only kept once, by keeping the first of them
+        int count = kept;
+        for (int i = 0; i < piece_count; i++) {
+            const free_rect & piece = pieces[i];
+            bool redundant = false;
+            for (int j = 0; (j < touching) && !redundant; j++)
+                redundant = contains(free_rects[j], piece);
+            for (int j = 0; (j < piece_count) && !redundant; j++) {
+                if ((j == i) || !contains(pieces[j], piece))
+                    continue;
+                redundant = (j < i) || !contains(piece, pieces[j]);
+            }
+            if (!redundant)
+                free_rects[count++] = piece;
+        }
+        packer.free_count = count;
+
+        result_x = x;
+        result_y = y;
+        return true;
+    }
+
+    bool insert (stbn_rect_packer & packer, int width, int height, int & x, int & y) {
+        if (!width || !height) {
+            x = y = 0;
+            return true;
+        }
+        if ((width > packer.width) || (height > packer.height))
+            return false;
+
+        bool ok = (packer.algorithm == STBN_RECT_PACK_SKYLINE)
+            ? skyline_insert(packer, width, height, x, y)
+            : maxrects_insert(packer, width, height, x, y);
+        if (ok)
+            packer.used_area += (int64_t)width * height;
+        return ok;
+    }
+}
+
+STBNDEF void stbn_rect_pack_reset (stbn_rect_packer * packer) {
+    if (!packer)
+        return;
+
+    packer->used_area = 0;
+    if (packer->algorithm == STBN_RECT_PACK_SKYLINE) {
+        packer->nodes[0] = { 0, 0, packer->width };
+        packer->node_count = 1;
+    } else {
+        packer->free_rects[0] = { 0, 0, packer->width, packer->height };
+        packer->free_count = 1;
+    }
+}
+
+STBNDEF stbn_rect_packer * stbn_rect_pack_create (int width, int height, int algorithm) {
+    if ((width <= 0) || (height <= 0) || (width > max_size) || (height > max_size))
+        return nullptr;
+    if ((algorithm != STBN_RECT_PACK_SKYLINE) && (algorithm != STBN_RECT_PACK_MAXRECTS))
+        return nullptr;
+
+    stbn_rect_packer * result = (stbn_rect_packer *)stbn_malloc(sizeof(stbn_rect_packer), STBN_ALLOC_NATIVE);
+    if (!result)
+        return nullptr;
+    memset(result, 0, sizeof(stbn_rect_packer));
+    result->width = width;
+    result->height = height;
+    result->algorithm = algorithm;
+
+    bool ok;
+    if (algorithm == STBN_RECT_PACK_SKYLINE) {
+        result->nodes = (skyline_node *)stbn_malloc((size_t)width * sizeof(skyline_node), STBN_ALLOC_NATIVE);
+        ok = result->nodes != nullptr;
+    } else {
+        ok = reserve(result->free_rects, result->free_capacity, 1);
+    }
+    if (!ok) {
+        stbn_rect_pack_destroy(result);
+        return nullptr;
+    }
+
+    stbn_rect_pack_reset(result);
+    return result;
+}
+
+STBNDEF void stbn_rect_pack_destroy (stbn_rect_packer * packer) {
+    if (!packer)
+        return;
+    stbn_free(packer->nodes);
+    stbn_free(packer->free_rects);
+    stbn_free(packer->pieces);
+    stbn_free(packer);
+}
+
+STBNDEF int stbn_rect_pack_insert (stbn_rect_packer * packer, int width, int height, int * x, int * y) {
+    if (!packer || !x || !y || (width < 0) || (height < 0))
+        return 0;
+    return insert(*packer, width, height, *x, *y) ? 1 : 0;
+}
+
+STBNDEF int stbn_rect_pack_insert_batch (stbn_rect_packer * packer, stbn_rect * rects, int count, int sort) {
+    if (!packer || (count < 0) || (!rects && count) || (sort < STBN_RECT_SORT_NONE) || (sort > STBN_RECT_SORT_PERIMETER))
+        return -1;
+
+    sort_key * keys = nullptr;
+    if ((sort != STBN_RECT_SORT_NONE) && (count > 1)) {
+        keys = (sort_key *)stbn_malloc((size_t)count * sizeof(sort_key), STBN_ALLOC_NATIVE);
+        if (!keys)
+            return -1;
+
+        for (int i = 0; i < count; i++) {
+            const int w = rects[i].width, h = rects[i].height,
+                longest = (w > h) ? w : h, shortest = (w > h) ? h : w;
+            sort_key & key = keys[i];
+            key.index = i;
+            switch (sort) {
+                case STBN_RECT_SORT_HEIGHT:
+                    key.primary = h;
+                    key.secondary = w;
+                    break;
+                case STBN_RECT_SORT_WIDTH:
+                    key.primary = w;
+                    key.secondary = h;
+                    break;
+                case STBN_RECT_SORT_AREA:
+                    key.primary = (int64_t)w * h;
+                    key.secondary = longest;
+                    break;
+                case STBN_RECT_SORT_MAX_SIDE:
+                    key.primary = longest;
+                    key.secondary = shortest;
+                    break;
+                default:
+                    key.primary = (int64_t)w + h;
+                    key.secondary = longest;
+                    break;
+            }
+        }
+        std::sort(keys, keys + count, sort_key_less);
+    }
+
+    int result = 0;
+    for (int i = 0; i < count; i++) {
+        stbn_rect & rect = rects[keys ? keys[i].index : i];
+        if ((rect.width >= 0) && (rect.height >= 0) && insert(*packer, rect.width, rect.height, rect.x, rect.y)) {
+            result++;
+        } else {
+            rect.x = rect.y = -1;
+        }
+    }
+
+    stbn_free(keys);
+    return result;
+}
+
+STBNDEF int64_t stbn_rect_pack_used_area (stbn_rect_packer * packer) {
+    return packer ? packer->used_area : 0;
+}
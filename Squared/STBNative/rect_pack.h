@@ -0,0 +1,57 @@
+#pragma once
+
+#include <stdint.h>
+
+// Rectangle packing for atlases, along the lines of stb_rect_pack. Unlike stb_rect_pack, a
+//  packer remembers its free space between calls, so rects can be added one at a time as
+//  they're needed (e.g. on glyph cache misses) as well as in sorted batches when an atlas is
+//  built or rebuilt.
+// SKYLINE tracks the top edge of everything placed so far as a list of horizontal segments
+//  and puts each rect wherever its top ends up lowest, breaking ties by how much space is
+//  left unreachable underneath it. This is what stb_rect_pack does, and it's very cheap.
+// MAXRECTS tracks every maximal free rectangle, so it can also fill holes left under the
+//  skyline, and puts each rect in the free rectangle it fits most snugly (best short side
+//  fit). It packs tighter, but each insert costs more as the free list grows.
+
+enum {
+    STBN_RECT_PACK_SKYLINE = 0,
+    STBN_RECT_PACK_MAXRECTS = 1,
+};
+
+// Matches RectanglePackerSort. Every order is descending, and rects that compare equal keep
+//  their order from the array.
+enum {
+    STBN_RECT_SORT_NONE = 0,
+    // Tallest first, then widest
+    STBN_RECT_SORT_HEIGHT = 1,
+    // Widest first, then tallest
+    STBN_RECT_SORT_WIDTH = 2,
+    // Largest first, then longest side
+    STBN_RECT_SORT_AREA = 3,
+    // Longest side first, then shortest side
+    STBN_RECT_SORT_MAX_SIDE = 4,
+    // Largest perimeter first, then longest side
+    STBN_RECT_SORT_PERIMETER = 5,
+};
+
+struct stbn_rect {
+    int width, height;
+    // Written by the packer, or -1 if the rect didn't fit
+    int x, y;
+};
+
+struct stbn_rect_packer;
+
+// Returns null if the arguments are invalid
+STBNDEF stbn_rect_packer * stbn_rect_pack_create (int width, int height, int algorithm);
+STBNDEF void stbn_rect_pack_destroy (stbn_rect_packer * packer);
+// Makes all of the space available again
+STBNDEF void stbn_rect_pack_reset (stbn_rect_packer * packer);
+// Returns 0 if there's no room for the rect. Empty rects always fit, at (0, 0), and take no space.
+STBNDEF int stbn_rect_pack_insert (stbn_rect_packer * packer, int width, int height, int * x, int * y);
+// Inserts every rect, in the order chosen by sort, without moving them around in the array.
+// Returns how many fit, or -1 if the arguments are invalid. Rects that don't fit get x = y = -1
+//  and don't stop the rest from being inserted.
+STBNDEF int stbn_rect_pack_insert_batch (stbn_rect_packer * packer, stbn_rect * rects, int count, int sort);
+// The total area of every rect inserted since the packer was created or reset
+STBNDEF int64_t stbn_rect_pack_used_area (stbn_rect_packer * packer);
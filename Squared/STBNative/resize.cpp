@@ -0,0 +1,59 @@
+#include "stbnative.h"
+
+// Reusable resize contexts.
+// stbir_resize builds (and frees) its samplers and scratch memory on every call, which
+//  dominates the cost of small resizes. A context builds them once for a fixed set of
+//  dimensions/layout/filter and then only swaps the buffer pointers for each resize.
+// A context may only be used by one thread at a time.
+
+STBNDEF STBIR_RESIZE * stbn_resize_context_create (
+    int input_w, int input_h, int output_w, int output_h,
+    stbir_pixel_layout pixel_layout, stbir_datatype data_type,
+    stbir_edge edge, stbir_filter filter
+) {
+    if ((input_w <= 0) || (input_h <= 0) || (output_w <= 0) || (output_h <= 0))
+        return 0;
+
+    STBIR_RESIZE * resize = (STBIR_RESIZE *)stbn_malloc(sizeof(STBIR_RESIZE), STBN_ALLOC_RESIZE);
+    if (!resize)
+        return 0;
+
+    stbir_resize_init(
+        resize,
+        0, input_w, input_h, 0,
+        0, output_w, output_h, 0,
+        pixel_layout, data_type
+    );
+    stbir_set_edgemodes(resize, edge, edge);
+    stbir_set_filters(resize, filter, filter);
+
+    if (!stbir_build_samplers(resize)) {
+        stbir_free_samplers(resize);
+        stbn_free(resize);
+        return 0;
+    }
+
+    return resize;
+}
+
+STBNDEF int stbn_resize_context_execute (
+    STBIR_RESIZE * resize,
+    const void * input_pixels, int input_stride_in_bytes,
+    void * output_pixels, int output_stride_in_bytes
+) {
+    if (!resize || !resize->samplers)
+        return 0;
+    if (!input_pixels || !output_pixels)
+        return 0;
+
+    stbir_set_buffer_ptrs(resize, input_pixels, input_stride_in_bytes, output_pixels, output_stride_in_bytes);
+    return stbir_resize_extended(resize);
+}
+
+STBNDEF void stbn_resize_context_destroy (STBIR_RESIZE * resize) {
+    if (!resize)
+        return;
+
+    stbir_free_samplers(resize);
+    stbn_free(resize);
+}
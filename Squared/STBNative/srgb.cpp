@@ -0,0 +1,30 @@
+#include "srgb.h"
+#include <math.h>
+
+double stbn_srgb_to_linear (double s) {
+    if (s <= 0.04045)
+        return s / 12.92;
+    else
+        return pow((s + 0.055) / 1.055, 2.4);
+}
+
+double stbn_linear_to_srgb (double l) {
+    if (l <= 0.0031308)
+        return l * 12.92;
+    else
+        return 1.055 * pow(l, 1.0 / 2.4) - 0.055;
+}
+
+stbn_srgb_tables::stbn_srgb_tables () {
+    for (int i = 0; i < 256; i++) {
+        double l = stbn_srgb_to_linear(i / 255.0);
+        to_linear8[i] = (uint8_t)(l * 255.0 + 0.5);
+        to_linear16[i] = (uint16_t)(l * 65535.0 + 0.5);
+        to_linearf[i] = (float)l;
+    }
+
+    for (int i = 0; i <= STBN_LINEAR_MAX; i++)
+        from_linear[i] = (uint8_t)(stbn_linear_to_srgb((double)i / STBN_LINEAR_MAX) * 255.0 + 0.5);
+}
+
+const stbn_srgb_tables stbn_srgb;
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <stdint.h>
+
+// sRGB <-> linear lookup tables shared by the native kernels.
+// Linear values are quantized to STBN_LINEAR_BITS bits when converting back to sRGB, which
+//  is enough precision for every sRGB byte to round-trip exactly.
+
+#define STBN_LINEAR_BITS 14
+#define STBN_LINEAR_MAX  (1 << STBN_LINEAR_BITS)
+
+struct stbn_srgb_tables {
+    // sRGB byte -> linear byte, rounded
+    uint8_t to_linear8[256];
+    // sRGB byte -> linear [0, 65535]
+    uint16_t to_linear16[256];
+    // sRGB byte -> linear [0, 1]
+    float to_linearf[256];
+    // linear [0, STBN_LINEAR_MAX] -> sRGB byte
+    uint8_t from_linear[STBN_LINEAR_MAX + 1];
+
+    stbn_srgb_tables ();
+};
+
+extern const stbn_srgb_tables stbn_srgb;
+
+// The exact transfer functions the tables are built from, for values in [0, 1]
+double stbn_srgb_to_linear (double s);
+double stbn_linear_to_srgb (double l);
+
+static inline uint8_t stbn_linear16_to_srgb (uint32_t linear16) {
+    return stbn_srgb.from_linear[(linear16 + 2) >> (16 - STBN_LINEAR_BITS)];
+}
+
+static inline uint8_t stbn_linearf_to_srgb (float linear) {
+    if (!(linear > 0))
+        return 0;
+    else if (linear >= 1)
+        return 255;
+    return stbn_srgb.from_linear[(int)(linear * STBN_LINEAR_MAX + 0.5f)];
+}
@@ -517,6 +517,31 @@ STBIDEF void stbi_convert_iphone_png_to_rgb(int flag_true_if_should_convert);
 // flip the image vertically, so the first pixel in the output array is the bottom left
 STBIDEF void stbi_set_flip_vertically_on_load(int flag_true_if_should_flip);
 
+// STBNative: spread large JPEG decodes across threads (on by default). only has an
+// effect when the implementation was built with STBI_PARALLEL_FOR
+STBIDEF void stbi_set_jpeg_parallel(int flag_true_if_should_decode_in_parallel);
+
+// STBNative: incremental decoding, so that rows can be used (e.g. uploaded) before the
+// rest of the image has been decoded. stbi_stream_begin_from_memory reads the header and
+// returns NULL, with the failure reason set, unless the image is a non-interlaced 8-bit
+// PNG or a baseline JPEG with all of its components in one scan (and flipping on load
+// is off); use stbi_load_from_memory for everything else. 'buffer' must stay valid
+// until stbi_stream_free. stbi_stream_read_rows decodes up to max_rows more rows into
+// output and returns how many it wrote, 0 once every row has been read, or -1 on error.
+typedef struct stbi__stream stbi_stream;
+STBIDEF stbi_stream *stbi_stream_begin_from_memory(stbi_uc const *buffer, int len, int *x, int *y, int *channels_in_file, int desired_channels);
+STBIDEF int          stbi_stream_read_rows        (stbi_stream *st, stbi_uc *output, int stride_in_bytes, int max_rows);
+STBIDEF void         stbi_stream_free             (stbi_stream *st);
+
+// STBNative: decodes straight into caller memory (e.g. a mapped upload buffer or an atlas
+// page) instead of a buffer stb_image allocates. The top-left pixel is written at
+// output + dest_y * stride_in_bytes + dest_x * desired_channels * bytes_per_channel, and
+// the image must fit inside the output_w x output_h destination or nothing is written.
+// bytes_per_channel selects 8-bit (1), 16-bit (2) or float (4) output. Images that can be
+// streamed (see above) are decoded in place; anything else is loaded and then copied.
+// Returns 1 on success, or 0 with the failure reason set.
+STBIDEF int stbi_load_into_from_memory(stbi_uc const *buffer, int len, void *output, int output_w, int output_h, int stride_in_bytes, int dest_x, int dest_y, int *x, int *y, int *channels_in_file, int desired_channels, int bytes_per_channel);
+
 // as above, but only applies to images loaded on the thread that calls the function
 // this function is only available if your compiler supports thread-local variables;
 // calling it will fail to link if your compiler doesn't
@@ -729,6 +754,20 @@ typedef unsigned char validate_uint32[sizeof(stbi__uint32)==4 ? 1 : -1];
 #define STBI_SSE2
 #include <emmintrin.h>
 
+// STBNative: SSE4.1 paths are only built when the includer supplies runtime
+// detection (STBI_SSE41_AVAILABLE()) and the function attribute its compiler
+// needs to generate SSE4.1 code (STBI_SSE41_TARGET, empty on MSVC).
+#if defined(STBI_SSE41_AVAILABLE) && defined(STBI_SSE41_TARGET)
+#define STBI_SSE41
+#include <smmintrin.h>
+#endif
+
+// STBNative: same for AVX2 (STBI_AVX2_AVAILABLE(), STBI_AVX2_TARGET)
+#if defined(STBI_AVX2_AVAILABLE) && defined(STBI_AVX2_TARGET)
+#define STBI_AVX2
+#include <immintrin.h>
+#endif
+
 #ifdef _MSC_VER
 
 #if _MSC_VER >= 1400  // not VC6
@@ -754,7 +793,7 @@ static int stbi__cpuid3(void)
 
 #define STBI_SIMD_ALIGN(type, name) __declspec(align(16)) type name
 
-#if !defined(STBI_NO_JPEG) && defined(STBI_SSE2)
+#if (!defined(STBI_NO_JPEG) || !defined(STBI_NO_PNG)) && defined(STBI_SSE2)
 static int stbi__sse2_available(void)
 {
    int info3 = stbi__cpuid3();
@@ -765,7 +804,7 @@ static int stbi__sse2_available(void)
 #else // assume GCC-style if not VC++
 #define STBI_SIMD_ALIGN(type, name) type name __attribute__((aligned(16)))
 
-#if !defined(STBI_NO_JPEG) && defined(STBI_SSE2)
+#if (!defined(STBI_NO_JPEG) || !defined(STBI_NO_PNG)) && defined(STBI_SSE2)
 static int stbi__sse2_available(void)
 {
    // If we're even attempting to compile this on GCC/Clang, that means
@@ -934,6 +973,13 @@ static void    *stbi__tga_load(stbi__context *s, int *x, int *y, int *comp, int
 static int      stbi__tga_info(stbi__context *s, int *x, int *y, int *comp);
 #endif
 
+#ifdef STBI_QOI_LOAD
+// STBNative: QOI is decoded outside this file, see below
+static int      stbi__qoi_test(stbi__context *s);
+static void    *stbi__qoi_load(stbi__context *s, int *x, int *y, int *comp, int req_comp);
+static int      stbi__qoi_info(stbi__context *s, int *x, int *y, int *comp);
+#endif
+
 #ifndef STBI_NO_PSD
 static int      stbi__psd_test(stbi__context *s);
 static void    *stbi__psd_load(stbi__context *s, int *x, int *y, int *comp, int req_comp, stbi__result_info *ri, int bpc);
@@ -1122,6 +1168,13 @@ STBIDEF void stbi_set_flip_vertically_on_load(int flag_true_if_should_flip)
    stbi__vertically_flip_on_load_global = flag_true_if_should_flip;
 }
 
+static int stbi__jpeg_parallel = 1;
+
+STBIDEF void stbi_set_jpeg_parallel(int flag_true_if_should_decode_in_parallel)
+{
+   stbi__jpeg_parallel = flag_true_if_should_decode_in_parallel;
+}
+
 #ifndef STBI_THREAD_LOCAL
 #define stbi__vertically_flip_on_load  stbi__vertically_flip_on_load_global
 #else
@@ -1164,6 +1217,9 @@ static void *stbi__load_main(stbi__context *s, int *x, int *y, int *comp, int re
    #ifndef STBI_NO_PIC
    if (stbi__pic_test(s))  return stbi__pic_load(s,x,y,comp,req_comp, ri);
    #endif
+   #ifdef STBI_QOI_LOAD
+   if (stbi__qoi_test(s))  return stbi__qoi_load(s,x,y,comp,req_comp);
+   #endif
 
    // then the formats that can end up attempting to load with just 1 or 2
    // bytes matching expectations; these are prone to false positives, so
@@ -1595,7 +1651,8 @@ enum
 {
    STBI__SCAN_load=0,
    STBI__SCAN_type,
-   STBI__SCAN_header
+   STBI__SCAN_header,
+   STBI__SCAN_rows // STBNative: PNG only, stops after inflating so rows can be streamed
 };
 
 static void stbi__refill_buffer(stbi__context *s)
@@ -1756,9 +1813,38 @@ static stbi_uc stbi__compute_y(int r, int g, int b)
 #if defined(STBI_NO_PNG) && defined(STBI_NO_BMP) && defined(STBI_NO_PSD) && defined(STBI_NO_TGA) && defined(STBI_NO_GIF) && defined(STBI_NO_PIC) && defined(STBI_NO_PNM)
 // nothing
 #else
+// STBNative: one scanline of stbi__convert_format, also used by the PNG row streamer.
+// returns 0 for an unsupported conversion
+static int stbi__convert_format_row(unsigned char *src, unsigned char *dest, int img_n, int req_comp, unsigned int x)
+{
+   int i;
+
+   #define STBI__COMBO(a,b)  ((a)*8+(b))
+   #define STBI__CASE(a,b)   case STBI__COMBO(a,b): for(i=x-1; i >= 0; --i, src += a, dest += b)
+   // convert source image with img_n components to one with req_comp components;
+   // avoid switch per pixel, so use switch per scanline and massive macros
+   switch (STBI__COMBO(img_n, req_comp)) {
+      STBI__CASE(1,2) { dest[0]=src[0]; dest[1]=255;                                     } break;
+      STBI__CASE(1,3) { dest[0]=dest[1]=dest[2]=src[0];                                  } break;
+      STBI__CASE(1,4) { dest[0]=dest[1]=dest[2]=src[0]; dest[3]=255;                     } break;
+      STBI__CASE(2,1) { dest[0]=src[0];                                                  } break;
+      STBI__CASE(2,3) { dest[0]=dest[1]=dest[2]=src[0];                                  } break;
+      STBI__CASE(2,4) { dest[0]=dest[1]=dest[2]=src[0]; dest[3]=src[1];                  } break;
+      STBI__CASE(3,4) { dest[0]=src[0];dest[1]=src[1];dest[2]=src[2];dest[3]=255;        } break;
+      STBI__CASE(3,1) { dest[0]=stbi__compute_y(src[0],src[1],src[2]);                   } break;
+      STBI__CASE(3,2) { dest[0]=stbi__compute_y(src[0],src[1],src[2]); dest[1] = 255;    } break;
+      STBI__CASE(4,1) { dest[0]=stbi__compute_y(src[0],src[1],src[2]);                   } break;
+      STBI__CASE(4,2) { dest[0]=stbi__compute_y(src[0],src[1],src[2]); dest[1] = src[3]; } break;
+      STBI__CASE(4,3) { dest[0]=src[0];dest[1]=src[1];dest[2]=src[2];                    } break;
+      default: STBI_ASSERT(0); return 0;
+   }
+   #undef STBI__CASE
+   return 1;
+}
+
 static unsigned char *stbi__convert_format(unsigned char *data, int img_n, int req_comp, unsigned int x, unsigned int y)
 {
-   int i,j;
+   int j;
    unsigned char *good;
 
    if (req_comp == img_n) return data;
@@ -1773,27 +1859,11 @@ static unsigned char *stbi__convert_format(unsigned char *data, int img_n, int r
    for (j=0; j < (int) y; ++j) {
       unsigned char *src  = data + j * x * img_n   ;
       unsigned char *dest = good + j * x * req_comp;
-
-      #define STBI__COMBO(a,b)  ((a)*8+(b))
-      #define STBI__CASE(a,b)   case STBI__COMBO(a,b): for(i=x-1; i >= 0; --i, src += a, dest += b)
-      // convert source image with img_n components to one with req_comp components;
-      // avoid switch per pixel, so use switch per scanline and massive macros
-      switch (STBI__COMBO(img_n, req_comp)) {
-         STBI__CASE(1,2) { dest[0]=src[0]; dest[1]=255;                                     } break;
-         STBI__CASE(1,3) { dest[0]=dest[1]=dest[2]=src[0];                                  } break;
-         STBI__CASE(1,4) { dest[0]=dest[1]=dest[2]=src[0]; dest[3]=255;                     } break;
-         STBI__CASE(2,1) { dest[0]=src[0];                                                  } break;
-         STBI__CASE(2,3) { dest[0]=dest[1]=dest[2]=src[0];                                  } break;
-         STBI__CASE(2,4) { dest[0]=dest[1]=dest[2]=src[0]; dest[3]=src[1];                  } break;
-         STBI__CASE(3,4) { dest[0]=src[0];dest[1]=src[1];dest[2]=src[2];dest[3]=255;        } break;
-         STBI__CASE(3,1) { dest[0]=stbi__compute_y(src[0],src[1],src[2]);                   } break;
-         STBI__CASE(3,2) { dest[0]=stbi__compute_y(src[0],src[1],src[2]); dest[1] = 255;    } break;
-         STBI__CASE(4,1) { dest[0]=stbi__compute_y(src[0],src[1],src[2]);                   } break;
-         STBI__CASE(4,2) { dest[0]=stbi__compute_y(src[0],src[1],src[2]); dest[1] = src[3]; } break;
-         STBI__CASE(4,3) { dest[0]=src[0];dest[1]=src[1];dest[2]=src[2];                    } break;
-         default: STBI_ASSERT(0); STBI_FREE(data); STBI_FREE(good); return stbi__errpuc("unsupported", "Unsupported format conversion");
+      if (!stbi__convert_format_row(src, dest, img_n, req_comp, x)) {
+         STBI_FREE(data);
+         STBI_FREE(good);
+         return stbi__errpuc("unsupported", "Unsupported format conversion");
       }
-      #undef STBI__CASE
    }
 
    STBI_FREE(data);
@@ -1858,6 +1928,42 @@ static stbi__uint16 *stbi__convert_format16(stbi__uint16 *data, int img_n, int r
 }
 #endif
 
+#ifdef STBI_QOI_LOAD
+// STBNative: QOI support is supplied by the includer:
+//    STBI_QOI_TEST(buffer, len) returns nonzero if the buffer holds a QOI image
+//    STBI_QOI_INFO(buffer, len, x, y, comp) reads its header
+//    STBI_QOI_LOAD(buffer, len, x, y, comp, req_comp) decodes it to 3 or 4 channels (req_comp
+//       0 keeps the file's channel count) into memory allocated with STBI_MALLOC
+// The decoder wants the whole file at once, so this only works for images loaded from memory.
+static int stbi__qoi_test(stbi__context *s)
+{
+   if (s->io.read) return 0;
+   return STBI_QOI_TEST(s->img_buffer, (int) (s->img_buffer_end - s->img_buffer));
+}
+
+static int stbi__qoi_info(stbi__context *s, int *x, int *y, int *comp)
+{
+   if (s->io.read) return 0;
+   return STBI_QOI_INFO(s->img_buffer, (int) (s->img_buffer_end - s->img_buffer), x, y, comp);
+}
+
+static void *stbi__qoi_load(stbi__context *s, int *x, int *y, int *comp, int req_comp)
+{
+   int n, w, h, decode_comp = ((req_comp == 3) || (req_comp == 4)) ? req_comp : 4;
+   unsigned char *result;
+   if (req_comp == 0 && !STBI_QOI_INFO(s->img_buffer, (int) (s->img_buffer_end - s->img_buffer), &w, &h, &decode_comp))
+      return stbi__errpuc("bad QOI header", "Corrupt QOI");
+   result = (unsigned char *) STBI_QOI_LOAD(s->img_buffer, (int) (s->img_buffer_end - s->img_buffer), &w, &h, &n, decode_comp);
+   if (!result) return stbi__errpuc("bad QOI data", "Corrupt QOI");
+   *x = w;
+   *y = h;
+   if (comp) *comp = n;
+   if (req_comp && req_comp != decode_comp)
+      result = stbi__convert_format(result, decode_comp, req_comp, w, h);
+   return result;
+}
+#endif
+
 #ifndef STBI_NO_LINEAR
 static float   *stbi__ldr_to_hdr(stbi_uc *data, int x, int y, int comp)
 {
@@ -2000,6 +2106,8 @@ typedef struct
 
 // kernels
    void (*idct_block_kernel)(stbi_uc *out, int out_stride, short data[64]);
+   // STBNative: optional, transforms two blocks at once
+   void (*idct_block2_kernel)(stbi_uc *out0, int out0_stride, short data0[64], stbi_uc *out1, int out1_stride, short data1[64]);
    void (*YCbCr_to_RGB_kernel)(stbi_uc *out, const stbi_uc *y, const stbi_uc *pcb, const stbi_uc *pcr, int count, int step);
    stbi_uc *(*resample_row_hv_2_kernel)(stbi_uc *out, stbi_uc *in_near, stbi_uc *in_far, int w, int hs);
 } stbi__jpeg;
@@ -2706,6 +2814,183 @@ static void stbi__idct_simd(stbi_uc *out, int out_stride, short data[64])
 #undef dct_pass
 }
 
+#ifdef STBI_AVX2
+// STBNative: AVX2 version of stbi__idct_simd that transforms two blocks at once,
+// block 0 in the low 128-bit lane and block 1 in the high lane. every operation
+// it uses works within lanes, so each lane computes exactly what the SSE2 version
+// does and the results are still bit-identical to the generic C version.
+static STBI_AVX2_TARGET void stbi__idct2_avx2(stbi_uc *out0, int out0_stride, short data0[64], stbi_uc *out1, int out1_stride, short data1[64])
+{
+   __m256i row0, row1, row2, row3, row4, row5, row6, row7;
+   __m256i tmp;
+
+   #define dct_const(x,y)  _mm256_broadcastsi128_si256(_mm_setr_epi16((x),(y),(x),(y),(x),(y),(x),(y)))
+
+   #define dct_rot(out0,out1, x,y,c0,c1) \
+      __m256i c0##lo = _mm256_unpacklo_epi16((x),(y)); \
+      __m256i c0##hi = _mm256_unpackhi_epi16((x),(y)); \
+      __m256i out0##_l = _mm256_madd_epi16(c0##lo, c0); \
+      __m256i out0##_h = _mm256_madd_epi16(c0##hi, c0); \
+      __m256i out1##_l = _mm256_madd_epi16(c0##lo, c1); \
+      __m256i out1##_h = _mm256_madd_epi16(c0##hi, c1)
+
+   #define dct_widen(out, in) \
+      __m256i out##_l = _mm256_srai_epi32(_mm256_unpacklo_epi16(_mm256_setzero_si256(), (in)), 4); \
+      __m256i out##_h = _mm256_srai_epi32(_mm256_unpackhi_epi16(_mm256_setzero_si256(), (in)), 4)
+
+   #define dct_wadd(out, a, b) \
+      __m256i out##_l = _mm256_add_epi32(a##_l, b##_l); \
+      __m256i out##_h = _mm256_add_epi32(a##_h, b##_h)
+
+   #define dct_wsub(out, a, b) \
+      __m256i out##_l = _mm256_sub_epi32(a##_l, b##_l); \
+      __m256i out##_h = _mm256_sub_epi32(a##_h, b##_h)
+
+   #define dct_bfly32o(out0, out1, a,b,bias,s) \
+      { \
+         __m256i abiased_l = _mm256_add_epi32(a##_l, bias); \
+         __m256i abiased_h = _mm256_add_epi32(a##_h, bias); \
+         dct_wadd(sum, abiased, b); \
+         dct_wsub(dif, abiased, b); \
+         out0 = _mm256_packs_epi32(_mm256_srai_epi32(sum_l, s), _mm256_srai_epi32(sum_h, s)); \
+         out1 = _mm256_packs_epi32(_mm256_srai_epi32(dif_l, s), _mm256_srai_epi32(dif_h, s)); \
+      }
+
+   #define dct_interleave8(a, b) \
+      tmp = a; \
+      a = _mm256_unpacklo_epi8(a, b); \
+      b = _mm256_unpackhi_epi8(tmp, b)
+
+   #define dct_interleave16(a, b) \
+      tmp = a; \
+      a = _mm256_unpacklo_epi16(a, b); \
+      b = _mm256_unpackhi_epi16(tmp, b)
+
+   #define dct_pass(bias,shift) \
+      { \
+         /* even part */ \
+         dct_rot(t2e,t3e, row2,row6, rot0_0,rot0_1); \
+         __m256i sum04 = _mm256_add_epi16(row0, row4); \
+         __m256i dif04 = _mm256_sub_epi16(row0, row4); \
+         dct_widen(t0e, sum04); \
+         dct_widen(t1e, dif04); \
+         dct_wadd(x0, t0e, t3e); \
+         dct_wsub(x3, t0e, t3e); \
+         dct_wadd(x1, t1e, t2e); \
+         dct_wsub(x2, t1e, t2e); \
+         /* odd part */ \
+         dct_rot(y0o,y2o, row7,row3, rot2_0,rot2_1); \
+         dct_rot(y1o,y3o, row5,row1, rot3_0,rot3_1); \
+         __m256i sum17 = _mm256_add_epi16(row1, row7); \
+         __m256i sum35 = _mm256_add_epi16(row3, row5); \
+         dct_rot(y4o,y5o, sum17,sum35, rot1_0,rot1_1); \
+         dct_wadd(x4, y0o, y4o); \
+         dct_wadd(x5, y1o, y5o); \
+         dct_wadd(x6, y2o, y5o); \
+         dct_wadd(x7, y3o, y4o); \
+         dct_bfly32o(row0,row7, x0,x7,bias,shift); \
+         dct_bfly32o(row1,row6, x1,x6,bias,shift); \
+         dct_bfly32o(row2,row5, x2,x5,bias,shift); \
+         dct_bfly32o(row3,row4, x3,x4,bias,shift); \
+      }
+
+   // row k of block 0 in the low lane, row k of block 1 in the high lane
+   #define dct_load(k) \
+      _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_load_si128((const __m128i *) (data0 + (k)*8))), \
+                              _mm_load_si128((const __m128i *) (data1 + (k)*8)), 1)
+
+   // store output rows r and r+1 of both blocks
+   #define dct_store(v, r) \
+      { \
+         __m128i v0 = _mm256_castsi256_si128(v); \
+         __m128i v1 = _mm256_extracti128_si256(v, 1); \
+         _mm_storel_epi64((__m128i *) (out0 + (r)*out0_stride), v0); \
+         _mm_storel_epi64((__m128i *) (out0 + (r+1)*out0_stride), _mm_shuffle_epi32(v0, 0x4e)); \
+         _mm_storel_epi64((__m128i *) (out1 + (r)*out1_stride), v1); \
+         _mm_storel_epi64((__m128i *) (out1 + (r+1)*out1_stride), _mm_shuffle_epi32(v1, 0x4e)); \
+      }
+
+   __m256i rot0_0 = dct_const(stbi__f2f(0.5411961f), stbi__f2f(0.5411961f) + stbi__f2f(-1.847759065f));
+   __m256i rot0_1 = dct_const(stbi__f2f(0.5411961f) + stbi__f2f( 0.765366865f), stbi__f2f(0.5411961f));
+   __m256i rot1_0 = dct_const(stbi__f2f(1.175875602f) + stbi__f2f(-0.899976223f), stbi__f2f(1.175875602f));
+   __m256i rot1_1 = dct_const(stbi__f2f(1.175875602f), stbi__f2f(1.175875602f) + stbi__f2f(-2.562915447f));
+   __m256i rot2_0 = dct_const(stbi__f2f(-1.961570560f) + stbi__f2f( 0.298631336f), stbi__f2f(-1.961570560f));
+   __m256i rot2_1 = dct_const(stbi__f2f(-1.961570560f), stbi__f2f(-1.961570560f) + stbi__f2f( 3.072711026f));
+   __m256i rot3_0 = dct_const(stbi__f2f(-0.390180644f) + stbi__f2f( 2.053119869f), stbi__f2f(-0.390180644f));
+   __m256i rot3_1 = dct_const(stbi__f2f(-0.390180644f), stbi__f2f(-0.390180644f) + stbi__f2f( 1.501321110f));
+
+   __m256i bias_0 = _mm256_set1_epi32(512);
+   __m256i bias_1 = _mm256_set1_epi32(65536 + (128<<17));
+
+   row0 = dct_load(0);
+   row1 = dct_load(1);
+   row2 = dct_load(2);
+   row3 = dct_load(3);
+   row4 = dct_load(4);
+   row5 = dct_load(5);
+   row6 = dct_load(6);
+   row7 = dct_load(7);
+
+   // column pass
+   dct_pass(bias_0, 10);
+
+   {
+      // 16bit 8x8 transpose, per lane
+      dct_interleave16(row0, row4);
+      dct_interleave16(row1, row5);
+      dct_interleave16(row2, row6);
+      dct_interleave16(row3, row7);
+
+      dct_interleave16(row0, row2);
+      dct_interleave16(row1, row3);
+      dct_interleave16(row4, row6);
+      dct_interleave16(row5, row7);
+
+      dct_interleave16(row0, row1);
+      dct_interleave16(row2, row3);
+      dct_interleave16(row4, row5);
+      dct_interleave16(row6, row7);
+   }
+
+   // row pass
+   dct_pass(bias_1, 17);
+
+   {
+      // pack, then 8bit 8x8 transpose, per lane
+      __m256i p0 = _mm256_packus_epi16(row0, row1);
+      __m256i p1 = _mm256_packus_epi16(row2, row3);
+      __m256i p2 = _mm256_packus_epi16(row4, row5);
+      __m256i p3 = _mm256_packus_epi16(row6, row7);
+
+      dct_interleave8(p0, p2);
+      dct_interleave8(p1, p3);
+
+      dct_interleave8(p0, p1);
+      dct_interleave8(p2, p3);
+
+      dct_interleave8(p0, p2);
+      dct_interleave8(p1, p3);
+
+      dct_store(p0, 0);
+      dct_store(p2, 2);
+      dct_store(p1, 4);
+      dct_store(p3, 6);
+   }
+
+#undef dct_const
+#undef dct_rot
+#undef dct_widen
+#undef dct_wadd
+#undef dct_wsub
+#undef dct_bfly32o
+#undef dct_interleave8
+#undef dct_interleave16
+#undef dct_pass
+#undef dct_load
+#undef dct_store
+}
+#endif // STBI_AVX2
+
 #endif // STBI_SSE2
 
 #ifdef STBI_NEON
@@ -2950,13 +3235,225 @@ static void stbi__jpeg_reset(stbi__jpeg *j)
    // since we don't even allow 1<<30 pixels
 }
 
+// STBNative: decoded baseline blocks wait here for their IDCT, so that pairs of them
+// can go through idct_block2_kernel when there is one. call stbi__jpeg_idct_flush
+// before the scan is considered done.
+typedef struct
+{
+   STBI_SIMD_ALIGN(short, data[2][64]);
+   stbi_uc *out;
+   int out_stride, queued;
+} stbi__jpeg_idct_queue;
+
+// the buffer the next block should be decoded into
+static short *stbi__jpeg_idct_next(stbi__jpeg_idct_queue *q)
+{
+   return q->data[q->queued];
+}
+
+// queue the block just decoded into stbi__jpeg_idct_next() for output at 'out'
+static void stbi__jpeg_idct_push(stbi__jpeg *z, stbi__jpeg_idct_queue *q, stbi_uc *out, int out_stride)
+{
+   if (q->queued) {
+      z->idct_block2_kernel(q->out, q->out_stride, q->data[0], out, out_stride, q->data[1]);
+      q->queued = 0;
+   } else if (z->idct_block2_kernel) {
+      q->out = out;
+      q->out_stride = out_stride;
+      q->queued = 1;
+   } else {
+      z->idct_block_kernel(out, out_stride, q->data[0]);
+   }
+}
+
+static void stbi__jpeg_idct_flush(stbi__jpeg *z, stbi__jpeg_idct_queue *q)
+{
+   if (q->queued) {
+      z->idct_block_kernel(q->out, q->out_stride, q->data[0]);
+      q->queued = 0;
+   }
+}
+
+// decode one baseline MCU (a single block for non-interleaved scans) and queue its IDCT
+static int stbi__jpeg_decode_baseline_mcu(stbi__jpeg *z, stbi__jpeg_idct_queue *q, int mcu)
+{
+   if (z->scan_n == 1) {
+      int n = z->order[0];
+      int w = (z->img_comp[n].x+7) >> 3;
+      int i = mcu % w, j = mcu / w;
+      int ha = z->img_comp[n].ha;
+      if (!stbi__jpeg_decode_block(z, stbi__jpeg_idct_next(q), z->huff_dc+z->img_comp[n].hd, z->huff_ac+ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
+      stbi__jpeg_idct_push(z, q, z->img_comp[n].data+z->img_comp[n].w2*j*8+i*8, z->img_comp[n].w2);
+   } else {
+      int i = mcu % z->img_mcu_x, j = mcu / z->img_mcu_x;
+      int k,x,y;
+      for (k=0; k < z->scan_n; ++k) {
+         int n = z->order[k];
+         for (y=0; y < z->img_comp[n].v; ++y) {
+            for (x=0; x < z->img_comp[n].h; ++x) {
+               int x2 = (i*z->img_comp[n].h + x)*8;
+               int y2 = (j*z->img_comp[n].v + y)*8;
+               int ha = z->img_comp[n].ha;
+               if (!stbi__jpeg_decode_block(z, stbi__jpeg_idct_next(q), z->huff_dc+z->img_comp[n].hd, z->huff_ac+ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
+               stbi__jpeg_idct_push(z, q, z->img_comp[n].data+z->img_comp[n].w2*y2+x2, z->img_comp[n].w2);
+            }
+         }
+      }
+   }
+   return 1;
+}
+
+#ifdef STBI_PARALLEL_FOR
+// STBNative: multi-threaded baseline decoding.
+// STBI_PARALLEL_FOR(count, fn, user) is supplied by the includer; it must call
+// fn(user, i) for every i in [0, count) and return once all of them are done.
+//
+// Restart intervals (DRI) reset the DC predictors and byte-align the entropy-coded
+// data, so once the RSTn markers have been located every interval can be decoded on
+// its own. Each task takes a run of intervals with a private copy of the decoder
+// state, and IDCTs straight into the shared component planes (tasks never touch the
+// same blocks). Anything unexpected makes us fall back to the serial decoder, which
+// then decodes the scan (and reports errors) exactly as it always has.
+
+#define STBI__JPEG_PARALLEL_MIN_PIXELS  (1 << 18) // below this, threading costs more than it saves
+#define STBI__JPEG_PARALLEL_MAX_TASKS   64
+
+static int stbi__jpeg_parallel_worthwhile(stbi__jpeg *z)
+{
+   return stbi__jpeg_parallel && (z->s->img_x >= STBI__JPEG_PARALLEL_MIN_PIXELS / z->s->img_y);
+}
+
+typedef struct
+{
+   stbi__jpeg *z;
+   stbi_uc **interval_start; // first entropy-coded byte of each restart interval
+   int num_intervals, intervals_per_task, num_mcus;
+   stbi_uc *task_ok;
+} stbi__jpeg_parallel_scan;
+
+typedef struct
+{
+   stbi__jpeg j;
+   stbi__context s;
+} stbi__jpeg_scan_worker;
+
+static void stbi__jpeg_parallel_scan_task(void *user, int task)
+{
+   stbi__jpeg_parallel_scan *p = (stbi__jpeg_parallel_scan *) user;
+   stbi__jpeg_scan_worker *w;
+   stbi__jpeg_idct_queue q;
+   int r, r_end, mcu, mcu_end;
+
+   p->task_ok[task] = 0;
+   w = (stbi__jpeg_scan_worker *) stbi__malloc(sizeof(stbi__jpeg_scan_worker));
+   if (!w) return;
+   memcpy(&w->j, p->z, sizeof(w->j));
+   w->j.s = &w->s;
+   // only the memory-reading part of the context is used while decoding
+   w->s.read_from_callbacks = 0;
+   w->s.img_buffer_end = p->z->s->img_buffer_end;
+
+   q.queued = 0;
+   r = task * p->intervals_per_task;
+   r_end = r + p->intervals_per_task;
+   if (r_end > p->num_intervals) r_end = p->num_intervals;
+   for (; r < r_end; ++r) {
+      w->s.img_buffer = p->interval_start[r];
+      stbi__jpeg_reset(&w->j);
+      mcu = r * w->j.restart_interval;
+      mcu_end = mcu + w->j.restart_interval;
+      if (mcu_end > p->num_mcus) mcu_end = p->num_mcus;
+      for (; mcu < mcu_end; ++mcu)
+         if (!stbi__jpeg_decode_baseline_mcu(&w->j, &q, mcu)) goto done;
+      // the serial decoder stops early if an interval isn't followed by a restart
+      // marker, so treat that as a mismatch rather than quietly doing better
+      if (r + 1 < p->num_intervals) {
+         if (w->j.code_bits < 24) stbi__grow_buffer_unsafe(&w->j);
+         if (!STBI__RESTART(w->j.marker)) goto done;
+      }
+   }
+   stbi__jpeg_idct_flush(&w->j, &q);
+   p->task_ok[task] = 1;
+done:
+   STBI_FREE(w);
+}
+
+// returns 1 if the scan was decoded, or 0 to have the serial decoder do it
+static int stbi__jpeg_parse_parallel(stbi__jpeg *z)
+{
+   stbi__context *s = z->s;
+   stbi__jpeg_parallel_scan p;
+   stbi_uc *c, *end = s->img_buffer_end, *terminator = NULL;
+   int found, num_tasks, i, ok = 1;
+
+   if (z->progressive || !z->restart_interval || s->read_from_callbacks) return 0;
+   if (!stbi__jpeg_parallel_worthwhile(z)) return 0;
+
+   if (z->scan_n == 1) {
+      int n = z->order[0];
+      p.num_mcus = ((z->img_comp[n].x+7) >> 3) * ((z->img_comp[n].y+7) >> 3);
+   } else {
+      p.num_mcus = z->img_mcu_x * z->img_mcu_y;
+   }
+   p.num_intervals = (p.num_mcus + z->restart_interval - 1) / z->restart_interval;
+   if (p.num_intervals < 2) return 0;
+
+   p.interval_start = (stbi_uc **) stbi__malloc_mad2(p.num_intervals, sizeof(stbi_uc *), 0);
+   if (!p.interval_start) return 0;
+
+   // find the restart markers the same way stbi__grow_buffer_unsafe would: 0xff 0x00 is
+   // a stuffed 0xff, extra 0xffs are fill, anything else is a marker
+   p.interval_start[0] = s->img_buffer;
+   found = 1;
+   for (c = s->img_buffer; c + 1 < end; ++c) {
+      if (*c != 0xff) continue;
+      while (c + 2 < end && c[1] == 0xff) ++c;
+      if (c[1] == 0x00) { ++c; continue; }
+      if (!STBI__RESTART(c[1]) || found == p.num_intervals) { terminator = c; break; }
+      p.interval_start[found++] = c + 2;
+      ++c;
+   }
+   if (!terminator || found != p.num_intervals) {
+      STBI_FREE(p.interval_start);
+      return 0;
+   }
+
+   num_tasks = p.num_intervals < STBI__JPEG_PARALLEL_MAX_TASKS ? p.num_intervals : STBI__JPEG_PARALLEL_MAX_TASKS;
+   p.intervals_per_task = (p.num_intervals + num_tasks - 1) / num_tasks;
+   num_tasks = (p.num_intervals + p.intervals_per_task - 1) / p.intervals_per_task;
+   p.task_ok = (stbi_uc *) stbi__malloc(num_tasks);
+   if (!p.task_ok) {
+      STBI_FREE(p.interval_start);
+      return 0;
+   }
+   p.z = z;
+
+   STBI_PARALLEL_FOR(num_tasks, stbi__jpeg_parallel_scan_task, &p);
+
+   for (i=0; i < num_tasks; ++i)
+      ok &= p.task_ok[i];
+   STBI_FREE(p.task_ok);
+   STBI_FREE(p.interval_start);
+   if (!ok) return 0;
+
+   // leave the stream where the serial decoder would: the caller skips ahead to
+   // the marker that ended the scan
+   s->img_buffer = terminator;
+   z->marker = STBI__MARKER_none;
+   return 1;
+}
+#endif
+
 static int stbi__parse_entropy_coded_data(stbi__jpeg *z)
 {
    stbi__jpeg_reset(z);
+#ifdef STBI_PARALLEL_FOR
+   if (stbi__jpeg_parse_parallel(z)) return 1;
+#endif
    if (!z->progressive) {
       if (z->scan_n == 1) {
          int i,j;
-         STBI_SIMD_ALIGN(short, data[64]);
+         stbi__jpeg_idct_queue q;
          int n = z->order[0];
          // non-interleaved data, we just need to process one block at a time,
          // in trivial scanline order
@@ -2964,25 +3461,28 @@ static int stbi__parse_entropy_coded_data(stbi__jpeg *z)
          // component has, independent of interleaved MCU blocking and such
          int w = (z->img_comp[n].x+7) >> 3;
          int h = (z->img_comp[n].y+7) >> 3;
+         q.queued = 0;
          for (j=0; j < h; ++j) {
             for (i=0; i < w; ++i) {
                int ha = z->img_comp[n].ha;
-               if (!stbi__jpeg_decode_block(z, data, z->huff_dc+z->img_comp[n].hd, z->huff_ac+ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
-               z->idct_block_kernel(z->img_comp[n].data+z->img_comp[n].w2*j*8+i*8, z->img_comp[n].w2, data);
+               if (!stbi__jpeg_decode_block(z, stbi__jpeg_idct_next(&q), z->huff_dc+z->img_comp[n].hd, z->huff_ac+ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
+               stbi__jpeg_idct_push(z, &q, z->img_comp[n].data+z->img_comp[n].w2*j*8+i*8, z->img_comp[n].w2);
                // every data block is an MCU, so countdown the restart interval
                if (--z->todo <= 0) {
                   if (z->code_bits < 24) stbi__grow_buffer_unsafe(z);
                   // if it's NOT a restart, then just bail, so we get corrupt data
                   // rather than no data
-                  if (!STBI__RESTART(z->marker)) return 1;
+                  if (!STBI__RESTART(z->marker)) { stbi__jpeg_idct_flush(z, &q); return 1; }
                   stbi__jpeg_reset(z);
                }
             }
          }
+         stbi__jpeg_idct_flush(z, &q);
          return 1;
       } else { // interleaved
          int i,j,k,x,y;
-         STBI_SIMD_ALIGN(short, data[64]);
+         stbi__jpeg_idct_queue q;
+         q.queued = 0;
          for (j=0; j < z->img_mcu_y; ++j) {
             for (i=0; i < z->img_mcu_x; ++i) {
                // scan an interleaved mcu... process scan_n components in order
@@ -2995,8 +3495,8 @@ static int stbi__parse_entropy_coded_data(stbi__jpeg *z)
                         int x2 = (i*z->img_comp[n].h + x)*8;
                         int y2 = (j*z->img_comp[n].v + y)*8;
                         int ha = z->img_comp[n].ha;
-                        if (!stbi__jpeg_decode_block(z, data, z->huff_dc+z->img_comp[n].hd, z->huff_ac+ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
-                        z->idct_block_kernel(z->img_comp[n].data+z->img_comp[n].w2*y2+x2, z->img_comp[n].w2, data);
+                        if (!stbi__jpeg_decode_block(z, stbi__jpeg_idct_next(&q), z->huff_dc+z->img_comp[n].hd, z->huff_ac+ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
+                        stbi__jpeg_idct_push(z, &q, z->img_comp[n].data+z->img_comp[n].w2*y2+x2, z->img_comp[n].w2);
                      }
                   }
                }
@@ -3004,11 +3504,12 @@ static int stbi__parse_entropy_coded_data(stbi__jpeg *z)
                // so now count down the restart interval
                if (--z->todo <= 0) {
                   if (z->code_bits < 24) stbi__grow_buffer_unsafe(z);
-                  if (!STBI__RESTART(z->marker)) return 1;
+                  if (!STBI__RESTART(z->marker)) { stbi__jpeg_idct_flush(z, &q); return 1; }
                   stbi__jpeg_reset(z);
                }
             }
          }
+         stbi__jpeg_idct_flush(z, &q);
          return 1;
       }
    } else {
@@ -3081,22 +3582,66 @@ static void stbi__jpeg_dequantize(short *data, stbi__uint16 *dequant)
       data[i] *= dequant[i];
 }
 
+// dequantize and IDCT block rows [j0, j1) of component n of a progressive image
+static void stbi__jpeg_finish_rows(stbi__jpeg *z, int n, int j0, int j1)
+{
+   int i,j;
+   int w = (z->img_comp[n].x+7) >> 3;
+   for (j=j0; j < j1; ++j) {
+      for (i=0; i < w; ++i) {
+         short *data = z->img_comp[n].coeff + 64 * (i + j * z->img_comp[n].coeff_w);
+         stbi_uc *out = z->img_comp[n].data+z->img_comp[n].w2*j*8+i*8;
+         stbi__jpeg_dequantize(data, z->dequant[z->img_comp[n].tq]);
+         if (z->idct_block2_kernel && i+1 < w) {
+            // STBNative: horizontal neighbours are adjacent in coeff, do them together
+            stbi__jpeg_dequantize(data+64, z->dequant[z->img_comp[n].tq]);
+            z->idct_block2_kernel(out, z->img_comp[n].w2, data, out+8, z->img_comp[n].w2, data+64);
+            ++i;
+         } else {
+            z->idct_block_kernel(out, z->img_comp[n].w2, data);
+         }
+      }
+   }
+}
+
+#ifdef STBI_PARALLEL_FOR
+#define STBI__JPEG_FINISH_BAND 16 // block rows per task
+
+// task i covers band i of the concatenation of every component's block rows
+static void stbi__jpeg_finish_task(void *user, int task)
+{
+   stbi__jpeg *z = (stbi__jpeg *) user;
+   int n;
+   for (n=0; n < z->s->img_n; ++n) {
+      int h = (z->img_comp[n].y+7) >> 3;
+      int bands = (h + STBI__JPEG_FINISH_BAND - 1) / STBI__JPEG_FINISH_BAND;
+      int j0 = task*STBI__JPEG_FINISH_BAND;
+      if (task >= bands) {
+         task -= bands;
+         continue;
+      }
+      stbi__jpeg_finish_rows(z, n, j0, j0 + STBI__JPEG_FINISH_BAND < h ? j0 + STBI__JPEG_FINISH_BAND : h);
+      return;
+   }
+}
+#endif
+
 static void stbi__jpeg_finish(stbi__jpeg *z)
 {
+#ifdef STBI_PARALLEL_FOR
+   if (z->progressive && stbi__jpeg_parallel_worthwhile(z)) {
+      int n, tasks = 0;
+      for (n=0; n < z->s->img_n; ++n)
+         tasks += (((z->img_comp[n].y+7) >> 3) + STBI__JPEG_FINISH_BAND - 1) / STBI__JPEG_FINISH_BAND;
+      STBI_PARALLEL_FOR(tasks, stbi__jpeg_finish_task, z);
+      return;
+   }
+#endif
    if (z->progressive) {
       // dequantize and idct the data
-      int i,j,n;
-      for (n=0; n < z->s->img_n; ++n) {
-         int w = (z->img_comp[n].x+7) >> 3;
-         int h = (z->img_comp[n].y+7) >> 3;
-         for (j=0; j < h; ++j) {
-            for (i=0; i < w; ++i) {
-               short *data = z->img_comp[n].coeff + 64 * (i + j * z->img_comp[n].coeff_w);
-               stbi__jpeg_dequantize(data, z->dequant[z->img_comp[n].tq]);
-               z->idct_block_kernel(z->img_comp[n].data+z->img_comp[n].w2*j*8+i*8, z->img_comp[n].w2, data);
-            }
-         }
-      }
+      int n;
+      for (n=0; n < z->s->img_n; ++n)
+         stbi__jpeg_finish_rows(z, n, 0, (z->img_comp[n].y+7) >> 3);
    }
 }
 
@@ -3647,6 +4192,75 @@ static stbi_uc *stbi__resample_row_hv_2_simd(stbi_uc *out, stbi_uc *in_near, stb
 }
 #endif
 
+#ifdef STBI_AVX2
+// STBNative: stbi__resample_row_hv_2_simd, 16 pixels at a time
+static STBI_AVX2_TARGET stbi_uc *stbi__resample_row_hv_2_avx2(stbi_uc *out, stbi_uc *in_near, stbi_uc *in_far, int w, int hs)
+{
+   int i=0,t0,t1;
+
+   if (w == 1) {
+      out[0] = out[1] = stbi__div4(3*in_near[0] + in_far[0] + 2);
+      return out;
+   }
+
+   t1 = 3*in_near[0] + in_far[0];
+   for (; i < ((w-1) & ~15); i += 16) {
+      // vertical pass, 3*x + y = 4*x + (y - x)
+      __m256i farw  = _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i *) (in_far + i)));
+      __m256i nearw = _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i *) (in_near + i)));
+      __m256i diff  = _mm256_sub_epi16(farw, nearw);
+      __m256i nears = _mm256_slli_epi16(nearw, 2);
+      __m256i curr  = _mm256_add_epi16(nears, diff);
+
+      // "prev" and "next" are curr shifted by one pixel either way. alignr only
+      // works within lanes, so pair each lane with the neighbouring one (or with
+      // the pixel from outside this block of 16) first
+      __m256i before = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_insert_epi16(_mm_setzero_si128(), t1, 7)),
+                                               _mm256_castsi256_si128(curr), 1);
+      __m256i after  = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm256_extracti128_si256(curr, 1)),
+                                               _mm_cvtsi32_si128(3*in_near[i+16] + in_far[i+16]), 1);
+      __m256i prev = _mm256_alignr_epi8(curr, before, 14);
+      __m256i next = _mm256_alignr_epi8(after, curr, 2);
+
+      // horizontal pass, same polyphase filter as the SSE2 version
+      __m256i bias = _mm256_set1_epi16(8);
+      __m256i curs = _mm256_slli_epi16(curr, 2);
+      __m256i prvd = _mm256_sub_epi16(prev, curr);
+      __m256i nxtd = _mm256_sub_epi16(next, curr);
+      __m256i curb = _mm256_add_epi16(curs, bias);
+      __m256i even = _mm256_add_epi16(prvd, curb);
+      __m256i odd  = _mm256_add_epi16(nxtd, curb);
+
+      // interleave even and odd pixels and undo scaling; both the unpacks and the
+      // pack stay within lanes, so this comes out in order
+      __m256i int0 = _mm256_unpacklo_epi16(even, odd);
+      __m256i int1 = _mm256_unpackhi_epi16(even, odd);
+      __m256i de0  = _mm256_srli_epi16(int0, 4);
+      __m256i de1  = _mm256_srli_epi16(int1, 4);
+      __m256i outv = _mm256_packus_epi16(de0, de1);
+      _mm256_storeu_si256((__m256i *) (out + i*2), outv);
+
+      t1 = 3*in_near[i+15] + in_far[i+15];
+   }
+
+   t0 = t1;
+   t1 = 3*in_near[i] + in_far[i];
+   out[i*2] = stbi__div16(3*t1 + t0 + 8);
+
+   for (++i; i < w; ++i) {
+      t0 = t1;
+      t1 = 3*in_near[i]+in_far[i];
+      out[i*2-1] = stbi__div16(3*t0 + t1 + 8);
+      out[i*2  ] = stbi__div16(3*t1 + t0 + 8);
+   }
+   out[w*2-1] = stbi__div4(t1+2);
+
+   STBI_NOTUSED(hs);
+
+   return out;
+}
+#endif
+
 static stbi_uc *stbi__resample_row_generic(stbi_uc *out, stbi_uc *in_near, stbi_uc *in_far, int w, int hs)
 {
    // resample with nearest-neighbor
@@ -3821,18 +4435,92 @@ static void stbi__YCbCr_to_RGB_simd(stbi_uc *out, stbi_uc const *y, stbi_uc cons
 }
 #endif
 
+#ifdef STBI_AVX2
+// STBNative: the step == 4 path of stbi__YCbCr_to_RGB_simd, 16 pixels at a time. this
+// is the one the loader uses for RGBA output, and it fills in alpha as it goes
+static STBI_AVX2_TARGET void stbi__YCbCr_to_RGB_avx2(stbi_uc *out, stbi_uc const *y, stbi_uc const *pcb, stbi_uc const *pcr, int count, int step)
+{
+   int i = 0;
+
+   if (step == 4) {
+      __m128i signflip  = _mm_set1_epi8(-0x80);
+      __m256i cr_const0 = _mm256_set1_epi16(   (short) ( 1.40200f*4096.0f+0.5f));
+      __m256i cr_const1 = _mm256_set1_epi16( - (short) ( 0.71414f*4096.0f+0.5f));
+      __m256i cb_const0 = _mm256_set1_epi16( - (short) ( 0.34414f*4096.0f+0.5f));
+      __m256i cb_const1 = _mm256_set1_epi16(   (short) ( 1.77200f*4096.0f+0.5f));
+      __m256i y_bias = _mm256_set1_epi16(128);
+      __m256i xw = _mm256_set1_epi16(255); // alpha channel
+
+      for (; i+15 < count; i += 16) {
+         // load
+         __m128i y_bytes = _mm_loadu_si128((__m128i *) (y+i));
+         __m128i cr_bytes = _mm_loadu_si128((__m128i *) (pcr+i));
+         __m128i cb_bytes = _mm_loadu_si128((__m128i *) (pcb+i));
+         __m128i cr_biased = _mm_xor_si128(cr_bytes, signflip); // -128
+         __m128i cb_biased = _mm_xor_si128(cb_bytes, signflip); // -128
+
+         // widen to short, with the same layout the SSE2 unpacks produce
+         __m256i yw  = _mm256_or_si256(_mm256_slli_epi16(_mm256_cvtepu8_epi16(y_bytes), 8), y_bias);
+         __m256i crw = _mm256_slli_epi16(_mm256_cvtepi8_epi16(cr_biased), 8);
+         __m256i cbw = _mm256_slli_epi16(_mm256_cvtepi8_epi16(cb_biased), 8);
+
+         // color transform
+         __m256i yws = _mm256_srli_epi16(yw, 4);
+         __m256i cr0 = _mm256_mulhi_epi16(cr_const0, crw);
+         __m256i cb0 = _mm256_mulhi_epi16(cb_const0, cbw);
+         __m256i cb1 = _mm256_mulhi_epi16(cbw, cb_const1);
+         __m256i cr1 = _mm256_mulhi_epi16(crw, cr_const1);
+         __m256i rws = _mm256_add_epi16(cr0, yws);
+         __m256i gwt = _mm256_add_epi16(cb0, yws);
+         __m256i bws = _mm256_add_epi16(yws, cb1);
+         __m256i gws = _mm256_add_epi16(gwt, cr1);
+
+         // descale
+         __m256i rw = _mm256_srai_epi16(rws, 4);
+         __m256i bw = _mm256_srai_epi16(bws, 4);
+         __m256i gw = _mm256_srai_epi16(gws, 4);
+
+         // back to byte and interleave channels; this works per lane, giving
+         // pixels 0-3 and 8-11 in o0 and pixels 4-7 and 12-15 in o1
+         __m256i brb = _mm256_packus_epi16(rw, bw);
+         __m256i gxb = _mm256_packus_epi16(gw, xw);
+         __m256i t0 = _mm256_unpacklo_epi8(brb, gxb);
+         __m256i t1 = _mm256_unpackhi_epi8(brb, gxb);
+         __m256i o0 = _mm256_unpacklo_epi16(t0, t1);
+         __m256i o1 = _mm256_unpackhi_epi16(t0, t1);
+
+         // store
+         _mm256_storeu_si256((__m256i *) (out + 0), _mm256_permute2x128_si256(o0, o1, 0x20));
+         _mm256_storeu_si256((__m256i *) (out + 32), _mm256_permute2x128_si256(o0, o1, 0x31));
+         out += 64;
+      }
+   }
+
+   // leftovers (and step == 3)
+   stbi__YCbCr_to_RGB_simd(out, y+i, pcb+i, pcr+i, count-i, step);
+}
+#endif
+
 // set up the kernels
 static void stbi__setup_jpeg(stbi__jpeg *j)
 {
    j->idct_block_kernel = stbi__idct_block;
    j->YCbCr_to_RGB_kernel = stbi__YCbCr_to_RGB_row;
    j->resample_row_hv_2_kernel = stbi__resample_row_hv_2;
+   j->idct_block2_kernel = NULL;
 
 #ifdef STBI_SSE2
    if (stbi__sse2_available()) {
       j->idct_block_kernel = stbi__idct_simd;
       j->YCbCr_to_RGB_kernel = stbi__YCbCr_to_RGB_simd;
       j->resample_row_hv_2_kernel = stbi__resample_row_hv_2_simd;
+#ifdef STBI_AVX2
+      if (STBI_AVX2_AVAILABLE()) {
+         j->idct_block2_kernel = stbi__idct2_avx2;
+         j->YCbCr_to_RGB_kernel = stbi__YCbCr_to_RGB_avx2;
+         j->resample_row_hv_2_kernel = stbi__resample_row_hv_2_avx2;
+      }
+#endif
    }
 #endif
 
@@ -3866,16 +4554,179 @@ static stbi_uc stbi__blinn_8x8(stbi_uc x, stbi_uc y)
    return (stbi_uc) ((t + (t >>8)) >> 8);
 }
 
-static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp, int req_comp)
+// resample and color-convert the next 'rows' rows of res_comp into output.
+// note that some of the conversions write one byte past the end of each row
+static void stbi__jpeg_convert_rows(stbi__jpeg *z, stbi__resample *res_comp, stbi_uc **linebuf, stbi_uc *output, int n, int decode_n, int is_rgb, unsigned int rows)
+{
+   int k;
+   unsigned int i,j;
+   stbi_uc *coutput[4] = { NULL, NULL, NULL, NULL };
+
+   for (j=0; j < rows; ++j) {
+      stbi_uc *out = output + n * z->s->img_x * j;
+      for (k=0; k < decode_n; ++k) {
+         stbi__resample *r = &res_comp[k];
+         int y_bot = r->ystep >= (r->vs >> 1);
+         coutput[k] = r->resample(linebuf[k],
+                                  y_bot ? r->line1 : r->line0,
+                                  y_bot ? r->line0 : r->line1,
+                                  r->w_lores, r->hs);
+         if (++r->ystep >= r->vs) {
+            r->ystep = 0;
+            r->line0 = r->line1;
+            if (++r->ypos < z->img_comp[k].y)
+               r->line1 += z->img_comp[k].w2;
+         }
+      }
+      if (n >= 3) {
+         stbi_uc *y = coutput[0];
+         if (z->s->img_n == 3) {
+            if (is_rgb) {
+               for (i=0; i < z->s->img_x; ++i) {
+                  out[0] = y[i];
+                  out[1] = coutput[1][i];
+                  out[2] = coutput[2][i];
+                  out[3] = 255;
+                  out += n;
+               }
+            } else {
+               z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
+            }
+         } else if (z->s->img_n == 4) {
+            if (z->app14_color_transform == 0) { // CMYK
+               for (i=0; i < z->s->img_x; ++i) {
+                  stbi_uc m = coutput[3][i];
+                  out[0] = stbi__blinn_8x8(coutput[0][i], m);
+                  out[1] = stbi__blinn_8x8(coutput[1][i], m);
+                  out[2] = stbi__blinn_8x8(coutput[2][i], m);
+                  out[3] = 255;
+                  out += n;
+               }
+            } else if (z->app14_color_transform == 2) { // YCCK
+               z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
+               for (i=0; i < z->s->img_x; ++i) {
+                  stbi_uc m = coutput[3][i];
+                  out[0] = stbi__blinn_8x8(255 - out[0], m);
+                  out[1] = stbi__blinn_8x8(255 - out[1], m);
+                  out[2] = stbi__blinn_8x8(255 - out[2], m);
+                  out += n;
+               }
+            } else { // YCbCr + alpha?  Ignore the fourth channel for now
+               z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
+            }
+         } else
+            for (i=0; i < z->s->img_x; ++i) {
+               out[0] = out[1] = out[2] = y[i];
+               out[3] = 255; // not used if n==3
+               out += n;
+            }
+      } else {
+         if (is_rgb) {
+            if (n == 1)
+               for (i=0; i < z->s->img_x; ++i)
+                  *out++ = stbi__compute_y(coutput[0][i], coutput[1][i], coutput[2][i]);
+            else {
+               for (i=0; i < z->s->img_x; ++i, out += 2) {
+                  out[0] = stbi__compute_y(coutput[0][i], coutput[1][i], coutput[2][i]);
+                  out[1] = 255;
+               }
+            }
+         } else if (z->s->img_n == 4 && z->app14_color_transform == 0) {
+            for (i=0; i < z->s->img_x; ++i) {
+               stbi_uc m = coutput[3][i];
+               stbi_uc r = stbi__blinn_8x8(coutput[0][i], m);
+               stbi_uc g = stbi__blinn_8x8(coutput[1][i], m);
+               stbi_uc b = stbi__blinn_8x8(coutput[2][i], m);
+               out[0] = stbi__compute_y(r, g, b);
+               out[1] = 255;
+               out += n;
+            }
+         } else if (z->s->img_n == 4 && z->app14_color_transform == 2) {
+            for (i=0; i < z->s->img_x; ++i) {
+               out[0] = stbi__blinn_8x8(255 - coutput[0][i], coutput[3][i]);
+               out[1] = 255;
+               out += n;
+            }
+         } else {
+            stbi_uc *y = coutput[0];
+            if (n == 1)
+               for (i=0; i < z->s->img_x; ++i) out[i] = y[i];
+            else
+               for (i=0; i < z->s->img_x; ++i) { *out++ = y[i]; *out++ = 255; }
+         }
+      }
+   }
+}
+
+#ifdef STBI_PARALLEL_FOR
+// advance a resampler past rows it doesn't need to produce
+static void stbi__jpeg_resample_skip(stbi__jpeg *z, stbi__resample *r, int k, unsigned int rows)
+{
+   while (rows--) {
+      if (++r->ystep >= r->vs) {
+         r->ystep = 0;
+         r->line0 = r->line1;
+         if (++r->ypos < z->img_comp[k].y)
+            r->line1 += z->img_comp[k].w2;
+      }
+   }
+}
+
+#define STBI__JPEG_CONVERT_BAND 64 // output rows per task
+
+typedef struct
 {
+   stbi__jpeg *z;
+   stbi__resample *res_comp; // positioned at row 0
+   stbi_uc *output;
    int n, decode_n, is_rgb;
-   z->s->img_n = 0; // make stbi__cleanup_jpeg safe
+   stbi_uc *band_ok;
+} stbi__jpeg_parallel_convert;
 
-   // validate req_comp
-   if (req_comp < 0 || req_comp > 4) return stbi__errpuc("bad req_comp", "Internal error");
+static void stbi__jpeg_convert_band(stbi__jpeg_parallel_convert *p, int band, stbi_uc **linebuf, stbi_uc *scratch)
+{
+   stbi__jpeg *z = p->z;
+   stbi__resample res_comp[4];
+   size_t row_bytes = (size_t) p->n * z->s->img_x;
+   unsigned int j0 = band * STBI__JPEG_CONVERT_BAND, j1 = j0 + STBI__JPEG_CONVERT_BAND;
+   int k;
+   if (j1 > z->s->img_y) j1 = z->s->img_y;
 
-   // load a jpeg image from whichever source, but leave in YCbCr format
-   if (!stbi__decode_jpeg_image(z)) { stbi__cleanup_jpeg(z); return NULL; }
+   for (k=0; k < p->decode_n; ++k) {
+      res_comp[k] = p->res_comp[k];
+      stbi__jpeg_resample_skip(z, &res_comp[k], k, j0);
+   }
+   stbi__jpeg_convert_rows(z, res_comp, linebuf, p->output + row_bytes * j0, p->n, p->decode_n, p->is_rgb, j1 - j0 - 1);
+   // the last row goes through scratch (one byte bigger than a row) so that we don't
+   // write into the first row of the next band, which another thread may own
+   stbi__jpeg_convert_rows(z, res_comp, linebuf, scratch, p->n, p->decode_n, p->is_rgb, 1);
+   memcpy(p->output + row_bytes * (j1 - 1), scratch, row_bytes);
+}
+
+static void stbi__jpeg_convert_task(void *user, int band)
+{
+   stbi__jpeg_parallel_convert *p = (stbi__jpeg_parallel_convert *) user;
+   stbi__jpeg *z = p->z;
+   stbi_uc *linebuf[4], *mem;
+   int k;
+
+   // out of memory: the caller redoes this band with its own buffers
+   mem = (stbi_uc *) stbi__malloc(p->decode_n * (z->s->img_x + 3) + p->n * z->s->img_x + 1);
+   p->band_ok[band] = mem != NULL;
+   if (!mem) return;
+   for (k=0; k < p->decode_n; ++k)
+      linebuf[k] = mem + k * (z->s->img_x + 3);
+   stbi__jpeg_convert_band(p, band, linebuf, mem + p->decode_n * (z->s->img_x + 3));
+   STBI_FREE(mem);
+}
+#endif
+
+// STBNative: the part of load_jpeg_image that decides on the output format and sets up
+// the resamplers, shared with the row streamer. the line buffers belong to img_comp and
+// are freed by stbi__cleanup_jpeg; returns 0 on failure (without cleaning up)
+static int stbi__jpeg_setup_output(stbi__jpeg *z, int req_comp, stbi__resample *res_comp, stbi_uc **linebuf, int *out_n, int *out_decode_n, int *out_is_rgb)
+{
+   int k, n, decode_n, is_rgb;
 
    // determine actual number of components to generate
    n = req_comp ? req_comp : z->s->img_n >= 3 ? 3 : 1;
@@ -3889,144 +4740,254 @@ static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp
 
    // nothing to do if no components requested; check this now to avoid
    // accessing uninitialized coutput[0] later
-   if (decode_n <= 0) { stbi__cleanup_jpeg(z); return NULL; }
+   if (decode_n <= 0) return 0;
+
+   for (k=0; k < decode_n; ++k) {
+      stbi__resample *r = &res_comp[k];
+
+      // allocate line buffer big enough for upsampling off the edges
+      // with upsample factor of 4
+      z->img_comp[k].linebuf = (stbi_uc *) stbi__malloc(z->s->img_x + 3);
+      if (!z->img_comp[k].linebuf) return stbi__err("outofmem", "Out of memory");
+      linebuf[k] = z->img_comp[k].linebuf;
+
+      r->hs      = z->img_h_max / z->img_comp[k].h;
+      r->vs      = z->img_v_max / z->img_comp[k].v;
+      r->ystep   = r->vs >> 1;
+      r->w_lores = (z->s->img_x + r->hs-1) / r->hs;
+      r->ypos    = 0;
+      r->line0   = r->line1 = z->img_comp[k].data;
+
+      if      (r->hs == 1 && r->vs == 1) r->resample = resample_row_1;
+      else if (r->hs == 1 && r->vs == 2) r->resample = stbi__resample_row_v_2;
+      else if (r->hs == 2 && r->vs == 1) r->resample = stbi__resample_row_h_2;
+      else if (r->hs == 2 && r->vs == 2) r->resample = z->resample_row_hv_2_kernel;
+      else                               r->resample = stbi__resample_row_generic;
+   }
+
+   *out_n = n;
+   *out_decode_n = decode_n;
+   *out_is_rgb = is_rgb;
+   return 1;
+}
+
+static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp, int req_comp)
+{
+   int n, decode_n, is_rgb;
+   z->s->img_n = 0; // make stbi__cleanup_jpeg safe
+
+   // validate req_comp
+   if (req_comp < 0 || req_comp > 4) return stbi__errpuc("bad req_comp", "Internal error");
+
+   // load a jpeg image from whichever source, but leave in YCbCr format
+   if (!stbi__decode_jpeg_image(z)) { stbi__cleanup_jpeg(z); return NULL; }
 
    // resample and color-convert
    {
-      int k;
-      unsigned int i,j;
       stbi_uc *output;
-      stbi_uc *coutput[4] = { NULL, NULL, NULL, NULL };
+      stbi_uc *linebuf[4];
 
       stbi__resample res_comp[4];
 
-      for (k=0; k < decode_n; ++k) {
-         stbi__resample *r = &res_comp[k];
-
-         // allocate line buffer big enough for upsampling off the edges
-         // with upsample factor of 4
-         z->img_comp[k].linebuf = (stbi_uc *) stbi__malloc(z->s->img_x + 3);
-         if (!z->img_comp[k].linebuf) { stbi__cleanup_jpeg(z); return stbi__errpuc("outofmem", "Out of memory"); }
-
-         r->hs      = z->img_h_max / z->img_comp[k].h;
-         r->vs      = z->img_v_max / z->img_comp[k].v;
-         r->ystep   = r->vs >> 1;
-         r->w_lores = (z->s->img_x + r->hs-1) / r->hs;
-         r->ypos    = 0;
-         r->line0   = r->line1 = z->img_comp[k].data;
-
-         if      (r->hs == 1 && r->vs == 1) r->resample = resample_row_1;
-         else if (r->hs == 1 && r->vs == 2) r->resample = stbi__resample_row_v_2;
-         else if (r->hs == 2 && r->vs == 1) r->resample = stbi__resample_row_h_2;
-         else if (r->hs == 2 && r->vs == 2) r->resample = z->resample_row_hv_2_kernel;
-         else                               r->resample = stbi__resample_row_generic;
-      }
+      if (!stbi__jpeg_setup_output(z, req_comp, res_comp, linebuf, &n, &decode_n, &is_rgb)) { stbi__cleanup_jpeg(z); return NULL; }
 
       // can't error after this so, this is safe
       output = (stbi_uc *) stbi__malloc_mad3(n, z->s->img_x, z->s->img_y, 1);
       if (!output) { stbi__cleanup_jpeg(z); return stbi__errpuc("outofmem", "Out of memory"); }
 
       // now go ahead and resample
-      for (j=0; j < z->s->img_y; ++j) {
-         stbi_uc *out = output + n * z->s->img_x * j;
-         for (k=0; k < decode_n; ++k) {
-            stbi__resample *r = &res_comp[k];
-            int y_bot = r->ystep >= (r->vs >> 1);
-            coutput[k] = r->resample(z->img_comp[k].linebuf,
-                                     y_bot ? r->line1 : r->line0,
-                                     y_bot ? r->line0 : r->line1,
-                                     r->w_lores, r->hs);
-            if (++r->ystep >= r->vs) {
-               r->ystep = 0;
-               r->line0 = r->line1;
-               if (++r->ypos < z->img_comp[k].y)
-                  r->line1 += z->img_comp[k].w2;
-            }
-         }
-         if (n >= 3) {
-            stbi_uc *y = coutput[0];
-            if (z->s->img_n == 3) {
-               if (is_rgb) {
-                  for (i=0; i < z->s->img_x; ++i) {
-                     out[0] = y[i];
-                     out[1] = coutput[1][i];
-                     out[2] = coutput[2][i];
-                     out[3] = 255;
-                     out += n;
-                  }
-               } else {
-                  z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
-               }
-            } else if (z->s->img_n == 4) {
-               if (z->app14_color_transform == 0) { // CMYK
-                  for (i=0; i < z->s->img_x; ++i) {
-                     stbi_uc m = coutput[3][i];
-                     out[0] = stbi__blinn_8x8(coutput[0][i], m);
-                     out[1] = stbi__blinn_8x8(coutput[1][i], m);
-                     out[2] = stbi__blinn_8x8(coutput[2][i], m);
-                     out[3] = 255;
-                     out += n;
-                  }
-               } else if (z->app14_color_transform == 2) { // YCCK
-                  z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
-                  for (i=0; i < z->s->img_x; ++i) {
-                     stbi_uc m = coutput[3][i];
-                     out[0] = stbi__blinn_8x8(255 - out[0], m);
-                     out[1] = stbi__blinn_8x8(255 - out[1], m);
-                     out[2] = stbi__blinn_8x8(255 - out[2], m);
-                     out += n;
-                  }
-               } else { // YCbCr + alpha?  Ignore the fourth channel for now
-                  z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
-               }
-            } else
-               for (i=0; i < z->s->img_x; ++i) {
-                  out[0] = out[1] = out[2] = y[i];
-                  out[3] = 255; // not used if n==3
-                  out += n;
-               }
+#ifdef STBI_PARALLEL_FOR
+      if (stbi__jpeg_parallel_worthwhile(z) && z->s->img_y > STBI__JPEG_CONVERT_BAND) {
+         stbi__jpeg_parallel_convert p;
+         int band, bands = (z->s->img_y + STBI__JPEG_CONVERT_BAND - 1) / STBI__JPEG_CONVERT_BAND;
+         // per-band status, followed by a scratch row for redoing failed bands
+         p.band_ok = (stbi_uc *) stbi__malloc(bands + n * z->s->img_x + 1);
+         if (p.band_ok) {
+            p.z = z;
+            p.res_comp = res_comp;
+            p.output = output;
+            p.n = n;
+            p.decode_n = decode_n;
+            p.is_rgb = is_rgb;
+            STBI_PARALLEL_FOR(bands, stbi__jpeg_convert_task, &p);
+            for (band=0; band < bands; ++band)
+               if (!p.band_ok[band])
+                  stbi__jpeg_convert_band(&p, band, linebuf, p.band_ok + bands);
+            STBI_FREE(p.band_ok);
          } else {
-            if (is_rgb) {
-               if (n == 1)
-                  for (i=0; i < z->s->img_x; ++i)
-                     *out++ = stbi__compute_y(coutput[0][i], coutput[1][i], coutput[2][i]);
-               else {
-                  for (i=0; i < z->s->img_x; ++i, out += 2) {
-                     out[0] = stbi__compute_y(coutput[0][i], coutput[1][i], coutput[2][i]);
-                     out[1] = 255;
-                  }
-               }
-            } else if (z->s->img_n == 4 && z->app14_color_transform == 0) {
-               for (i=0; i < z->s->img_x; ++i) {
-                  stbi_uc m = coutput[3][i];
-                  stbi_uc r = stbi__blinn_8x8(coutput[0][i], m);
-                  stbi_uc g = stbi__blinn_8x8(coutput[1][i], m);
-                  stbi_uc b = stbi__blinn_8x8(coutput[2][i], m);
-                  out[0] = stbi__compute_y(r, g, b);
-                  out[1] = 255;
-                  out += n;
-               }
-            } else if (z->s->img_n == 4 && z->app14_color_transform == 2) {
-               for (i=0; i < z->s->img_x; ++i) {
-                  out[0] = stbi__blinn_8x8(255 - coutput[0][i], coutput[3][i]);
-                  out[1] = 255;
-                  out += n;
-               }
-            } else {
-               stbi_uc *y = coutput[0];
-               if (n == 1)
-                  for (i=0; i < z->s->img_x; ++i) out[i] = y[i];
-               else
-                  for (i=0; i < z->s->img_x; ++i) { *out++ = y[i]; *out++ = 255; }
-            }
+            stbi__jpeg_convert_rows(z, res_comp, linebuf, output, n, decode_n, is_rgb, z->s->img_y);
+         }
+      } else
+#endif
+      stbi__jpeg_convert_rows(z, res_comp, linebuf, output, n, decode_n, is_rgb, z->s->img_y);
+      stbi__cleanup_jpeg(z);
+      *out_x = z->s->img_x;
+      *out_y = z->s->img_y;
+      if (comp) *comp = z->s->img_n >= 3 ? 3 : 1; // report original components, not output
+      return output;
+   }
+}
+
+// STBNative: incremental decoding of baseline JPEGs that have every component in one
+// scan (see stbi_stream_begin_from_memory). MCU rows are entropy decoded on demand, and
+// output rows are resampled and color-converted as soon as all the plane rows they read
+// have been decoded. Restart intervals and the IDCT queue behave just as they do in
+// stbi__parse_entropy_coded_data.
+typedef struct
+{
+   stbi__jpeg *z;
+   stbi__jpeg_idct_queue q;
+   stbi__resample res_comp[4];
+   stbi_uc *linebuf[4];
+   stbi_uc *scratch;        // one output row, plus the byte some converters write past it
+   int n, decode_n, is_rgb;
+   int mcus_per_row, mcu_rows, mcu_row;
+   stbi__uint32 rows_ready, row;
+} stbi__jpeg_stream;
+
+static void stbi__jpeg_stream_free(stbi__jpeg_stream *js)
+{
+   if (js->z) {
+      stbi__cleanup_jpeg(js->z);
+      STBI_FREE(js->z);
+   }
+   STBI_FREE(js->scratch);
+   STBI_FREE(js);
+}
+
+// returns NULL (with the failure reason set) if the image can't be streamed
+static stbi__jpeg_stream *stbi__jpeg_stream_begin(stbi__context *s, int req_comp)
+{
+   stbi__jpeg_stream *js;
+   stbi__jpeg *z;
+   int m;
+
+   js = (stbi__jpeg_stream *) stbi__malloc(sizeof(stbi__jpeg_stream));
+   if (!js) return (stbi__jpeg_stream *) stbi__errpuc("outofmem", "Out of memory");
+   memset(js, 0, sizeof(*js));
+   z = js->z = (stbi__jpeg *) stbi__malloc(sizeof(stbi__jpeg));
+   if (!z) {
+      stbi__jpeg_stream_free(js);
+      return (stbi__jpeg_stream *) stbi__errpuc("outofmem", "Out of memory");
+   }
+   memset(z, 0, sizeof(stbi__jpeg));
+   z->s = s;
+   s->img_n = 0; // make stbi__cleanup_jpeg safe
+   stbi__setup_jpeg(z);
+
+   if (!stbi__decode_jpeg_header(z, STBI__SCAN_load)) goto fail;
+   if (z->progressive) { stbi__err("not streamable", "JPEG can't be decoded incrementally"); goto fail; }
+
+   // the tables etc. up to the first scan, as in stbi__decode_jpeg_image
+   m = stbi__get_marker(z);
+   while (!stbi__SOS(m)) {
+      if (!stbi__process_marker(z, m)) goto fail;
+      m = stbi__get_marker(z);
+   }
+   if (!stbi__process_scan_header(z)) goto fail;
+   if (z->scan_n != s->img_n) { stbi__err("not streamable", "JPEG can't be decoded incrementally"); goto fail; }
+
+   if (!stbi__jpeg_setup_output(z, req_comp, js->res_comp, js->linebuf, &js->n, &js->decode_n, &js->is_rgb)) goto fail;
+   js->scratch = (stbi_uc *) stbi__malloc_mad2(js->n, s->img_x, 1);
+   if (!js->scratch) { stbi__err("outofmem", "Out of memory"); goto fail; }
+
+   if (z->scan_n == 1) {
+      int n = z->order[0];
+      js->mcus_per_row = (z->img_comp[n].x+7) >> 3;
+      js->mcu_rows = (z->img_comp[n].y+7) >> 3;
+   } else {
+      js->mcus_per_row = z->img_mcu_x;
+      js->mcu_rows = z->img_mcu_y;
+   }
+   stbi__jpeg_reset(z);
+   return js;
+
+fail:
+   stbi__jpeg_stream_free(js);
+   return NULL;
+}
+
+// the scan ended early. the regular decoder leaves the rest of the planes as they were
+// allocated; clear them instead so that the output is at least predictable
+static void stbi__jpeg_stream_clear(stbi__jpeg_stream *js, int next_mcu)
+{
+   stbi__jpeg *z = js->z;
+   int k, y;
+   for (k=0; k < z->s->img_n; ++k) {
+      int w2 = z->img_comp[k].w2, h2 = z->img_comp[k].h2;
+      int mcu_w = z->scan_n == 1 ? 8 : z->img_comp[k].h * 8, mcu_h = z->scan_n == 1 ? 8 : z->img_comp[k].v * 8;
+      int y0 = js->mcu_row * mcu_h, x0 = next_mcu * mcu_w;
+      if (x0 > w2) x0 = w2;
+      for (y=y0; y < h2; ++y) {
+         int x = y < y0 + mcu_h ? x0 : 0;
+         memset(z->img_comp[k].data + w2*y + x, 0, w2 - x);
+      }
+   }
+}
+
+// entropy decode the next MCU row (block row, for single-component images)
+static int stbi__jpeg_stream_mcu_row(stbi__jpeg_stream *js)
+{
+   stbi__jpeg *z = js->z;
+   int i, first = js->mcu_row * js->mcus_per_row;
+   for (i=0; i < js->mcus_per_row; ++i) {
+      if (!stbi__jpeg_decode_baseline_mcu(z, &js->q, first + i)) return 0;
+      if (--z->todo <= 0) {
+         if (z->code_bits < 24) stbi__grow_buffer_unsafe(z);
+         if (!STBI__RESTART(z->marker)) {
+            stbi__jpeg_idct_flush(z, &js->q);
+            stbi__jpeg_stream_clear(js, i + 1);
+            js->mcu_row = js->mcu_rows;
+            return 1;
          }
+         stbi__jpeg_reset(z);
+      }
+   }
+   stbi__jpeg_idct_flush(z, &js->q);
+   ++js->mcu_row;
+   return 1;
+}
+
+// how many output rows only read plane rows that have been decoded. the resamplers are
+// (vs >> 1) rows ahead of the output, see stbi__jpeg_convert_rows
+static stbi__uint32 stbi__jpeg_stream_rows_ready(stbi__jpeg_stream *js)
+{
+   stbi__jpeg *z = js->z;
+   stbi__uint32 ready = z->s->img_y;
+   int k;
+   if (js->mcu_row >= js->mcu_rows) return ready;
+   for (k=0; k < js->decode_n; ++k) {
+      stbi__resample *r = &js->res_comp[k];
+      int plane_rows = js->mcu_row * (z->scan_n == 1 ? 8 : 8 * z->img_comp[k].v);
+      int rows = plane_rows * r->vs - (r->vs >> 1);
+      if (rows <= 0) return 0;
+      if ((stbi__uint32) rows < ready) ready = rows;
+   }
+   return ready;
+}
+
+static int stbi__jpeg_stream_rows(stbi__jpeg_stream *js, stbi_uc *output, int stride, int max_rows)
+{
+   stbi__jpeg *z = js->z;
+   stbi__uint32 start = js->row, end = z->s->img_y;
+   size_t row_bytes = (size_t) js->n * z->s->img_x;
+
+   if (end - start > (stbi__uint32) max_rows) end = start + max_rows;
+   while (js->rows_ready < end) {
+      if (!stbi__jpeg_stream_mcu_row(js)) return -1;
+      js->rows_ready = stbi__jpeg_stream_rows_ready(js);
+   }
+   for (; js->row < end; ++js->row, output += stride) {
+      // some of the converters for fewer than 4 channels write a byte past the row,
+      // which may not be ours to write
+      if (js->n < 4) {
+         stbi__jpeg_convert_rows(z, js->res_comp, js->linebuf, js->scratch, js->n, js->decode_n, js->is_rgb, 1);
+         memcpy(output, js->scratch, row_bytes);
+      } else {
+         stbi__jpeg_convert_rows(z, js->res_comp, js->linebuf, output, js->n, js->decode_n, js->is_rgb, 1);
       }
-      stbi__cleanup_jpeg(z);
-      *out_x = z->s->img_x;
-      *out_y = z->s->img_y;
-      if (comp) *comp = z->s->img_n >= 3 ? 3 : 1; // report original components, not output
-      return output;
    }
+   return (int) (end - start);
 }
 
 static void *stbi__jpeg_load(stbi__context *s, int *x, int *y, int *comp, int req_comp, stbi__result_info *ri)
@@ -4096,6 +5057,28 @@ static int stbi__jpeg_info(stbi__context *s, int *x, int *y, int *comp)
 #define STBI__ZFAST_MASK  ((1 << STBI__ZFAST_BITS) - 1)
 #define STBI__ZNSYMS 288 // number of symbols in literal/length alphabet
 
+// STBNative: wide-table inflate fast path. Needs cheap unaligned little-endian
+// 64-bit loads, so it is only enabled on x86/x64; everything else uses the
+// original bit-at-a-time decoder, which also still handles the tail of every block.
+#if defined(STBI__X86_TARGET) || defined(STBI__X64_TARGET)
+#define STBI__ZFASTLIT
+#define STBI__ZLIT_BITS   11 // wide enough for most dynamic codes and for literal pairs
+#define STBI__ZLIT_MASK   ((1 << STBI__ZLIT_BITS) - 1)
+// fast-path entry kinds; entries are
+//    bits 0-3  number of bits consumed
+//    bits 4-6  kind
+//    bits 8-15 first literal, or number of extra length bits
+//    bits 16+  second literal, or base length
+#define STBI__ZLIT_SLOW   0 // longer than STBI__ZLIT_BITS or invalid, decode the slow way
+#define STBI__ZLIT_ONE    1
+#define STBI__ZLIT_TWO    2
+#define STBI__ZLIT_LEN    3
+#define STBI__ZLIT_END    4
+// output slack the fast path needs: one maximal match plus one 16-byte overcopy
+#define STBI__ZOUT_SLACK  (258 + 16)
+typedef unsigned long long stbi__zbits;
+#endif
+
 // zlib-style huffman encoding
 // (jpegs packs from left, zlib from right, so can't share code)
 typedef struct
@@ -4183,6 +5166,7 @@ typedef struct
    stbi_uc *zbuffer, *zbuffer_end;
    int num_bits;
    int hit_zeof_once;
+   int pad_bits; // zero bits made up past the end of the input
    stbi__uint32 code_buffer;
 
    char *zout;
@@ -4191,6 +5175,9 @@ typedef struct
    int   z_expandable;
 
    stbi__zhuffman z_length, z_distance;
+#ifdef STBI__ZFASTLIT
+   stbi__uint32 z_lit[1 << STBI__ZLIT_BITS];
+#endif
 } stbi__zbuf;
 
 stbi_inline static int stbi__zeof(stbi__zbuf *z)
@@ -4210,6 +5197,7 @@ static void stbi__fill_bits(stbi__zbuf *z)
         z->zbuffer = z->zbuffer_end;  /* treat this as EOF so we fail. */
         return;
       }
+      if (stbi__zeof(z)) z->pad_bits += 8;
       z->code_buffer |= (unsigned int) stbi__zget8(z) << z->num_bits;
       z->num_bits += 8;
    } while (z->num_bits <= 24);
@@ -4255,6 +5243,7 @@ stbi_inline static int stbi__zhuffman_decode(stbi__zbuf *a, stbi__zhuffman *z)
             // though, that is invalid data. This is caught later.
             a->hit_zeof_once = 1;
             a->num_bits += 16; // add 16 implicit zero bits
+            a->pad_bits += 16;
          } else {
             // We already inserted our extra 16 padding bits and are again
             // out, this stream is actually prematurely terminated.
@@ -4310,11 +5299,222 @@ static const int stbi__zdist_base[32] = { 1,2,3,4,5,7,9,13,17,25,33,49,65,97,129
 static const int stbi__zdist_extra[32] =
 { 0,0,0,0,1,1,2,2,3,3,4,4,5,5,6,6,7,7,8,8,9,9,10,10,11,11,12,12,13,13};
 
+#ifdef STBI__ZFASTLIT
+// build the wide literal/length table from the code lengths a->z_length was
+// just built from (so the lengths are known to be valid)
+static void stbi__zbuild_fastlit(stbi__zbuf *a, const stbi_uc *sizelist, int num)
+{
+   stbi__uint32 *t = a->z_lit;
+   int i, j, next_code[16];
+   memset(t, 0, sizeof(a->z_lit));
+   for (i=1; i < 16; ++i)
+      next_code[i] = a->z_length.firstcode[i];
+   for (i=0; i < num; ++i) {
+      int s = sizelist[i];
+      stbi__uint32 e;
+      if (!s) continue;
+      j = stbi__bit_reverse(next_code[s]++, s);
+      if (s > STBI__ZLIT_BITS || i >= 286)
+         continue;
+      if (i < 256)
+         e = (STBI__ZLIT_ONE << 4) | (i << 8);
+      else if (i == 256)
+         e = (STBI__ZLIT_END << 4);
+      else
+         e = (STBI__ZLIT_LEN << 4) | (stbi__zlength_extra[i-257] << 8) | (stbi__zlength_base[i-257] << 16);
+      e |= s;
+      for (; j < (1 << STBI__ZLIT_BITS); j += (1 << s))
+         t[j] = e;
+   }
+   // pair up literals whose codes both fit in the table width. walking down
+   // means the entry for the remaining bits (always a smaller index) is
+   // still a single-symbol entry when we look at it
+   for (j=(1 << STBI__ZLIT_BITS)-1; j >= 0; --j) {
+      stbi__uint32 e = t[j], e2;
+      int s = e & 15;
+      if (((e >> 4) & 7) != STBI__ZLIT_ONE) continue;
+      e2 = t[j >> s];
+      if (((e2 >> 4) & 7) != STBI__ZLIT_ONE) continue;
+      if ((int) (e2 & 15) > STBI__ZLIT_BITS - s) continue;
+      t[j] = (STBI__ZLIT_TWO << 4) | (s + (e2 & 15)) | (e & 0xff00) | ((e2 & 0xff00) << 8);
+   }
+}
+
+static stbi__zbits stbi__zload64(const stbi_uc *p)
+{
+   stbi__zbits v;
+   memcpy(&v, p, sizeof(v));
+   return v;
+}
+
+// same as stbi__zhuffman_decode_slowpath, but on the fast path's bit buffer
+static int stbi__zfast_slow_symbol(stbi__zhuffman *z, stbi__zbits bits, int *size)
+{
+   int b,s,k;
+   k = stbi__bit_reverse((int) (bits & 0xffff), 16);
+   for (s=STBI__ZFAST_BITS+1; ; ++s)
+      if (k < z->maxcode[s])
+         break;
+   if (s >= 16) return -1;
+   b = (k >> (16-s)) - z->firstcode[s] + z->firstsymbol[s];
+   if (b >= STBI__ZNSYMS) return -1;
+   if (z->size[b] != s) return -1;
+   *size = s;
+   return z->value[b];
+}
+
+// decodes as much of the current block as can be done without bounds checks:
+// the bit buffer is refilled 56+ bits at a time with one unaligned load (enough
+// for a full length/distance pair), literals come out of the wide table one or
+// two at a time, and matches are copied with 8/16-byte overlapping stores.
+// returns 1 at end of block, or -1 (with the stream state left consistent)
+// once the input/output is too close to the end or something needs the
+// careful decoder, including reporting errors.
+static int stbi__zinflate_fast(stbi__zbuf *a)
+{
+   const stbi_uc *in = a->zbuffer, *in_end = a->zbuffer_end;
+   char *zout = a->zout, *zout_start = a->zout_start, *zout_end = a->zout_end;
+   const stbi__uint32 *lit = a->z_lit;
+   stbi__zbits bits = a->code_buffer;
+   int nb = a->num_bits, result = -1;
+
+   // only take over while the bit buffer holds nothing but real input bytes;
+   // the careful decoder pads with zeros (and the eof bits) once it runs out
+   if (a->hit_zeof_once || in_end - in < 8 || zout_end - zout < STBI__ZOUT_SLACK)
+      return -1;
+
+   while ((in_end - in >= 8) && (zout_end - zout >= STBI__ZOUT_SLACK)) {
+      stbi__zbits saved_bits;
+      stbi__uint32 e;
+      int saved_nb, s, z, len, dist;
+
+      // bits above nb are always the stream's real next bits, so or-ing the
+      // same bytes back in is harmless
+      bits |= stbi__zload64(in) << nb;
+      in += (63 - nb) >> 3;
+      nb |= 56;
+      saved_bits = bits;
+      saved_nb = nb;
+
+      e = lit[bits & STBI__ZLIT_MASK];
+      s = e & 15;
+      switch ((e >> 4) & 7) {
+         case STBI__ZLIT_TWO:
+            zout[0] = (char) (e >> 8);
+            zout[1] = (char) (e >> 16);
+            zout += 2;
+            bits >>= s;
+            nb -= s;
+            continue;
+         case STBI__ZLIT_ONE:
+            *zout++ = (char) (e >> 8);
+            bits >>= s;
+            nb -= s;
+            continue;
+         case STBI__ZLIT_LEN:
+            bits >>= s;
+            nb -= s;
+            s = (e >> 8) & 7;
+            len = (int) (e >> 16) + (int) (bits & ((1u << s) - 1));
+            bits >>= s;
+            nb -= s;
+            break;
+         case STBI__ZLIT_END:
+            bits >>= s;
+            nb -= s;
+            result = 1;
+            goto done;
+         default:
+            z = stbi__zfast_slow_symbol(&a->z_length, bits, &s);
+            if (z < 0 || z >= 286) goto done;
+            bits >>= s;
+            nb -= s;
+            if (z < 256) {
+               *zout++ = (char) z;
+               continue;
+            }
+            if (z == 256) {
+               result = 1;
+               goto done;
+            }
+            z -= 257;
+            len = stbi__zlength_base[z];
+            if (stbi__zlength_extra[z]) {
+               len += (int) (bits & ((1u << stbi__zlength_extra[z]) - 1));
+               bits >>= stbi__zlength_extra[z];
+               nb -= stbi__zlength_extra[z];
+            }
+            break;
+      }
+
+      z = a->z_distance.fast[bits & STBI__ZFAST_MASK];
+      if (z) {
+         s = z >> 9;
+         z &= 511;
+      } else {
+         z = stbi__zfast_slow_symbol(&a->z_distance, bits, &s);
+      }
+      if (z < 0 || z >= 30) {
+         // let the careful decoder report it
+         bits = saved_bits;
+         nb = saved_nb;
+         goto done;
+      }
+      bits >>= s;
+      nb -= s;
+      dist = stbi__zdist_base[z];
+      if (stbi__zdist_extra[z]) {
+         dist += (int) (bits & ((1u << stbi__zdist_extra[z]) - 1));
+         bits >>= stbi__zdist_extra[z];
+         nb -= stbi__zdist_extra[z];
+      }
+      if (zout - zout_start < dist) {
+         bits = saved_bits;
+         nb = saved_nb;
+         goto done;
+      }
+
+      {
+         const char *p = zout - dist;
+         char *q = zout, *q_end = zout + len;
+         if (dist >= 16) {
+            do { memcpy(q, p, 16); q += 16; p += 16; } while (q < q_end);
+         } else if (dist >= 8) {
+            do { memcpy(q, p, 8); q += 8; p += 8; } while (q < q_end);
+         } else if (dist == 1) {
+            memset(q, *p, len);
+         } else {
+            do *q++ = *p++; while (q < q_end);
+         }
+         zout = q_end;
+      }
+   }
+
+done:
+   // hand back whole unconsumed bytes so the careful decoder's 32-bit buffer
+   // sees exactly the same stream position
+   in -= nb >> 3;
+   nb &= 7;
+   a->zbuffer = (stbi_uc *) in;
+   a->code_buffer = (stbi__uint32) (bits & ((1u << nb) - 1));
+   a->num_bits = nb;
+   a->zout = zout;
+   return result;
+}
+#endif
+
 static int stbi__parse_huffman_block(stbi__zbuf *a)
 {
    char *zout = a->zout;
    for(;;) {
-      int z = stbi__zhuffman_decode(a, &a->z_length);
+      int z;
+#ifdef STBI__ZFASTLIT
+      a->zout = zout;
+      z = stbi__zinflate_fast(a);
+      if (z >= 0) return z;
+      zout = a->zout;
+#endif
+      z = stbi__zhuffman_decode(a, &a->z_length);
       if (z < 256) {
          if (z < 0) return stbi__err("bad huffman code","Corrupt PNG"); // error in huffman codes
          if (zout >= a->zout_end) {
@@ -4327,11 +5527,14 @@ static int stbi__parse_huffman_block(stbi__zbuf *a)
          int len,dist;
          if (z == 256) {
             a->zout = zout;
-            if (a->hit_zeof_once && a->num_bits < 16) {
+            if (a->num_bits < a->pad_bits) {
                // The first time we hit zeof, we inserted 16 extra zero bits into our bit
                // buffer so the decoder can just do its speculative decoding. But if we
                // actually consumed any of those bits (which is the case when num_bits < 16),
                // the stream actually read past the end so it is malformed.
+               // STBNative: stbi__fill_bits also pads with zeros once the input runs out,
+               // so count every made-up bit. Otherwise whether a truncated stream is
+               // accepted depends on how full the bit buffer happened to be.
                return stbi__err("unexpected end","Corrupt PNG");
             }
             return 1;
@@ -4407,6 +5610,9 @@ static int stbi__compute_huffman_codes(stbi__zbuf *a)
    if (n != ntot) return stbi__err("bad codelengths","Corrupt PNG");
    if (!stbi__zbuild_huffman(&a->z_length, lencodes, hlit)) return 0;
    if (!stbi__zbuild_huffman(&a->z_distance, lencodes+hlit, hdist)) return 0;
+#ifdef STBI__ZFASTLIT
+   stbi__zbuild_fastlit(a, lencodes, hlit);
+#endif
    return 1;
 }
 
@@ -4490,6 +5696,7 @@ static int stbi__parse_zlib(stbi__zbuf *a, int parse_header)
    a->num_bits = 0;
    a->code_buffer = 0;
    a->hit_zeof_once = 0;
+   a->pad_bits = 0;
    do {
       final = stbi__zreceive(a,1);
       type = stbi__zreceive(a,2);
@@ -4502,6 +5709,9 @@ static int stbi__parse_zlib(stbi__zbuf *a, int parse_header)
             // use fixed code lengths
             if (!stbi__zbuild_huffman(&a->z_length  , stbi__zdefault_length  , STBI__ZNSYMS)) return 0;
             if (!stbi__zbuild_huffman(&a->z_distance, stbi__zdefault_distance,  32)) return 0;
+#ifdef STBI__ZFASTLIT
+            stbi__zbuild_fastlit(a, stbi__zdefault_length, STBI__ZNSYMS);
+#endif
          } else {
             if (!stbi__compute_huffman_codes(a)) return 0;
          }
@@ -4631,11 +5841,14 @@ static int stbi__check_png_header(stbi__context *s)
    return 1;
 }
 
+typedef struct stbi__png_stream stbi__png_stream;
+
 typedef struct
 {
    stbi__context *s;
    stbi_uc *idata, *expanded, *out;
    int depth;
+   stbi__png_stream *stream; // STBNative: only used by STBI__SCAN_rows
 } stbi__png;
 
 
@@ -4696,21 +5909,301 @@ static void stbi__create_png_alpha_expand8(stbi_uc *dest, stbi_uc *src, stbi__ui
    }
 }
 
+#ifdef STBI_SSE2
+// STBNative: SSE2 unfiltering.
+// Up has no dependency between bytes, so it runs 16 bytes at a time for any format.
+// Sub/Avg/Paeth depend on the pixel to the left, so they run one pixel per iteration
+// with the pixel in the low lanes; that covers 3/4-byte (8-bit RGB/RGBA) and 6/8-byte
+// (16-bit RGB/RGBA) pixels, which is where nearly all the unfiltering time goes.
+// Pixel loads/stores read and write up to the next 4/8-byte boundary, which is fine
+// everywhere except the last pixel of a row, so that one is done exactly.
+static stbi_inline __m128i stbi__png_load_pixel(const stbi_uc *p, int bpp, int exact)
+{
+   stbi_uc tmp[8];
+   int v;
+   if (exact && (bpp & 3)) {
+      memset(tmp, 0, sizeof(tmp));
+      memcpy(tmp, p, bpp);
+      p = tmp;
+   }
+   if (bpp > 4)
+      return _mm_loadl_epi64((const __m128i *) p);
+   memcpy(&v, p, 4);
+   return _mm_cvtsi32_si128(v);
+}
+
+static stbi_inline void stbi__png_store_pixel(stbi_uc *p, __m128i x, int bpp, int exact)
+{
+   stbi_uc tmp[8];
+   int v;
+   if (exact && (bpp & 3)) {
+      _mm_storel_epi64((__m128i *) tmp, x);
+      memcpy(p, tmp, bpp);
+   } else if (bpp > 4) {
+      _mm_storel_epi64((__m128i *) p, x);
+   } else {
+      v = _mm_cvtsi128_si32(x);
+      memcpy(p, &v, 4);
+   }
+}
+
+static void stbi__png_unfilter_up_sse2(stbi_uc *cur, const stbi_uc *prior, const stbi_uc *raw, int nk)
+{
+   int k;
+   for (k = 0; k + 16 <= nk; k += 16) {
+      __m128i x = _mm_loadu_si128((const __m128i *) (raw + k));
+      __m128i b = _mm_loadu_si128((const __m128i *) (prior + k));
+      _mm_storeu_si128((__m128i *) (cur + k), _mm_add_epi8(x, b));
+   }
+   for (; k < nk; ++k)
+      cur[k] = STBI__BYTECAST(raw[k] + prior[k]);
+}
+
+// filter is sub, avg, avg_first or paeth; a and c start out as zero, which is
+// exactly what the spec says to use for the first pixel
+static stbi_inline void stbi__png_unfilter_sse2(int filter, stbi_uc *cur, const stbi_uc *prior, const stbi_uc *raw, int nk, int bpp)
+{
+   __m128i zero = _mm_setzero_si128(), byte_mask = _mm_set1_epi16(255);
+   __m128i a = zero, c = zero;
+   int k, last = nk - bpp;
+
+   switch (filter) {
+   case STBI__F_sub:
+      for (k = 0; k <= last; k += bpp) {
+         a = _mm_add_epi8(stbi__png_load_pixel(raw + k, bpp, k == last), a);
+         stbi__png_store_pixel(cur + k, a, bpp, k == last);
+      }
+      break;
+   case STBI__F_avg:
+   case STBI__F_avg_first: {
+      // floor((a+b)/2) in 8 bits: pavgb rounds up, so take off the lost low bit
+      __m128i one = _mm_set1_epi8(1);
+      for (k = 0; k <= last; k += bpp) {
+         __m128i b = (filter == STBI__F_avg) ? stbi__png_load_pixel(prior + k, bpp, k == last) : zero;
+         __m128i avg = _mm_sub_epi8(_mm_avg_epu8(a, b), _mm_and_si128(_mm_xor_si128(a, b), one));
+         a = _mm_add_epi8(stbi__png_load_pixel(raw + k, bpp, k == last), avg);
+         stbi__png_store_pixel(cur + k, a, bpp, k == last);
+      }
+      break;
+   }
+   case STBI__F_paeth:
+      // a, b and c are kept widened to 16 bits so nothing can overflow; this is the
+      // same branch-free formulation as stbi__paeth
+      for (k = 0; k <= last; k += bpp) {
+         __m128i b = _mm_unpacklo_epi8(stbi__png_load_pixel(prior + k, bpp, k == last), zero);
+         __m128i x = _mm_unpacklo_epi8(stbi__png_load_pixel(raw + k, bpp, k == last), zero);
+         __m128i thresh = _mm_sub_epi16(_mm_add_epi16(c, _mm_add_epi16(c, c)), _mm_add_epi16(a, b));
+         __m128i lo = _mm_min_epi16(a, b), hi = _mm_max_epi16(a, b);
+         __m128i use_c = _mm_cmpgt_epi16(hi, thresh), use_t0 = _mm_cmpgt_epi16(thresh, lo);
+         __m128i t0 = _mm_or_si128(_mm_and_si128(use_c, c), _mm_andnot_si128(use_c, lo));
+         __m128i t1 = _mm_or_si128(_mm_and_si128(use_t0, t0), _mm_andnot_si128(use_t0, hi));
+         a = _mm_and_si128(_mm_add_epi16(x, t1), byte_mask);
+         stbi__png_store_pixel(cur + k, _mm_packus_epi16(a, a), bpp, k == last);
+         c = b;
+      }
+      break;
+   }
+}
+
+#ifdef STBI_SSE41
+// Paeth is one long dependency chain per pixel; pblendvb shortens it enough to matter
+static stbi_inline STBI_SSE41_TARGET void stbi__png_paeth_sse41(stbi_uc *cur, const stbi_uc *prior, const stbi_uc *raw, int nk, int bpp)
+{
+   __m128i zero = _mm_setzero_si128(), byte_mask = _mm_set1_epi16(255);
+   __m128i a = zero, c = zero;
+   int k, last = nk - bpp;
+   for (k = 0; k <= last; k += bpp) {
+      __m128i b = _mm_unpacklo_epi8(stbi__png_load_pixel(prior + k, bpp, k == last), zero);
+      __m128i x = _mm_unpacklo_epi8(stbi__png_load_pixel(raw + k, bpp, k == last), zero);
+      __m128i thresh = _mm_sub_epi16(_mm_add_epi16(c, _mm_add_epi16(c, c)), _mm_add_epi16(a, b));
+      __m128i lo = _mm_min_epi16(a, b), hi = _mm_max_epi16(a, b);
+      __m128i t0 = _mm_blendv_epi8(lo, c, _mm_cmpgt_epi16(hi, thresh));
+      __m128i t1 = _mm_blendv_epi8(hi, t0, _mm_cmpgt_epi16(thresh, lo));
+      a = _mm_and_si128(_mm_add_epi16(x, t1), byte_mask);
+      stbi__png_store_pixel(cur + k, _mm_packus_epi16(a, a), bpp, k == last);
+      c = b;
+   }
+}
+
+static STBI_SSE41_TARGET void stbi__png_unfilter_paeth_sse41(stbi_uc *cur, const stbi_uc *prior, const stbi_uc *raw, int nk, int bpp)
+{
+   switch (bpp) {
+   case 3: stbi__png_paeth_sse41(cur, prior, raw, nk, 3); break;
+   case 4: stbi__png_paeth_sse41(cur, prior, raw, nk, 4); break;
+   case 6: stbi__png_paeth_sse41(cur, prior, raw, nk, 6); break;
+   case 8: stbi__png_paeth_sse41(cur, prior, raw, nk, 8); break;
+   }
+}
+#endif
+#endif
+
+// STBNative: the per-row parts of stbi__create_png_image_raw, split out so that the
+// row streamer (stbi__png_stream_row) can use them too.
+
+// which SIMD unfilters stbi__png_unfilter_row may use; bit 0 = SSE2, bit 1 = SSE4.1
+static int stbi__png_unfilter_simd(void)
+{
+   int simd = 0;
+#ifdef STBI_SSE2
+   if (stbi__sse2_available()) {
+      simd = 1;
+#ifdef STBI_SSE41
+      if (STBI_SSE41_AVAILABLE()) simd |= 2;
+#endif
+   }
+#endif
+   return simd;
+}
+
+// unfilter nk bytes of raw into cur. filter must already be remapped for the first row
+static void stbi__png_unfilter_row(int filter, stbi_uc *cur, stbi_uc *prior, stbi_uc *raw, int nk, int filter_bytes, int simd)
+{
+   int k;
+#ifdef STBI_SSE2
+   int simd_bpp = 0;
+   if (simd && (filter_bytes == 3 || filter_bytes == 4 || filter_bytes == 6 || filter_bytes == 8))
+      simd_bpp = filter_bytes;
+
+   if (simd && filter == STBI__F_up) {
+      stbi__png_unfilter_up_sse2(cur, prior, raw, nk);
+      return;
+   }
+#ifdef STBI_SSE41
+   if (simd_bpp && (simd & 2) && filter == STBI__F_paeth) {
+      stbi__png_unfilter_paeth_sse41(cur, prior, raw, nk, simd_bpp);
+      return;
+   }
+#endif
+   if (simd_bpp && filter != STBI__F_none) {
+      // constant pixel sizes so each call gets its own specialized loop
+      switch (simd_bpp) {
+      case 3: stbi__png_unfilter_sse2(filter, cur, prior, raw, nk, 3); break;
+      case 4: stbi__png_unfilter_sse2(filter, cur, prior, raw, nk, 4); break;
+      case 6: stbi__png_unfilter_sse2(filter, cur, prior, raw, nk, 6); break;
+      case 8: stbi__png_unfilter_sse2(filter, cur, prior, raw, nk, 8); break;
+      }
+      return;
+   }
+#else
+   STBI_NOTUSED(simd);
+#endif
+   switch (filter) {
+   case STBI__F_none:
+      memcpy(cur, raw, nk);
+      break;
+   case STBI__F_sub:
+      memcpy(cur, raw, filter_bytes);
+      for (k = filter_bytes; k < nk; ++k)
+         cur[k] = STBI__BYTECAST(raw[k] + cur[k-filter_bytes]);
+      break;
+   case STBI__F_up:
+      for (k = 0; k < nk; ++k)
+         cur[k] = STBI__BYTECAST(raw[k] + prior[k]);
+      break;
+   case STBI__F_avg:
+      for (k = 0; k < filter_bytes; ++k)
+         cur[k] = STBI__BYTECAST(raw[k] + (prior[k]>>1));
+      for (k = filter_bytes; k < nk; ++k)
+         cur[k] = STBI__BYTECAST(raw[k] + ((prior[k] + cur[k-filter_bytes])>>1));
+      break;
+   case STBI__F_paeth:
+      for (k = 0; k < filter_bytes; ++k)
+         cur[k] = STBI__BYTECAST(raw[k] + prior[k]); // prior[k] == stbi__paeth(0,prior[k],0)
+      for (k = filter_bytes; k < nk; ++k)
+         cur[k] = STBI__BYTECAST(raw[k] + stbi__paeth(cur[k-filter_bytes], prior[k], prior[k-filter_bytes]));
+      break;
+   case STBI__F_avg_first:
+      memcpy(cur, raw, filter_bytes);
+      for (k = filter_bytes; k < nk; ++k)
+         cur[k] = STBI__BYTECAST(raw[k] + (cur[k-filter_bytes] >> 1));
+      break;
+   }
+}
+
+// expand decoded bits in cur to dest, also adding an extra alpha channel if desired
+static void stbi__png_expand_row(stbi_uc *dest, stbi_uc *cur, stbi__uint32 x, int img_n, int out_n, int depth, int color)
+{
+   stbi__uint32 i;
+   if (depth < 8) {
+      stbi_uc scale = (color == 0) ? stbi__depth_scale_table[depth] : 1; // scale grayscale values to 0..255 range
+      stbi_uc *in = cur;
+      stbi_uc *out = dest;
+      stbi_uc inb = 0;
+      stbi__uint32 nsmp = x*img_n;
+
+      // expand bits to bytes first
+      if (depth == 4) {
+         for (i=0; i < nsmp; ++i) {
+            if ((i & 1) == 0) inb = *in++;
+            *out++ = scale * (inb >> 4);
+            inb <<= 4;
+         }
+      } else if (depth == 2) {
+         for (i=0; i < nsmp; ++i) {
+            if ((i & 3) == 0) inb = *in++;
+            *out++ = scale * (inb >> 6);
+            inb <<= 2;
+         }
+      } else {
+         STBI_ASSERT(depth == 1);
+         for (i=0; i < nsmp; ++i) {
+            if ((i & 7) == 0) inb = *in++;
+            *out++ = scale * (inb >> 7);
+            inb <<= 1;
+         }
+      }
+
+      // insert alpha=255 values if desired
+      if (img_n != out_n)
+         stbi__create_png_alpha_expand8(dest, dest, x, img_n);
+   } else if (depth == 8) {
+      if (img_n == out_n)
+         memcpy(dest, cur, x*img_n);
+      else
+         stbi__create_png_alpha_expand8(dest, cur, x, img_n);
+   } else if (depth == 16) {
+      // convert the image data from big-endian to platform-native
+      stbi__uint16 *dest16 = (stbi__uint16*)dest;
+      stbi__uint32 nsmp = x*img_n;
+
+      if (img_n == out_n) {
+         for (i = 0; i < nsmp; ++i, ++dest16, cur += 2)
+            *dest16 = (cur[0] << 8) | cur[1];
+      } else {
+         STBI_ASSERT(img_n+1 == out_n);
+         if (img_n == 1) {
+            for (i = 0; i < x; ++i, dest16 += 2, cur += 2) {
+               dest16[0] = (cur[0] << 8) | cur[1];
+               dest16[1] = 0xffff;
+            }
+         } else {
+            STBI_ASSERT(img_n == 3);
+            for (i = 0; i < x; ++i, dest16 += 4, cur += 6) {
+               dest16[0] = (cur[0] << 8) | cur[1];
+               dest16[1] = (cur[2] << 8) | cur[3];
+               dest16[2] = (cur[4] << 8) | cur[5];
+               dest16[3] = 0xffff;
+            }
+         }
+      }
+   }
+}
+
 // create the png data from post-deflated data
 static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 raw_len, int out_n, stbi__uint32 x, stbi__uint32 y, int depth, int color)
 {
    int bytes = (depth == 16 ? 2 : 1);
    stbi__context *s = a->s;
-   stbi__uint32 i,j,stride = x*out_n*bytes;
+   stbi__uint32 j,stride = x*out_n*bytes;
    stbi__uint32 img_len, img_width_bytes;
    stbi_uc *filter_buf;
    int all_ok = 1;
-   int k;
    int img_n = s->img_n; // copy it into a local for later
 
    int output_bytes = out_n*bytes;
    int filter_bytes = img_n*bytes;
    int width = x;
+   int simd = stbi__png_unfilter_simd();
 
    STBI_ASSERT(out_n == s->img_n || out_n == s->img_n+1);
    a->out = (stbi_uc *) stbi__malloc_mad3(x, y, output_bytes, 0); // extra bytes to write off the end into
@@ -4756,104 +6249,11 @@ static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 r
       if (j == 0) filter = first_row_filter[filter];
 
       // perform actual filtering
-      switch (filter) {
-      case STBI__F_none:
-         memcpy(cur, raw, nk);
-         break;
-      case STBI__F_sub:
-         memcpy(cur, raw, filter_bytes);
-         for (k = filter_bytes; k < nk; ++k)
-            cur[k] = STBI__BYTECAST(raw[k] + cur[k-filter_bytes]);
-         break;
-      case STBI__F_up:
-         for (k = 0; k < nk; ++k)
-            cur[k] = STBI__BYTECAST(raw[k] + prior[k]);
-         break;
-      case STBI__F_avg:
-         for (k = 0; k < filter_bytes; ++k)
-            cur[k] = STBI__BYTECAST(raw[k] + (prior[k]>>1));
-         for (k = filter_bytes; k < nk; ++k)
-            cur[k] = STBI__BYTECAST(raw[k] + ((prior[k] + cur[k-filter_bytes])>>1));
-         break;
-      case STBI__F_paeth:
-         for (k = 0; k < filter_bytes; ++k)
-            cur[k] = STBI__BYTECAST(raw[k] + prior[k]); // prior[k] == stbi__paeth(0,prior[k],0)
-         for (k = filter_bytes; k < nk; ++k)
-            cur[k] = STBI__BYTECAST(raw[k] + stbi__paeth(cur[k-filter_bytes], prior[k], prior[k-filter_bytes]));
-         break;
-      case STBI__F_avg_first:
-         memcpy(cur, raw, filter_bytes);
-         for (k = filter_bytes; k < nk; ++k)
-            cur[k] = STBI__BYTECAST(raw[k] + (cur[k-filter_bytes] >> 1));
-         break;
-      }
+      stbi__png_unfilter_row(filter, cur, prior, raw, nk, filter_bytes, simd);
 
       raw += nk;
 
-      // expand decoded bits in cur to dest, also adding an extra alpha channel if desired
-      if (depth < 8) {
-         stbi_uc scale = (color == 0) ? stbi__depth_scale_table[depth] : 1; // scale grayscale values to 0..255 range
-         stbi_uc *in = cur;
-         stbi_uc *out = dest;
-         stbi_uc inb = 0;
-         stbi__uint32 nsmp = x*img_n;
-
-         // expand bits to bytes first
-         if (depth == 4) {
-            for (i=0; i < nsmp; ++i) {
-               if ((i & 1) == 0) inb = *in++;
-               *out++ = scale * (inb >> 4);
-               inb <<= 4;
-            }
-         } else if (depth == 2) {
-            for (i=0; i < nsmp; ++i) {
-               if ((i & 3) == 0) inb = *in++;
-               *out++ = scale * (inb >> 6);
-               inb <<= 2;
-            }
-         } else {
-            STBI_ASSERT(depth == 1);
-            for (i=0; i < nsmp; ++i) {
-               if ((i & 7) == 0) inb = *in++;
-               *out++ = scale * (inb >> 7);
-               inb <<= 1;
-            }
-         }
-
-         // insert alpha=255 values if desired
-         if (img_n != out_n)
-            stbi__create_png_alpha_expand8(dest, dest, x, img_n);
-      } else if (depth == 8) {
-         if (img_n == out_n)
-            memcpy(dest, cur, x*img_n);
-         else
-            stbi__create_png_alpha_expand8(dest, cur, x, img_n);
-      } else if (depth == 16) {
-         // convert the image data from big-endian to platform-native
-         stbi__uint16 *dest16 = (stbi__uint16*)dest;
-         stbi__uint32 nsmp = x*img_n;
-
-         if (img_n == out_n) {
-            for (i = 0; i < nsmp; ++i, ++dest16, cur += 2)
-               *dest16 = (cur[0] << 8) | cur[1];
-         } else {
-            STBI_ASSERT(img_n+1 == out_n);
-            if (img_n == 1) {
-               for (i = 0; i < x; ++i, dest16 += 2, cur += 2) {
-                  dest16[0] = (cur[0] << 8) | cur[1];
-                  dest16[1] = 0xffff;
-               }
-            } else {
-               STBI_ASSERT(img_n == 3);
-               for (i = 0; i < x; ++i, dest16 += 4, cur += 6) {
-                  dest16[0] = (cur[0] << 8) | cur[1];
-                  dest16[1] = (cur[2] << 8) | cur[3];
-                  dest16[2] = (cur[4] << 8) | cur[5];
-                  dest16[3] = 0xffff;
-               }
-            }
-         }
-      }
+      stbi__png_expand_row(dest, cur, x, img_n, out_n, depth, color);
    }
 
    STBI_FREE(filter_buf);
@@ -4907,11 +6307,10 @@ static int stbi__create_png_image(stbi__png *a, stbi_uc *image_data, stbi__uint3
    return 1;
 }
 
-static int stbi__compute_transparency(stbi__png *z, stbi_uc tc[3], int out_n)
+// STBNative: takes the pixels to work on so that the row streamer can use it
+static void stbi__compute_transparency_pixels(stbi_uc *p, stbi__uint32 pixel_count, stbi_uc tc[3], int out_n)
 {
-   stbi__context *s = z->s;
-   stbi__uint32 i, pixel_count = s->img_x * s->img_y;
-   stbi_uc *p = z->out;
+   stbi__uint32 i;
 
    // compute color-based transparency, assuming we've
    // already got 255 as the alpha value in the output
@@ -4929,6 +6328,12 @@ static int stbi__compute_transparency(stbi__png *z, stbi_uc tc[3], int out_n)
          p += 4;
       }
    }
+}
+
+static int stbi__compute_transparency(stbi__png *z, stbi_uc tc[3], int out_n)
+{
+   stbi__context *s = z->s;
+   stbi__compute_transparency_pixels(z->out, s->img_x * s->img_y, tc, out_n);
    return 1;
 }
 
@@ -4957,17 +6362,10 @@ static int stbi__compute_transparency16(stbi__png *z, stbi__uint16 tc[3], int ou
    return 1;
 }
 
-static int stbi__expand_png_palette(stbi__png *a, stbi_uc *palette, int len, int pal_img_n)
+// STBNative: takes the pixels to work on so that the row streamer can use it
+static void stbi__expand_png_palette_pixels(stbi_uc *p, stbi_uc *orig, stbi__uint32 pixel_count, stbi_uc *palette, int pal_img_n)
 {
-   stbi__uint32 i, pixel_count = a->s->img_x * a->s->img_y;
-   stbi_uc *p, *temp_out, *orig = a->out;
-
-   p = (stbi_uc *) stbi__malloc_mad2(pixel_count, pal_img_n, 0);
-   if (p == NULL) return stbi__err("outofmem", "Out of memory");
-
-   // between here and free(out) below, exitting would leak
-   temp_out = p;
-
+   stbi__uint32 i;
    if (pal_img_n == 3) {
       for (i=0; i < pixel_count; ++i) {
          int n = orig[i]*4;
@@ -4986,6 +6384,17 @@ static int stbi__expand_png_palette(stbi__png *a, stbi_uc *palette, int len, int
          p += 4;
       }
    }
+}
+
+static int stbi__expand_png_palette(stbi__png *a, stbi_uc *palette, int len, int pal_img_n)
+{
+   stbi__uint32 pixel_count = a->s->img_x * a->s->img_y;
+   stbi_uc *temp_out;
+
+   temp_out = (stbi_uc *) stbi__malloc_mad2(pixel_count, pal_img_n, 0);
+   if (temp_out == NULL) return stbi__err("outofmem", "Out of memory");
+
+   stbi__expand_png_palette_pixels(temp_out, a->out, pixel_count, palette, pal_img_n);
    STBI_FREE(a->out);
    a->out = temp_out;
 
@@ -5077,6 +6486,101 @@ static void stbi__de_iphone(stbi__png *z)
    }
 }
 
+// STBNative: incremental decoding of non-interlaced 8-bit PNGs (see stbi_stream_begin_from_memory).
+// stbi__parse_png_file still inflates the whole image, but the unfiltering, expansion and
+// format conversion happen a row at a time, straight into the caller's buffer.
+struct stbi__png_stream
+{
+   stbi__png p;             // p.expanded holds the inflated image
+   stbi_uc *raw;            // filter byte of the next row
+   stbi_uc *filter_buf;     // two rows, as in stbi__create_png_image_raw
+   stbi_uc *line;           // one row at img_out_n, then one at the palette's channel count
+   stbi_uc palette[1024], tc[3];
+   stbi__uint32 width_bytes, row;
+   int img_n, color, has_trans, pal_img_n, pal_out_n, req_comp, simd;
+};
+
+// called by stbi__parse_png_file in place of stbi__create_png_image & co.
+static int stbi__png_stream_setup(stbi__png *z, stbi__uint32 raw_len, int color, int has_trans, stbi_uc tc[3], stbi_uc palette[1024], int pal_img_n, int req_comp)
+{
+   stbi__png_stream *ps = z->stream;
+   stbi__context *s = z->s;
+
+   if (!stbi__mad3sizes_valid(s->img_n, s->img_x, z->depth, 7)) return stbi__err("too large", "Corrupt PNG");
+   ps->width_bytes = (((s->img_n * s->img_x * z->depth) + 7) >> 3);
+   if (!stbi__mad2sizes_valid(ps->width_bytes, s->img_y, ps->width_bytes)) return stbi__err("too large", "Corrupt PNG");
+   if (raw_len < (ps->width_bytes + 1) * s->img_y) return stbi__err("not enough pixels","Corrupt PNG");
+
+   ps->filter_buf = (stbi_uc *) stbi__malloc_mad2(ps->width_bytes, 2, 0);
+   ps->line = (stbi_uc *) stbi__malloc_mad2(s->img_x, 8, 0);
+   if (!ps->filter_buf || !ps->line) return stbi__err("outofmem", "Out of memory");
+
+   ps->raw = z->expanded;
+   ps->row = 0;
+   ps->img_n = s->img_n;
+   ps->color = color;
+   ps->has_trans = has_trans;
+   memcpy(ps->tc, tc, 3);
+   ps->pal_img_n = pal_img_n;
+   ps->pal_out_n = pal_img_n;
+   ps->simd = stbi__png_unfilter_simd();
+   if (pal_img_n) {
+      memcpy(ps->palette, palette, 1024);
+      if (req_comp >= 3) ps->pal_out_n = req_comp;
+      s->img_n = pal_img_n;
+   } else if (has_trans) {
+      ++s->img_n;
+   }
+   ps->req_comp = req_comp ? req_comp : s->img_n;
+   return 1;
+}
+
+// produce the next row at req_comp channels
+static int stbi__png_stream_row(stbi__png_stream *ps, stbi_uc *dest)
+{
+   stbi__context *s = ps->p.s;
+   stbi_uc *cur = ps->filter_buf + (ps->row & 1)*ps->width_bytes;
+   stbi_uc *prior = ps->filter_buf + (~ps->row & 1)*ps->width_bytes;
+   stbi_uc *line = ps->line;
+   int out_n = s->img_out_n;
+   int filter = *ps->raw++;
+
+   if (filter > 4) return stbi__err("invalid filter","Corrupt PNG");
+   if (ps->row == 0) filter = first_row_filter[filter];
+   stbi__png_unfilter_row(filter, cur, prior, ps->raw, (int) ps->width_bytes, ps->p.depth < 8 ? 1 : ps->img_n, ps->simd);
+   ps->raw += ps->width_bytes;
+
+   // expand straight into dest when nothing else needs doing
+   if (!ps->pal_img_n && out_n == ps->req_comp) line = dest;
+   stbi__png_expand_row(line, cur, s->img_x, ps->img_n, out_n, ps->p.depth, ps->color);
+   if (ps->has_trans)
+      stbi__compute_transparency_pixels(line, s->img_x, ps->tc, out_n);
+   if (ps->pal_img_n) {
+      stbi_uc *expanded = ps->line + s->img_x * 4;
+      stbi__expand_png_palette_pixels(expanded, line, s->img_x, ps->palette, ps->pal_out_n);
+      line = expanded;
+      out_n = ps->pal_out_n;
+   }
+   if (out_n == ps->req_comp) {
+      if (line != dest) memcpy(dest, line, s->img_x * out_n);
+   } else if (!stbi__convert_format_row(line, dest, out_n, ps->req_comp, s->img_x)) {
+      return stbi__err("unsupported", "Unsupported format conversion");
+   }
+
+   ++ps->row;
+   return 1;
+}
+
+static void stbi__png_stream_free(stbi__png_stream *ps)
+{
+   STBI_FREE(ps->p.idata);
+   STBI_FREE(ps->p.expanded);
+   STBI_FREE(ps->p.out);
+   STBI_FREE(ps->filter_buf);
+   STBI_FREE(ps->line);
+   STBI_FREE(ps);
+}
+
 #define STBI__PNG_TYPE(a,b,c,d)  (((unsigned) (a) << 24) + ((unsigned) (b) << 16) + ((unsigned) (c) << 8) + (unsigned) (d))
 
 static int stbi__parse_png_file(stbi__png *z, int scan, int req_comp)
@@ -5120,6 +6624,7 @@ static int stbi__parse_png_file(stbi__png *z, int scan, int req_comp)
             filter= stbi__get8(s);  if (filter) return stbi__err("bad filter method","Corrupt PNG");
             interlace = stbi__get8(s); if (interlace>1) return stbi__err("bad interlace method","Corrupt PNG");
             if (!s->img_x || !s->img_y) return stbi__err("0-pixel image","Corrupt PNG");
+            if (scan == STBI__SCAN_rows && (interlace || z->depth == 16 || is_iphone)) return stbi__err("not streamable","PNG can't be decoded incrementally");
             if (!pal_img_n) {
                s->img_n = (color & 2 ? 3 : 1) + (color & 4 ? 1 : 0);
                if ((1 << 30) / s->img_x / s->img_n < s->img_y) return stbi__err("too large", "Image too large to decode");
@@ -5203,7 +6708,7 @@ static int stbi__parse_png_file(stbi__png *z, int scan, int req_comp)
          case STBI__PNG_TYPE('I','E','N','D'): {
             stbi__uint32 raw_len, bpl;
             if (first) return stbi__err("first not IHDR", "Corrupt PNG");
-            if (scan != STBI__SCAN_load) return 1;
+            if (scan != STBI__SCAN_load && scan != STBI__SCAN_rows) return 1;
             if (z->idata == NULL) return stbi__err("no IDAT","Corrupt PNG");
             // initial guess for decoded data size to avoid unnecessary reallocs
             bpl = (s->img_x * z->depth + 7) / 8; // bytes per line, per component
@@ -5215,6 +6720,8 @@ static int stbi__parse_png_file(stbi__png *z, int scan, int req_comp)
                s->img_out_n = s->img_n+1;
             else
                s->img_out_n = s->img_n;
+            if (scan == STBI__SCAN_rows)
+               return stbi__png_stream_setup(z, raw_len, color, has_trans, tc, palette, pal_img_n, req_comp);
             if (!stbi__create_png_image(z, z->expanded, raw_len, s->img_out_n, z->depth, color, interlace)) return 0;
             if (has_trans) {
                if (z->depth == 16) {
@@ -5296,6 +6803,21 @@ static void *stbi__do_png(stbi__png *p, int *x, int *y, int *n, int req_comp, st
    return result;
 }
 
+// STBNative: returns NULL (with the failure reason set) if the image can't be streamed
+static stbi__png_stream *stbi__png_stream_begin(stbi__context *s, int req_comp)
+{
+   stbi__png_stream *ps = (stbi__png_stream *) stbi__malloc(sizeof(stbi__png_stream));
+   if (!ps) return (stbi__png_stream *) stbi__errpuc("outofmem", "Out of memory");
+   memset(ps, 0, sizeof(*ps));
+   ps->p.s = s;
+   ps->p.stream = ps;
+   if (!stbi__parse_png_file(&ps->p, STBI__SCAN_rows, req_comp)) {
+      stbi__png_stream_free(ps);
+      return NULL;
+   }
+   return ps;
+}
+
 static void *stbi__png_load(stbi__context *s, int *x, int *y, int *comp, int req_comp, stbi__result_info *ri)
 {
    stbi__png p;
@@ -7643,6 +9165,10 @@ static int stbi__info_main(stbi__context *s, int *x, int *y, int *comp)
    if (stbi__png_info(s, x, y, comp))  return 1;
    #endif
 
+   #ifdef STBI_QOI_LOAD
+   if (stbi__qoi_info(s, x, y, comp))  return 1;
+   #endif
+
    #ifndef STBI_NO_GIF
    if (stbi__gif_info(s, x, y, comp))  return 1;
    #endif
@@ -7763,6 +9289,152 @@ STBIDEF int stbi_is_16_bit_from_callbacks(stbi_io_callbacks const *c, void *user
    return stbi__is_16_main(&s);
 }
 
+// STBNative: incremental decoding
+struct stbi__stream
+{
+   stbi__context s;
+   int failed;
+#ifndef STBI_NO_PNG
+   stbi__png_stream *png;
+#endif
+#ifndef STBI_NO_JPEG
+   stbi__jpeg_stream *jpeg;
+#endif
+};
+
+STBIDEF void stbi_stream_free(stbi_stream *st)
+{
+   if (!st) return;
+#ifndef STBI_NO_PNG
+   if (st->png) stbi__png_stream_free(st->png);
+#endif
+#ifndef STBI_NO_JPEG
+   if (st->jpeg) stbi__jpeg_stream_free(st->jpeg);
+#endif
+   STBI_FREE(st);
+}
+
+STBIDEF stbi_stream *stbi_stream_begin_from_memory(stbi_uc const *buffer, int len, int *x, int *y, int *comp, int req_comp)
+{
+   stbi_stream *st;
+   int ok = 0, channels = 0;
+   if (req_comp < 0 || req_comp > 4) return (stbi_stream *) stbi__errpuc("bad req_comp", "Internal error");
+   if (stbi__vertically_flip_on_load) return (stbi_stream *) stbi__errpuc("not streamable", "Can't flip images that are decoded incrementally");
+
+   st = (stbi_stream *) stbi__malloc(sizeof(stbi_stream));
+   if (!st) return (stbi_stream *) stbi__errpuc("outofmem", "Out of memory");
+   memset(st, 0, sizeof(*st));
+   stbi__start_mem(&st->s, buffer, len);
+
+   #ifndef STBI_NO_PNG
+   if (stbi__png_test(&st->s)) {
+      st->png = stbi__png_stream_begin(&st->s, req_comp);
+      ok = st->png != NULL;
+      channels = st->s.img_n;
+   } else
+   #endif
+   #ifndef STBI_NO_JPEG
+   if (stbi__jpeg_test(&st->s)) {
+      st->jpeg = stbi__jpeg_stream_begin(&st->s, req_comp);
+      ok = st->jpeg != NULL;
+      channels = st->s.img_n >= 3 ? 3 : 1; // report original components, like load_jpeg_image
+   } else
+   #endif
+   stbi__err("not streamable", "Image can't be decoded incrementally");
+
+   if (!ok) {
+      stbi_stream_free(st);
+      return NULL;
+   }
+   *x = st->s.img_x;
+   *y = st->s.img_y;
+   if (comp) *comp = channels;
+   return st;
+}
+
+STBIDEF int stbi_stream_read_rows(stbi_stream *st, stbi_uc *output, int stride_in_bytes, int max_rows)
+{
+   int rows = 0;
+   if (st->failed) return -1;
+   if (max_rows <= 0) return 0;
+#ifndef STBI_NO_PNG
+   if (st->png) {
+      for (; rows < max_rows && st->png->row < st->s.img_y; ++rows, output += stride_in_bytes) {
+         if (!stbi__png_stream_row(st->png, output)) {
+            rows = -1;
+            break;
+         }
+      }
+   }
+#endif
+#ifndef STBI_NO_JPEG
+   if (st->jpeg)
+      rows = stbi__jpeg_stream_rows(st->jpeg, output, stride_in_bytes, max_rows);
+#endif
+   if (rows < 0) st->failed = 1;
+   return rows;
+}
+
+// STBNative: decoding into caller memory
+STBIDEF int stbi_load_into_from_memory(stbi_uc const *buffer, int len, void *output, int output_w, int output_h, int stride_in_bytes, int dest_x, int dest_y, int *x, int *y, int *comp, int req_comp, int bytes_per_channel)
+{
+   int w, h, n, row;
+   size_t pixel_bytes, row_bytes;
+   stbi_uc *dest;
+   void *pixels;
+
+   if (req_comp < 1 || req_comp > 4) return stbi__err("bad req_comp", "Internal error");
+   if (bytes_per_channel != 1 && bytes_per_channel != 2 && bytes_per_channel != 4) return stbi__err("bad bytes_per_channel", "Internal error");
+   pixel_bytes = (size_t) req_comp * bytes_per_channel;
+   if (!output || dest_x < 0 || dest_y < 0 || output_w < 0 || output_h < 0 || stride_in_bytes < 0 || (size_t) stride_in_bytes < (size_t) output_w * pixel_bytes)
+      return stbi__err("bad destination", "Invalid destination buffer");
+
+   // check the header first so nothing gets decoded if it won't fit
+   if (!stbi_info_from_memory(buffer, len, &w, &h, &n)) return 0;
+   if (w > output_w - dest_x || h > output_h - dest_y) return stbi__err("too large", "Image doesn't fit in destination");
+   dest = (stbi_uc *) output + (size_t) dest_y * stride_in_bytes + (size_t) dest_x * pixel_bytes;
+
+   if (bytes_per_channel == 1) {
+      stbi_stream *st = stbi_stream_begin_from_memory(buffer, len, &w, &h, &n, req_comp);
+      if (st) {
+         int rows = 0;
+         for (row = 0; row < h; row += rows) {
+            rows = stbi_stream_read_rows(st, dest + (size_t) row * stride_in_bytes, stride_in_bytes, h - row);
+            if (rows <= 0) break;
+         }
+         stbi_stream_free(st);
+         if (rows < 0) return 0;
+         if (row < h) return stbi__err("truncated", "Image ended early");
+         if (x) *x = w;
+         if (y) *y = h;
+         if (comp) *comp = n;
+         return 1;
+      }
+   }
+
+   if (bytes_per_channel == 1)
+      pixels = stbi_load_from_memory(buffer, len, &w, &h, &n, req_comp);
+   else if (bytes_per_channel == 2)
+      pixels = stbi_load_16_from_memory(buffer, len, &w, &h, &n, req_comp);
+   else
+      pixels = stbi_loadf_from_memory(buffer, len, &w, &h, &n, req_comp);
+   if (!pixels) return 0;
+
+   if (w > output_w - dest_x || h > output_h - dest_y) {
+      STBI_FREE(pixels);
+      return stbi__err("too large", "Image doesn't fit in destination");
+   }
+   row_bytes = (size_t) w * pixel_bytes;
+   for (row = 0; row < h; ++row)
+      memcpy(dest + (size_t) row * stride_in_bytes, (stbi_uc *) pixels + row * row_bytes, row_bytes);
+   STBI_FREE(pixels);
+
+   if (x) *x = w;
+   if (y) *y = h;
+   if (comp) *comp = n;
+   return 1;
+}
+
 #endif // STB_IMAGE_IMPLEMENTATION
 
 /*
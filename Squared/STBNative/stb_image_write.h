@@ -194,6 +194,17 @@ STBIWDEF int stbi_write_jpg_to_func(stbi_write_func *func, void *context, int x,
 
 STBIWDEF void stbi_flip_vertically_on_write(int flip_boolean);
 
+// STBNative: thread-safe PNG writers that take the compression level and filter per call
+// instead of reading stbi_write_png_compression_level and stbi_write_force_png_filter.
+// force_filter is -1 to pick the filter for each row, or 0-4 to use the same one everywhere.
+STBIWDEF unsigned char *stbi_write_png_to_mem_ex(const unsigned char *pixels, int stride_bytes, int x, int y, int n, int *out_len, int compression_level, int force_filter);
+STBIWDEF int stbi_write_png_to_func_ex(stbi_write_func *func, void *context, int w, int h, int comp, const void  *data, int stride_in_bytes, int compression_level, int force_filter);
+
+// STBNative: with parallel set, large images are cut into bands separated by restart markers and
+// the bands are encoded at the same time (if STBIW_PARALLEL_FOR is defined). The result is still a
+// baseline JPEG, just a slightly larger one.
+STBIWDEF int stbi_write_jpg_to_func_ex(stbi_write_func *func, void *context, int x, int y, int comp, const void  *data, int quality, int parallel);
+
 #endif//INCLUDE_STB_IMAGE_WRITE_H
 
 #ifdef STB_IMAGE_WRITE_IMPLEMENTATION
@@ -247,6 +258,19 @@ STBIWDEF void stbi_flip_vertically_on_write(int flip_boolean);
 
 #define STBIW_UCHAR(x) (unsigned char) ((x) & 0xff)
 
+// STBNative: SSE2 is part of the x64 baseline, so no runtime check is needed
+#if !defined(STBIW_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define STBIW_SSE2
+#include <emmintrin.h>
+#endif
+
+// STBNative: AVX2 paths are only built when the includer supplies runtime detection
+// (STBIW_AVX2_AVAILABLE()) and the function attribute its compiler needs (STBIW_AVX2_TARGET)
+#if defined(STBIW_SSE2) && defined(STBIW_AVX2_AVAILABLE) && defined(STBIW_AVX2_TARGET)
+#define STBIW_AVX2
+#include <immintrin.h>
+#endif
+
 #ifdef STB_IMAGE_WRITE_STATIC
 static int stbi_write_png_compression_level = 8;
 static int stbi_write_tga_with_rle = 1;
@@ -892,34 +916,46 @@ static unsigned int stbiw__zhash(unsigned char *data)
 
 #endif // STBIW_ZLIB_COMPRESS
 
-STBIWDEF unsigned char * stbi_zlib_compress(unsigned char *data, int data_len, int *out_len, int quality)
+#ifndef STBIW_ZLIB_COMPRESS
+static unsigned short stbiw__lengthc[] = { 3,4,5,6,7,8,9,10,11,13,15,17,19,23,27,31,35,43,51,59,67,83,99,115,131,163,195,227,258, 259 };
+static unsigned char  stbiw__lengtheb[]= { 0,0,0,0,0,0,0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4,  4,  5,  5,  5,  5,  0 };
+static unsigned short stbiw__distc[]   = { 1,2,3,4,5,7,9,13,17,25,33,49,65,97,129,193,257,385,513,769,1025,1537,2049,3073,4097,6145,8193,12289,16385,24577, 32768 };
+static unsigned char  stbiw__disteb[]  = { 0,0,0,0,1,1,2,2,3,3,4,4,5,5,6,6,7,7,8,8,9,9,10,10,11,11,12,12,13,13 };
+
+// STBNative: compresses data[start, end) as one fixed-huffman block, appended to 'out'.
+// Matches can reach back up to 32K before 'start' (a preset dictionary), so independent
+// chunks of a larger stream can be compressed separately. If 'final' is 0 the block is
+// followed by a sync flush (an empty stored block), so the output always ends on a byte
+// boundary and the next chunk's output can simply be appended.
+static unsigned char *stbiw__zlib_deflate_block(unsigned char *out, unsigned char *data, int start, int end, int quality, int final)
 {
-#ifdef STBIW_ZLIB_COMPRESS
-   // user provided a zlib compress implementation, use that
-   return STBIW_ZLIB_COMPRESS(data, data_len, out_len, quality);
-#else // use builtin
-   static unsigned short lengthc[] = { 3,4,5,6,7,8,9,10,11,13,15,17,19,23,27,31,35,43,51,59,67,83,99,115,131,163,195,227,258, 259 };
-   static unsigned char  lengtheb[]= { 0,0,0,0,0,0,0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4,  4,  5,  5,  5,  5,  0 };
-   static unsigned short distc[]   = { 1,2,3,4,5,7,9,13,17,25,33,49,65,97,129,193,257,385,513,769,1025,1537,2049,3073,4097,6145,8193,12289,16385,24577, 32768 };
-   static unsigned char  disteb[]  = { 0,0,0,0,1,1,2,2,3,3,4,4,5,5,6,6,7,7,8,8,9,9,10,10,11,11,12,12,13,13 };
    unsigned int bitbuf=0;
    int i,j, bitcount=0;
-   unsigned char *out = NULL;
    unsigned char ***hash_table = (unsigned char***) STBIW_MALLOC(stbiw__ZHASH * sizeof(unsigned char**));
-   if (hash_table == NULL)
+   if (hash_table == NULL) {
+      (void) stbiw__sbfree(out);
       return NULL;
+   }
    if (quality < 5) quality = 5;
 
-   stbiw__sbpush(out, 0x78);   // DEFLATE 32K window
-   stbiw__sbpush(out, 0x5e);   // FLEVEL = 1
-   stbiw__zlib_add(1,1);  // BFINAL = 1
+   stbiw__zlib_add(final ? 1 : 0,1);  // BFINAL
    stbiw__zlib_add(1,2);  // BTYPE = 1 -- fixed huffman
 
    for (i=0; i < stbiw__ZHASH; ++i)
       hash_table[i] = NULL;
 
-   i=0;
-   while (i < data_len-3) {
+   // seed the hash chains with the dictionary
+   for (i = start > 32768 ? start - 32768 : 0; i < start; ++i) {
+      int h = stbiw__zhash(data+i)&(stbiw__ZHASH-1);
+      if (hash_table[h] && stbiw__sbn(hash_table[h]) == 2*quality) {
+         STBIW_MEMMOVE(hash_table[h], hash_table[h]+quality, sizeof(hash_table[h][0])*quality);
+         stbiw__sbn(hash_table[h]) = quality;
+      }
+      stbiw__sbpush(hash_table[h],data+i);
+   }
+
+   i=start;
+   while (i < end-3) {
       // hash next 3 bytes of data to be compressed
       int h = stbiw__zhash(data+i)&(stbiw__ZHASH-1), best=3;
       unsigned char *bestloc = 0;
@@ -927,7 +963,7 @@ STBIWDEF unsigned char * stbi_zlib_compress(unsigned char *data, int data_len, i
       int n = stbiw__sbcount(hlist);
       for (j=0; j < n; ++j) {
          if (hlist[j]-data > i-32768) { // if entry lies within window
-            int d = stbiw__zlib_countm(hlist[j], data+i, data_len-i);
+            int d = stbiw__zlib_countm(hlist[j], data+i, end-i);
             if (d >= best) { best=d; bestloc=hlist[j]; }
          }
       }
@@ -945,7 +981,7 @@ STBIWDEF unsigned char * stbi_zlib_compress(unsigned char *data, int data_len, i
          n = stbiw__sbcount(hlist);
          for (j=0; j < n; ++j) {
             if (hlist[j]-data > i-32767) {
-               int e = stbiw__zlib_countm(hlist[j], data+i+1, data_len-i-1);
+               int e = stbiw__zlib_countm(hlist[j], data+i+1, end-i-1);
                if (e > best) { // if next match is better, bail on current match
                   bestloc = NULL;
                   break;
@@ -957,12 +993,12 @@ STBIWDEF unsigned char * stbi_zlib_compress(unsigned char *data, int data_len, i
       if (bestloc) {
          int d = (int) (data+i - bestloc); // distance back
          STBIW_ASSERT(d <= 32767 && best <= 258);
-         for (j=0; best > lengthc[j+1]-1; ++j);
+         for (j=0; best > stbiw__lengthc[j+1]-1; ++j);
          stbiw__zlib_huff(j+257);
-         if (lengtheb[j]) stbiw__zlib_add(best - lengthc[j], lengtheb[j]);
-         for (j=0; d > distc[j+1]-1; ++j);
+         if (stbiw__lengtheb[j]) stbiw__zlib_add(best - stbiw__lengthc[j], stbiw__lengtheb[j]);
+         for (j=0; d > stbiw__distc[j+1]-1; ++j);
          stbiw__zlib_add(stbiw__zlib_bitrev(j,5),5);
-         if (disteb[j]) stbiw__zlib_add(d - distc[j], disteb[j]);
+         if (stbiw__disteb[j]) stbiw__zlib_add(d - stbiw__distc[j], stbiw__disteb[j]);
          i += best;
       } else {
          stbiw__zlib_huffb(data[i]);
@@ -970,50 +1006,93 @@ STBIWDEF unsigned char * stbi_zlib_compress(unsigned char *data, int data_len, i
       }
    }
    // write out final bytes
-   for (;i < data_len; ++i)
+   for (;i < end; ++i)
       stbiw__zlib_huffb(data[i]);
    stbiw__zlib_huff(256); // end of block
+   if (!final) {
+      stbiw__zlib_add(0,3); // BFINAL = 0, BTYPE = 0 -- empty stored block
+   }
    // pad with 0 bits to byte boundary
    while (bitcount)
       stbiw__zlib_add(0,1);
+   if (!final) {
+      stbiw__sbpush(out, 0x00); // LEN
+      stbiw__sbpush(out, 0x00);
+      stbiw__sbpush(out, 0xff); // NLEN
+      stbiw__sbpush(out, 0xff);
+   }
 
    for (i=0; i < stbiw__ZHASH; ++i)
       (void) stbiw__sbfree(hash_table[i]);
    STBIW_FREE(hash_table);
+   return out;
+}
+
+// STBNative: appends data[0, data_len) as stored (uncompressed) blocks
+static unsigned char *stbiw__zlib_store_blocks(unsigned char *out, unsigned char *data, int data_len, int final)
+{
+   int j;
+   for (j = 0; j < data_len;) {
+      int blocklen = data_len - j;
+      if (blocklen > 32767) blocklen = 32767;
+      stbiw__sbpush(out, final && (data_len - j == blocklen)); // BFINAL = ?, BTYPE = 0 -- no compression
+      stbiw__sbpush(out, STBIW_UCHAR(blocklen)); // LEN
+      stbiw__sbpush(out, STBIW_UCHAR(blocklen >> 8));
+      stbiw__sbpush(out, STBIW_UCHAR(~blocklen)); // NLEN
+      stbiw__sbpush(out, STBIW_UCHAR(~blocklen >> 8));
+      stbiw__sbmaybegrow(out, blocklen);
+      memcpy(out+stbiw__sbn(out), data+j, blocklen);
+      stbiw__sbn(out) += blocklen;
+      j += blocklen;
+   }
+   return out;
+}
+
+static unsigned int stbiw__adler32(unsigned char *data, int data_len)
+{
+   unsigned int s1=1, s2=0;
+   int i, j=0;
+   int blocklen = (int) (data_len % 5552);
+   while (j < data_len) {
+      for (i=0; i < blocklen; ++i) { s1 += data[j+i]; s2 += s1; }
+      s1 %= 65521; s2 %= 65521;
+      j += blocklen;
+      blocklen = 5552;
+   }
+   return (s2 << 16) | s1;
+}
+
+static unsigned char *stbiw__zlib_push_adler32(unsigned char *out, unsigned int adler)
+{
+   stbiw__sbpush(out, STBIW_UCHAR(adler >> 24));
+   stbiw__sbpush(out, STBIW_UCHAR(adler >> 16));
+   stbiw__sbpush(out, STBIW_UCHAR(adler >> 8));
+   stbiw__sbpush(out, STBIW_UCHAR(adler));
+   return out;
+}
+#endif // STBIW_ZLIB_COMPRESS
+
+STBIWDEF unsigned char * stbi_zlib_compress(unsigned char *data, int data_len, int *out_len, int quality)
+{
+#ifdef STBIW_ZLIB_COMPRESS
+   // user provided a zlib compress implementation, use that
+   return STBIW_ZLIB_COMPRESS(data, data_len, out_len, quality);
+#else // use builtin
+   unsigned char *out = NULL;
+
+   stbiw__sbpush(out, 0x78);   // DEFLATE 32K window
+   stbiw__sbpush(out, 0x5e);   // FLEVEL = 1
+   out = stbiw__zlib_deflate_block(out, data, 0, data_len, quality, 1);
+   if (out == NULL)
+      return NULL;
 
    // store uncompressed instead if compression was worse
    if (stbiw__sbn(out) > data_len + 2 + ((data_len+32766)/32767)*5) {
       stbiw__sbn(out) = 2;  // truncate to DEFLATE 32K window and FLEVEL = 1
-      for (j = 0; j < data_len;) {
-         int blocklen = data_len - j;
-         if (blocklen > 32767) blocklen = 32767;
-         stbiw__sbpush(out, data_len - j == blocklen); // BFINAL = ?, BTYPE = 0 -- no compression
-         stbiw__sbpush(out, STBIW_UCHAR(blocklen)); // LEN
-         stbiw__sbpush(out, STBIW_UCHAR(blocklen >> 8));
-         stbiw__sbpush(out, STBIW_UCHAR(~blocklen)); // NLEN
-         stbiw__sbpush(out, STBIW_UCHAR(~blocklen >> 8));
-         memcpy(out+stbiw__sbn(out), data+j, blocklen);
-         stbiw__sbn(out) += blocklen;
-         j += blocklen;
-      }
+      out = stbiw__zlib_store_blocks(out, data, data_len, 1);
    }
 
-   {
-      // compute adler32 on input
-      unsigned int s1=1, s2=0;
-      int blocklen = (int) (data_len % 5552);
-      j=0;
-      while (j < data_len) {
-         for (i=0; i < blocklen; ++i) { s1 += data[j+i]; s2 += s1; }
-         s1 %= 65521; s2 %= 65521;
-         j += blocklen;
-         blocklen = 5552;
-      }
-      stbiw__sbpush(out, STBIW_UCHAR(s2 >> 8));
-      stbiw__sbpush(out, STBIW_UCHAR(s2));
-      stbiw__sbpush(out, STBIW_UCHAR(s1 >> 8));
-      stbiw__sbpush(out, STBIW_UCHAR(s1));
-   }
+   out = stbiw__zlib_push_adler32(out, stbiw__adler32(data, data_len));
    *out_len = stbiw__sbn(out);
    // make returned pointer freeable
    STBIW_MEMMOVE(stbiw__sbraw(out), out, *out_len);
@@ -1125,14 +1204,239 @@ static void stbiw__encode_png_line(unsigned char *pixels, int stride_bytes, int
    }
 }
 
-STBIWDEF unsigned char *stbi_write_png_to_mem(const unsigned char *pixels, int stride_bytes, int x, int y, int n, int *out_len)
+// STBNative: estimates the entropy of a row under each of the five filters (the sum of the
+// absolute values of the filtered bytes; the less, the better) straight from the raw rows,
+// instead of filtering the row five times. prior is the row above, or all zeroes for the
+// first row, which gives the same results as firstmap.
+static void stbiw__png_filter_costs(const unsigned char *z, const unsigned char *prior, int len, int n, int costs[5])
+{
+   int i, a, b, c;
+   for (i = 0; i < 5; ++i)
+      costs[i] = 0;
+
+   // the first pixel has no left neighbour
+   for (i = 0; i < n; ++i) {
+      costs[0] += abs((signed char) z[i]);
+      costs[1] += abs((signed char) z[i]);
+      costs[2] += abs((signed char) (z[i] - prior[i]));
+      costs[3] += abs((signed char) (z[i] - (prior[i]>>1)));
+      costs[4] += abs((signed char) (z[i] - stbiw__paeth(0, prior[i], 0)));
+   }
+
+#ifdef STBIW_SSE2
+   {
+      // |v| of a signed byte is min(v, -v) when both are treated as unsigned, and psadbw
+      // sums unsigned bytes, so each filter costs a subtract, a min and a psadbw
+      __m128i zero = _mm_setzero_si128(), one = _mm_set1_epi8(1);
+      __m128i sums[5];
+      for (a = 0; a < 5; ++a)
+         sums[a] = zero;
+
+      #define STBIW__SAD_ACCUM(k, v) { __m128i d = (v); sums[k] = _mm_add_epi64(sums[k], _mm_sad_epu8(_mm_min_epu8(d, _mm_sub_epi8(zero, d)), zero)); }
+      #define STBIW__ABS16(v) _mm_max_epi16((v), _mm_sub_epi16(zero, (v)))
+      for (; i + 16 <= len; i += 16) {
+         __m128i x  = _mm_loadu_si128((const __m128i *) (z + i));
+         __m128i va = _mm_loadu_si128((const __m128i *) (z + i - n));
+         __m128i vb = _mm_loadu_si128((const __m128i *) (prior + i));
+         __m128i vc = _mm_loadu_si128((const __m128i *) (prior + i - n));
+         // pavgb rounds up, the average filter rounds down
+         __m128i avg = _mm_sub_epi8(_mm_avg_epu8(va, vb), _mm_and_si128(_mm_xor_si128(va, vb), one));
+         __m128i pa_lo, pa_hi, pb_lo, pb_hi, pc_lo, pc_hi, not_a, not_b, paeth;
+         {
+            // pa = |b - c|, pb = |a - c|, pc = |a + b - 2c|
+            __m128i a_lo = _mm_unpacklo_epi8(va, zero), a_hi = _mm_unpackhi_epi8(va, zero);
+            __m128i b_lo = _mm_unpacklo_epi8(vb, zero), b_hi = _mm_unpackhi_epi8(vb, zero);
+            __m128i c_lo = _mm_unpacklo_epi8(vc, zero), c_hi = _mm_unpackhi_epi8(vc, zero);
+            __m128i bc_lo = _mm_sub_epi16(b_lo, c_lo), bc_hi = _mm_sub_epi16(b_hi, c_hi);
+            __m128i ac_lo = _mm_sub_epi16(a_lo, c_lo), ac_hi = _mm_sub_epi16(a_hi, c_hi);
+            pa_lo = STBIW__ABS16(bc_lo); pa_hi = STBIW__ABS16(bc_hi);
+            pb_lo = STBIW__ABS16(ac_lo); pb_hi = STBIW__ABS16(ac_hi);
+            pc_lo = STBIW__ABS16(_mm_add_epi16(bc_lo, ac_lo)); pc_hi = STBIW__ABS16(_mm_add_epi16(bc_hi, ac_hi));
+         }
+         // same order of preference as stbiw__paeth: a, then b, then c
+         not_a = _mm_packs_epi16(
+            _mm_or_si128(_mm_cmpgt_epi16(pa_lo, pb_lo), _mm_cmpgt_epi16(pa_lo, pc_lo)),
+            _mm_or_si128(_mm_cmpgt_epi16(pa_hi, pb_hi), _mm_cmpgt_epi16(pa_hi, pc_hi))
+         );
+         not_b = _mm_packs_epi16(_mm_cmpgt_epi16(pb_lo, pc_lo), _mm_cmpgt_epi16(pb_hi, pc_hi));
+         paeth = _mm_or_si128(_mm_and_si128(not_b, vc), _mm_andnot_si128(not_b, vb));
+         paeth = _mm_or_si128(_mm_and_si128(not_a, paeth), _mm_andnot_si128(not_a, va));
+
+         STBIW__SAD_ACCUM(0, x);
+         STBIW__SAD_ACCUM(1, _mm_sub_epi8(x, va));
+         STBIW__SAD_ACCUM(2, _mm_sub_epi8(x, vb));
+         STBIW__SAD_ACCUM(3, _mm_sub_epi8(x, avg));
+         STBIW__SAD_ACCUM(4, _mm_sub_epi8(x, paeth));
+      }
+      #undef STBIW__SAD_ACCUM
+      #undef STBIW__ABS16
+
+      for (a = 0; a < 5; ++a)
+         costs[a] += _mm_cvtsi128_si32(sums[a]) + _mm_cvtsi128_si32(_mm_srli_si128(sums[a], 8));
+   }
+#endif
+
+   for (; i < len; ++i) {
+      a = z[i-n]; b = prior[i]; c = prior[i-n];
+      costs[0] += abs((signed char) z[i]);
+      costs[1] += abs((signed char) (z[i] - a));
+      costs[2] += abs((signed char) (z[i] - b));
+      costs[3] += abs((signed char) (z[i] - ((a + b)>>1)));
+      costs[4] += abs((signed char) (z[i] - stbiw__paeth(a, b, c)));
+   }
+}
+
+// STBNative: filters row j of the image into filt (filter type byte + x*n bytes).
+// zero_row is x*n zero bytes, used as the row above the first one.
+static void stbiw__filter_png_row(unsigned char *pixels, int stride_bytes, int x, int y, int n, int j, int force_filter, const unsigned char *zero_row, unsigned char *filt)
+{
+   int filter_type;
+   if (force_filter > -1) {
+      filter_type = force_filter;
+   } else {
+      unsigned char *z = pixels + stride_bytes * (stbi__flip_vertically_on_write ? y-1-j : j);
+      int signed_stride = stbi__flip_vertically_on_write ? -stride_bytes : stride_bytes;
+      int costs[5], i;
+      stbiw__png_filter_costs(z, j ? z - signed_stride : zero_row, x*n, n, costs);
+      filter_type = 0;
+      for (i = 1; i < 5; ++i)
+         if (costs[i] < costs[filter_type])
+            filter_type = i;
+   }
+   filt[0] = (unsigned char) filter_type;
+   stbiw__encode_png_line(pixels, stride_bytes, x, y, j, n, filter_type, (signed char *) filt+1);
+}
+
+#if defined(STBIW_PARALLEL_FOR) && !defined(STBIW_ZLIB_COMPRESS)
+// STBNative: multi-threaded PNG encoding, in the style of pigz.
+// STBIW_PARALLEL_FOR(count, fn, user) is supplied by the includer; it must call
+// fn(user, i) for every i in [0, count) and return once all of them are done.
+//
+// Rows are filtered in parallel bands (each row only depends on the raw pixels). The
+// filtered stream is then cut into fixed-size chunks which are deflated independently,
+// each using the 32K before it as a preset dictionary and ending with a sync flush, so
+// their outputs concatenate into one valid deflate stream. The Adler-32 of each chunk is
+// computed alongside and the results are combined at the end.
+
+#define STBIW__PNG_PARALLEL_MIN_BYTES  (1 << 18) // below this, threading costs more than it saves
+#define STBIW__PNG_CHUNK_BYTES         (1 << 17)
+#define STBIW__PNG_FILTER_BAND_BYTES   (1 << 16)
+
+typedef struct
+{
+   unsigned char *pixels, *filt;
+   const unsigned char *zero_row;
+   int stride_bytes, x, y, n, force_filter, rows_per_band;
+} stbiw__png_filter_job;
+
+static void stbiw__png_filter_task(void *user, int band)
+{
+   stbiw__png_filter_job *job = (stbiw__png_filter_job *) user;
+   int j, first = band * job->rows_per_band, last = first + job->rows_per_band;
+   if (last > job->y) last = job->y;
+   for (j = first; j < last; ++j)
+      stbiw__filter_png_row(job->pixels, job->stride_bytes, job->x, job->y, job->n, j, job->force_filter, job->zero_row, job->filt + j*(job->x*job->n+1));
+}
+
+typedef struct
+{
+   unsigned char *data;
+   int data_len, chunk_count, quality;
+   unsigned char **outputs;
+   unsigned int *adlers;
+} stbiw__zlib_chunk_job;
+
+static void stbiw__zlib_chunk_task(void *user, int chunk)
+{
+   stbiw__zlib_chunk_job *job = (stbiw__zlib_chunk_job *) user;
+   int start = chunk * STBIW__PNG_CHUNK_BYTES, end = start + STBIW__PNG_CHUNK_BYTES, len, final;
+   unsigned char *out = NULL;
+   if (end > job->data_len) end = job->data_len;
+   len = end - start;
+   final = chunk == job->chunk_count - 1;
+
+   out = stbiw__zlib_deflate_block(out, job->data, start, end, job->quality, final);
+   // store uncompressed instead if compression was worse
+   if (out && stbiw__sbn(out) > len + ((len+32766)/32767)*5) {
+      stbiw__sbn(out) = 0;
+      out = stbiw__zlib_store_blocks(out, job->data + start, len, final);
+   }
+   job->outputs[chunk] = out;
+   job->adlers[chunk] = stbiw__adler32(job->data + start, len);
+}
+
+// adler32 of A followed by B, given adler32(A), adler32(B) and the length of B
+static unsigned int stbiw__adler32_combine(unsigned int adler1, unsigned int adler2, unsigned int len2)
+{
+   unsigned int rem = len2 % 65521;
+   unsigned int a1 = adler1 & 0xffff, b1 = adler1 >> 16, a2 = adler2 & 0xffff, b2 = adler2 >> 16;
+   unsigned int a = a1 + a2 + 65520; // a1 + (a2 - 1), kept positive
+   unsigned int b = (unsigned int) ((rem * (unsigned long long) a1) % 65521) + b1 + b2 + 65521 - rem;
+   a %= 65521;
+   b %= 65521;
+   return (b << 16) | a;
+}
+
+static unsigned char *stbiw__zlib_compress_parallel(unsigned char *data, int data_len, int *out_len, int quality)
+{
+   stbiw__zlib_chunk_job job;
+   unsigned char *out = NULL;
+   unsigned int adler;
+   int i, failed = 0;
+
+   job.data = data;
+   job.data_len = data_len;
+   job.chunk_count = (data_len + STBIW__PNG_CHUNK_BYTES - 1) / STBIW__PNG_CHUNK_BYTES;
+   job.quality = quality;
+   job.outputs = (unsigned char **) STBIW_MALLOC(job.chunk_count * sizeof(unsigned char *));
+   job.adlers = (unsigned int *) STBIW_MALLOC(job.chunk_count * sizeof(unsigned int));
+   if (!job.outputs || !job.adlers) {
+      STBIW_FREE(job.outputs);
+      STBIW_FREE(job.adlers);
+      return NULL;
+   }
+
+   STBIW_PARALLEL_FOR(job.chunk_count, stbiw__zlib_chunk_task, &job);
+
+   stbiw__sbpush(out, 0x78);   // DEFLATE 32K window
+   stbiw__sbpush(out, 0x5e);   // FLEVEL = 1
+   adler = 1;
+   for (i=0; i < job.chunk_count; ++i) {
+      unsigned char *chunk = job.outputs[i];
+      int start = i * STBIW__PNG_CHUNK_BYTES, len = (i == job.chunk_count - 1) ? data_len - start : STBIW__PNG_CHUNK_BYTES;
+      if (!chunk) {
+         failed = 1;
+         continue;
+      }
+      if (!failed) {
+         stbiw__sbmaybegrow(out, stbiw__sbn(chunk));
+         memcpy(out + stbiw__sbn(out), chunk, stbiw__sbn(chunk));
+         stbiw__sbn(out) += stbiw__sbn(chunk);
+         adler = stbiw__adler32_combine(adler, job.adlers[i], len);
+      }
+      (void) stbiw__sbfree(chunk);
+   }
+   STBIW_FREE(job.outputs);
+   STBIW_FREE(job.adlers);
+   if (failed) {
+      (void) stbiw__sbfree(out);
+      return NULL;
+   }
+
+   out = stbiw__zlib_push_adler32(out, adler);
+   *out_len = stbiw__sbn(out);
+   // make returned pointer freeable
+   STBIW_MEMMOVE(stbiw__sbraw(out), out, *out_len);
+   return (unsigned char *) stbiw__sbraw(out);
+}
+#endif
+
+STBIWDEF unsigned char *stbi_write_png_to_mem_ex(const unsigned char *pixels, int stride_bytes, int x, int y, int n, int *out_len, int compression_level, int force_filter)
 {
-   int force_filter = stbi_write_force_png_filter;
    int ctype[5] = { -1, 0, 4, 2, 6 };
    unsigned char sig[8] = { 137,80,78,71,13,10,26,10 };
-   unsigned char *out,*o, *filt, *zlib;
-   signed char *line_buffer;
-   int j,zlen;
+   unsigned char *out,*o, *filt, *zlib, *zero_row;
+   int j,zlen,filt_len;
 
    if (stride_bytes == 0)
       stride_bytes = x * n;
@@ -1141,41 +1445,37 @@ STBIWDEF unsigned char *stbi_write_png_to_mem(const unsigned char *pixels, int s
       force_filter = -1;
    }
 
-   filt = (unsigned char *) STBIW_MALLOC((x*n+1) * y); if (!filt) return 0;
-   line_buffer = (signed char *) STBIW_MALLOC(x * n); if (!line_buffer) { STBIW_FREE(filt); return 0; }
-   for (j=0; j < y; ++j) {
-      int filter_type;
-      if (force_filter > -1) {
-         filter_type = force_filter;
-         stbiw__encode_png_line((unsigned char*)(pixels), stride_bytes, x, y, j, n, force_filter, line_buffer);
-      } else { // Estimate the best filter by running through all of them:
-         int best_filter = 0, best_filter_val = 0x7fffffff, est, i;
-         for (filter_type = 0; filter_type < 5; filter_type++) {
-            stbiw__encode_png_line((unsigned char*)(pixels), stride_bytes, x, y, j, n, filter_type, line_buffer);
-
-            // Estimate the entropy of the line using this filter; the less, the better.
-            est = 0;
-            for (i = 0; i < x*n; ++i) {
-               est += abs((signed char) line_buffer[i]);
-            }
-            if (est < best_filter_val) {
-               best_filter_val = est;
-               best_filter = filter_type;
-            }
-         }
-         if (filter_type != best_filter) {  // If the last iteration already got us the best filter, don't redo it
-            stbiw__encode_png_line((unsigned char*)(pixels), stride_bytes, x, y, j, n, best_filter, line_buffer);
-            filter_type = best_filter;
-         }
-      }
-      // when we get here, filter_type contains the filter type, and line_buffer contains the data
-      filt[j*(x*n+1)] = (unsigned char) filter_type;
-      STBIW_MEMMOVE(filt+j*(x*n+1)+1, line_buffer, x*n);
+   filt_len = (x*n+1) * y;
+   filt = (unsigned char *) STBIW_MALLOC(filt_len); if (!filt) return 0;
+   zero_row = (unsigned char *) STBIW_MALLOC(x * n); if (!zero_row) { STBIW_FREE(filt); return 0; }
+   memset(zero_row, 0, x * n);
+#if defined(STBIW_PARALLEL_FOR) && !defined(STBIW_ZLIB_COMPRESS)
+   if (filt_len >= STBIW__PNG_PARALLEL_MIN_BYTES) {
+      stbiw__png_filter_job job;
+      job.pixels = (unsigned char *) pixels;
+      job.filt = filt;
+      job.stride_bytes = stride_bytes;
+      job.x = x;
+      job.y = y;
+      job.n = n;
+      job.force_filter = force_filter;
+      job.zero_row = zero_row;
+      job.rows_per_band = STBIW__PNG_FILTER_BAND_BYTES / (x*n+1) + 1;
+      STBIW_PARALLEL_FOR((y + job.rows_per_band - 1) / job.rows_per_band, stbiw__png_filter_task, &job);
+      STBIW_FREE(zero_row);
+      zlib = stbiw__zlib_compress_parallel(filt, filt_len, &zlen, compression_level);
+      STBIW_FREE(filt);
+      if (!zlib) return 0;
+   } else
+#endif
+   {
+      for (j=0; j < y; ++j)
+         stbiw__filter_png_row((unsigned char *) pixels, stride_bytes, x, y, n, j, force_filter, zero_row, filt+j*(x*n+1));
+      STBIW_FREE(zero_row);
+      zlib = stbi_zlib_compress(filt, filt_len, &zlen, compression_level);
+      STBIW_FREE(filt);
+      if (!zlib) return 0;
    }
-   STBIW_FREE(line_buffer);
-   zlib = stbi_zlib_compress(filt, y*( x*n+1), &zlen, stbi_write_png_compression_level);
-   STBIW_FREE(filt);
-   if (!zlib) return 0;
 
    // each tag requires 12 bytes of overhead
    out = (unsigned char *) STBIW_MALLOC(8 + 12+13 + 12+zlen + 12);
@@ -1211,6 +1511,11 @@ STBIWDEF unsigned char *stbi_write_png_to_mem(const unsigned char *pixels, int s
    return out;
 }
 
+STBIWDEF unsigned char *stbi_write_png_to_mem(const unsigned char *pixels, int stride_bytes, int x, int y, int n, int *out_len)
+{
+   return stbi_write_png_to_mem_ex(pixels, stride_bytes, x, y, n, out_len, stbi_write_png_compression_level, stbi_write_force_png_filter);
+}
+
 #ifndef STBI_WRITE_NO_STDIO
 STBIWDEF int stbi_write_png(char const *filename, int x, int y, int comp, const void *data, int stride_bytes)
 {
@@ -1238,6 +1543,16 @@ STBIWDEF int stbi_write_png_to_func(stbi_write_func *func, void *context, int x,
    return 1;
 }
 
+STBIWDEF int stbi_write_png_to_func_ex(stbi_write_func *func, void *context, int x, int y, int comp, const void *data, int stride_bytes, int compression_level, int force_filter)
+{
+   int len;
+   unsigned char *png = stbi_write_png_to_mem_ex((const unsigned char *) data, stride_bytes, x, y, comp, &len, compression_level, force_filter);
+   if (png == NULL) return 0;
+   func(context, png, len);
+   STBIW_FREE(png);
+   return 1;
+}
+
 
 /* ***************************************************************************
  *
@@ -1256,9 +1571,10 @@ static void stbiw__jpg_writeBits(stbi__write_context *s, int *bitBufP, int *bitC
    bitBuf |= bs[0] << (24 - bitCnt);
    while(bitCnt >= 8) {
       unsigned char c = (bitBuf >> 16) & 255;
-      stbiw__putc(s, c);
+      // STBNative: buffered, the callback used to be called for every byte of the scan
+      stbiw__write1(s, c);
       if(c == 255) {
-         stbiw__putc(s, 0);
+         stbiw__write1(s, 0);
       }
       bitBuf <<= 8;
       bitCnt -= 8;
@@ -1325,11 +1641,13 @@ static void stbiw__jpg_calcBits(int val, unsigned short bits[2]) {
    bits[0] = val & ((1<<bits[1])-1);
 }
 
-static int stbiw__jpg_processDU(stbi__write_context *s, int *bitBuf, int *bitCnt, float *CDU, int du_stride, float *fdtbl, int DC, const unsigned short HTDC[256][2], const unsigned short HTAC[256][2]) {
-   const unsigned short EOB[2] = { HTAC[0x00][0], HTAC[0x00][1] };
-   const unsigned short M16zeroes[2] = { HTAC[0xF0][0], HTAC[0xF0][1] };
-   int dataOff, i, j, n, diff, end0pos, x, y;
-   int DU[64];
+// STBNative: the DCT and quantization of one 8x8 block, leaving the rounded coefficients in DU
+// in zigzag order. The SIMD versions below perform exactly the same float operations in the same
+// order as this one, so every version produces the same file.
+typedef void stbiw__jpg_fdct_fn(float *CDU, int du_stride, const float *fdtbl, int *DU);
+
+static void stbiw__jpg_fdct(float *CDU, int du_stride, const float *fdtbl, int *DU) {
+   int dataOff, i, j, n, x, y;
 
    // DCT rows
    for(dataOff=0, n=du_stride*8; dataOff<n; dataOff+=du_stride) {
@@ -1351,6 +1669,206 @@ static int stbiw__jpg_processDU(stbi__write_context *s, int *bitBuf, int *bitCnt
          DU[stbiw__jpg_ZigZag[j]] = (int)(v < 0 ? v - 0.5f : v + 0.5f);
       }
    }
+}
+
+#ifdef STBIW_SSE2
+// STBNative: stbiw__jpg_DCT applied to d[0..7], where each vector holds one input of several
+// independent rows (or columns)
+#define STBIW__JPG_VDCT(T, d, vadd, vsub, vmul, vset1) do { \
+      T tmp0 = vadd(d[0], d[7]), tmp7 = vsub(d[0], d[7]), tmp1 = vadd(d[1], d[6]), tmp6 = vsub(d[1], d[6]); \
+      T tmp2 = vadd(d[2], d[5]), tmp5 = vsub(d[2], d[5]), tmp3 = vadd(d[3], d[4]), tmp4 = vsub(d[3], d[4]); \
+      T tmp10 = vadd(tmp0, tmp3), tmp13 = vsub(tmp0, tmp3), tmp11 = vadd(tmp1, tmp2), tmp12 = vsub(tmp1, tmp2); \
+      T z1, z2, z3, z4, z5, z11, z13; \
+      d[0] = vadd(tmp10, tmp11); \
+      d[4] = vsub(tmp10, tmp11); \
+      z1 = vmul(vadd(tmp12, tmp13), vset1(0.707106781f)); \
+      d[2] = vadd(tmp13, z1); \
+      d[6] = vsub(tmp13, z1); \
+      tmp10 = vadd(tmp4, tmp5); \
+      tmp11 = vadd(tmp5, tmp6); \
+      tmp12 = vadd(tmp6, tmp7); \
+      z5 = vmul(vsub(tmp10, tmp12), vset1(0.382683433f)); \
+      z2 = vadd(vmul(tmp10, vset1(0.541196100f)), z5); \
+      z4 = vadd(vmul(tmp12, vset1(1.306562965f)), z5); \
+      z3 = vmul(tmp11, vset1(0.707106781f)); \
+      z11 = vadd(tmp7, z3); \
+      z13 = vsub(tmp7, z3); \
+      d[5] = vadd(z13, z2); \
+      d[3] = vsub(z13, z2); \
+      d[1] = vadd(z11, z4); \
+      d[7] = vsub(z11, z4); \
+   } while (0)
+
+// STBNative: the color conversion from the MCU loop, with the same operation order
+#define STBIW__JPG_VYUV(r, g, b, y, u, v, vadd, vsub, vmul, vset1) do { \
+      y = vsub(vadd(vadd(vmul(vset1(+0.29900f), r), vmul(vset1(0.58700f), g)), vmul(vset1(0.11400f), b)), vset1(128.0f)); \
+      u = vadd(vsub(vmul(vset1(-0.16874f), r), vmul(vset1(0.33126f), g)), vmul(vset1(0.50000f), b)); \
+      v = vsub(vsub(vmul(vset1(+0.50000f), r), vmul(vset1(0.41869f), g)), vmul(vset1(0.08131f), b)); \
+   } while (0)
+
+// An 8x8 block as four 4x4 quadrants: lo[i] is columns 0-3 of row i, hi[i] columns 4-7
+static void stbiw__jpg_transpose_sse2(__m128 *lo, __m128 *hi) {
+   __m128 a0 = lo[0], a1 = lo[1], a2 = lo[2], a3 = lo[3];
+   __m128 b0 = hi[0], b1 = hi[1], b2 = hi[2], b3 = hi[3];
+   __m128 c0 = lo[4], c1 = lo[5], c2 = lo[6], c3 = lo[7];
+   __m128 d0 = hi[4], d1 = hi[5], d2 = hi[6], d3 = hi[7];
+   _MM_TRANSPOSE4_PS(a0, a1, a2, a3);
+   _MM_TRANSPOSE4_PS(b0, b1, b2, b3);
+   _MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+   _MM_TRANSPOSE4_PS(d0, d1, d2, d3);
+   lo[0] = a0; lo[1] = a1; lo[2] = a2; lo[3] = a3;
+   hi[0] = c0; hi[1] = c1; hi[2] = c2; hi[3] = c3;
+   lo[4] = b0; lo[5] = b1; lo[6] = b2; lo[7] = b3;
+   hi[4] = d0; hi[5] = d1; hi[6] = d2; hi[7] = d3;
+}
+
+static void stbiw__jpg_fdct_sse2(float *CDU, int du_stride, const float *fdtbl, int *DU) {
+   const __m128 sign = _mm_set1_ps(-0.0f), half = _mm_set1_ps(0.5f);
+   __m128 lo[8], hi[8];
+   int i, q[64];
+
+   for(i = 0; i < 8; ++i) {
+      lo[i] = _mm_loadu_ps(CDU + i*du_stride);
+      hi[i] = _mm_loadu_ps(CDU + i*du_stride + 4);
+   }
+   // DCT rows, four at a time
+   stbiw__jpg_transpose_sse2(lo, hi);
+   STBIW__JPG_VDCT(__m128, lo, _mm_add_ps, _mm_sub_ps, _mm_mul_ps, _mm_set1_ps);
+   STBIW__JPG_VDCT(__m128, hi, _mm_add_ps, _mm_sub_ps, _mm_mul_ps, _mm_set1_ps);
+   // DCT columns
+   stbiw__jpg_transpose_sse2(lo, hi);
+   STBIW__JPG_VDCT(__m128, lo, _mm_add_ps, _mm_sub_ps, _mm_mul_ps, _mm_set1_ps);
+   STBIW__JPG_VDCT(__m128, hi, _mm_add_ps, _mm_sub_ps, _mm_mul_ps, _mm_set1_ps);
+   // Quantize, rounding half away from zero like the scalar version
+   for(i = 0; i < 8; ++i) {
+      __m128 vl = _mm_mul_ps(lo[i], _mm_loadu_ps(fdtbl + i*8));
+      __m128 vh = _mm_mul_ps(hi[i], _mm_loadu_ps(fdtbl + i*8 + 4));
+      vl = _mm_add_ps(vl, _mm_or_ps(half, _mm_and_ps(vl, sign)));
+      vh = _mm_add_ps(vh, _mm_or_ps(half, _mm_and_ps(vh, sign)));
+      _mm_storeu_si128((__m128i *) (q + i*8), _mm_cvttps_epi32(vl));
+      _mm_storeu_si128((__m128i *) (q + i*8 + 4), _mm_cvttps_epi32(vh));
+   }
+   for(i = 0; i < 64; ++i) {
+      DU[stbiw__jpg_ZigZag[i]] = q[i];
+   }
+}
+#endif
+
+#ifdef STBIW_AVX2
+static STBIW_AVX2_TARGET void stbiw__jpg_transpose_avx2(__m256 *r) {
+   __m256 t0 = _mm256_unpacklo_ps(r[0], r[1]), t1 = _mm256_unpackhi_ps(r[0], r[1]);
+   __m256 t2 = _mm256_unpacklo_ps(r[2], r[3]), t3 = _mm256_unpackhi_ps(r[2], r[3]);
+   __m256 t4 = _mm256_unpacklo_ps(r[4], r[5]), t5 = _mm256_unpackhi_ps(r[4], r[5]);
+   __m256 t6 = _mm256_unpacklo_ps(r[6], r[7]), t7 = _mm256_unpackhi_ps(r[6], r[7]);
+   __m256 s0 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1,0,1,0)), s1 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3,2,3,2));
+   __m256 s2 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1,0,1,0)), s3 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3,2,3,2));
+   __m256 s4 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(1,0,1,0)), s5 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(3,2,3,2));
+   __m256 s6 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(1,0,1,0)), s7 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(3,2,3,2));
+   r[0] = _mm256_permute2f128_ps(s0, s4, 0x20);
+   r[1] = _mm256_permute2f128_ps(s1, s5, 0x20);
+   r[2] = _mm256_permute2f128_ps(s2, s6, 0x20);
+   r[3] = _mm256_permute2f128_ps(s3, s7, 0x20);
+   r[4] = _mm256_permute2f128_ps(s0, s4, 0x31);
+   r[5] = _mm256_permute2f128_ps(s1, s5, 0x31);
+   r[6] = _mm256_permute2f128_ps(s2, s6, 0x31);
+   r[7] = _mm256_permute2f128_ps(s3, s7, 0x31);
+}
+
+static STBIW_AVX2_TARGET void stbiw__jpg_fdct_avx2(float *CDU, int du_stride, const float *fdtbl, int *DU) {
+   const __m256 sign = _mm256_set1_ps(-0.0f), half = _mm256_set1_ps(0.5f);
+   __m256 r[8];
+   int i, q[64];
+
+   for(i = 0; i < 8; ++i) {
+      r[i] = _mm256_loadu_ps(CDU + i*du_stride);
+   }
+   // DCT rows, all eight at once
+   stbiw__jpg_transpose_avx2(r);
+   STBIW__JPG_VDCT(__m256, r, _mm256_add_ps, _mm256_sub_ps, _mm256_mul_ps, _mm256_set1_ps);
+   // DCT columns
+   stbiw__jpg_transpose_avx2(r);
+   STBIW__JPG_VDCT(__m256, r, _mm256_add_ps, _mm256_sub_ps, _mm256_mul_ps, _mm256_set1_ps);
+   for(i = 0; i < 8; ++i) {
+      __m256 v = _mm256_mul_ps(r[i], _mm256_loadu_ps(fdtbl + i*8));
+      v = _mm256_add_ps(v, _mm256_or_ps(half, _mm256_and_ps(v, sign)));
+      _mm256_storeu_si256((__m256i *) (q + i*8), _mm256_cvttps_epi32(v));
+   }
+   for(i = 0; i < 64; ++i) {
+      DU[stbiw__jpg_ZigZag[i]] = q[i];
+   }
+}
+
+// 8 RGBA pixels
+static STBIW_AVX2_TARGET void stbiw__jpg_rgba_to_yuv_avx2(const unsigned char *p, float *Y, float *U, float *V) {
+   const __m256i mask = _mm256_set1_epi32(0xff);
+   __m256i px = _mm256_loadu_si256((const __m256i *) p);
+   __m256 r = _mm256_cvtepi32_ps(_mm256_and_si256(px, mask));
+   __m256 g = _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(px, 8), mask));
+   __m256 b = _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(px, 16), mask));
+   __m256 y, u, v;
+   STBIW__JPG_VYUV(r, g, b, y, u, v, _mm256_add_ps, _mm256_sub_ps, _mm256_mul_ps, _mm256_set1_ps);
+   _mm256_storeu_ps(Y, y);
+   _mm256_storeu_ps(U, u);
+   _mm256_storeu_ps(V, v);
+}
+#endif
+
+// STBNative: converts count pixels of one input row to YCbCr starting at column x, repeating the
+// last column past the right edge. comp == 2 is grey+alpha (alpha is ignored)
+static void stbiw__jpg_rgb_to_yuv(const unsigned char *row, int x, int count, int width, int comp, int avx2, float *Y, float *U, float *V) {
+   int ofsG = comp > 2 ? 1 : 0, ofsB = comp > 2 ? 2 : 0;
+   int i = 0;
+#ifdef STBIW_SSE2
+   if (comp >= 3 && x + count <= width) {
+      const __m128i mask = _mm_set1_epi32(0xff);
+#ifdef STBIW_AVX2
+      if (avx2 && comp == 4) {
+         for (; i + 8 <= count; i += 8)
+            stbiw__jpg_rgba_to_yuv_avx2(row + (x + i)*4, Y + i, U + i, V + i);
+      }
+#else
+      (void) avx2;
+#endif
+      for (; i + 4 <= count; i += 4) {
+         const unsigned char *p = row + (x + i)*comp;
+         __m128 r, g, b, y, u, v;
+         if (comp == 4) {
+            __m128i px = _mm_loadu_si128((const __m128i *) p);
+            r = _mm_cvtepi32_ps(_mm_and_si128(px, mask));
+            g = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(px, 8), mask));
+            b = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(px, 16), mask));
+         } else {
+            r = _mm_setr_ps(p[0], p[3], p[6], p[9]);
+            g = _mm_setr_ps(p[1], p[4], p[7], p[10]);
+            b = _mm_setr_ps(p[2], p[5], p[8], p[11]);
+         }
+         STBIW__JPG_VYUV(r, g, b, y, u, v, _mm_add_ps, _mm_sub_ps, _mm_mul_ps, _mm_set1_ps);
+         _mm_storeu_ps(Y + i, y);
+         _mm_storeu_ps(U + i, u);
+         _mm_storeu_ps(V + i, v);
+      }
+   }
+#else
+   (void) avx2;
+#endif
+   for (; i < count; ++i) {
+      // if col >= width => use pixel from last input column
+      int col = x + i;
+      const unsigned char *p = row + ((col < width) ? col : (width-1))*comp;
+      float r = p[0], g = p[ofsG], b = p[ofsB];
+      Y[i]= +0.29900f*r + 0.58700f*g + 0.11400f*b - 128;
+      U[i]= -0.16874f*r - 0.33126f*g + 0.50000f*b;
+      V[i]= +0.50000f*r - 0.41869f*g - 0.08131f*b;
+   }
+}
+
+static int stbiw__jpg_processDU(stbi__write_context *s, int *bitBuf, int *bitCnt, float *CDU, int du_stride, const float *fdtbl, int DC, const unsigned short HTDC[256][2], const unsigned short HTAC[256][2], stbiw__jpg_fdct_fn *fdct) {
+   const unsigned short EOB[2] = { HTAC[0x00][0], HTAC[0x00][1] };
+   const unsigned short M16zeroes[2] = { HTAC[0xF0][0], HTAC[0xF0][1] };
+   int i, diff, end0pos;
+   int DU[64];
+
+   fdct(CDU, du_stride, fdtbl, DU);
 
    // Encode DC
    diff = DU[0] - DC;
@@ -1395,7 +1913,178 @@ static int stbiw__jpg_processDU(stbi__write_context *s, int *bitBuf, int *bitCnt
    return DU[0];
 }
 
-static int stbi_write_jpg_core(stbi__write_context *s, int width, int height, int comp, const void* data, int quality) {
+// Huffman tables (STBNative: file scope, they are shared with stbiw__jpg_encode_rows)
+static const unsigned short stbiw__jpg_YDC_HT[256][2] = { {0,2},{2,3},{3,3},{4,3},{5,3},{6,3},{14,4},{30,5},{62,6},{126,7},{254,8},{510,9}};
+static const unsigned short stbiw__jpg_UVDC_HT[256][2] = { {0,2},{1,2},{2,2},{6,3},{14,4},{30,5},{62,6},{126,7},{254,8},{510,9},{1022,10},{2046,11}};
+static const unsigned short stbiw__jpg_YAC_HT[256][2] = {
+   {10,4},{0,2},{1,2},{4,3},{11,4},{26,5},{120,7},{248,8},{1014,10},{65410,16},{65411,16},{0,0},{0,0},{0,0},{0,0},{0,0},{0,0},
+   {12,4},{27,5},{121,7},{502,9},{2038,11},{65412,16},{65413,16},{65414,16},{65415,16},{65416,16},{0,0},{0,0},{0,0},{0,0},{0,0},{0,0},
+   {28,5},{249,8},{1015,10},{4084,12},{65417,16},{65418,16},{65419,16},{65420,16},{65421,16},{65422,16},{0,0},{0,0},{0,0},{0,0},{0,0},{0,0},
+   {58,6},{503,9},{4085,12},{65423,16},{65424,16},{65425,16},{65426,16},{65427,16},{65428,16},{65429,16},{0,0},{0,0},{0,0},{0,0},{0,0},{0,0},
+   {59,6},{1016,10},{65430,16},{65431,16},{65432,16},{65433,16},{65434,16},{65435,16},{65436,16},{65437,16},{0,0},{0,0},{0,0},{0,0},{0,0},{0,0},
+   {122,7},{2039,11},{65438,16},{65439,16},{65440,16},{65441,16},{65442,16},{65443,16},{65444,16},{65445,16},{0,0},{0,0},{0,0},{0,0},{0,0},{0,0},
+   {123,7},{4086,12},{65446,16},{65447,16},{65448,16},{65449,16},{65450,16},{65451,16},{65452,16},{65453,16},{0,0},{0,0},{0,0},{0,0},{0,0},{0,0},
+   {250,8},{4087,12},{65454,16},{65455,16},{65456,16},{65457,16},{65458,16},{65459,16},{65460,16},{65461,16},{0,0},{0,0},{0,0},{0,0},{0,0},{0,0},
+   {504,9},{32704,15},{65462,16},{65463,16},{65464,16},{65465,16},{65466,16},{65467,16},{65468,16},{65469,16},{0,0},{0,0},{0,0},{0,0},{0,0},{0,0},
+   {505,9},{65470,16},{65471,16},{65472,16},{65473,16},{65474,16},{65475,16},{65476,16},{65477,16},{65478,16},{0,0},{0,0},{0,0},{0,0},{0,0},{0,0},
+   {506,9},{65479,16},{65480,16},{65481,16},{65482,16},{65483,16},{65484,16},{65485,16},{65486,16},{65487,16},{0,0},{0,0},{0,0},{0,0},{0,0},{0,0},
+   {1017,10},{65488,16},{65489,16},{65490,16},{65491,16},{65492,16},{65493,16},{65494,16},{65495,16},{65496,16},{0,0},{0,0},{0,0},{0,0},{0,0},{0,0},
+   {1018,10},{65497,16},{65498,16},{65499,16},{65500,16},{65501,16},{65502,16},{65503,16},{65504,16},{65505,16},{0,0},{0,0},{0,0},{0,0},{0,0},{0,0},
+   {2040,11},{65506,16},{65507,16},{65508,16},{65509,16},{65510,16},{65511,16},{65512,16},{65513,16},{65514,16},{0,0},{0,0},{0,0},{0,0},{0,0},{0,0},
+   {65515,16},{65516,16},{65517,16},{65518,16},{65519,16},{65520,16},{65521,16},{65522,16},{65523,16},{65524,16},{0,0},{0,0},{0,0},{0,0},{0,0},
+   {2041,11},{65525,16},{65526,16},{65527,16},{65528,16},{65529,16},{65530,16},{65531,16},{65532,16},{65533,16},{65534,16},{0,0},{0,0},{0,0},{0,0},{0,0}
+};
+static const unsigned short stbiw__jpg_UVAC_HT[256][2] = {
+   {0,2},{1,2},{4,3},{10,4},{24,5},{25,5},{56,6},{120,7},{500,9},{1014,10},{4084,12},{0,0},{0,0},{0,0},{0,0},{0,0},{0,0},
+   {11,4},{57,6},{246,8},{501,9},{2038,11},{4085,12},{65416,16},{65417,16},{65418,16},{65419,16},{0,0},{0,0},{0,0},{0,0},{0,0},{0,0},
+   {26,5},{247,8},{1015,10},{4086,12},{32706,15},{65420,16},{65421,16},{65422,16},{65423,16},{65424,16},{0,0},{0,0},{0,0},{0,0},{0,0},{0,0},
+   {27,5},{248,8},{1016,10},{4087,12},{65425,16},{65426,16},{65427,16},{65428,16},{65429,16},{65430,16},{0,0},{0,0},{0,0},{0,0},{0,0},{0,0},
+   {58,6},{502,9},{65431,16},{65432,16},{65433,16},{65434,16},{65435,16},{65436,16},{65437,16},{65438,16},{0,0},{0,0},{0,0},{0,0},{0,0},{0,0},
+   {59,6},{1017,10},{65439,16},{65440,16},{65441,16},{65442,16},{65443,16},{65444,16},{65445,16},{65446,16},{0,0},{0,0},{0,0},{0,0},{0,0},{0,0},
+   {121,7},{2039,11},{65447,16},{65448,16},{65449,16},{65450,16},{65451,16},{65452,16},{65453,16},{65454,16},{0,0},{0,0},{0,0},{0,0},{0,0},{0,0},
+   {122,7},{2040,11},{65455,16},{65456,16},{65457,16},{65458,16},{65459,16},{65460,16},{65461,16},{65462,16},{0,0},{0,0},{0,0},{0,0},{0,0},{0,0},
+   {249,8},{65463,16},{65464,16},{65465,16},{65466,16},{65467,16},{65468,16},{65469,16},{65470,16},{65471,16},{0,0},{0,0},{0,0},{0,0},{0,0},{0,0},
+   {503,9},{65472,16},{65473,16},{65474,16},{65475,16},{65476,16},{65477,16},{65478,16},{65479,16},{65480,16},{0,0},{0,0},{0,0},{0,0},{0,0},{0,0},
+   {504,9},{65481,16},{65482,16},{65483,16},{65484,16},{65485,16},{65486,16},{65487,16},{65488,16},{65489,16},{0,0},{0,0},{0,0},{0,0},{0,0},{0,0},
+   {505,9},{65490,16},{65491,16},{65492,16},{65493,16},{65494,16},{65495,16},{65496,16},{65497,16},{65498,16},{0,0},{0,0},{0,0},{0,0},{0,0},{0,0},
+   {506,9},{65499,16},{65500,16},{65501,16},{65502,16},{65503,16},{65504,16},{65505,16},{65506,16},{65507,16},{0,0},{0,0},{0,0},{0,0},{0,0},{0,0},
+   {2041,11},{65508,16},{65509,16},{65510,16},{65511,16},{65512,16},{65513,16},{65514,16},{65515,16},{65516,16},{0,0},{0,0},{0,0},{0,0},{0,0},{0,0},
+   {16352,14},{65517,16},{65518,16},{65519,16},{65520,16},{65521,16},{65522,16},{65523,16},{65524,16},{65525,16},{0,0},{0,0},{0,0},{0,0},{0,0},
+   {1018,10},{32707,15},{65526,16},{65527,16},{65528,16},{65529,16},{65530,16},{65531,16},{65532,16},{65533,16},{65534,16},{0,0},{0,0},{0,0},{0,0},{0,0}
+};
+
+// STBNative: everything the MCU loop needs to know about the image being encoded
+typedef struct
+{
+   const unsigned char *data;
+   int width, height, comp, subsample, avx2;
+   const float *fdtbl_Y, *fdtbl_UV;
+   stbiw__jpg_fdct_fn *fdct;
+} stbiw__jpg_image;
+
+// STBNative: encodes the MCUs covering input rows [y_begin, y_end) (y_begin is a multiple of the
+// MCU height). DC prediction starts from zero and the last byte is padded with 1 bits, which is
+// what both the end of the scan and a restart marker need.
+static void stbiw__jpg_encode_rows(stbi__write_context *s, const stbiw__jpg_image *img, int y_begin, int y_end) {
+   static const unsigned short fillBits[] = {0x7F, 7};
+   int DCY=0, DCU=0, DCV=0;
+   int bitBuf=0, bitCnt=0;
+   int width = img->width, height = img->height, comp = img->comp;
+   const unsigned char *data = img->data;
+   int x, y, row, pos;
+   if (y_end > height) y_end = height;
+   if(img->subsample) {
+      for(y = y_begin; y < y_end; y += 16) {
+         for(x = 0; x < width; x += 16) {
+            float Y[256], U[256], V[256];
+            for(row = y, pos = 0; row < y+16; ++row, pos += 16) {
+               // row >= height => use last input row
+               int clamped_row = (row < height) ? row : height - 1;
+               size_t base_p = (size_t) (stbi__flip_vertically_on_write ? (height-1-clamped_row) : clamped_row)*width*comp;
+               stbiw__jpg_rgb_to_yuv(data + base_p, x, 16, width, comp, img->avx2, Y+pos, U+pos, V+pos);
+            }
+            DCY = stbiw__jpg_processDU(s, &bitBuf, &bitCnt, Y+0,   16, img->fdtbl_Y, DCY, stbiw__jpg_YDC_HT, stbiw__jpg_YAC_HT, img->fdct);
+            DCY = stbiw__jpg_processDU(s, &bitBuf, &bitCnt, Y+8,   16, img->fdtbl_Y, DCY, stbiw__jpg_YDC_HT, stbiw__jpg_YAC_HT, img->fdct);
+            DCY = stbiw__jpg_processDU(s, &bitBuf, &bitCnt, Y+128, 16, img->fdtbl_Y, DCY, stbiw__jpg_YDC_HT, stbiw__jpg_YAC_HT, img->fdct);
+            DCY = stbiw__jpg_processDU(s, &bitBuf, &bitCnt, Y+136, 16, img->fdtbl_Y, DCY, stbiw__jpg_YDC_HT, stbiw__jpg_YAC_HT, img->fdct);
+
+            // subsample U,V
+            {
+               float subU[64], subV[64];
+               int yy, xx;
+               for(yy = 0, pos = 0; yy < 8; ++yy) {
+                  for(xx = 0; xx < 8; ++xx, ++pos) {
+                     int j = yy*32+xx*2;
+                     subU[pos] = (U[j+0] + U[j+1] + U[j+16] + U[j+17]) * 0.25f;
+                     subV[pos] = (V[j+0] + V[j+1] + V[j+16] + V[j+17]) * 0.25f;
+                  }
+               }
+               DCU = stbiw__jpg_processDU(s, &bitBuf, &bitCnt, subU, 8, img->fdtbl_UV, DCU, stbiw__jpg_UVDC_HT, stbiw__jpg_UVAC_HT, img->fdct);
+               DCV = stbiw__jpg_processDU(s, &bitBuf, &bitCnt, subV, 8, img->fdtbl_UV, DCV, stbiw__jpg_UVDC_HT, stbiw__jpg_UVAC_HT, img->fdct);
+            }
+         }
+      }
+   } else {
+      for(y = y_begin; y < y_end; y += 8) {
+         for(x = 0; x < width; x += 8) {
+            float Y[64], U[64], V[64];
+            for(row = y, pos = 0; row < y+8; ++row, pos += 8) {
+               // row >= height => use last input row
+               int clamped_row = (row < height) ? row : height - 1;
+               size_t base_p = (size_t) (stbi__flip_vertically_on_write ? (height-1-clamped_row) : clamped_row)*width*comp;
+               stbiw__jpg_rgb_to_yuv(data + base_p, x, 8, width, comp, img->avx2, Y+pos, U+pos, V+pos);
+            }
+
+            DCY = stbiw__jpg_processDU(s, &bitBuf, &bitCnt, Y, 8, img->fdtbl_Y,  DCY, stbiw__jpg_YDC_HT, stbiw__jpg_YAC_HT, img->fdct);
+            DCU = stbiw__jpg_processDU(s, &bitBuf, &bitCnt, U, 8, img->fdtbl_UV, DCU, stbiw__jpg_UVDC_HT, stbiw__jpg_UVAC_HT, img->fdct);
+            DCV = stbiw__jpg_processDU(s, &bitBuf, &bitCnt, V, 8, img->fdtbl_UV, DCV, stbiw__jpg_UVDC_HT, stbiw__jpg_UVAC_HT, img->fdct);
+         }
+      }
+   }
+
+   // Do the bit alignment of the EOI (or restart) marker
+   stbiw__jpg_writeBits(s, &bitBuf, &bitCnt, fillBits);
+   stbiw__write_flush(s);
+}
+
+#ifdef STBIW_PARALLEL_FOR
+// STBNative: multi-threaded JPEG encoding. The image is cut into bands of whole MCU rows and the
+// restart interval is set to one band, so each band's entropy-coded data is independent of the
+// others: they are encoded into separate buffers at the same time and then written out in order
+// with RSTn markers in between. The band size doesn't depend on the number of threads, so the
+// output is always the same.
+#define STBIW__JPG_BAND_PIXELS (256*1024)
+
+typedef struct
+{
+   unsigned char *data;
+   int length, capacity, failed;
+} stbiw__jpg_band;
+
+static void stbiw__jpg_band_write(void *context, void *data, int size)
+{
+   stbiw__jpg_band *band = (stbiw__jpg_band *) context;
+   if (band->failed || size <= 0)
+      return;
+   if (size > band->capacity - band->length) {
+      int capacity = band->capacity ? band->capacity : 64*1024;
+      unsigned char *grown;
+      while (capacity - band->length < size) {
+         if (capacity > 0x3fffffff) {
+            band->failed = 1;
+            return;
+         }
+         capacity *= 2;
+      }
+      grown = (unsigned char *) STBIW_REALLOC_SIZED(band->data, band->capacity, capacity);
+      if (!grown) {
+         band->failed = 1;
+         return;
+      }
+      band->data = grown;
+      band->capacity = capacity;
+   }
+   STBIW_MEMMOVE(band->data + band->length, data, size);
+   band->length += size;
+}
+
+typedef struct
+{
+   const stbiw__jpg_image *img;
+   stbiw__jpg_band *bands;
+   int band_rows;
+} stbiw__jpg_band_job;
+
+static void stbiw__jpg_band_task(void *user, int i)
+{
+   stbiw__jpg_band_job *job = (stbiw__jpg_band_job *) user;
+   stbi__write_context s = { 0 };
+   stbi__start_write_callbacks(&s, stbiw__jpg_band_write, &job->bands[i]);
+   stbiw__jpg_encode_rows(&s, job->img, i * job->band_rows, (i + 1) * job->band_rows);
+}
+#endif
+
+static int stbi_write_jpg_core(stbi__write_context *s, int width, int height, int comp, const void* data, int quality, int parallel) {
    // Constants that don't pollute global namespace
    static const unsigned char std_dc_luminance_nrcodes[] = {0,0,1,5,1,1,1,1,1,1,0,0,0,0,0,0,0};
    static const unsigned char std_dc_luminance_values[] = {0,1,2,3,4,5,6,7,8,9,10,11};
@@ -1421,45 +2110,6 @@ static int stbi_write_jpg_core(stbi__write_context *s, int width, int height, in
       0xb5,0xb6,0xb7,0xb8,0xb9,0xba,0xc2,0xc3,0xc4,0xc5,0xc6,0xc7,0xc8,0xc9,0xca,0xd2,0xd3,0xd4,0xd5,0xd6,0xd7,0xd8,0xd9,0xda,
       0xe2,0xe3,0xe4,0xe5,0xe6,0xe7,0xe8,0xe9,0xea,0xf2,0xf3,0xf4,0xf5,0xf6,0xf7,0xf8,0xf9,0xfa
    };
-   // Huffman tables
-   static const unsigned short YDC_HT[256][2] = { {0,2},{2,3},{3,3},{4,3},{5,3},{6,3},{14,4},{30,5},{62,6},{126,7},{254,8},{510,9}};
-   static const unsigned short UVDC_HT[256][2] = { {0,2},{1,2},{2,2},{6,3},{14,4},{30,5},{62,6},{126,7},{254,8},{510,9},{1022,10},{2046,11}};
-   static const unsigned short YAC_HT[256][2] = {
-      {10,4},{0,2},{1,2},{4,3},{11,4},{26,5},{120,7},{248,8},{1014,10},{65410,16},{65411,16},{0,0},{0,0},{0,0},{0,0},{0,0},{0,0},
-      {12,4},{27,5},{121,7},{502,9},{2038,11},{65412,16},{65413,16},{65414,16},{65415,16},{65416,16},{0,0},{0,0},{0,0},{0,0},{0,0},{0,0},
-      {28,5},{249,8},{1015,10},{4084,12},{65417,16},{65418,16},{65419,16},{65420,16},{65421,16},{65422,16},{0,0},{0,0},{0,0},{0,0},{0,0},{0,0},
-      {58,6},{503,9},{4085,12},{65423,16},{65424,16},{65425,16},{65426,16},{65427,16},{65428,16},{65429,16},{0,0},{0,0},{0,0},{0,0},{0,0},{0,0},
-      {59,6},{1016,10},{65430,16},{65431,16},{65432,16},{65433,16},{65434,16},{65435,16},{65436,16},{65437,16},{0,0},{0,0},{0,0},{0,0},{0,0},{0,0},
-      {122,7},{2039,11},{65438,16},{65439,16},{65440,16},{65441,16},{65442,16},{65443,16},{65444,16},{65445,16},{0,0},{0,0},{0,0},{0,0},{0,0},{0,0},
-      {123,7},{4086,12},{65446,16},{65447,16},{65448,16},{65449,16},{65450,16},{65451,16},{65452,16},{65453,16},{0,0},{0,0},{0,0},{0,0},{0,0},{0,0},
-      {250,8},{4087,12},{65454,16},{65455,16},{65456,16},{65457,16},{65458,16},{65459,16},{65460,16},{65461,16},{0,0},{0,0},{0,0},{0,0},{0,0},{0,0},
-      {504,9},{32704,15},{65462,16},{65463,16},{65464,16},{65465,16},{65466,16},{65467,16},{65468,16},{65469,16},{0,0},{0,0},{0,0},{0,0},{0,0},{0,0},
-      {505,9},{65470,16},{65471,16},{65472,16},{65473,16},{65474,16},{65475,16},{65476,16},{65477,16},{65478,16},{0,0},{0,0},{0,0},{0,0},{0,0},{0,0},
-      {506,9},{65479,16},{65480,16},{65481,16},{65482,16},{65483,16},{65484,16},{65485,16},{65486,16},{65487,16},{0,0},{0,0},{0,0},{0,0},{0,0},{0,0},
-      {1017,10},{65488,16},{65489,16},{65490,16},{65491,16},{65492,16},{65493,16},{65494,16},{65495,16},{65496,16},{0,0},{0,0},{0,0},{0,0},{0,0},{0,0},
-      {1018,10},{65497,16},{65498,16},{65499,16},{65500,16},{65501,16},{65502,16},{65503,16},{65504,16},{65505,16},{0,0},{0,0},{0,0},{0,0},{0,0},{0,0},
-      {2040,11},{65506,16},{65507,16},{65508,16},{65509,16},{65510,16},{65511,16},{65512,16},{65513,16},{65514,16},{0,0},{0,0},{0,0},{0,0},{0,0},{0,0},
-      {65515,16},{65516,16},{65517,16},{65518,16},{65519,16},{65520,16},{65521,16},{65522,16},{65523,16},{65524,16},{0,0},{0,0},{0,0},{0,0},{0,0},
-      {2041,11},{65525,16},{65526,16},{65527,16},{65528,16},{65529,16},{65530,16},{65531,16},{65532,16},{65533,16},{65534,16},{0,0},{0,0},{0,0},{0,0},{0,0}
-   };
-   static const unsigned short UVAC_HT[256][2] = {
-      {0,2},{1,2},{4,3},{10,4},{24,5},{25,5},{56,6},{120,7},{500,9},{1014,10},{4084,12},{0,0},{0,0},{0,0},{0,0},{0,0},{0,0},
-      {11,4},{57,6},{246,8},{501,9},{2038,11},{4085,12},{65416,16},{65417,16},{65418,16},{65419,16},{0,0},{0,0},{0,0},{0,0},{0,0},{0,0},
-      {26,5},{247,8},{1015,10},{4086,12},{32706,15},{65420,16},{65421,16},{65422,16},{65423,16},{65424,16},{0,0},{0,0},{0,0},{0,0},{0,0},{0,0},
-      {27,5},{248,8},{1016,10},{4087,12},{65425,16},{65426,16},{65427,16},{65428,16},{65429,16},{65430,16},{0,0},{0,0},{0,0},{0,0},{0,0},{0,0},
-      {58,6},{502,9},{65431,16},{65432,16},{65433,16},{65434,16},{65435,16},{65436,16},{65437,16},{65438,16},{0,0},{0,0},{0,0},{0,0},{0,0},{0,0},
-      {59,6},{1017,10},{65439,16},{65440,16},{65441,16},{65442,16},{65443,16},{65444,16},{65445,16},{65446,16},{0,0},{0,0},{0,0},{0,0},{0,0},{0,0},
-      {121,7},{2039,11},{65447,16},{65448,16},{65449,16},{65450,16},{65451,16},{65452,16},{65453,16},{65454,16},{0,0},{0,0},{0,0},{0,0},{0,0},{0,0},
-      {122,7},{2040,11},{65455,16},{65456,16},{65457,16},{65458,16},{65459,16},{65460,16},{65461,16},{65462,16},{0,0},{0,0},{0,0},{0,0},{0,0},{0,0},
-      {249,8},{65463,16},{65464,16},{65465,16},{65466,16},{65467,16},{65468,16},{65469,16},{65470,16},{65471,16},{0,0},{0,0},{0,0},{0,0},{0,0},{0,0},
-      {503,9},{65472,16},{65473,16},{65474,16},{65475,16},{65476,16},{65477,16},{65478,16},{65479,16},{65480,16},{0,0},{0,0},{0,0},{0,0},{0,0},{0,0},
-      {504,9},{65481,16},{65482,16},{65483,16},{65484,16},{65485,16},{65486,16},{65487,16},{65488,16},{65489,16},{0,0},{0,0},{0,0},{0,0},{0,0},{0,0},
-      {505,9},{65490,16},{65491,16},{65492,16},{65493,16},{65494,16},{65495,16},{65496,16},{65497,16},{65498,16},{0,0},{0,0},{0,0},{0,0},{0,0},{0,0},
-      {506,9},{65499,16},{65500,16},{65501,16},{65502,16},{65503,16},{65504,16},{65505,16},{65506,16},{65507,16},{0,0},{0,0},{0,0},{0,0},{0,0},{0,0},
-      {2041,11},{65508,16},{65509,16},{65510,16},{65511,16},{65512,16},{65513,16},{65514,16},{65515,16},{65516,16},{0,0},{0,0},{0,0},{0,0},{0,0},{0,0},
-      {16352,14},{65517,16},{65518,16},{65519,16},{65520,16},{65521,16},{65522,16},{65523,16},{65524,16},{65525,16},{0,0},{0,0},{0,0},{0,0},{0,0},
-      {1018,10},{32707,15},{65526,16},{65527,16},{65528,16},{65529,16},{65530,16},{65531,16},{65532,16},{65533,16},{65534,16},{0,0},{0,0},{0,0},{0,0},{0,0}
-   };
    static const int YQT[] = {16,11,10,16,24,40,51,61,12,12,14,19,26,58,60,55,14,13,16,24,40,57,69,56,14,17,22,29,51,87,80,62,18,22,
                              37,56,68,109,103,77,24,35,55,64,81,104,113,92,49,64,78,87,103,121,120,101,72,92,95,98,112,100,103,99};
    static const int UVQT[] = {17,18,24,47,99,99,99,99,18,21,26,66,99,99,99,99,24,26,56,99,99,99,99,99,47,66,99,99,99,99,99,99,
@@ -1467,9 +2117,13 @@ static int stbi_write_jpg_core(stbi__write_context *s, int width, int height, in
    static const float aasf[] = { 1.0f * 2.828427125f, 1.387039845f * 2.828427125f, 1.306562965f * 2.828427125f, 1.175875602f * 2.828427125f,
                                  1.0f * 2.828427125f, 0.785694958f * 2.828427125f, 0.541196100f * 2.828427125f, 0.275899379f * 2.828427125f };
 
-   int row, col, i, k, subsample;
+   int row, col, i, k, subsample, restart_rows = 0, restart_interval = 0, band_count = 0;
    float fdtbl_Y[64], fdtbl_UV[64];
    unsigned char YTable[64], UVTable[64];
+   stbiw__jpg_image img;
+#ifdef STBIW_PARALLEL_FOR
+   stbiw__jpg_band *bands = NULL;
+#endif
 
    if(!data || !width || !height || comp > 4 || comp < 1) {
       return 0;
@@ -1494,6 +2148,45 @@ static int stbi_write_jpg_core(stbi__write_context *s, int width, int height, in
       }
    }
 
+   img.data = (const unsigned char *) data;
+   img.width = width;
+   img.height = height;
+   img.comp = comp;
+   img.subsample = subsample;
+   img.fdtbl_Y = fdtbl_Y;
+   img.fdtbl_UV = fdtbl_UV;
+   img.avx2 = 0;
+   img.fdct = stbiw__jpg_fdct;
+#ifdef STBIW_SSE2
+   img.fdct = stbiw__jpg_fdct_sse2;
+#endif
+#ifdef STBIW_AVX2
+   if (STBIW_AVX2_AVAILABLE()) {
+      img.avx2 = 1;
+      img.fdct = stbiw__jpg_fdct_avx2;
+   }
+#endif
+
+#ifdef STBIW_PARALLEL_FOR
+   // Only worth it when there are several bands, and the restart interval is a 16-bit MCU count
+   if (parallel) {
+      int mcu_size = subsample ? 16 : 8, mcu_cols = (width + mcu_size - 1) / mcu_size;
+      int band_mcu_rows = STBIW__JPG_BAND_PIXELS / (mcu_cols * mcu_size * mcu_size);
+      if (band_mcu_rows < 1) band_mcu_rows = 1;
+      band_count = (height + band_mcu_rows*mcu_size - 1) / (band_mcu_rows*mcu_size);
+      if (band_count >= 2 && mcu_cols * band_mcu_rows <= 65535) {
+         bands = (stbiw__jpg_band *) STBIW_MALLOC(band_count * sizeof(stbiw__jpg_band));
+         if (bands) {
+            memset(bands, 0, band_count * sizeof(stbiw__jpg_band));
+            restart_rows = band_mcu_rows * mcu_size;
+            restart_interval = mcu_cols * band_mcu_rows;
+         }
+      }
+   }
+#else
+   (void) parallel;
+#endif
+
    // Write Headers
    {
       static const unsigned char head0[] = { 0xFF,0xD8,0xFF,0xE0,0,0x10,'J','F','I','F',0,1,1,0,0,1,0,1,0,0,0xFF,0xDB,0,0x84,0 };
@@ -1516,86 +2209,41 @@ static int stbi_write_jpg_core(stbi__write_context *s, int width, int height, in
       stbiw__putc(s, 0x11); // HTUACinfo
       s->func(s->context, (void*)(std_ac_chrominance_nrcodes+1), sizeof(std_ac_chrominance_nrcodes)-1);
       s->func(s->context, (void*)std_ac_chrominance_values, sizeof(std_ac_chrominance_values));
+      if (restart_interval) {
+         // DRI
+         const unsigned char dri[] = { 0xFF,0xDD,0,4,(unsigned char)(restart_interval>>8),STBIW_UCHAR(restart_interval) };
+         s->func(s->context, (void*)dri, sizeof(dri));
+      }
       s->func(s->context, (void*)head2, sizeof(head2));
    }
 
    // Encode 8x8 macroblocks
-   {
-      static const unsigned short fillBits[] = {0x7F, 7};
-      int DCY=0, DCU=0, DCV=0;
-      int bitBuf=0, bitCnt=0;
-      // comp == 2 is grey+alpha (alpha is ignored)
-      int ofsG = comp > 2 ? 1 : 0, ofsB = comp > 2 ? 2 : 0;
-      const unsigned char *dataR = (const unsigned char *)data;
-      const unsigned char *dataG = dataR + ofsG;
-      const unsigned char *dataB = dataR + ofsB;
-      int x, y, pos;
-      if(subsample) {
-         for(y = 0; y < height; y += 16) {
-            for(x = 0; x < width; x += 16) {
-               float Y[256], U[256], V[256];
-               for(row = y, pos = 0; row < y+16; ++row) {
-                  // row >= height => use last input row
-                  int clamped_row = (row < height) ? row : height - 1;
-                  int base_p = (stbi__flip_vertically_on_write ? (height-1-clamped_row) : clamped_row)*width*comp;
-                  for(col = x; col < x+16; ++col, ++pos) {
-                     // if col >= width => use pixel from last input column
-                     int p = base_p + ((col < width) ? col : (width-1))*comp;
-                     float r = dataR[p], g = dataG[p], b = dataB[p];
-                     Y[pos]= +0.29900f*r + 0.58700f*g + 0.11400f*b - 128;
-                     U[pos]= -0.16874f*r - 0.33126f*g + 0.50000f*b;
-                     V[pos]= +0.50000f*r - 0.41869f*g - 0.08131f*b;
-                  }
-               }
-               DCY = stbiw__jpg_processDU(s, &bitBuf, &bitCnt, Y+0,   16, fdtbl_Y, DCY, YDC_HT, YAC_HT);
-               DCY = stbiw__jpg_processDU(s, &bitBuf, &bitCnt, Y+8,   16, fdtbl_Y, DCY, YDC_HT, YAC_HT);
-               DCY = stbiw__jpg_processDU(s, &bitBuf, &bitCnt, Y+128, 16, fdtbl_Y, DCY, YDC_HT, YAC_HT);
-               DCY = stbiw__jpg_processDU(s, &bitBuf, &bitCnt, Y+136, 16, fdtbl_Y, DCY, YDC_HT, YAC_HT);
-
-               // subsample U,V
-               {
-                  float subU[64], subV[64];
-                  int yy, xx;
-                  for(yy = 0, pos = 0; yy < 8; ++yy) {
-                     for(xx = 0; xx < 8; ++xx, ++pos) {
-                        int j = yy*32+xx*2;
-                        subU[pos] = (U[j+0] + U[j+1] + U[j+16] + U[j+17]) * 0.25f;
-                        subV[pos] = (V[j+0] + V[j+1] + V[j+16] + V[j+17]) * 0.25f;
-                     }
-                  }
-                  DCU = stbiw__jpg_processDU(s, &bitBuf, &bitCnt, subU, 8, fdtbl_UV, DCU, UVDC_HT, UVAC_HT);
-                  DCV = stbiw__jpg_processDU(s, &bitBuf, &bitCnt, subV, 8, fdtbl_UV, DCV, UVDC_HT, UVAC_HT);
-               }
-            }
-         }
-      } else {
-         for(y = 0; y < height; y += 8) {
-            for(x = 0; x < width; x += 8) {
-               float Y[64], U[64], V[64];
-               for(row = y, pos = 0; row < y+8; ++row) {
-                  // row >= height => use last input row
-                  int clamped_row = (row < height) ? row : height - 1;
-                  int base_p = (stbi__flip_vertically_on_write ? (height-1-clamped_row) : clamped_row)*width*comp;
-                  for(col = x; col < x+8; ++col, ++pos) {
-                     // if col >= width => use pixel from last input column
-                     int p = base_p + ((col < width) ? col : (width-1))*comp;
-                     float r = dataR[p], g = dataG[p], b = dataB[p];
-                     Y[pos]= +0.29900f*r + 0.58700f*g + 0.11400f*b - 128;
-                     U[pos]= -0.16874f*r - 0.33126f*g + 0.50000f*b;
-                     V[pos]= +0.50000f*r - 0.41869f*g - 0.08131f*b;
-                  }
-               }
-
-               DCY = stbiw__jpg_processDU(s, &bitBuf, &bitCnt, Y, 8, fdtbl_Y,  DCY, YDC_HT, YAC_HT);
-               DCU = stbiw__jpg_processDU(s, &bitBuf, &bitCnt, U, 8, fdtbl_UV, DCU, UVDC_HT, UVAC_HT);
-               DCV = stbiw__jpg_processDU(s, &bitBuf, &bitCnt, V, 8, fdtbl_UV, DCV, UVDC_HT, UVAC_HT);
+#ifdef STBIW_PARALLEL_FOR
+   if (bands) {
+      stbiw__jpg_band_job job;
+      int failed = 0;
+      job.img = &img;
+      job.bands = bands;
+      job.band_rows = restart_rows;
+      STBIW_PARALLEL_FOR(band_count, stbiw__jpg_band_task, &job);
+      for (i = 0; i < band_count; ++i) {
+         failed |= bands[i].failed;
+         if (!failed) {
+            if (i > 0) {
+               // RSTn
+               stbiw__putc(s, 0xFF);
+               stbiw__putc(s, (unsigned char) (0xD0 + ((i - 1) & 7)));
             }
+            s->func(s->context, bands[i].data, bands[i].length);
          }
+         STBIW_FREE(bands[i].data);
       }
-
-      // Do the bit alignment of the EOI marker
-      stbiw__jpg_writeBits(s, &bitBuf, &bitCnt, fillBits);
-   }
+      STBIW_FREE(bands);
+      if (failed)
+         return 0;
+   } else
+#endif
+   stbiw__jpg_encode_rows(s, &img, 0, height);
 
    // EOI
    stbiw__putc(s, 0xFF);
@@ -1608,7 +2256,14 @@ STBIWDEF int stbi_write_jpg_to_func(stbi_write_func *func, void *context, int x,
 {
    stbi__write_context s = { 0 };
    stbi__start_write_callbacks(&s, func, context);
-   return stbi_write_jpg_core(&s, x, y, comp, (void *) data, quality);
+   return stbi_write_jpg_core(&s, x, y, comp, (void *) data, quality, 0);
+}
+
+STBIWDEF int stbi_write_jpg_to_func_ex(stbi_write_func *func, void *context, int x, int y, int comp, const void *data, int quality, int parallel)
+{
+   stbi__write_context s = { 0 };
+   stbi__start_write_callbacks(&s, func, context);
+   return stbi_write_jpg_core(&s, x, y, comp, (void *) data, quality, parallel);
 }
 
 
@@ -1617,7 +2272,7 @@ STBIWDEF int stbi_write_jpg(char const *filename, int x, int y, int comp, const
 {
    stbi__write_context s = { 0 };
    if (stbi__start_write_file(&s,filename)) {
-      int r = stbi_write_jpg_core(&s, x, y, comp, data, quality);
+      int r = stbi_write_jpg_core(&s, x, y, comp, data, quality, 0);
       stbi__end_write_file(&s);
       return r;
    } else
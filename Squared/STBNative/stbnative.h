@@ -0,0 +1,44 @@
+#pragma once
+
+// Shared configuration for every STBNative translation unit.
+// Only main.cpp defines the STB_*_IMPLEMENTATION macros; everything else just needs
+//  to see the same declarations.
+
+#define STBIDEF  extern "C" __declspec(dllexport)
+#define STBIWDEF extern "C" __declspec(dllexport)
+#define STBIRDEF extern "C" __declspec(dllexport)
+
+// Our own exports (not part of stb)
+#define STBNDEF  extern "C" __declspec(dllexport)
+
+#define STBI_NO_STDIO
+// #define STBI_WRITE_NO_STDIO
+
+#define STBI_BUFFER_SIZE 40960
+
+#define STBI_NO_BMP
+#define STBI_NO_GIF
+#define STBI_NO_PIC
+#define STBI_NO_PNM
+#define STBI_NO_HDR
+
+// #define STBI_WRITE_NO_HDR
+
+#define STBIR_MAX_CHANNELS 4
+
+// Route all of stb's allocations through our tracked allocator (see alloc.h)
+#include "alloc.h"
+#define STBI_MALLOC(sz)             stbn_malloc(sz, STBN_ALLOC_IMAGE)
+#define STBI_REALLOC(p,newsz)       stbn_realloc(p, newsz, STBN_ALLOC_IMAGE)
+#define STBI_FREE(p)                stbn_free(p)
+#define STBIW_MALLOC(sz)            stbn_malloc(sz, STBN_ALLOC_WRITE)
+#define STBIW_REALLOC(p,newsz)      stbn_realloc(p, newsz, STBN_ALLOC_WRITE)
+#define STBIW_FREE(p)               stbn_free(p)
+#define STBIR_MALLOC(size,user_data) ((void)(user_data), stbn_malloc(size, STBN_ALLOC_RESIZE))
+#define STBIR_FREE(ptr,user_data)    ((void)(user_data), stbn_free(ptr))
+
+#include <stdio.h>
+
+#include "stb_image.h"
+#include "stb_image_write.h"
+#include "stb_image_resize2.h"
@@ -0,0 +1,113 @@
+// Stress test for the worker pool in threads.cpp. Mixes stbn_parallel_for, whose job lives on
+//  the caller's stack, with stbn_parallel_for_async from several threads at once, so any access
+//  to a job after its caller has returned shows up under AddressSanitizer:
+//   g++ -std=c++17 -g -O1 -fsanitize=address threads_test.cpp ../threads.cpp -lpthread
+//   cl /std:c++17 /Zi /fsanitize=address threads_test.cpp ..\threads.cpp
+// Exits with a non-zero status if any index isn't visited exactly once.
+
+#include "../threads.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#if defined(__SANITIZE_ADDRESS__)
+// Returned stack frames are what the synchronous jobs live in, so make them poisonable
+extern "C" const char * __asan_default_options () {
+    return "detect_stack_use_after_return=1";
+}
+#endif
+
+namespace {
+    const int caller_count = 8, iteration_count = 2000, max_task_count = 64;
+
+    std::atomic<int> failure_count(0);
+
+    struct tasks {
+        std::atomic<int> visits[max_task_count];
+        int count;
+
+        explicit tasks (int count) : count(count) {
+            for (int i = 0; i < count; i++)
+                visits[i] = 0;
+        }
+
+        static void visit (void * userdata, int index) {
+            auto self = (tasks *)userdata;
+            self->visits[index]++;
+        }
+
+        void check (const char * kind) {
+            for (int i = 0; i < count; i++) {
+                if (visits[i] != 1) {
+                    std::fprintf(stderr, "%s: index %d of %d was visited %d times\n", kind, i, count, (int)visits[i]);
+                    failure_count++;
+                }
+            }
+        }
+    };
+
+    struct async_tasks : tasks {
+        std::mutex lock;
+        std::condition_variable signal;
+        bool done;
+
+        explicit async_tasks (int count) : tasks(count), done(false) {
+        }
+
+        static void on_done (void * userdata) {
+            auto self = (async_tasks *)userdata;
+            std::lock_guard<std::mutex> guard(self->lock);
+            self->done = true;
+            self->signal.notify_all();
+        }
+
+        void wait () {
+            std::unique_lock<std::mutex> guard(lock);
+            signal.wait(guard, [this] { return done; });
+        }
+    };
+
+    void run_synchronous (int count) {
+        tasks t(count);
+        stbn_parallel_for(count, tasks::visit, &t);
+        t.check("stbn_parallel_for");
+    }
+
+    void run_async (int count) {
+        async_tasks t(count);
+        stbn_parallel_for_async(count, async_tasks::visit, &t, async_tasks::on_done, &t);
+        t.wait();
+        t.check("stbn_parallel_for_async");
+    }
+
+    void caller (int seed) {
+        for (int i = 0; i < iteration_count; i++) {
+            // Small counts finish fastest, which is when a worker is most likely to still be
+            //  touching the job after its caller has returned
+            int count = 2 + ((seed * 7 + i * 13) % (max_task_count - 1));
+            run_synchronous(count);
+            run_async(count);
+            run_synchronous(2);
+        }
+    }
+}
+
+int main () {
+    std::printf("%d threads\n", stbn_thread_count());
+
+    std::vector<std::thread> callers;
+    for (int i = 0; i < caller_count; i++)
+        callers.emplace_back(caller, i);
+    for (auto & t : callers)
+        t.join();
+
+    if (failure_count != 0) {
+        std::printf("%d failures\n", (int)failure_count);
+        return 1;
+    }
+    std::printf("ok\n");
+    return 0;
+}
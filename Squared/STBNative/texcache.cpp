@@ -0,0 +1,382 @@
+#include "stbnative.h"
+#include "texcache.h"
+#include "threads.h"
+#include <atomic>
+#include <string.h>
+
+#define ZSTD_STATIC_LINKING_ONLY
+#include "../../Ext/zstd/zstd.h"
+
+// Layout (little-endian):
+//  file_header
+//  level_entry[level_count]
+//  chunk_entry[chunk_count], for every level in order
+//  compressed chunks
+// Nothing in the file is trusted until read_info has checked it, since a cache file can be
+//  truncated by a crash or left over from an older build.
+
+namespace {
+    const char magic[4] = { 'S', 'T', 'B', 'T' };
+    const uint32_t version = 1;
+    // Small enough to keep every worker busy on a single large level, large enough that
+    //  zstd's ratio doesn't suffer
+    const int64_t chunk_size = 1024 * 1024;
+    const int max_levels = 32;
+
+    struct file_header {
+        char magic[4];
+        uint32_t version;
+        uint64_t key;
+        int32_t width, height, original_width, original_height;
+        int32_t channels, original_channels, bytes_per_pixel, flags;
+        int32_t level_count, chunk_size, chunk_count, reserved;
+    };
+
+    struct level_entry {
+        int32_t width, height, first_chunk, chunk_count;
+        int64_t size;
+    };
+
+    struct chunk_entry {
+        int64_t offset, compressed_size;
+    };
+
+    static_assert(sizeof(file_header) == 64, "file_header layout");
+    static_assert(sizeof(level_entry) == 24, "level_entry layout");
+    static_assert(sizeof(chunk_entry) == 16, "chunk_entry layout");
+
+    void * zstd_alloc (void *, size_t size) {
+        return stbn_malloc(size, STBN_ALLOC_NATIVE);
+    }
+
+    void zstd_free (void *, void * address) {
+        stbn_free(address);
+    }
+
+    const ZSTD_customMem zstd_memory = { zstd_alloc, zstd_free, nullptr };
+
+    // Fills in the levels for info, returning the total chunk count or -1 if info is invalid
+    int plan_levels (const stbn_texcache_info & info, level_entry * levels) {
+        if ((info.width <= 0) || (info.height <= 0) || (info.bytes_per_pixel <= 0) || (info.bytes_per_pixel > 16) ||
+            (info.level_count <= 0) || (info.level_count > max_levels) ||
+            ((info.width >> (info.level_count - 1)) < 1) || ((info.height >> (info.level_count - 1)) < 1))
+            return -1;
+
+        int64_t chunk_count = 0;
+        for (int i = 0; i < info.level_count; i++) {
+            level_entry & level = levels[i];
+            level.width = info.width >> i;
+            level.height = info.height >> i;
+            level.size = (int64_t)level.width * level.height * info.bytes_per_pixel;
+            level.first_chunk = (int32_t)chunk_count;
+            level.chunk_count = (int32_t)((level.size + chunk_size - 1) / chunk_size);
+            chunk_count += level.chunk_count;
+            if (chunk_count > INT32_MAX / (int64_t)sizeof(chunk_entry))
+                return -1;
+        }
+        return (int)chunk_count;
+    }
+
+    struct compress_job {
+        const level_entry * levels;
+        int level_count;
+        const void * const * sources;
+        int zstd_level;
+        // One per chunk
+        uint8_t ** outputs;
+        size_t * output_sizes;
+        std::atomic<bool> failed;
+    };
+
+    // Finds the level holding a chunk, and where the chunk starts within it
+    template<typename Job>
+    int locate_chunk (const Job & job, int chunk, int64_t & offset, int64_t & size) {
+        int level = 0;
+        while ((level < job.level_count - 1) && (chunk >= job.levels[level + 1].first_chunk))
+            level++;
+        offset = (int64_t)(chunk - job.levels[level].first_chunk) * chunk_size;
+        size = job.levels[level].size - offset;
+        if (size > chunk_size)
+            size = chunk_size;
+        return level;
+    }
+
+    void compress_chunk (void * userdata, int chunk) {
+        compress_job & job = *(compress_job *)userdata;
+        int64_t offset, size;
+        const int level = locate_chunk(job, chunk, offset, size);
+        const size_t bound = ZSTD_compressBound((size_t)size);
+        uint8_t * output = (uint8_t *)stbn_malloc(bound, STBN_ALLOC_WRITE);
+        ZSTD_CCtx * context = output ? ZSTD_createCCtx_advanced(zstd_memory) : nullptr;
+        size_t compressed = 0;
+        if (context) {
+            compressed = ZSTD_compressCCtx(
+                context, output, bound, (const uint8_t *)job.sources[level] + offset, (size_t)size, job.zstd_level
+            );
+            ZSTD_freeCCtx(context);
+        }
+        if (!context || ZSTD_isError(compressed)) {
+            stbn_free(output);
+            job.failed = true;
+            return;
+        }
+        job.outputs[chunk] = output;
+        job.output_sizes[chunk] = compressed;
+    }
+
+    struct decompress_job {
+        const uint8_t * buffer;
+        const level_entry * levels;
+        const chunk_entry * chunks;
+        int first_chunk, level_count;
+        void * const * dests;
+        std::atomic<bool> failed;
+    };
+
+    void decompress_chunk (void * userdata, int index) {
+        decompress_job & job = *(decompress_job *)userdata;
+        const int chunk = job.first_chunk + index;
+        int64_t offset, size;
+        const int level = locate_chunk(job, chunk, offset, size);
+        const chunk_entry & entry = job.chunks[chunk];
+        ZSTD_DCtx * context = ZSTD_createDCtx_advanced(zstd_memory);
+        if (!context) {
+            job.failed = true;
+            return;
+        }
+        const size_t decompressed = ZSTD_decompressDCtx(
+            context, (uint8_t *)job.dests[level] + offset, (size_t)size,
+            job.buffer + entry.offset, (size_t)entry.compressed_size
+        );
+        ZSTD_freeDCtx(context);
+        if (ZSTD_isError(decompressed) || (decompressed != (size_t)size))
+            job.failed = true;
+    }
+
+    const uint64_t prime1 = 0x9E3779B185EBCA87ull, prime2 = 0xC2B2AE3D27D4EB4Full,
+        prime3 = 0x165667B19E3779F9ull, prime4 = 0x85EBCA77C2B2AE63ull, prime5 = 0x27D4EB2F165667C5ull;
+
+    inline uint64_t rotl (uint64_t value, int bits) {
+        return (value << bits) | (value >> (64 - bits));
+    }
+
+    inline uint64_t read64 (const uint8_t * p) {
+        uint64_t result;
+        memcpy(&result, p, 8);
+        return result;
+    }
+
+    inline uint32_t read32 (const uint8_t * p) {
+        uint32_t result;
+        memcpy(&result, p, 4);
+        return result;
+    }
+
+    inline uint64_t xxh_round (uint64_t acc, uint64_t input) {
+        acc += input * prime2;
+        return rotl(acc, 31) * prime1;
+    }
+
+    inline uint64_t xxh_merge (uint64_t acc, uint64_t value) {
+        acc ^= xxh_round(0, value);
+        return acc * prime1 + prime4;
+    }
+}
+
+STBNDEF uint64_t stbn_xxh64 (const void * data, int64_t length, uint64_t seed) {
+    const uint8_t * p = (const uint8_t *)data, * end = p + ((length > 0) ? length : 0);
+    uint64_t h;
+
+    if (end - p >= 32) {
+        uint64_t v1 = seed + prime1 + prime2, v2 = seed + prime2, v3 = seed, v4 = seed - prime1;
+        const uint8_t * limit = end - 32;
+        do {
+            v1 = xxh_round(v1, read64(p));
+            v2 = xxh_round(v2, read64(p + 8));
+            v3 = xxh_round(v3, read64(p + 16));
+            v4 = xxh_round(v4, read64(p + 24));
+            p += 32;
+        } while (p <= limit);
+        h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+        h = xxh_merge(h, v1);
+        h = xxh_merge(h, v2);
+        h = xxh_merge(h, v3);
+        h = xxh_merge(h, v4);
+    } else
+        h = seed + prime5;
+
+    h += (uint64_t)((length > 0) ? length : 0);
+    for (; end - p >= 8; p += 8) {
+        h ^= xxh_round(0, read64(p));
+        h = rotl(h, 27) * prime1 + prime4;
+    }
+    if (end - p >= 4) {
+        h ^= (uint64_t)read32(p) * prime1;
+        h = rotl(h, 23) * prime2 + prime3;
+        p += 4;
+    }
+    for (; p < end; p++) {
+        h ^= *p * prime5;
+        h = rotl(h, 11) * prime1;
+    }
+
+    h ^= h >> 33;
+    h *= prime2;
+    h ^= h >> 29;
+    h *= prime3;
+    h ^= h >> 32;
+    return h;
+}
+
+STBNDEF void * stbn_texcache_write (
+    const stbn_texcache_info * info, const void * const * levels, int zstd_level, int64_t * out_length
+) {
+    if (!info || !levels || !out_length)
+        return nullptr;
+    *out_length = 0;
+
+    level_entry level_table[max_levels];
+    const int chunk_count = plan_levels(*info, level_table);
+    if (chunk_count < 0)
+        return nullptr;
+    for (int i = 0; i < info->level_count; i++)
+        if (!levels[i])
+            return nullptr;
+
+    compress_job job;
+    job.levels = level_table;
+    job.level_count = info->level_count;
+    job.sources = levels;
+    job.zstd_level = (zstd_level < 1) ? 1 : ((zstd_level > ZSTD_maxCLevel()) ? ZSTD_maxCLevel() : zstd_level);
+    job.outputs = (uint8_t **)stbn_malloc(sizeof(uint8_t *) * chunk_count, STBN_ALLOC_NATIVE);
+    job.output_sizes = (size_t *)stbn_malloc(sizeof(size_t) * chunk_count, STBN_ALLOC_NATIVE);
+    job.failed = !job.outputs || !job.output_sizes;
+    if (!job.failed) {
+        memset(job.outputs, 0, sizeof(uint8_t *) * chunk_count);
+        stbn_parallel_for(chunk_count, compress_chunk, &job);
+    }
+
+    uint8_t * result = nullptr;
+    const int64_t tables_size = sizeof(file_header) + sizeof(level_entry) * (int64_t)info->level_count +
+        sizeof(chunk_entry) * (int64_t)chunk_count;
+    int64_t total = tables_size;
+    if (!job.failed) {
+        for (int i = 0; i < chunk_count; i++)
+            total += (int64_t)job.output_sizes[i];
+        result = ((uint64_t)total <= SIZE_MAX) ? (uint8_t *)stbn_malloc((size_t)total, STBN_ALLOC_WRITE) : nullptr;
+    }
+
+    if (result) {
+        file_header header = {};
+        memcpy(header.magic, magic, sizeof(magic));
+        header.version = version;
+        header.key = info->key;
+        header.width = info->width;
+        header.height = info->height;
+        header.original_width = info->original_width;
+        header.original_height = info->original_height;
+        header.channels = info->channels;
+        header.original_channels = info->original_channels;
+        header.bytes_per_pixel = info->bytes_per_pixel;
+        header.flags = info->flags;
+        header.level_count = info->level_count;
+        header.chunk_size = (int32_t)chunk_size;
+        header.chunk_count = chunk_count;
+        memcpy(result, &header, sizeof(header));
+        memcpy(result + sizeof(header), level_table, sizeof(level_entry) * info->level_count);
+
+        chunk_entry * chunks = (chunk_entry *)(result + sizeof(header) + sizeof(level_entry) * info->level_count);
+        int64_t offset = tables_size;
+        for (int i = 0; i < chunk_count; i++) {
+            chunk_entry entry = { offset, (int64_t)job.output_sizes[i] };
+            memcpy(&chunks[i], &entry, sizeof(entry));
+            memcpy(result + offset, job.outputs[i], job.output_sizes[i]);
+            offset += entry.compressed_size;
+        }
+        *out_length = total;
+    }
+
+    if (job.outputs)
+        for (int i = 0; i < chunk_count; i++)
+            stbn_free(job.outputs[i]);
+    stbn_free(job.outputs);
+    stbn_free(job.output_sizes);
+    return result;
+}
+
+STBNDEF int stbn_texcache_read_info (const void * buffer, int64_t length, stbn_texcache_info * info) {
+    if (!buffer || !info || (length < (int64_t)sizeof(file_header)))
+        return 0;
+
+    const uint8_t * bytes = (const uint8_t *)buffer;
+    file_header header;
+    memcpy(&header, bytes, sizeof(header));
+    if (memcmp(header.magic, magic, sizeof(magic)) || (header.version != version) || (header.chunk_size != chunk_size))
+        return 0;
+
+    stbn_texcache_info result;
+    result.key = header.key;
+    result.width = header.width;
+    result.height = header.height;
+    result.original_width = header.original_width;
+    result.original_height = header.original_height;
+    result.channels = header.channels;
+    result.original_channels = header.original_channels;
+    result.bytes_per_pixel = header.bytes_per_pixel;
+    result.flags = header.flags;
+    result.level_count = header.level_count;
+
+    // The tables have to match what we'd have written for these dimensions
+    level_entry expected[max_levels];
+    const int chunk_count = plan_levels(result, expected);
+    if ((chunk_count < 0) || (chunk_count != header.chunk_count))
+        return 0;
+    const int64_t tables_size = sizeof(file_header) + sizeof(level_entry) * (int64_t)header.level_count +
+        sizeof(chunk_entry) * (int64_t)chunk_count;
+    if (length < tables_size)
+        return 0;
+    if (memcmp(bytes + sizeof(file_header), expected, sizeof(level_entry) * header.level_count))
+        return 0;
+
+    const uint8_t * chunks = bytes + sizeof(file_header) + sizeof(level_entry) * header.level_count;
+    for (int i = 0; i < chunk_count; i++) {
+        chunk_entry entry;
+        memcpy(&entry, chunks + sizeof(chunk_entry) * i, sizeof(entry));
+        if ((entry.offset < tables_size) || (entry.compressed_size <= 0) || (entry.offset > length - entry.compressed_size))
+            return 0;
+    }
+
+    *info = result;
+    return 1;
+}
+
+STBNDEF int stbn_texcache_decompress (
+    const void * buffer, int64_t length, int first_level, int level_count, void * const * dests
+) {
+    stbn_texcache_info info;
+    if (!dests || !stbn_texcache_read_info(buffer, length, &info))
+        return 0;
+    if ((first_level < 0) || (level_count <= 0) || (first_level > info.level_count - level_count))
+        return 0;
+    for (int i = 0; i < level_count; i++)
+        if (!dests[i])
+            return 0;
+
+    const uint8_t * bytes = (const uint8_t *)buffer;
+    level_entry levels[max_levels];
+    memcpy(levels, bytes + sizeof(file_header), sizeof(level_entry) * info.level_count);
+
+    decompress_job job;
+    job.buffer = bytes;
+    // Offset so that locate_chunk and dests both start at first_level
+    job.levels = levels + first_level;
+    job.level_count = level_count;
+    job.chunks = (const chunk_entry *)(bytes + sizeof(file_header) + sizeof(level_entry) * info.level_count);
+    job.first_chunk = levels[first_level].first_chunk;
+    job.dests = dests;
+    job.failed = false;
+
+    const level_entry & last = levels[first_level + level_count - 1];
+    stbn_parallel_for(last.first_chunk + last.chunk_count - job.first_chunk, decompress_chunk, &job);
+    return job.failed ? 0 : 1;
+}
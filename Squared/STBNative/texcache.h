@@ -0,0 +1,40 @@
+#pragma once
+
+#include <stdint.h>
+
+// A cache container for processed images: the pixels of every mip level exactly as they're
+//  uploaded, zstd-compressed, so the next run can skip decoding, premultiplying, resizing and
+//  mip generation entirely.
+// Each level is split into fixed-size chunks, each compressed as its own zstd frame, so both
+//  writing and reading are spread across the worker pool and every chunk decompresses
+//  directly into its place in the destination.
+// Level n is (width >> n) x (height >> n) tightly packed pixels of bytes_per_pixel bytes, and
+//  the chain stops before either dimension reaches 0, like the managed mip generator.
+
+struct stbn_texcache_info {
+    // Identifies what the pixels were produced from (see stbn_xxh64). Not interpreted by us.
+    uint64_t key;
+    int width, height, original_width, original_height;
+    int channels, original_channels, bytes_per_pixel;
+    // Not interpreted by us
+    int flags;
+    int level_count;
+};
+
+// XXH64 (https://github.com/Cyan4973/xxHash). zstd.c keeps its copy private, so this is our own.
+STBNDEF uint64_t stbn_xxh64 (const void * data, int64_t length, uint64_t seed);
+
+// levels[n] points to the pixels of level n. zstd_level is 1-22.
+// Returns the container (free with stbi_image_free) or null on failure.
+STBNDEF void * stbn_texcache_write (
+    const stbn_texcache_info * info, const void * const * levels, int zstd_level, int64_t * out_length
+);
+
+// Reads and validates the header and tables. Returns 0 if buffer isn't a complete container.
+STBNDEF int stbn_texcache_read_info (const void * buffer, int64_t length, stbn_texcache_info * info);
+
+// Decompresses level_count levels starting at first_level, dests[i] receiving level
+//  first_level + i. Returns 1 if every level was decompressed successfully.
+STBNDEF int stbn_texcache_decompress (
+    const void * buffer, int64_t length, int first_level, int level_count, void * const * dests
+);
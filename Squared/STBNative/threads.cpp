@@ -0,0 +1,168 @@
+#include "threads.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <algorithm>
+#include <mutex>
+#include <thread>
+
+namespace {
+    struct job {
+        stbn_task_fn fn;
+        void * userdata;
+        int count;
+        std::atomic<int> next;
+        // Workers currently holding a pointer to this job (guarded by the pool lock).
+        // The job lives on the caller's stack, so the caller can't return until it's 0.
+        int active;
+        // Async jobs live on the heap and are deleted by the last worker
+        bool async;
+        stbn_done_fn done;
+        void * done_userdata;
+    };
+
+    struct pool {
+        std::mutex lock;
+        std::condition_variable wake, idle;
+        std::deque<job *> jobs;
+        int worker_count;
+
+        pool () {
+            unsigned hardware = std::thread::hardware_concurrency();
+            worker_count = (int)std::min(std::max(hardware, 1u), 64u) - 1;
+            // The pool is never destroyed: joining threads from a DLL's static
+            //  destructors deadlocks on the Windows loader lock.
+            for (int i = 0; i < worker_count; i++)
+                std::thread([this] { work(); }).detach();
+        }
+
+        static void run (job * j) {
+            for (int i = j->next++; i < j->count; i = j->next++)
+                j->fn(j->userdata, i);
+        }
+
+        void retire (job * j) {
+            auto it = std::find(jobs.begin(), jobs.end(), j);
+            if (it != jobs.end())
+                jobs.erase(it);
+        }
+
+        void work () {
+            for (;;) {
+                job * j;
+                {
+                    std::unique_lock<std::mutex> guard(lock);
+                    wake.wait(guard, [this] { return !jobs.empty(); });
+                    j = jobs.front();
+                    j->active++;
+                }
+
+                run(j);
+
+                bool finished, async;
+                {
+                    std::lock_guard<std::mutex> guard(lock);
+                    // Every index has been claimed, so nobody else needs to pick it up
+                    retire(j);
+                    finished = (--j->active == 0);
+                    // A synchronous job's caller can return as soon as the lock is released,
+                    //  taking the job with it, so it must not be touched past this point
+                    async = j->async;
+                    if (finished && !async)
+                        idle.notify_all();
+                }
+
+                // Nobody else can see an async job once it's retired, so the last worker out owns it
+                if (finished && async) {
+                    if (j->done)
+                        j->done(j->done_userdata);
+                    delete j;
+                }
+            }
+        }
+
+        void parallel_for_async (int count, stbn_task_fn fn, void * userdata, stbn_done_fn done, void * done_userdata) {
+            job * j = new job;
+            j->fn = fn;
+            j->userdata = userdata;
+            j->count = count;
+            j->next = 0;
+            j->active = 0;
+            j->async = true;
+            j->done = done;
+            j->done_userdata = done_userdata;
+
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                jobs.push_back(j);
+            }
+            if (count > 1)
+                wake.notify_all();
+            else
+                wake.notify_one();
+        }
+
+        void parallel_for (int count, stbn_task_fn fn, void * userdata) {
+            job j;
+            j.fn = fn;
+            j.userdata = userdata;
+            j.count = count;
+            j.next = 0;
+            j.active = 0;
+            j.async = false;
+            j.done = nullptr;
+            j.done_userdata = nullptr;
+
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                jobs.push_back(&j);
+            }
+            if (count > 2)
+                wake.notify_all();
+            else
+                wake.notify_one();
+
+            run(&j);
+
+            std::unique_lock<std::mutex> guard(lock);
+            retire(&j);
+            idle.wait(guard, [&j] { return j.active == 0; });
+        }
+    };
+
+    pool & get_pool () {
+        static pool * instance = new pool();
+        return *instance;
+    }
+}
+
+void stbn_parallel_for (int count, stbn_task_fn fn, void * userdata) {
+    if (count <= 0)
+        return;
+
+    pool & p = get_pool();
+    if ((count == 1) || (p.worker_count <= 0)) {
+        for (int i = 0; i < count; i++)
+            fn(userdata, i);
+        return;
+    }
+
+    p.parallel_for(count, fn, userdata);
+}
+
+int stbn_thread_count () {
+    return get_pool().worker_count + 1;
+}
+
+void stbn_parallel_for_async (int count, stbn_task_fn fn, void * userdata, stbn_done_fn done, void * done_userdata) {
+    pool & p = get_pool();
+    if ((count <= 0) || (p.worker_count <= 0)) {
+        for (int i = 0; i < count; i++)
+            fn(userdata, i);
+        if (done)
+            done(done_userdata);
+        return;
+    }
+
+    p.parallel_for_async(count, fn, userdata, done, done_userdata);
+}
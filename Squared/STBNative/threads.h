@@ -0,0 +1,21 @@
+#pragma once
+
+// Shared worker pool for the multi-threaded decode/encode paths.
+// The workers are started on first use and live until the process exits.
+
+typedef void (*stbn_task_fn) (void * userdata, int index);
+typedef void (*stbn_done_fn) (void * userdata);
+
+// Calls fn(userdata, i) for every i in [0, count), spread across the pool and the
+//  calling thread, and returns once every call has finished.
+// Safe to call from any thread, including from inside a task; the caller always works
+//  through the indices itself too, so nested calls can't deadlock.
+void stbn_parallel_for (int count, stbn_task_fn fn, void * userdata);
+
+// Like stbn_parallel_for, but returns immediately and only runs on the workers. Once every
+//  call has finished, done(done_userdata) is called from whichever worker ran the last one.
+// Without any workers (single core machines) everything runs on the calling thread instead.
+void stbn_parallel_for_async (int count, stbn_task_fn fn, void * userdata, stbn_done_fn done, void * done_userdata);
+
+// How many threads stbn_parallel_for can run tasks on at once (workers + the caller).
+int stbn_thread_count ();